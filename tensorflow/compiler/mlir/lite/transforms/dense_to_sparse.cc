@@ -191,7 +191,7 @@ InspectResult InspectWeight(
 
   // Currently we only support compressing weights of ops:
   //   Conv, DepthwiseConv, TransposeConv, whose filter has rank 4, and
-  //   FullyConnected, whose filter has rank 2.
+  //   FullyConnected and BatchMatMul, whose filter has rank 2.
   if (type.getRank() != 2 && type.getRank() != 4) {
     result.can_compress = false;
     return result;
@@ -209,6 +209,13 @@ InspectResult InspectWeight(
   std::vector<int> selected_block_size;
   result.needs_densify = true;
   for (const auto& block_size : supported_block_size) {
+    // Skip the block configs which do not tile the weight.
+    if (block_size.size() != static_cast<size_t>(type.getRank())) continue;
+    bool tiles_weight = true;
+    for (int i = 0; i < type.getRank(); ++i) {
+      tiles_weight &= type.getDimSize(i) % block_size[i] == 0;
+    }
+    if (!tiles_weight) continue;
     curr_sparsity = CalculateBlockSparsity(attr, type, block_size);
     if (curr_sparsity / random_sparsity > ratio_threshold) {
       selected_block_size = block_size;
@@ -16,6 +16,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/remapper.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <map>
 #include <set>
@@ -25,6 +26,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
@@ -92,12 +94,19 @@ constexpr char kFusedDepthwiseConv2dNative[] = "_FusedDepthwiseConv2dNative";
 constexpr char kFusedBatchNormEx[] = "_FusedBatchNormEx";
 constexpr char kFusedBatchNormGradEx[] = "_FusedBatchNormGradEx";
 constexpr char kTensorToHashBucket[] = "_TensorToHashBucketFast";
+constexpr char kDynamicRangeQuantizedMatMul[] = "_DynamicRangeQuantizedMatMul";
+constexpr char kFusedEmbeddingLookupSparse[] = "_FusedEmbeddingLookupSparse";
+constexpr char kFusedScaledDotProductAttention[] =
+    "_FusedScaledDotProductAttention";
 constexpr char kLeakyRelu[] = "LeakyRelu";
 constexpr char kMklFusedMish[] = "_MklFusedMish";
 constexpr char kRelu[] = "Relu";
 constexpr char kRelu6[] = "Relu6";
 constexpr char kElu[] = "Elu";
 
+// Must match kPrepackRhsAttr in core/kernels/matmul_op_prepacked.h.
+constexpr char kPrepackRhs[] = "_prepack_rhs";
+
 constexpr char kDataFormat[] = "data_format";
 constexpr char kIsTraining[] = "is_training";
 
@@ -106,6 +115,10 @@ constexpr char kFill[] = "fill";
 
 constexpr int kMissingIndex = -1;
 
+// Constant MatMul weights with fewer elements than this are left in float;
+// the quantization overhead is not amortized for them.
+constexpr int64_t kMinDynamicRangeQuantizedWeights = 1024;
+
 struct RemapperContext {
   explicit RemapperContext(GrapplerItem* item, Status* status,
                            RewriterConfig::CpuLayout cpu_layout_conversion,
@@ -126,6 +139,7 @@ struct RemapperContext {
   RewriterConfig::CpuLayout cpu_layout_conversion;
   bool xla_auto_clustering_on;
   bool xla_cpu_jit_disable_fusion;
+  bool dynamic_range_quantized_matmul = false;
 };
 
 // FusedBatchNorm that can be replaced with a cheaper set of primitives.
@@ -183,6 +197,52 @@ struct PadWithConv3D {
   int padding_const_idx = kMissingIndex;
 };
 
+// MatMul with constant float weights that can be replaced with a
+// _DynamicRangeQuantizedMatMul.
+struct DynamicRangeQuantizedMatMul {
+  DynamicRangeQuantizedMatMul() = default;
+  DynamicRangeQuantizedMatMul(int matmul, int weights)
+      : matmul(matmul), weights(weights) {}
+
+  int matmul = kMissingIndex;
+  int weights = kMissingIndex;
+};
+
+// Sparse embedding lookup as built by tf.nn.embedding_lookup_sparse, that can
+// be replaced with a _FusedEmbeddingLookupSparse.
+//   Unweighted: SparseSegment{Sum,Mean,SqrtN}(
+//                   GatherV2(params, Unique(ids):0), Unique:1, segment_ids)
+//   Weighted:   SegmentSum(Mul(GatherV2(GatherV2(params, Unique(ids):0),
+//                                       Unique:1),
+//                              Reshape(weights)), segment_ids)
+// The embeddings gathered from `params` may pass through an Identity.
+struct FusedEmbeddingLookup {
+  int segment_reduction = kMissingIndex;
+  int unique = kMissingIndex;
+  int gather = kMissingIndex;
+  int identity = kMissingIndex;
+  // Only set for the weighted pattern.
+  int expand = kMissingIndex;
+  int mul = kMissingIndex;
+  int reshape = kMissingIndex;
+  string combiner;
+};
+
+// Attention built from BatchMatMul and Softmax, that can be replaced with a
+// _FusedScaledDotProductAttention:
+//   BatchMatMul(Softmax(AddV2(Mul(BatchMatMul(q, k, adj_y=true), scale),
+//                             causal_mask)), v)
+// The Mul by a scalar constant, which may also be a RealDiv, and the AddV2 of
+// a constant causal mask are optional.
+struct FusedScaledDotProductAttention {
+  int output_matmul = kMissingIndex;
+  int softmax = kMissingIndex;
+  int mask = kMissingIndex;
+  int scale = kMissingIndex;
+  int scores_matmul = kMissingIndex;
+  float scale_value = 1.0f;
+};
+
 // Contraction node followed by a BiasAdd.
 struct ContractionWithBiasAdd {
   ContractionWithBiasAdd() = default;
@@ -2379,6 +2439,16 @@ bool BatchnormSpatialPersistentEnabled() {
 #endif
 }
 
+// Rewriting float MatMul weights to int8 changes numerics, so it is opt-in.
+// Read on every Optimize() call so that it can be toggled between sessions.
+bool DynamicRangeQuantizedMatMulEnabled() {
+  bool is_enabled = false;
+  TF_CHECK_OK(tensorflow::ReadBoolFromEnvVar(
+      "TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL",
+      /*default_val=*/false, &is_enabled));
+  return is_enabled;
+}
+
 bool FindFusedBatchNormEx(const RemapperContext& ctx, int node_index,
                           FusedBatchNormEx* matched) {
   // Root of the pattern must be a Relu.
@@ -4493,6 +4563,588 @@ Status AddMklFusedInstanceNorm(RemapperContext* ctx,
   return absl::OkStatus();
 }
 
+bool FindDynamicRangeQuantizedMatMul(const RemapperContext& ctx,
+                                     int node_index,
+                                     DynamicRangeQuantizedMatMul* matched) {
+  if (!ctx.dynamic_range_quantized_matmul) return false;
+  if (IsMKLEnabled() || ctx.xla_cpu_jit_disable_fusion) return false;
+
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (!IsMatMul(*node_def) || HasControlFaninOrFanout(*node_view)) {
+    return false;
+  }
+  if (!NodeIsOnCpu(node_def) || !HasDataType(node_def, DT_FLOAT)) return false;
+
+  bool transpose_a = false;
+  if (!TryGetNodeAttr(*node_def, "transpose_a", &transpose_a) || transpose_a) {
+    return false;
+  }
+
+  if (node_view->NumRegularFanins() < 2) return false;
+  const auto* weights_view = node_view->GetRegularFanin(1).node_view();
+  const auto* weights_def = weights_view->node();
+  if (!IsConstant(*weights_def) ||
+      !HasDataType(weights_def, DT_FLOAT, "dtype")) {
+    return false;
+  }
+  const auto value = weights_def->attr().find("value");
+  if (value == weights_def->attr().end()) return false;
+  const TensorShapeProto& shape = value->second.tensor().tensor_shape();
+  if (shape.dim_size() != 2 ||
+      shape.dim(0).size() * shape.dim(1).size() <
+          kMinDynamicRangeQuantizedWeights) {
+    return false;
+  }
+
+  *matched =
+      DynamicRangeQuantizedMatMul(node_index, weights_view->node_index());
+  return true;
+}
+
+// Replaces MatMul(a, Const(b)) with
+// _DynamicRangeQuantizedMatMul(a, Const(weights), Const(weight_scales)), where
+// `weights` is the transpose of `b` quantized to int8 with one symmetric scale
+// per output channel.
+Status AddDynamicRangeQuantizedMatMul(
+    RemapperContext* ctx, const DynamicRangeQuantizedMatMul& matched,
+    std::vector<bool>* invalidated_nodes, std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& matmul = graph->node(matched.matmul);
+  const NodeDef& weights = graph->node(matched.weights);
+  VLOG(2) << "Quantize weights of MatMul: " << matmul.name()
+          << " weights=" << weights.name();
+
+  Tensor float_weights;
+  if (!float_weights.FromProto(weights.attr().at("value").tensor())) {
+    return errors::InvalidArgument("Cannot parse tensor from proto: ",
+                                   weights.name());
+  }
+  bool transpose_b = false;
+  TF_RETURN_IF_ERROR(GetNodeAttr(matmul, "transpose_b", &transpose_b));
+  const int64_t k = float_weights.dim_size(transpose_b ? 1 : 0);
+  const int64_t n = float_weights.dim_size(transpose_b ? 0 : 1);
+  auto b = float_weights.matrix<float>();
+
+  Tensor quantized(DT_INT8, TensorShape({n, k}));
+  Tensor scales(DT_FLOAT, TensorShape({n}));
+  auto q = quantized.matrix<int8>();
+  auto s = scales.vec<float>();
+  for (int64_t j = 0; j < n; ++j) {
+    float max_abs = 0.0f;
+    for (int64_t i = 0; i < k; ++i) {
+      max_abs = std::max(max_abs, std::abs(transpose_b ? b(j, i) : b(i, j)));
+    }
+    // Values are restricted to [-127, 127], as the kernel's int8 dot product
+    // requires; an all-zero channel gets a zero scale.
+    const float scale = max_abs / 127.0f;
+    const float inverse_scale = max_abs == 0.0f ? 0.0f : 127.0f / max_abs;
+    for (int64_t i = 0; i < k; ++i) {
+      const float value = transpose_b ? b(j, i) : b(i, j);
+      const float rounded = std::round(value * inverse_scale);
+      q(j, i) = static_cast<int8>(std::min(127.0f, std::max(-127.0f, rounded)));
+    }
+    s(j) = scale;
+  }
+
+  // The new constants inherit the control inputs of the original one, so they
+  // stay in the same frame.
+  auto make_const = [&weights](const string& name, const Tensor& value) {
+    NodeDef node;
+    node.set_name(name);
+    node.set_op("Const");
+    node.set_device(weights.device());
+    for (const string& input : weights.input()) node.add_input(input);
+    AddNodeAttr("dtype", value.dtype(), &node);
+    value.AsProtoTensorContent(
+        (*node.mutable_attr())["value"].mutable_tensor());
+    return node;
+  };
+  const string quantized_name =
+      AddPrefixToNodeName("dynamic_range_weights", matmul.name());
+  const string scales_name =
+      AddPrefixToNodeName("dynamic_range_scales", matmul.name());
+
+  NodeDef quantized_matmul;
+  quantized_matmul.set_name(matmul.name());
+  quantized_matmul.set_op(kDynamicRangeQuantizedMatMul);
+  quantized_matmul.set_device(matmul.device());
+  quantized_matmul.add_input(matmul.input(0));
+  quantized_matmul.add_input(quantized_name);
+  quantized_matmul.add_input(scales_name);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(make_const(quantized_name, quantized), &status);
+  TF_RETURN_IF_ERROR(status);
+  mutation->AddNode(make_const(scales_name, scales), &status);
+  TF_RETURN_IF_ERROR(status);
+  mutation->AddNode(std::move(quantized_matmul), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.matmul] = true;
+  const auto* weights_view = ctx->graph_view.GetNode(matched.weights);
+  if (weights_view->NumRegularFanouts() == 0 &&
+      !IsInPreserveSet(*ctx, &weights)) {
+    (*nodes_to_delete)[matched.weights] = true;
+  }
+
+  return absl::OkStatus();
+}
+
+// Returns true if the node is a float MatMul or BatchMatMul placed on CPU
+// whose right-hand side is a Const, so that the CPU kernel may pack the
+// weights once and reuse the packed buffer on every step.
+bool IsMatMulWithConstantRhs(const RemapperContext& ctx, int node_index) {
+  // oneDNN kernels replace MatMul on CPU and do their own weight caching.
+  if (IsMKLEnabled() || ctx.xla_cpu_jit_disable_fusion) return false;
+
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (!IsMatMul(*node_def) && !IsAnyBatchMatMul(*node_def)) return false;
+  if (!NodeIsOnCpu(node_def) || !HasDataType(node_def, DT_FLOAT)) return false;
+  if (node_def->attr().count(kPrepackRhs) > 0) return false;
+
+  if (node_view->NumRegularFanins() < 2) return false;
+  const auto* rhs_def = node_view->GetRegularFanin(1).node_view()->node();
+  return IsConstant(*rhs_def) && NodeIsOnCpu(rhs_def);
+}
+
+Status AddPrepackRhsAttr(RemapperContext* ctx, int node_index) {
+  auto* node_view = ctx->graph_view.GetNode(node_index);
+  VLOG(2) << "Prepack constant weights of " << node_view->node()->op() << ": "
+          << node_view->node()->name();
+
+  AttrValue prepack;
+  prepack.set_b(true);
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  mutation->AddOrUpdateNodeAttr(node_view, kPrepackRhs, prepack);
+  return mutation->Apply();
+}
+
+// Returns true if `node_view` is a GatherV2 along axis 0 without batch dims.
+bool IsGatherAlongFirstAxis(const utils::MutableNodeView& node_view) {
+  const NodeDef* node_def = node_view.node();
+  if (node_def->op() != "GatherV2" || node_view.NumRegularFanins() != 3) {
+    return false;
+  }
+  int batch_dims = 0;
+  if (TryGetNodeAttr(*node_def, "batch_dims", &batch_dims) && batch_dims != 0) {
+    return false;
+  }
+  const NodeDef* axis_def = node_view.GetRegularFanin(2).node_view()->node();
+  if (!IsConstant(*axis_def) || axis_def->attr().count("value") == 0) {
+    return false;
+  }
+  Tensor axis;
+  if (!axis.FromProto(axis_def->attr().at("value").tensor()) ||
+      axis.NumElements() != 1) {
+    return false;
+  }
+  if (axis.dtype() == DT_INT32) return axis.flat<int32>()(0) == 0;
+  if (axis.dtype() == DT_INT64) return axis.flat<int64_t>()(0) == 0;
+  return false;
+}
+
+bool FindFusedEmbeddingLookup(RemapperContext* ctx, int node_index,
+                              FusedEmbeddingLookup* matched) {
+  if (ctx->xla_cpu_jit_disable_fusion) return false;
+
+  const GraphDef* graph = ctx->graph_view.graph();
+  const auto* root_view = ctx->graph_view.GetNode(node_index);
+  const auto* root_def = root_view->node();
+  const string& op = root_def->op();
+  const bool weighted = op == "SegmentSum";
+  FusedEmbeddingLookup pattern;
+  if (op == "SparseSegmentSum" || weighted) {
+    pattern.combiner = "sum";
+  } else if (op == "SparseSegmentMean") {
+    pattern.combiner = "mean";
+  } else if (op == "SparseSegmentSqrtN") {
+    pattern.combiner = "sqrtn";
+  } else {
+    return false;
+  }
+  if (HasControlFaninOrFanout(*root_view) || !NodeIsOnCpu(root_def) ||
+      !HasDataType(root_def, DT_FLOAT) ||
+      root_view->NumRegularFanins() != (weighted ? 2 : 3)) {
+    return false;
+  }
+  pattern.segment_reduction = node_index;
+
+  // Nodes inside the pattern are removed, so nothing else may read them.
+  auto is_intermediate = [ctx](const utils::MutableNodeView* view) {
+    return !HasControlFaninOrFanout(*view) && view->NumRegularFanouts() == 1 &&
+           !IsInPreserveSet(*ctx, view->node());
+  };
+  // Checks that `fanin` is output `port` of the Unique node in the pattern.
+  auto is_unique_output = [&pattern](const utils::MutableFaninView& fanin,
+                                     int port) {
+    if (fanin.node_view()->node()->op() != "Unique" || fanin.index() != port) {
+      return false;
+    }
+    if (pattern.unique == kMissingIndex) {
+      pattern.unique = fanin.node_index();
+    }
+    return pattern.unique == fanin.node_index();
+  };
+
+  const utils::MutableNodeView* embeddings_view = nullptr;
+  if (weighted) {
+    const auto* mul_view = root_view->GetRegularFanin(0).node_view();
+    if (!IsMul(*mul_view->node()) || !is_intermediate(mul_view)) return false;
+    pattern.mul = mul_view->node_index();
+    for (int i = 0; i < 2; ++i) {
+      const auto* expand_view = mul_view->GetRegularFanin(i).node_view();
+      const auto* reshape_view = mul_view->GetRegularFanin(1 - i).node_view();
+      if (IsGatherAlongFirstAxis(*expand_view) &&
+          IsReshape(*reshape_view->node())) {
+        pattern.expand = expand_view->node_index();
+        pattern.reshape = reshape_view->node_index();
+        break;
+      }
+    }
+    if (pattern.expand == kMissingIndex) return false;
+    const auto* expand_view = ctx->graph_view.GetNode(pattern.expand);
+    const auto* reshape_view = ctx->graph_view.GetNode(pattern.reshape);
+    if (!is_intermediate(expand_view) || !is_intermediate(reshape_view) ||
+        !is_unique_output(expand_view->GetRegularFanin(1), 1)) {
+      return false;
+    }
+    embeddings_view = expand_view->GetRegularFanin(0).node_view();
+  } else {
+    if (!is_unique_output(root_view->GetRegularFanin(1), 1)) return false;
+    embeddings_view = root_view->GetRegularFanin(0).node_view();
+  }
+
+  if (IsIdentity(*embeddings_view->node())) {
+    if (!is_intermediate(embeddings_view)) return false;
+    pattern.identity = embeddings_view->node_index();
+    embeddings_view = embeddings_view->GetRegularFanin(0).node_view();
+  }
+  if (!IsGatherAlongFirstAxis(*embeddings_view) ||
+      !is_intermediate(embeddings_view) ||
+      !HasDataType(embeddings_view->node(), DT_FLOAT, "Tparams") ||
+      !is_unique_output(embeddings_view->GetRegularFanin(1), 0)) {
+    return false;
+  }
+  pattern.gather = embeddings_view->node_index();
+
+  const auto* unique_view = ctx->graph_view.GetNode(pattern.unique);
+  if (HasControlFaninOrFanout(*unique_view) ||
+      (!HasDataType(unique_view->node(), DT_INT32) &&
+       !HasDataType(unique_view->node(), DT_INT64))) {
+    return false;
+  }
+
+  if (weighted) {
+    // The weights must be a vector reshaped to [nnz, 1, ..., 1] so that the
+    // Mul scales whole embedding rows.
+    if (!ctx->inferred_graph_properties) {
+      Status s = ctx->graph_properties.InferStatically(
+          /*assume_valid_feeds=*/true,
+          /*aggressive_shape_inference=*/false,
+          /*include_input_tensor_values=*/false,
+          /*include_output_tensor_values=*/true);
+      if (!s.ok()) return false;
+      ctx->inferred_graph_properties = true;
+    }
+    const string& reshape = graph->node(pattern.reshape).name();
+    const auto& reshape_inputs =
+        ctx->graph_properties.GetInputProperties(reshape);
+    const auto& reshape_outputs =
+        ctx->graph_properties.GetOutputProperties(reshape);
+    const auto& gather_outputs = ctx->graph_properties.GetOutputProperties(
+        embeddings_view->node()->name());
+    if (reshape_inputs.empty() || reshape_outputs.empty() ||
+        gather_outputs.empty()) {
+      return false;
+    }
+    const TensorShapeProto& weights_shape = reshape_inputs[0].shape();
+    const TensorShapeProto& bcast_shape = reshape_outputs[0].shape();
+    const TensorShapeProto& embeddings_shape = gather_outputs[0].shape();
+    if (reshape_inputs[0].dtype() != DT_FLOAT ||
+        weights_shape.unknown_rank() || weights_shape.dim_size() != 1 ||
+        bcast_shape.unknown_rank() || embeddings_shape.unknown_rank() ||
+        bcast_shape.dim_size() != embeddings_shape.dim_size()) {
+      return false;
+    }
+    for (int d = 1; d < bcast_shape.dim_size(); ++d) {
+      if (bcast_shape.dim(d).size() != 1) return false;
+    }
+  }
+
+  *matched = pattern;
+  return true;
+}
+
+// Replaces the embedding lookup with
+// _FusedEmbeddingLookupSparse(params, ids, segment_ids[, weights]).
+Status AddFusedEmbeddingLookup(RemapperContext* ctx,
+                               const FusedEmbeddingLookup& matched,
+                               std::vector<bool>* invalidated_nodes,
+                               std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& segment_reduction = graph->node(matched.segment_reduction);
+  const NodeDef& gather = graph->node(matched.gather);
+  const NodeDef& unique = graph->node(matched.unique);
+  const bool weighted = matched.mul != kMissingIndex;
+  // Unique is only removed if the pattern holds its only two readers.
+  const bool delete_unique =
+      ctx->graph_view.GetNode(matched.unique)->NumRegularFanouts() == 2 &&
+      !IsInPreserveSet(*ctx, &unique);
+  VLOG(2) << "Fuse embedding lookup: " << segment_reduction.name()
+          << " gather=" << gather.name() << " unique=" << unique.name()
+          << " combiner=" << matched.combiner;
+
+  NodeDef fused_op;
+  fused_op.set_name(segment_reduction.name());
+  fused_op.set_op(kFusedEmbeddingLookupSparse);
+  fused_op.set_device(segment_reduction.device());
+  fused_op.add_input(gather.input(0));                         // params
+  fused_op.add_input(unique.input(0));                         // ids
+  fused_op.add_input(segment_reduction.input(weighted ? 1 : 2));  // segments
+  if (weighted) fused_op.add_input(graph->node(matched.reshape).input(0));
+
+  auto* attr = fused_op.mutable_attr();
+  SetAttrValue(DT_FLOAT, &(*attr)["T"]);
+  (*attr)["Tidx"] = unique.attr().at("T");
+  (*attr)["Tsegmentids"] = segment_reduction.attr().at(
+      weighted ? "Tindices" : "Tsegmentids");
+  SetAttrValue(weighted ? 1 : 0, &(*attr)["num_weights"]);
+  SetAttrValue(matched.combiner, &(*attr)["combiner"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.segment_reduction] = true;
+  for (int node : {matched.gather, matched.identity, matched.expand,
+                   matched.mul, matched.reshape}) {
+    if (node != kMissingIndex) (*nodes_to_delete)[node] = true;
+  }
+  if (delete_unique) (*nodes_to_delete)[matched.unique] = true;
+
+  return absl::OkStatus();
+}
+
+// Returns true if `node_view` is a BatchMatMul or BatchMatMulV2 of floats
+// with the given adjoint attributes.
+bool IsFloatBatchMatMul(const utils::MutableNodeView& node_view, bool adj_x,
+                        bool adj_y) {
+  const NodeDef* node_def = node_view.node();
+  if ((node_def->op() != "BatchMatMul" && node_def->op() != "BatchMatMulV2") ||
+      !HasDataType(node_def, DT_FLOAT) || node_view.NumRegularFanins() != 2) {
+    return false;
+  }
+  bool node_adj_x = false;
+  bool node_adj_y = false;
+  TryGetNodeAttr(*node_def, "adj_x", &node_adj_x);
+  TryGetNodeAttr(*node_def, "adj_y", &node_adj_y);
+  return node_adj_x == adj_x && node_adj_y == adj_y;
+}
+
+// Returns the value of `node_view` if it is a float Const.
+bool GetFloatConstant(const utils::MutableNodeView& node_view, Tensor* value) {
+  const NodeDef* node_def = node_view.node();
+  if (!IsConstant(*node_def) || node_def->attr().count("value") == 0) {
+    return false;
+  }
+  return value->FromProto(node_def->attr().at("value").tensor()) &&
+         value->dtype() == DT_FLOAT;
+}
+
+// Masked scores must be at most this value, so that they vanish from the
+// softmax like the keys the fused kernel skips.
+constexpr float kMaxCausalMaskValue = -1e9f;
+
+// Returns true if `mask` is a [1, ..., 1, Sq, Sk] tensor with Sq <= Sk that
+// is zero where key j <= query i + Sk - Sq and at most kMaxCausalMaskValue
+// elsewhere, which is the masking of _FusedScaledDotProductAttention with
+// `causal` set. Every query attends to at least one key.
+bool IsCausalMask(const Tensor& mask, int64_t num_queries, int64_t num_keys) {
+  const int rank = mask.dims();
+  if (rank < 2 || mask.dim_size(rank - 2) != num_queries ||
+      mask.dim_size(rank - 1) != num_keys || num_queries > num_keys) {
+    return false;
+  }
+  for (int d = 0; d < rank - 2; ++d) {
+    if (mask.dim_size(d) != 1) return false;
+  }
+  const float* values = mask.flat<float>().data();
+  for (int64_t i = 0; i < num_queries; ++i) {
+    for (int64_t j = 0; j < num_keys; ++j) {
+      const float value = values[i * num_keys + j];
+      const bool attended = j <= i + num_keys - num_queries;
+      if (attended ? value != 0.0f : !(value <= kMaxCausalMaskValue)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FindFusedScaledDotProductAttention(
+    RemapperContext* ctx, int node_index,
+    FusedScaledDotProductAttention* matched) {
+  if (ctx->xla_cpu_jit_disable_fusion) return false;
+
+  const auto* root_view = ctx->graph_view.GetNode(node_index);
+  if (!IsFloatBatchMatMul(*root_view, /*adj_x=*/false, /*adj_y=*/false) ||
+      HasControlFaninOrFanout(*root_view) || !NodeIsOnCpu(root_view->node())) {
+    return false;
+  }
+  FusedScaledDotProductAttention pattern;
+  pattern.output_matmul = node_index;
+
+  // Nodes inside the pattern are removed, so nothing else may read them.
+  auto is_intermediate = [ctx](const utils::MutableNodeView* view) {
+    return !HasControlFaninOrFanout(*view) && view->NumRegularFanouts() == 1 &&
+           !IsInPreserveSet(*ctx, view->node());
+  };
+
+  const auto* softmax_view = root_view->GetRegularFanin(0).node_view();
+  if (!IsSoftmax(*softmax_view->node()) || !is_intermediate(softmax_view)) {
+    return false;
+  }
+  pattern.softmax = softmax_view->node_index();
+
+  // Optional causal mask, checked once the shapes are known.
+  Tensor mask;
+  const auto* scores_view = softmax_view->GetRegularFanin(0).node_view();
+  if (IsAdd(*scores_view->node())) {
+    if (!is_intermediate(scores_view)) return false;
+    const utils::MutableNodeView* masked_view = nullptr;
+    for (int i = 0; i < 2; ++i) {
+      if (GetFloatConstant(*scores_view->GetRegularFanin(i).node_view(),
+                           &mask)) {
+        masked_view = scores_view->GetRegularFanin(1 - i).node_view();
+        break;
+      }
+    }
+    if (masked_view == nullptr) return false;
+    pattern.mask = scores_view->node_index();
+    scores_view = masked_view;
+  }
+
+  // Optional scale.
+  Tensor scale;
+  if (IsMul(*scores_view->node()) || IsRealDiv(*scores_view->node())) {
+    if (!is_intermediate(scores_view)) return false;
+    const bool is_div = IsRealDiv(*scores_view->node());
+    const utils::MutableNodeView* scaled_view = nullptr;
+    for (int i = is_div ? 1 : 0; i < 2; ++i) {
+      if (GetFloatConstant(*scores_view->GetRegularFanin(i).node_view(),
+                           &scale) &&
+          scale.NumElements() == 1) {
+        scaled_view = scores_view->GetRegularFanin(1 - i).node_view();
+        break;
+      }
+    }
+    if (scaled_view == nullptr) return false;
+    const float value = scale.flat<float>()(0);
+    pattern.scale_value = is_div ? 1.0f / value : value;
+    pattern.scale = scores_view->node_index();
+    scores_view = scaled_view;
+  }
+
+  if (!IsFloatBatchMatMul(*scores_view, /*adj_x=*/false, /*adj_y=*/true) ||
+      !is_intermediate(scores_view)) {
+    return false;
+  }
+  pattern.scores_matmul = scores_view->node_index();
+
+  // The fused op does not broadcast, so query, key and value must have the
+  // same batch dimensions. A scale that is not a scalar, or a mask that is
+  // not causal, could also change the shape of the scores.
+  if (!ctx->inferred_graph_properties) {
+    Status s = ctx->graph_properties.InferStatically(
+        /*assume_valid_feeds=*/true,
+        /*aggressive_shape_inference=*/false,
+        /*include_input_tensor_values=*/false,
+        /*include_output_tensor_values=*/true);
+    if (!s.ok()) return false;
+    ctx->inferred_graph_properties = true;
+  }
+  const auto& scores_inputs =
+      ctx->graph_properties.GetInputProperties(scores_view->node()->name());
+  const auto& output_inputs =
+      ctx->graph_properties.GetInputProperties(root_view->node()->name());
+  if (scores_inputs.size() != 2 || output_inputs.size() != 2) return false;
+  const TensorShapeProto& query = scores_inputs[0].shape();
+  const TensorShapeProto& key = scores_inputs[1].shape();
+  const TensorShapeProto& value = output_inputs[1].shape();
+  if (query.unknown_rank() || key.unknown_rank() || value.unknown_rank()) {
+    return false;
+  }
+  const int rank = query.dim_size();
+  if (rank < 2 || key.dim_size() != rank || value.dim_size() != rank ||
+      scale.dims() > rank) {
+    return false;
+  }
+  for (int d = 0; d < rank - 2; ++d) {
+    if (!IsKnownSymbolically(query.dim(d)) ||
+        key.dim(d).size() != query.dim(d).size() ||
+        value.dim(d).size() != query.dim(d).size()) {
+      return false;
+    }
+  }
+  if (pattern.mask != kMissingIndex &&
+      (mask.dims() > rank || !IsKnown(query.dim(rank - 2)) ||
+       !IsKnown(key.dim(rank - 2)) ||
+       !IsCausalMask(mask, query.dim(rank - 2).size(),
+                     key.dim(rank - 2).size()))) {
+    return false;
+  }
+
+  *matched = pattern;
+  return true;
+}
+
+// Replaces the attention with
+// _FusedScaledDotProductAttention(query, key, value).
+Status AddFusedScaledDotProductAttention(
+    RemapperContext* ctx, const FusedScaledDotProductAttention& matched,
+    std::vector<bool>* invalidated_nodes, std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& output_matmul = graph->node(matched.output_matmul);
+  const NodeDef& scores_matmul = graph->node(matched.scores_matmul);
+  VLOG(2) << "Fuse scaled dot product attention: " << output_matmul.name()
+          << " scores=" << scores_matmul.name()
+          << " scale=" << matched.scale_value
+          << " causal=" << (matched.mask != kMissingIndex);
+
+  NodeDef fused_op;
+  fused_op.set_name(output_matmul.name());
+  fused_op.set_op(kFusedScaledDotProductAttention);
+  fused_op.set_device(output_matmul.device());
+  fused_op.add_input(scores_matmul.input(0));  // query
+  fused_op.add_input(scores_matmul.input(1));  // key
+  fused_op.add_input(output_matmul.input(1));  // value
+
+  auto* attr = fused_op.mutable_attr();
+  SetAttrValue(DT_FLOAT, &(*attr)["T"]);
+  SetAttrValue(matched.scale_value, &(*attr)["scale"]);
+  SetAttrValue(matched.mask != kMissingIndex, &(*attr)["causal"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.output_matmul] = true;
+  for (int node : {matched.softmax, matched.mask, matched.scale,
+                   matched.scores_matmul}) {
+    if (node != kMissingIndex) (*nodes_to_delete)[node] = true;
+  }
+
+  return absl::OkStatus();
+}
+
 // This function supports below patterns that require inferred
 // shapes:
 // 1. Contraction + Add.
@@ -4843,6 +5495,7 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
   RemapperContext ctx(&mutable_item, &status, cpu_layout_conversion_,
                       xla_auto_clustering_on_, xla_cpu_jit_disable_fusion);
   TF_RETURN_IF_ERROR(status);
+  ctx.dynamic_range_quantized_matmul = DynamicRangeQuantizedMatMulEnabled();
 
   // Processing graph in reverse-topological sorted order allows to remap
   // longer chains of dependent ops in one pass.
@@ -4860,6 +5513,23 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
   bool allow_non_differentiable_rewrites =
       item.optimization_options().allow_non_differentiable_rewrites;
 
+  // Replace MatMul with constant float weights by an int8 dynamic-range
+  // quantized MatMul (opt-in via TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL).
+  // This runs before the fusions below: they are matched at the consumers of
+  // the MatMul, e.g. a BiasAdd, which are visited first and would fold the
+  // MatMul into a float _FusedMatMul.
+  if (allow_non_differentiable_rewrites && ctx.dynamic_range_quantized_matmul) {
+    for (int i = num_nodes - 1; i >= 0; --i) {
+      DynamicRangeQuantizedMatMul dynamic_range_quantized_matmul;
+      if (FindDynamicRangeQuantizedMatMul(ctx, i,
+                                          &dynamic_range_quantized_matmul)) {
+        TF_RETURN_IF_ERROR(AddDynamicRangeQuantizedMatMul(
+            &ctx, dynamic_range_quantized_matmul, &invalidated_nodes,
+            &nodes_to_delete));
+      }
+    }
+  }
+
   for (int i = num_nodes - 1; i >= 0; --i) {
     // Check if node was invalidated by one of the previous remaps.
     if (invalidated_nodes[i] || nodes_to_delete[i]) {
@@ -5182,6 +5852,27 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
       continue;
     }
 
+    // Remap Unique+GatherV2+SparseSegment{Sum,Mean,SqrtN} (and the weighted
+    // SegmentSum variant) into _FusedEmbeddingLookupSparse.
+    FusedEmbeddingLookup fused_embedding_lookup;
+    if (allow_non_differentiable_rewrites &&
+        FindFusedEmbeddingLookup(&ctx, i, &fused_embedding_lookup)) {
+      TF_RETURN_IF_ERROR(AddFusedEmbeddingLookup(&ctx, fused_embedding_lookup,
+                                                 &invalidated_nodes,
+                                                 &nodes_to_delete));
+      continue;
+    }
+
+    // Remap BatchMatMul+[Mul]+[AddV2]+Softmax+BatchMatMul attention into
+    // _FusedScaledDotProductAttention.
+    FusedScaledDotProductAttention fused_attention;
+    if (allow_non_differentiable_rewrites &&
+        FindFusedScaledDotProductAttention(&ctx, i, &fused_attention)) {
+      TF_RETURN_IF_ERROR(AddFusedScaledDotProductAttention(
+          &ctx, fused_attention, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
     // During inference, most of the inputs to FusedBatchNorm are constant, and
     // we can therefore replace the op with a much cheaper set of primitives.
     FusedBatchNorm fused_batch_norm;
@@ -5189,6 +5880,14 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
       TF_RETURN_IF_ERROR(AddBatchNormNodes(&ctx, fused_batch_norm));
       continue;
     }
+
+    // MatMul and BatchMatMul with constant weights (frozen serving graphs)
+    // can reuse a packed copy of the weights instead of having Eigen repack
+    // them on every call.
+    if (IsMatMulWithConstantRhs(ctx, i)) {
+      TF_RETURN_IF_ERROR(AddPrepackRhsAttr(&ctx, i));
+      continue;
+    }
   }
 
   // Remove invalidated nodes.
@@ -1767,6 +1767,413 @@ TEST_F(RemapperTensorToHashBucketTest, I32) { RunTest<DT_INT32>(); }
 
 TEST_F(RemapperTensorToHashBucketTest, I64) { RunTest<DT_INT64>(); }
 
+TEST_F(RemapperTest, PrepackConstantMatMulWeights) {
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto lhs_shape = ops::Placeholder::Shape({4, 32});
+  auto rhs_shape = ops::Placeholder::Shape({32, 24});
+
+  auto lhs = Placeholder(s.WithOpName("lhs"), DT_FLOAT, lhs_shape);
+  auto fed_rhs = Placeholder(s.WithOpName("fed_rhs"), DT_FLOAT, rhs_shape);
+  auto const_rhs = ops::Const(s.WithOpName("const_rhs"),
+                              Input::Initializer(
+                                  GenerateRandomTensor<DT_FLOAT>({32, 24})));
+  auto const_matmul = ops::MatMul(s.WithOpName("const_matmul"), lhs, const_rhs);
+  auto fed_matmul = ops::MatMul(s.WithOpName("fed_matmul"), lhs, fed_rhs);
+  auto const_fetch = ops::Identity(s.WithOpName("const_fetch"), const_matmul);
+  auto fed_fetch = ops::Identity(s.WithOpName("fed_fetch"), fed_matmul);
+
+  auto lhs_t = GenerateRandomTensor<DT_FLOAT>({4, 32});
+  auto rhs_t = GenerateRandomTensor<DT_FLOAT>({32, 24});
+
+  GrapplerItem item;
+  item.fetch = {"const_fetch", "fed_fetch"};
+  item.feed = {{"lhs", lhs_t}, {"fed_rhs", rhs_t}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "const_matmul") {
+      EXPECT_EQ(node.op(), "MatMul");
+      if (IsMKLEnabled()) {
+        EXPECT_EQ(node.attr().count("_prepack_rhs"), 0);
+      } else {
+        ASSERT_EQ(node.attr().count("_prepack_rhs"), 1);
+        EXPECT_TRUE(node.attr().at("_prepack_rhs").b());
+      }
+      found++;
+    } else if (node.name() == "fed_matmul") {
+      EXPECT_EQ(node.op(), "MatMul");
+      EXPECT_EQ(node.attr().count("_prepack_rhs"), 0);
+      found++;
+    }
+  }
+  EXPECT_EQ(found, 2);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 2);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 2);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-4);
+  test::ExpectTensorNear<float>(tensors[1], tensors_expected[1], 1e-4);
+}
+
+TEST_F(RemapperTest, DynamicRangeQuantizedMatMul) {
+  if (IsMKLEnabled()) GTEST_SKIP() << "oneDNN handles MatMul on CPU.";
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto lhs = Placeholder(s.WithOpName("lhs"), DT_FLOAT,
+                         ops::Placeholder::Shape({4, 64}));
+  auto weights = ops::Const(
+      s.WithOpName("weights"),
+      Input::Initializer(GenerateRandomTensor<DT_FLOAT>({48, 64})));
+  auto small_weights = ops::Const(
+      s.WithOpName("small_weights"),
+      Input::Initializer(GenerateRandomTensor<DT_FLOAT>({64, 8})));
+  auto matmul = ops::MatMul(s.WithOpName("matmul"), lhs, weights,
+                            ops::MatMul::Attrs().TransposeB(true));
+  auto small_matmul =
+      ops::MatMul(s.WithOpName("small_matmul"), lhs, small_weights);
+  auto fetch = ops::Identity(s.WithOpName("fetch"), matmul);
+  auto small_fetch = ops::Identity(s.WithOpName("small_fetch"), small_matmul);
+
+  auto lhs_t = GenerateRandomTensor<DT_FLOAT>({4, 64});
+
+  GrapplerItem item;
+  item.fetch = {"fetch", "small_fetch"};
+  item.feed = {{"lhs", lhs_t}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  setenv("TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL", "1", 1 /* replace */);
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  unsetenv("TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL");
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "matmul") {
+      EXPECT_EQ(node.op(), "_DynamicRangeQuantizedMatMul");
+      ASSERT_EQ(node.input_size(), 3);
+      EXPECT_EQ(node.input(0), "lhs");
+      EXPECT_EQ(node.input(1), "matmul/dynamic_range_weights");
+      EXPECT_EQ(node.input(2), "matmul/dynamic_range_scales");
+      found++;
+    } else if (node.name() == "matmul/dynamic_range_weights") {
+      EXPECT_EQ(node.attr().at("dtype").type(), DT_INT8);
+      found++;
+    } else if (node.name() == "small_matmul") {
+      // Too few weights to be worth quantizing.
+      EXPECT_EQ(node.op(), "MatMul");
+      found++;
+    } else if (node.name() == "weights") {
+      ADD_FAILURE() << "Float weights should have been removed.";
+    }
+  }
+  EXPECT_EQ(found, 3);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 2);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 2);
+  test::ExpectClose(tensors[0], tensors_expected[0], /*atol=*/0.1,
+                    /*rtol=*/0.02);
+  test::ExpectTensorNear<float>(tensors[1], tensors_expected[1], 1e-4);
+}
+
+TEST_F(RemapperTest, FuseEmbeddingLookupSparse) {
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto params = Placeholder(s.WithOpName("params"), DT_FLOAT,
+                            ops::Placeholder::Shape({16, 8}));
+  auto ids = Placeholder(s.WithOpName("ids"), DT_INT64,
+                         ops::Placeholder::Shape({6}));
+  auto segment_ids = Placeholder(s.WithOpName("segment_ids"), DT_INT32,
+                                 ops::Placeholder::Shape({6}));
+  auto weights = Placeholder(s.WithOpName("weights"), DT_FLOAT,
+                             ops::Placeholder::Shape({6}));
+  auto axis = ops::Const(s.WithOpName("axis"), 0, {});
+
+  // Unweighted lookup with a mean combiner.
+  auto unique = ops::Unique(s.WithOpName("unique"), ids);
+  auto gather =
+      ops::GatherV2(s.WithOpName("gather"), params, unique.y, axis);
+  auto identity = ops::Identity(s.WithOpName("identity"), gather);
+  auto mean = ops::SparseSegmentMean(s.WithOpName("mean"), identity,
+                                     unique.idx, segment_ids);
+
+  // Weighted lookup with a sum combiner.
+  auto weighted_unique = ops::Unique(s.WithOpName("weighted_unique"), ids);
+  auto weighted_gather = ops::GatherV2(s.WithOpName("weighted_gather"),
+                                       params, weighted_unique.y, axis);
+  auto expand = ops::GatherV2(s.WithOpName("expand"), weighted_gather,
+                              weighted_unique.idx, axis);
+  auto bcast_weights =
+      ops::Reshape(s.WithOpName("bcast_weights"), weights,
+                   ops::Const(s.WithOpName("bcast_shape"), {6, 1}, {2}));
+  auto mul = ops::Mul(s.WithOpName("mul"), expand, bcast_weights);
+  auto sum = ops::SegmentSum(s.WithOpName("sum"), mul, segment_ids);
+
+  auto fetch = ops::Identity(s.WithOpName("fetch"), mean);
+  auto weighted_fetch = ops::Identity(s.WithOpName("weighted_fetch"), sum);
+
+  auto params_t = GenerateRandomTensor<DT_FLOAT>({16, 8});
+  auto ids_t = test::AsTensor<int64_t>({3, 15, 3, 0, 7, 3});
+  auto segment_ids_t = test::AsTensor<int32>({0, 0, 1, 3, 3, 3});
+  auto weights_t = test::AsTensor<float>({0.5, 2, 1, -1, 0.25, 3});
+
+  GrapplerItem item;
+  item.fetch = {"fetch", "weighted_fetch"};
+  item.feed = {{"params", params_t},
+               {"ids", ids_t},
+               {"segment_ids", segment_ids_t},
+               {"weights", weights_t}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "mean") {
+      EXPECT_EQ(node.op(), "_FusedEmbeddingLookupSparse");
+      ASSERT_EQ(node.input_size(), 3);
+      EXPECT_EQ(node.input(0), "params");
+      EXPECT_EQ(node.input(1), "ids");
+      EXPECT_EQ(node.input(2), "segment_ids");
+      EXPECT_EQ(node.attr().at("combiner").s(), "mean");
+      EXPECT_EQ(node.attr().at("num_weights").i(), 0);
+      EXPECT_EQ(node.attr().at("Tidx").type(), DT_INT64);
+      found++;
+    } else if (node.name() == "sum") {
+      EXPECT_EQ(node.op(), "_FusedEmbeddingLookupSparse");
+      ASSERT_EQ(node.input_size(), 4);
+      EXPECT_EQ(node.input(0), "params");
+      EXPECT_EQ(node.input(1), "ids");
+      EXPECT_EQ(node.input(2), "segment_ids");
+      EXPECT_EQ(node.input(3), "weights");
+      EXPECT_EQ(node.attr().at("combiner").s(), "sum");
+      EXPECT_EQ(node.attr().at("num_weights").i(), 1);
+      found++;
+    } else if (node.name() == "unique" || node.name() == "gather" ||
+               node.name() == "identity" || node.name() == "expand" ||
+               node.name() == "mul") {
+      ADD_FAILURE() << "Fused node " << node.name() << " was not removed.";
+    }
+  }
+  EXPECT_EQ(found, 2);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 2);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 2);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-5);
+  test::ExpectTensorNear<float>(tensors[1], tensors_expected[1], 1e-5);
+}
+
+TEST_F(RemapperTest, FuseScaledDotProductAttention) {
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto query = Placeholder(s.WithOpName("query"), DT_FLOAT,
+                           ops::Placeholder::Shape({2, 3, 5, 16}));
+  auto key = Placeholder(s.WithOpName("key"), DT_FLOAT,
+                         ops::Placeholder::Shape({2, 3, 7, 16}));
+  auto value = Placeholder(s.WithOpName("value"), DT_FLOAT,
+                           ops::Placeholder::Shape({2, 3, 7, 8}));
+
+  // Masks with zeros where key j <= query i + 2 and where key j <= query i.
+  // Only the first one matches the causal masking of the fused op.
+  Tensor causal_mask(DT_FLOAT, TensorShape({5, 7}));
+  Tensor other_mask(DT_FLOAT, TensorShape({5, 7}));
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 7; ++j) {
+      causal_mask.matrix<float>()(i, j) = j <= i + 2 ? 0.0f : -1e9f;
+      other_mask.matrix<float>()(i, j) = j <= i ? 0.0f : -1e9f;
+    }
+  }
+
+  // Unmasked attention, scaled with a Mul.
+  auto scores = ops::BatchMatMulV2(s.WithOpName("scores"), query, key,
+                                   ops::BatchMatMulV2::AdjY(true));
+  auto scaled = ops::Mul(s.WithOpName("scaled"), scores,
+                         ops::Const(s.WithOpName("scale"), 0.25f, {}));
+  auto probs = ops::Softmax(s.WithOpName("probs"), scaled);
+  auto attention =
+      ops::BatchMatMulV2(s.WithOpName("attention"), probs, value);
+
+  // Causal attention, scaled with a RealDiv.
+  auto causal_scores =
+      ops::BatchMatMulV2(s.WithOpName("causal_scores"), query, key,
+                         ops::BatchMatMulV2::AdjY(true));
+  auto causal_scaled =
+      ops::RealDiv(s.WithOpName("causal_scaled"), causal_scores,
+                   ops::Const(s.WithOpName("divisor"), 4.0f, {}));
+  auto causal_masked =
+      ops::AddV2(s.WithOpName("causal_masked"), causal_scaled,
+                 ops::Const(s.WithOpName("causal_mask"), causal_mask));
+  auto causal_probs = ops::Softmax(s.WithOpName("causal_probs"),
+                                   causal_masked);
+  auto causal_attention = ops::BatchMatMulV2(
+      s.WithOpName("causal_attention"), causal_probs, value);
+
+  // Attention with a mask the fused op does not support.
+  auto other_scores =
+      ops::BatchMatMulV2(s.WithOpName("other_scores"), query, key,
+                         ops::BatchMatMulV2::AdjY(true));
+  auto other_masked =
+      ops::AddV2(s.WithOpName("other_masked"), other_scores,
+                 ops::Const(s.WithOpName("other_mask"), other_mask));
+  auto other_probs = ops::Softmax(s.WithOpName("other_probs"), other_masked);
+  auto other_attention = ops::BatchMatMulV2(s.WithOpName("other_attention"),
+                                            other_probs, value);
+
+  auto fetch = ops::Identity(s.WithOpName("fetch"), attention);
+  auto causal_fetch =
+      ops::Identity(s.WithOpName("causal_fetch"), causal_attention);
+  auto other_fetch =
+      ops::Identity(s.WithOpName("other_fetch"), other_attention);
+
+  GrapplerItem item;
+  item.fetch = {"fetch", "causal_fetch", "other_fetch"};
+  item.feed = {{"query", GenerateRandomTensor<DT_FLOAT>({2, 3, 5, 16})},
+               {"key", GenerateRandomTensor<DT_FLOAT>({2, 3, 7, 16})},
+               {"value", GenerateRandomTensor<DT_FLOAT>({2, 3, 7, 8})}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "attention" || node.name() == "causal_attention") {
+      const bool causal = node.name() == "causal_attention";
+      EXPECT_EQ(node.op(), "_FusedScaledDotProductAttention");
+      ASSERT_EQ(node.input_size(), 3);
+      EXPECT_EQ(node.input(0), "query");
+      EXPECT_EQ(node.input(1), "key");
+      EXPECT_EQ(node.input(2), "value");
+      EXPECT_FLOAT_EQ(node.attr().at("scale").f(), 0.25f);
+      EXPECT_EQ(node.attr().at("causal").b(), causal);
+      found++;
+    } else if (node.name() == "other_attention") {
+      EXPECT_EQ(node.op(), "BatchMatMulV2");
+      found++;
+    } else if (node.name() == "scores" || node.name() == "probs" ||
+               node.name() == "causal_masked" ||
+               node.name() == "causal_probs") {
+      ADD_FAILURE() << "Fused node " << node.name() << " was not removed.";
+    }
+  }
+  EXPECT_EQ(found, 3);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 3);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    test::ExpectTensorNear<float>(tensors[i], tensors_expected[i], 1e-5);
+  }
+}
+
+// A MatMul followed by BiasAdd and Relu is quantized rather than fused into a
+// float _FusedMatMul, although the fusions are matched at the BiasAdd and Relu
+// which come first in reverse topological order.
+TEST_F(RemapperTest, DynamicRangeQuantizedMatMulBeforeBiasAddFusion) {
+  if (IsMKLEnabled()) GTEST_SKIP() << "oneDNN handles MatMul on CPU.";
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto lhs = Placeholder(s.WithOpName("lhs"), DT_FLOAT,
+                         ops::Placeholder::Shape({4, 64}));
+  auto weights = ops::Const(
+      s.WithOpName("weights"),
+      Input::Initializer(GenerateRandomTensor<DT_FLOAT>({64, 48})));
+  auto bias = ops::Const(
+      s.WithOpName("bias"),
+      Input::Initializer(GenerateRandomTensor<DT_FLOAT>({48})));
+  auto matmul = ops::MatMul(s.WithOpName("matmul"), lhs, weights);
+  auto bias_add = ops::BiasAdd(s.WithOpName("bias_add"), matmul, bias);
+  auto relu = ops::Relu(s.WithOpName("relu"), bias_add);
+  auto fetch = ops::Identity(s.WithOpName("fetch"), relu);
+
+  auto lhs_t = GenerateRandomTensor<DT_FLOAT>({4, 64});
+
+  GrapplerItem item;
+  item.fetch = {"fetch"};
+  item.feed = {{"lhs", lhs_t}};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  setenv("TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL", "1", 1 /* replace */);
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  unsetenv("TF_ENABLE_DYNAMIC_RANGE_QUANTIZED_MATMUL");
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE(node.op(), "_FusedMatMul") << node.name();
+    if (node.name() == "matmul") {
+      EXPECT_EQ(node.op(), "_DynamicRangeQuantizedMatMul");
+      ASSERT_EQ(node.input_size(), 3);
+      EXPECT_EQ(node.input(0), "lhs");
+      found++;
+    } else if (node.name() == "bias_add") {
+      EXPECT_EQ(node.op(), "BiasAdd");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "matmul");
+      found++;
+    }
+  }
+  EXPECT_EQ(found, 2);
+
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+  ASSERT_EQ(tensors_expected.size(), 1);
+  auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectClose(tensors[0], tensors_expected[0], /*atol=*/0.1,
+                    /*rtol=*/0.02);
+}
+
 class RemapperFuseMatMulWithBiasTest : public RemapperTest {
  public:
   template <DataType DTYPE>
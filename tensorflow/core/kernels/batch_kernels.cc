@@ -315,6 +315,10 @@ BatchFunctionKernel::BatchFunctionKernel(OpKernelConstruction* c)
     has_attribute_enable_large_batch_splitting_ = true;
   }
 
+  if (c->HasAttr("length_buckets")) {
+    OP_REQUIRES_OK(c, c->GetAttr("length_buckets", &length_buckets_));
+  }
+
   // Helper function `SetAdaptiveBatchSchedulerOptions` calls
   // `OP_REQUIRES_OK`, which exits the current function upon error.
   // So validate status of `op-kernel-construction`.
@@ -339,6 +343,7 @@ BatchFunctionKernel::BatchFunctionKernel(OpKernelConstruction* c)
   }
 
   OP_REQUIRES_OK(c, ValidateAllowedBatchSizes());
+  OP_REQUIRES_OK(c, ValidateLengthBuckets());
 }
 
 bool BatchFunctionKernel::IsExpensive() { return false; }
@@ -421,6 +426,7 @@ void BatchFunctionKernel::ComputeAsync(OpKernelContext* c, DoneCallback done) {
       if (session_metadata) {
         new_resource->set_session_metadata(*session_metadata);
       }
+      new_resource->set_length_buckets(length_buckets_);
       *r = new_resource.release();
       return absl::OkStatus();
     };
@@ -443,6 +449,7 @@ void BatchFunctionKernel::ComputeAsync(OpKernelContext* c, DoneCallback done) {
       if (session_metadata) {
         new_resource->set_session_metadata(*session_metadata);
       }
+      new_resource->set_length_buckets(length_buckets_);
       *r = new_resource.release();
       return absl::OkStatus();
     };
@@ -573,6 +580,19 @@ Status BatchFunctionKernel::ValidateAllowedBatchSizes() const {
   return absl::OkStatus();
 }
 
+Status BatchFunctionKernel::ValidateLengthBuckets() const {
+  int32_t last_length = 0;
+  for (const int32_t length : length_buckets_) {
+    if (length <= last_length) {
+      return errors::InvalidArgument(
+          "length_buckets entries must be positive and monotonically "
+          "increasing");
+    }
+    last_length = length;
+  }
+  return absl::OkStatus();
+}
+
 // Initialize vars by reading from op-kernel-construction.
 // Vars
 // - enable_adaptive_batch_threads_
@@ -80,6 +80,10 @@ class BatchFunctionKernel : public AsyncOpKernel {
   // to `max_batch_size_`.
   Status ValidateAllowedBatchSizes() const;
 
+  // Validates 'length_buckets_'. The entries must be positive and increase
+  // monotonically.
+  Status ValidateLengthBuckets() const;
+
   // Creates the function handle if it isn't initialized yet; and re-use it
   // afterwards.
   Status GetOrCreateFunctionHandle(OpKernelContext* c,
@@ -112,6 +116,7 @@ class BatchFunctionKernel : public AsyncOpKernel {
   std::vector<int32> low_priority_allowed_batch_sizes_;
   std::string mixed_priority_policy_;
   std::string batch_padding_policy_;
+  std::vector<int32> length_buckets_;
   NameAttrList func_;
   absl::optional<FunctionLibraryRuntime::Handle> fhandle_ TF_GUARDED_BY(mu_);
   bool enable_large_batch_splitting_ = false;
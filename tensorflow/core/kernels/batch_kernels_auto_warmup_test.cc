@@ -15,17 +15,24 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/batch_kernels.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/framework/device_factory.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.pb.h"
@@ -35,6 +42,7 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/protobuf/config.pb.h"
 #include "tensorflow/core/public/version.h"
 #include "tsl/lib/core/status_test_util.h"
@@ -53,8 +61,10 @@ class BatchFunctionKernelTest : public test_util::BatchFunctionKernelTestBase {
 
 class BatchFunctionKernelParallelWarmupTestState : public OpsTestBase {
  public:
-  // Init test fixture with a batch kernel instance.
-  Status Init(bool enable_splitting, bool check_output_shape) {
+  // Init test fixture with a batch kernel instance. If 'device' is null, the
+  // kernel runs on a device that is shared between all tests.
+  Status Init(bool enable_splitting, bool check_output_shape,
+              Device *device = nullptr) {
     static auto *const cpu_device = []() {
       auto device =
           DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
@@ -63,7 +73,7 @@ class BatchFunctionKernelParallelWarmupTestState : public OpsTestBase {
 
     // Override the per-test/per-op device with a global device so that it can
     // be shared between ops.
-    device_ = cpu_device;
+    device_ = device != nullptr ? device : cpu_device;
 
     NameAttrList f;
     f.set_name("BatchFunctionKernelParallelWarmupTestStateFunc");
@@ -277,8 +287,318 @@ TEST_P(BatchFunctionKernelParallelWarmupTest, AutoBatchWorks) {
   }
 }
 
+TEST_P(BatchFunctionKernelParallelWarmupTest, WarmsUpEachBatchSizeOnce) {
+  // Use a dedicated device, so that the batch resource has not been warmed up
+  // by the other tests.
+  std::unique_ptr<Device> device =
+      DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+  SessionMetadata session_metadata;
+  session_metadata.set_name("test_model");
+  session_metadata.set_version(123);
+  serving::WarmupStateRegistry::Key key(session_metadata.name(),
+                                        session_metadata.version());
+
+  int num_requests = 16;
+
+  bool enable_splitting = GetParam();
+  auto per_model_data = std::make_unique<PerModelData>();
+  per_model_data->warmup_all_batch_sizes = true;
+  per_model_data->warmup_each_batch_size_once = true;
+  auto handle = serving::GetGlobalWarmupStateRegistry().Register(
+      key, std::move(per_model_data));
+
+  std::atomic<int> num_warmed_up_requests(0);
+  tsl::BlockingCounter blocking_counter(num_requests);
+  for (int i = 0; i < num_requests; ++i) {
+    Env::Default()->SchedClosure([&]() {
+      BatchFunctionKernelParallelWarmupTestState test;
+      test.set_session_metadata(session_metadata);
+      TF_CHECK_OK(test.Init(enable_splitting, /*check_output_shape=*/true,
+                            device.get()));
+      test.AddInputFromList<int64_t>(TensorShape({2}), {123, 456});
+      auto status = test.RunOpKernel();
+      if (!status.ok()) {
+        // The kernel was executed with batch sizes other than 2.
+        EXPECT_TRUE(absl::StrContains(status.message(),
+                                      "is not compatible with expected shape"));
+        ++num_warmed_up_requests;
+      } else {
+        test::ExpectTensorEqual<int64_t>(*test.GetOutput(0),
+                                         test::AsTensor<int64_t>({123, 456}));
+      }
+      blocking_counter.DecrementCount();
+    });
+  }
+  blocking_counter.Wait();
+
+  // Only the first request warmed up all batch sizes.
+  EXPECT_EQ(num_warmed_up_requests, 1);
+}
+
 INSTANTIATE_TEST_SUITE_P(BatchFunctionKernelParallelWarmupTestSuite,
                          BatchFunctionKernelParallelWarmupTest,
                          ::testing::Bool());
+
+// Returns its input, and records the size of each batch it processes and the
+// largest number of batches it has processed concurrently.
+class BatchSizeRecorderOp : public OpKernel {
+ public:
+  explicit BatchSizeRecorderOp(OpKernelConstruction *context)
+      : OpKernel(context) {}
+
+  void Compute(OpKernelContext *context) override {
+    {
+      absl::MutexLock l(&mu_);
+      batch_sizes_.push_back(context->input(0).dim_size(0));
+      max_num_in_flight_ = std::max(max_num_in_flight_, ++num_in_flight_);
+    }
+    // Gives concurrent batches a chance to overlap.
+    Env::Default()->SleepForMicroseconds(1000);
+    {
+      absl::MutexLock l(&mu_);
+      --num_in_flight_;
+    }
+    context->set_output(0, context->input(0));
+  }
+
+  static void Reset() {
+    absl::MutexLock l(&mu_);
+    batch_sizes_.clear();
+    num_in_flight_ = 0;
+    max_num_in_flight_ = 0;
+  }
+
+  static std::vector<int64_t> BatchSizes() {
+    absl::MutexLock l(&mu_);
+    return batch_sizes_;
+  }
+
+  static int MaxNumInFlight() {
+    absl::MutexLock l(&mu_);
+    return max_num_in_flight_;
+  }
+
+ private:
+  static absl::Mutex mu_;
+  static std::vector<int64_t> batch_sizes_ ABSL_GUARDED_BY(mu_);
+  static int num_in_flight_ ABSL_GUARDED_BY(mu_);
+  static int max_num_in_flight_ ABSL_GUARDED_BY(mu_);
+};
+
+absl::Mutex BatchSizeRecorderOp::mu_(absl::kConstInit);
+std::vector<int64_t> BatchSizeRecorderOp::batch_sizes_;
+int BatchSizeRecorderOp::num_in_flight_ = 0;
+int BatchSizeRecorderOp::max_num_in_flight_ = 0;
+
+REGISTER_OP("BatchSizeRecorder")
+    .Input("x: int64")
+    .Output("o: int64")
+    .SetIsStateful();
+REGISTER_KERNEL_BUILDER(Name("BatchSizeRecorder").Device(DEVICE_CPU),
+                        BatchSizeRecorderOp);
+
+// A BatchFunction op with many batch threads, whose function records the size
+// of its batches.
+class WarmupOrderTestState : public OpsTestBase {
+ public:
+  Status Init(Device *device) {
+    device_ = device;
+
+    NameAttrList f;
+    f.set_name("WarmupOrderTestStateFunc");
+    FunctionDef func = FunctionDefHelper::Create(
+        // function_name
+        f.name(),
+        // in_def
+        {"x:int64"},
+        // out_def
+        {"o:int64"},
+        // attr_def
+        {},
+        // node_def
+        {{{"o"}, "BatchSizeRecorder", {"x"}, {}}},
+        // ret_def
+        {{"o", "o:o:0"}});
+    TF_RETURN_IF_ERROR(flib_def_->AddFunctionDef(func));
+
+    pflr_ = std::make_unique<ProcessFunctionLibraryRuntime>(
+        device_mgr_.get(), Env::Default(), /*config=*/nullptr,
+        TF_GRAPH_DEF_VERSION, flib_def_.get(), OptimizerOptions(),
+        /*thread_pool=*/nullptr, /*parent=*/nullptr,
+        /*session_metadata=*/nullptr,
+        Rendezvous::Factory{[](const int64_t, const DeviceMgr *device_mgr,
+                               tsl::core::RefCountPtr<Rendezvous> *r) {
+          *r = tsl::core::RefCountPtr<Rendezvous>(
+              new IntraProcessRendezvous(device_mgr));
+          return absl::OkStatus();
+        }});
+
+    std::vector<NodeDefBuilder::NodeOut> inputs(
+        {NodeDefBuilder::NodeOut({"n1", 0, DataType::DT_INT64})});
+    TF_RETURN_IF_ERROR(NodeDefBuilder("BatchTPUInput", "BatchFunction")
+                           .Attr("max_batch_size", 8)
+                           .Attr("num_batch_threads", 8)
+                           .Attr("allowed_batch_sizes", {2, 4, 8})
+                           .Attr("batch_timeout_micros", 0)
+                           .Attr("max_enqueued_batches", 10)
+                           .Attr("Tin", {DataType::DT_INT64})
+                           .Input(inputs)
+                           .Attr("Tcaptured", std::vector<DataType>{})
+                           .Input(std::vector<NodeDefBuilder::NodeOut>{})
+                           .Attr("Tout", std::vector<DataType>{DT_INT64})
+                           .Attr("f", f)
+                           .Finalize(node_def()));
+    return InitOp();
+  }
+
+  void TestBody() override {}
+};
+
+TEST(BatchFunctionKernelWarmupOrderTest, WarmsUpLargestFirstOneAtATime) {
+  // Use a dedicated device, so that the batch resource has not been warmed up
+  // by the other tests.
+  std::unique_ptr<Device> device =
+      DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+  SessionMetadata session_metadata;
+  session_metadata.set_name("warmup_order_model");
+  session_metadata.set_version(1);
+  serving::WarmupStateRegistry::Key key(session_metadata.name(),
+                                        session_metadata.version());
+  auto per_model_data = std::make_unique<PerModelData>();
+  per_model_data->warmup_all_batch_sizes = true;
+  auto handle = serving::GetGlobalWarmupStateRegistry().Register(
+      key, std::move(per_model_data));
+  TF_ASSERT_OK(handle.status());
+  BatchSizeRecorderOp::Reset();
+
+  WarmupOrderTestState test;
+  test.set_session_metadata(session_metadata);
+  TF_ASSERT_OK(test.Init(device.get()));
+  test.AddInputFromList<int64_t>(TensorShape({2}), {123, 456});
+  TF_ASSERT_OK(test.RunOpKernel());
+  test::ExpectTensorEqual<int64_t>(*test.GetOutput(0),
+                                   test::AsTensor<int64_t>({123, 456}));
+
+  // The dummy batches run from the largest to the smallest, followed by the
+  // real request, and never overlap although there are 8 batch threads.
+  EXPECT_EQ(BatchSizeRecorderOp::BatchSizes(),
+            std::vector<int64_t>({8, 4, 2, 2}));
+  EXPECT_EQ(BatchSizeRecorderOp::MaxNumInFlight(), 1);
+}
+
+// A BatchFunction op returning its input, which processes its batches without
+// waiting for a timeout, so that the latency of a request is the time it
+// takes to process its batch.
+class FirstRequestLatencyTestState : public OpsTestBase {
+ public:
+  Status Init(Device *device) {
+    device_ = device;
+
+    NameAttrList f;
+    f.set_name("FirstRequestLatencyTestStateFunc");
+    FunctionDef func = FunctionDefHelper::Create(
+        // function_name
+        f.name(),
+        // in_def
+        {"x:int64"},
+        // out_def
+        {"o:int64"},
+        // attr_def
+        {},
+        // node_def
+        {{{"o"}, "Identity", {"x"}, {{"T", DataType::DT_INT64}}}},
+        // ret_def
+        {{"o", "o:output"}});
+    TF_RETURN_IF_ERROR(flib_def_->AddFunctionDef(func));
+
+    pflr_ = std::make_unique<ProcessFunctionLibraryRuntime>(
+        device_mgr_.get(), Env::Default(), /*config=*/nullptr,
+        TF_GRAPH_DEF_VERSION, flib_def_.get(), OptimizerOptions(),
+        /*thread_pool=*/nullptr, /*parent=*/nullptr,
+        /*session_metadata=*/nullptr,
+        Rendezvous::Factory{[](const int64_t, const DeviceMgr *device_mgr,
+                               tsl::core::RefCountPtr<Rendezvous> *r) {
+          *r = tsl::core::RefCountPtr<Rendezvous>(
+              new IntraProcessRendezvous(device_mgr));
+          return absl::OkStatus();
+        }});
+
+    std::vector<NodeDefBuilder::NodeOut> inputs(
+        {NodeDefBuilder::NodeOut({"n1", 0, DataType::DT_INT64})});
+    TF_RETURN_IF_ERROR(NodeDefBuilder("BatchTPUInput", "BatchFunction")
+                           .Attr("max_batch_size", 64)
+                           .Attr("num_batch_threads", 1)
+                           .Attr("allowed_batch_sizes", {2, 8, 64})
+                           .Attr("batch_timeout_micros", 0)
+                           .Attr("max_enqueued_batches", 10)
+                           .Attr("Tin", {DataType::DT_INT64})
+                           .Input(inputs)
+                           .Attr("Tcaptured", std::vector<DataType>{})
+                           .Input(std::vector<NodeDefBuilder::NodeOut>{})
+                           .Attr("Tout", std::vector<DataType>{DT_INT64})
+                           .Attr("f", f)
+                           .Finalize(node_def()));
+    return InitOp();
+  }
+
+  // Runs a request of 'batch_size' rows. Returns its latency in microseconds.
+  int64_t RunRequest(int batch_size) {
+    inputs_.clear();
+    AddInputFromArray<int64_t>(TensorShape({batch_size}),
+                               std::vector<int64_t>(batch_size));
+    const uint64_t start_time_us = Env::Default()->NowMicros();
+    TF_CHECK_OK(RunOpKernel());
+    return Env::Default()->NowMicros() - start_time_us;
+  }
+
+  void TestBody() override {}
+};
+
+// Measures the latency of the first request of each allowed batch size after
+// a model is loaded, with (Arg 1) and without (Arg 0) warming up all batch
+// sizes during loading. Each iteration loads the model on a new device, and
+// thus with a new batch resource and function instantiation. The label
+// reports the mean latency of each first request, which stays flat across
+// batch sizes once they are warmed up.
+void BM_BatchFunctionFirstRequestLatency(::testing::benchmark::State &state) {
+  const bool warmup = state.range(0);
+  const std::vector<int> batch_sizes = {2, 8, 64};
+  SessionMetadata session_metadata;
+  session_metadata.set_name("first_request_latency_model");
+  session_metadata.set_version(1);
+  serving::WarmupStateRegistry::Key key(session_metadata.name(),
+                                        session_metadata.version());
+
+  std::vector<int64_t> total_latencies_us(batch_sizes.size());
+  int64_t num_iterations = 0;
+  for (auto s : state) {
+    std::unique_ptr<Device> device =
+        DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+    FirstRequestLatencyTestState test_state;
+    test_state.set_session_metadata(session_metadata);
+    TF_CHECK_OK(test_state.Init(device.get()));
+    if (warmup) {
+      auto per_model_data = std::make_unique<PerModelData>();
+      per_model_data->warmup_all_batch_sizes = true;
+      auto handle = serving::GetGlobalWarmupStateRegistry().Register(
+          key, std::move(per_model_data));
+      TF_CHECK_OK(handle.status());
+      test_state.RunRequest(batch_sizes.front());
+    }
+    for (int i = 0; i < batch_sizes.size(); ++i) {
+      total_latencies_us[i] += test_state.RunRequest(batch_sizes[i]);
+    }
+    ++num_iterations;
+  }
+
+  std::string label = warmup ? "warm" : "cold";
+  for (int i = 0; i < batch_sizes.size(); ++i) {
+    absl::StrAppend(&label, " first_request_latency_us[", batch_sizes[i],
+                    "]=", total_latencies_us[i] / num_iterations);
+  }
+  state.SetLabel(label);
+}
+BENCHMARK(BM_BatchFunctionFirstRequestLatency)->Arg(0)->Arg(1);
+
 }  // namespace
 }  // namespace tensorflow
@@ -15,13 +15,17 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/batch_kernels.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <random>
 #include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/framework/device_factory.h"
@@ -37,6 +41,7 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/protobuf/config.pb.h"
 #include "tensorflow/core/public/version.h"
 #include "tsl/lib/core/status_test_util.h"
@@ -688,5 +693,192 @@ INSTANTIATE_TEST_SUITE_P(BatchFunctionKernelParallelWarmupTestSuite,
                          BatchFunctionKernelParallelWarmupTest,
                          ::testing::Bool());
 
+class LengthBucketingTestState : public SharedBatchFunctionTestState {
+ public:
+  // Init test fixture with a batch kernel instance that buckets its inputs by
+  // length. The function checks that its input has 'expected_shape'.
+  absl::Status Init(Device *device, const std::vector<int> &length_buckets,
+                    const std::vector<int> &allowed_batch_sizes,
+                    const PartialTensorShape &expected_shape) {
+    device_ = device;
+
+    NameAttrList f;
+    f.set_name("LengthBucketingFunction");
+    FunctionDef func = FunctionDefHelper::Create(
+        // function_name
+        f.name(),
+        // in_def
+        {"x:int64"},
+        // out_def
+        {"o:int64"},
+        // attr_def
+        {},
+        // node_def
+        {{{"o"},
+          "EnsureShape",
+          {"x"},
+          {{"T", DataType::DT_INT64}, {"shape", expected_shape}}}},
+        // ret_def
+        {{"o", "o:output"}});
+    TF_RETURN_IF_ERROR(flib_def_->AddFunctionDef(func));
+    SharedBatchFunctionTestState::CreateFunctionLibraryRuntime();
+
+    const int max_batch_size =
+        allowed_batch_sizes.empty() ? 64 : allowed_batch_sizes.back();
+    std::vector<NodeDefBuilder::NodeOut> inputs(
+        {NodeDefBuilder::NodeOut({"n1", 0, DataType::DT_INT64})});
+    TF_RETURN_IF_ERROR(NodeDefBuilder("BatchTPUInput", "BatchFunction")
+                           .Attr("max_batch_size", max_batch_size)
+                           .Attr("num_batch_threads", 4)
+                           .Attr("allowed_batch_sizes", allowed_batch_sizes)
+                           .Attr("batch_timeout_micros", 1000)
+                           .Attr("max_enqueued_batches", 100)
+                           .Attr("length_buckets", length_buckets)
+                           .Attr("Tin", {DataType::DT_INT64})
+                           .Input(inputs)
+                           .Attr("Tcaptured", std::vector<DataType>{})
+                           .Input(std::vector<NodeDefBuilder::NodeOut>{})
+                           .Attr("Tout", std::vector<DataType>{DT_INT64})
+                           .Attr("f", f)
+                           .Finalize(node_def()));
+    return OpsTestBase::InitOp();
+  }
+
+  void TestBody() override {}
+};
+
+class LengthBucketingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    cpu_device_ =
+        DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+  }
+  std::unique_ptr<Device> cpu_device_;
+};
+
+TEST_F(LengthBucketingTest, PadsToBucketLength) {
+  tsl::BlockingCounter blocking_counter(2);
+  // Inputs of length 5 and 7 both fall into the bucket of length 8. They are
+  // padded to form a tensor with [4, 8] shape which is verified within the
+  // function, and get their rows back with the bucket length.
+  for (int length : {5, 7}) {
+    Env::Default()->SchedClosure([&, length]() {
+      LengthBucketingTestState test_state;
+      TF_ASSERT_OK(test_state.Init(cpu_device_.get(),
+                                   /*length_buckets=*/{4, 8},
+                                   /*allowed_batch_sizes=*/{4},
+                                   PartialTensorShape({4, 8})));
+      std::vector<int64_t> input(length, length);
+      test_state.AddInputFromArray<int64_t>(TensorShape({1, length}), input);
+      TF_EXPECT_OK(test_state.RunOpKernel());
+
+      std::vector<int64_t> expected(8, 0);
+      std::fill_n(expected.begin(), length, length);
+      test::ExpectTensorEqual<int64_t>(
+          *test_state.GetOutput(0),
+          test::AsTensor<int64_t>(expected, TensorShape({1, 8})));
+      blocking_counter.DecrementCount();
+    });
+  }
+  blocking_counter.Wait();
+}
+
+TEST_F(LengthBucketingTest, BatchesBucketsSeparately) {
+  tsl::BlockingCounter blocking_counter(4);
+  // Inputs of length 3 and 6 fall into different buckets and are never
+  // concatenated; each batch is padded to its own bucket length.
+  for (int length : {3, 3, 6, 6}) {
+    Env::Default()->SchedClosure([&, length]() {
+      LengthBucketingTestState test_state;
+      TF_ASSERT_OK(test_state.Init(cpu_device_.get(),
+                                   /*length_buckets=*/{4, 8},
+                                   /*allowed_batch_sizes=*/{4},
+                                   PartialTensorShape({4, -1})));
+      std::vector<int64_t> input(2 * length, length);
+      test_state.AddInputFromArray<int64_t>(TensorShape({2, length}), input);
+      TF_EXPECT_OK(test_state.RunOpKernel());
+
+      EXPECT_EQ(test_state.GetOutput(0)->shape(),
+                TensorShape({2, length <= 4 ? 4 : 8}));
+      blocking_counter.DecrementCount();
+    });
+  }
+  blocking_counter.Wait();
+}
+
+TEST_F(LengthBucketingTest, RejectsInputLongerThanLargestBucket) {
+  LengthBucketingTestState test_state;
+  TF_ASSERT_OK(test_state.Init(cpu_device_.get(), /*length_buckets=*/{4, 8},
+                               /*allowed_batch_sizes=*/{4},
+                               PartialTensorShape({4, -1})));
+  test_state.AddInputFromArray<int64_t>(TensorShape({1, 9}),
+                                        std::vector<int64_t>(9));
+  EXPECT_EQ(test_state.RunOpKernel().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(LengthBucketingTest, RejectsUnsortedBuckets) {
+  LengthBucketingTestState test_state;
+  EXPECT_EQ(test_state
+                .Init(cpu_device_.get(), /*length_buckets=*/{8, 4},
+                      /*allowed_batch_sizes=*/{4}, PartialTensorShape({4, -1}))
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+// Sends 'kNumRequests' concurrent requests of variable length, following a
+// long-tailed distribution, through a BatchFunction op. Without bucketing,
+// every request is padded to the longest supported length by the client, as
+// inputs of different length cannot be batched together. The label reports
+// the fraction of the processed elements that are padding, i.e. the fraction
+// of the FLOPs of a model that is linear in the length that is wasted.
+void BM_BatchFunctionLengthBucketing(::testing::benchmark::State &state) {
+  constexpr int kNumRequests = 64;
+  constexpr int kMaxLength = 512;
+  const bool bucketing = state.range(0);
+  const std::vector<int> length_buckets =
+      bucketing ? std::vector<int>{32, 64, 128, 256, kMaxLength}
+                : std::vector<int>{};
+
+  std::unique_ptr<Device> cpu_device =
+      DeviceFactory::NewDevice("CPU", {}, "/job:a/replica:0/task:0");
+  std::mt19937 rng(42);
+  std::exponential_distribution<double> length_distribution(1.0 / 64);
+  int64_t real_elements = 0;
+  int64_t processed_elements = 0;
+  for (auto s : state) {
+    std::vector<int> lengths(kNumRequests);
+    for (int &length : lengths) {
+      length = std::min<int>(kMaxLength, 1 + length_distribution(rng));
+      real_elements += length;
+    }
+    std::atomic<int64_t> processed(0);
+    tsl::BlockingCounter blocking_counter(kNumRequests);
+    for (int length : lengths) {
+      Env::Default()->SchedClosure([&, length]() {
+        LengthBucketingTestState test_state;
+        TF_CHECK_OK(test_state.Init(cpu_device.get(), length_buckets,
+                                    /*allowed_batch_sizes=*/{},
+                                    PartialTensorShape({-1, -1})));
+        const int padded_length = bucketing ? length : kMaxLength;
+        std::vector<int64_t> input(padded_length, 0);
+        std::fill_n(input.begin(), length, 1);
+        test_state.AddInputFromArray<int64_t>(TensorShape({1, padded_length}),
+                                              input);
+        TF_CHECK_OK(test_state.RunOpKernel());
+        processed += test_state.GetOutput(0)->NumElements();
+        blocking_counter.DecrementCount();
+      });
+    }
+    blocking_counter.Wait();
+    processed_elements += processed;
+  }
+  state.SetItemsProcessed(real_elements);
+  state.SetLabel(absl::StrCat(
+      bucketing ? "bucketing" : "no_bucketing", " wasted_flops_ratio=",
+      1.0 - static_cast<double>(real_elements) / processed_elements));
+}
+BENCHMARK(BM_BatchFunctionLengthBucketing)->Arg(0)->Arg(1)->UseRealTime();
+
 }  // namespace
 }  // namespace tensorflow
@@ -35,6 +35,7 @@ limitations under the License.
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "tensorflow/core/common_runtime/cost_constants.h"
@@ -48,6 +49,7 @@ limitations under the License.
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/op_requires.h"
 #include "tensorflow/core/framework/ops_util.h"
+#include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_util.h"
@@ -65,10 +67,13 @@ limitations under the License.
 #include "tensorflow/core/lib/monitoring/sampler.h"
 #include "tensorflow/core/lib/monitoring/types.h"
 #include "tensorflow/core/platform/context.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/refcount.h"
 #include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
@@ -270,6 +275,31 @@ void RecordBatchCosts(const std::string& model_name,
       ->Add(absl::ToDoubleMicroseconds(total_cost));
 }
 
+void RecordWarmupBatchProcessingTimeUs(int64_t processing_time_us,
+                                       const string& model_name,
+                                       const string& op_name,
+                                       int32_t batch_size) {
+  static auto* cell = tensorflow::monitoring::Sampler<3>::New(
+      {"/tensorflow/serving/batching/warmup_batch_processing_time_us",
+       "Tracks the time (in microseconds) to process the warm-up batches, i.e. "
+       "the cold latency of each batch size, by model_name and op_name (if "
+       "available).",
+       "model_name", "op_name", "batch_size"},
+      // It's 27 buckets with the last bucket being 2^26 to DBL_MAX;
+      // so the limits are [1, 2, 4, 8, ..., 64 * 1024 * 1024, DBL_MAX].
+      monitoring::Buckets::Exponential(1, 2, 27));
+  cell->GetCell(model_name, op_name, std::to_string(batch_size))
+      ->Add(static_cast<double>(processing_time_us));
+}
+
+// Returns the single thread that enqueues the warm-up batches of all batch
+// resources.
+thread::ThreadPool* GetWarmupThreadPool() {
+  static thread::ThreadPool* warmup_thread_pool = new thread::ThreadPool(
+      Env::Default(), "batch_warmup", /*num_threads=*/1);
+  return warmup_thread_pool;
+}
+
 const string& GetModelName(OpKernelContext* ctx) {
   static string* kModelNameUnset = new string("model_name_unset");
   if (!ctx->session_metadata()) return *kModelNameUnset;
@@ -288,6 +318,54 @@ int GetTotalTaskSize(
   return tasks_size;
 }
 
+// Copies each row of 'input' to the start of the corresponding row of
+// 'output' and fills the rest of the row with zeros.
+template <typename T>
+void PadToLength(const Tensor& input, Tensor* output) {
+  const int64_t rows = input.dim_size(0);
+  const int64_t input_row_size = input.NumElements() / rows;
+  const int64_t output_row_size = output->NumElements() / rows;
+  const T* input_data = input.unaligned_flat<T>().data();
+  T* output_data = output->unaligned_flat<T>().data();
+  for (int64_t row = 0; row < rows; ++row) {
+    T* output_row = std::copy_n(input_data + row * input_row_size,
+                                input_row_size,
+                                output_data + row * output_row_size);
+    std::fill(output_row, output_data + (row + 1) * output_row_size, T());
+  }
+}
+
+// Pads 'input' with zeros along dimension 1 up to 'length'. The result aliases
+// 'input' if it already has that length.
+Status PadToLength(OpKernelContext* context, const Tensor& input,
+                   int64_t length, Tensor* output) {
+  if (input.dim_size(1) == length) {
+    *output = input;
+    return absl::OkStatus();
+  }
+  TensorShape output_shape = input.shape();
+  output_shape.set_dim(1, length);
+  AllocatorAttributes attr;
+  attr.set_on_host(true);
+  TF_RETURN_IF_ERROR(
+      context->allocate_temp(input.dtype(), output_shape, output, attr));
+  if (output->NumElements() == 0) {
+    return absl::OkStatus();
+  }
+  switch (input.dtype()) {
+#define CASE(type)                    \
+  case DataTypeToEnum<type>::value:   \
+    PadToLength<type>(input, output); \
+    break;
+    TF_CALL_ALL_TYPES(CASE);
+#undef CASE
+    default:
+      return errors::InvalidArgument("Unsupported data type: ",
+                                     input.dtype());
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
 std::unique_ptr<BatchResourceBase::BatchTask>
@@ -308,6 +386,7 @@ BatchResourceBase::BatchTask::CreateSplitTask(
   task->start_time = this->start_time;
   task->request_cost = this->request_cost;
   task->forced_warmup_batch_size = this->forced_warmup_batch_size;
+  task->bucket_length = this->bucket_length;
 
   return task;
 }
@@ -331,36 +410,79 @@ Status BatchResourceBase::RegisterWarmupInputs(
     int64_t guid, OpKernelContext* context, const string& batcher_queue_name,
     const CreateBatchTaskFn& create_batch_task_fn,
     AsyncOpKernel::DoneCallback done) {
-  auto shared_status = std::make_shared<ThreadSafeStatus>();
-  auto create_batch_task_fn_share_status = [&create_batch_task_fn,
-                                            &shared_status]() {
-    auto batch_task = create_batch_task_fn();
-    if (!batch_task.ok()) {
+  if (ShouldWarmupEachBatchSizeOnce(context)) {
+    OpInputList tensors;
+    TF_RETURN_IF_ERROR(context->input_list("in_tensors", &tensors));
+    string signature = batcher_queue_name;
+    for (const Tensor& tensor : tensors) {
+      absl::StrAppend(&signature, ";", DataTypeString(tensor.dtype()));
+      for (int i = 1; i < tensor.dims(); ++i) {
+        absl::StrAppend(&signature, ",", tensor.dim_size(i));
+      }
+    }
+    bool warmed_up;
+    {
+      absl::MutexLock l(&warmed_up_signatures_mu_);
+      warmed_up = !warmed_up_signatures_.insert(std::move(signature)).second;
+    }
+    if (warmed_up) {
+      return RegisterInput(guid, context, batcher_queue_name,
+                           create_batch_task_fn, std::move(done));
+    }
+  }
+  // Warm-up requests run one at a time on a single thread, and each warm-up
+  // batch is enqueued only once the previous one has been processed. The
+  // batches then don't compete for the batch threads or the allocators: the
+  // largest batch grows the allocator pools to their high-water mark once, and
+  // the smaller batches are served from memory that is already reserved.
+  //
+  // The caller may drop its reference to the resource as soon as this returns,
+  // so the closure holds its own. The thread is not owned by the resource,
+  // which may be destroyed on it when the closure releases the last reference.
+  Ref();
+  GetWarmupThreadPool()->Schedule([this, guid, context, batcher_queue_name,
+                                   create_batch_task_fn, done = std::move(done),
+                                   propagated_context =
+                                       Context(ContextKind::kThread)] {
+    core::ScopedUnref unref(this);
+    WithContext wc(propagated_context);
+    auto shared_status = std::make_shared<ThreadSafeStatus>();
+    auto create_batch_task_fn_share_status = [&create_batch_task_fn,
+                                              &shared_status]() {
+      auto batch_task = create_batch_task_fn();
+      if (!batch_task.ok()) {
+        return batch_task;
+      }
+      (*batch_task)->status = shared_status;
       return batch_task;
+    };
+    // Enqueue warmup batches, from the largest to the smallest.
+    for (auto it = allowed_batch_sizes_.rbegin();
+         it != allowed_batch_sizes_.rend(); ++it) {
+      absl::Notification processed;
+      Status status = RegisterInput(
+          guid, context, batcher_queue_name, create_batch_task_fn_share_status,
+          [&processed]() { processed.Notify(); }, *it);
+      if (!status.ok()) {
+        context->SetStatus(status);
+        done();
+        return;
+      }
+      processed.WaitForNotification();
     }
-    (*batch_task)->status = shared_status;
-    return batch_task;
-  };
-  auto warmup_counter =
-      std::make_shared<absl::BlockingCounter>(allowed_batch_sizes_.size());
-  // Enqueue warmup batches.
-  for (int i = 0; i < allowed_batch_sizes_.size(); ++i) {
+    // Enqueue real batch if the other batches were enqueued successfully.
     Status status = RegisterInput(
         guid, context, batcher_queue_name, create_batch_task_fn_share_status,
-        [warmup_counter = warmup_counter.get()]() {
-          warmup_counter->DecrementCount();
-        },
-        allowed_batch_sizes_[i]);
-    if (!status.ok()) return status;
-  }
-  // Enqueue real batch if the other batches were enqueued successfully.
-  return RegisterInput(
-      guid, context, batcher_queue_name, create_batch_task_fn_share_status,
-      [warmup_counter, context, shared_status, done = std::move(done)]() {
-        warmup_counter->Wait();
-        context->SetStatus(shared_status->status());
-        done();
-      });
+        [context, shared_status, done]() {
+          context->SetStatus(shared_status->status());
+          done();
+        });
+    if (!status.ok()) {
+      context->SetStatus(status);
+      done();
+    }
+  });
+  return absl::OkStatus();
 }
 
 Status BatchResourceBase::RegisterInput(
@@ -392,6 +514,9 @@ Status BatchResourceBase::RegisterInput(
     }
     batch_components->inputs.push_back(tensor);
   }
+  string queue_name = batcher_queue_name;
+  TF_RETURN_IF_ERROR(
+      AssignLengthBucket(context, *batch_components, &queue_name));
   RecordInputBatchSize(tensors[0].shape().dim_size(0), GetModelName(context),
                        context->op_kernel().name());
   RecordInputBatchSizeV2(tensors[0].shape().dim_size(0), GetModelName(context),
@@ -472,8 +597,7 @@ Status BatchResourceBase::RegisterInput(
   }
 
   BatcherQueueT* batcher_queue;
-  TF_RETURN_IF_ERROR(
-      LookupOrCreateBatcherQueue(batcher_queue_name, &batcher_queue));
+  TF_RETURN_IF_ERROR(LookupOrCreateBatcherQueue(queue_name, &batcher_queue));
 
   if (!session_metadata().name().empty()) {
     absl::MutexLock lock(&outstanding_batch_mu_);
@@ -664,13 +788,15 @@ Status BatchResourceBase::ConcatInputTensors(
   const int padding_amount =
       just_for_warmup ? padded_batch_size
                       : padded_batch_size - batch.size() - unbatched_tasks_size;
+  const int64_t bucket_length = batch.task(0).bucket_length;
   tsl::profiler::TraceMe trace_me(
-      [padded_batch_size, padding_amount,
+      [padded_batch_size, padding_amount, bucket_length,
        disable_padding = batcher_queue_options_.disable_padding]() {
         return tsl::profiler::TraceMeEncode(
             "ConcatInputTensors",
             {{"batch_size_after_padding", padded_batch_size},
              {"padding_amount", padding_amount},
+             {"bucket_length", bucket_length},
              {"disable_padding", disable_padding}});
       });
   // TODO(b/316379576): Add metrics for the breakdown between the size of the
@@ -691,6 +817,17 @@ Status BatchResourceBase::ConcatInputTensors(
   const int num_inputs = batch.task(0).inputs.size();
   concatenated_tensors->reserve(num_inputs);
 
+  // When bucketing by length, all tasks of the batch are in the same bucket
+  // and their inputs are padded along dimension 1 to the bucket length.
+  auto get_input = [context, bucket_length](const BatchTask& task, int i,
+                                            Tensor* input) -> Status {
+    if (bucket_length == 0) {
+      *input = task.inputs.at(i);
+      return absl::OkStatus();
+    }
+    return PadToLength(context, task.inputs.at(i), bucket_length, input);
+  };
+
   // Process each input one at a time (the typical case has just one). When
   // `just_for_warmup` is true, the real data is not added. Otherwise, the real
   // data is added to the front of each `concatenated_tensor`.
@@ -703,17 +840,22 @@ Status BatchResourceBase::ConcatInputTensors(
       to_concatenate.reserve(batch.num_tasks() + unbatched_tasks.size() +
                              padding_amount);
       for (int task_idx = 0; task_idx < batch.num_tasks(); ++task_idx) {
-        to_concatenate.push_back(batch.task(task_idx).inputs.at(i));
+        Tensor input;
+        TF_RETURN_IF_ERROR(get_input(batch.task(task_idx), i, &input));
+        to_concatenate.push_back(std::move(input));
       }
       for (int task_idx = 0; task_idx < unbatched_tasks.size(); ++task_idx) {
-        to_concatenate.push_back(unbatched_tasks[task_idx]->inputs.at(i));
+        Tensor input;
+        TF_RETURN_IF_ERROR(get_input(*unbatched_tasks[task_idx], i, &input));
+        to_concatenate.push_back(std::move(input));
       }
     }
 
     // Add padding as needed if padding is allowed. Use the first row of the
     // first task's tensor as the data for padding.
     if (padding_amount != 0) {
-      const Tensor& padding_source = batch.task(0).inputs.at(i);
+      Tensor padding_source;
+      TF_RETURN_IF_ERROR(get_input(batch.task(0), i, &padding_source));
       Tensor padding;
       if (padding_source.shape().dim_size(0) == 0) {
         return errors::InvalidArgument(
@@ -1028,6 +1170,16 @@ void BatchResourceBase::ProcessFuncBatch(
   finally.release();
   ProcessFuncBatchImpl(
       last_task, args, &combined_outputs, [&](const Status& run_status) {
+        if (last_task.forced_warmup_batch_size > 0 && run_status.ok()) {
+          const int64_t processing_time_us =
+              (EnvTime::NowNanos() - current_time) / 1000;
+          RecordWarmupBatchProcessingTimeUs(
+              processing_time_us, model_name, op_name,
+              last_task.forced_warmup_batch_size);
+          VLOG(1) << "Warmed up batch size "
+                  << last_task.forced_warmup_batch_size << " of " << op_name
+                  << " in " << processing_time_us << " us";
+        }
         Status final_status;
         auto run_finally = gtl::MakeCleanup([&]() {
           // We do the cleanup here as an optimization, so that
@@ -1172,6 +1324,41 @@ void BatchResourceBase::ProcessBatchCallBack(
   }
 }
 
+// Rounds the length of the inputs, i.e. the size of their dimension 1, up to
+// the smallest bucket which holds it. Tasks of different buckets go to
+// different batcher queues so that batches are only padded within a bucket.
+Status BatchResourceBase::AssignLengthBucket(OpKernelContext* context,
+                                             BatchTask& task,
+                                             string* queue_name) const {
+  if (length_buckets_.empty()) {
+    return absl::OkStatus();
+  }
+  const Tensor& first_input = task.inputs[0];
+  for (const Tensor& input : task.inputs) {
+    if (input.dims() < 2 || input.dim_size(1) != first_input.dim_size(1)) {
+      OpInputList tensors;
+      TF_RETURN_IF_ERROR(context->input_list("in_tensors", &tensors));
+      return errors::InvalidArgument(
+          "Batching input tensors must have at least two dimensions and equal "
+          "1st-dimension size when length_buckets is set.\nBelow are the "
+          "input tensors: \n",
+          GetTensorNamesAndShapesString(context, tensors));
+    }
+  }
+  const int64_t length = first_input.dim_size(1);
+  auto bucket =
+      std::lower_bound(length_buckets_.begin(), length_buckets_.end(), length);
+  if (bucket == length_buckets_.end()) {
+    return errors::InvalidArgument(
+        "Batching input tensors have 1st-dimension size ", length,
+        ", which exceeds the largest entry in length_buckets (",
+        length_buckets_.back(), ")");
+  }
+  task.bucket_length = *bucket;
+  absl::StrAppend(queue_name, "/length_bucket_", *bucket);
+  return absl::OkStatus();
+}
+
 // Looks up the batcher queue for 'queue_name'. If it didn't previously exist,
 // creates it.
 Status BatchResourceBase::LookupOrCreateBatcherQueue(const string& queue_name,
@@ -24,6 +24,7 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_join.h"
 #include "absl/synchronization/blocking_counter.h"
 #include "tensorflow/core/common_runtime/cost_measurement_registry.h"
@@ -138,6 +139,10 @@ class BatchResourceBase : public ResourceBase {
     // batch is processed, but is not propagated to the kernel outputs.
     int forced_warmup_batch_size = 0;
 
+    // If nonzero, the length bucket of this task. Its inputs are padded along
+    // dimension 1 up to this length before being batched.
+    int64_t bucket_length = 0;
+
    protected:
     virtual std::unique_ptr<BatchTask> CreateDerivedTask() {
       return std::make_unique<BatchTask>();
@@ -183,11 +188,25 @@ class BatchResourceBase : public ResourceBase {
 
   const SessionMetadata& session_metadata() const { return session_metadata_; }
 
+  // Enables bucketing by length. Each task goes to the batcher queue of the
+  // smallest entry in 'length_buckets' that is greater than or equal to the
+  // size of dimension 1 of its inputs, and is padded with zeros along that
+  // dimension up to the bucket length. Tasks longer than the last entry are
+  // rejected. 'length_buckets' must increase monotonically.
+  void set_length_buckets(std::vector<int32> length_buckets) {
+    length_buckets_ = std::move(length_buckets);
+  }
+
   using CreateBatchTaskFn =
       std::function<StatusOr<std::unique_ptr<BatchTask>>()>;
 
   // Like `RegisterInput`, but extra "dummy" batches are processed for each
-  // batch size. Only the real request's outputs are propagated to the caller.
+  // batch size, from the largest to the smallest. The dummy batches are
+  // processed one at a time, and the warm-up requests of all resources are
+  // warmed up one after the other on a shared thread. Only the real request's
+  // outputs are propagated to the caller, which is notified through `done`.
+  // If the model asks for each batch size to be warmed up once, the dummy
+  // batches are skipped for input signatures that have already been warmed up.
   Status RegisterWarmupInputs(int64_t guid, OpKernelContext* context,
                               const string& batcher_queue_name,
                               const CreateBatchTaskFn& create_batch_task_fn,
@@ -332,6 +351,12 @@ class BatchResourceBase : public ResourceBase {
   static Status EmitIndexTensor(OpKernelContext* context, const BatchT& batch,
                                 int output_index);
 
+  // Sets the 'bucket_length' of 'task' from the size of dimension 1 of its
+  // inputs and appends the bucket to 'queue_name'. A no-op if bucketing by
+  // length is disabled.
+  Status AssignLengthBucket(OpKernelContext* context, BatchTask& task,
+                            string* queue_name) const;
+
   // Looks up the batcher queue for 'queue_name'. If it did't previously exist,
   // creates it.
   Status LookupOrCreateBatcherQueue(const string& queue_name,
@@ -342,6 +367,12 @@ class BatchResourceBase : public ResourceBase {
   absl::Mutex outstanding_batch_mu_;
   int num_outstanding_batched_items_ TF_GUARDED_BY(outstanding_batch_mu_) = 0;
 
+  // Queue names and input shapes (without the batch dimension) for which all
+  // allowed batch sizes have been warmed up.
+  absl::Mutex warmed_up_signatures_mu_;
+  absl::flat_hash_set<string> warmed_up_signatures_
+      TF_GUARDED_BY(warmed_up_signatures_mu_);
+
   // True if user specified a batch processing function for this resource.
   const bool has_process_batch_function_;
   // A batch scheduler, and options for creating queues.
@@ -363,6 +394,10 @@ class BatchResourceBase : public ResourceBase {
   // A concatenated string of <allowed_batch_sizes_>, separated by ",". This is
   // used to record batching parameter.
   string allowed_batch_sizes_str_;
+
+  // Bucket lengths along dimension 1 of the inputs; empty if bucketing by
+  // length is disabled.
+  std::vector<int32> length_buckets_;
 };
 
 }  // namespace serving
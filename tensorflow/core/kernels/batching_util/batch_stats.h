@@ -117,8 +117,14 @@ class BatchSizeStats {
  public:
   CostTracker& tpu_cost() { return tpu_cost_; };
 
+  // The wall time it takes to process a batch of this size, as measured by
+  // the batch scheduler.
+  CostTracker& processing_time() { return processing_time_; };
+  const CostTracker& processing_time() const { return processing_time_; };
+
  private:
   CostTracker tpu_cost_;
+  CostTracker processing_time_;
 };
 
 // Tracks statistics for a particular model.
@@ -140,6 +146,39 @@ class ModelBatchStats {
     return batch_size_stats_by_batch_size_[batch_size];
   }
 
+  // Estimates the time it takes to process a batch of size `batch_size` from
+  // the registered processing times, interpolating linearly between the
+  // nearest batch sizes that have samples. Beyond the largest such batch size,
+  // the time is assumed to grow proportionally to the batch size; below the
+  // smallest, it is assumed to be that of the smallest.
+  //
+  // Returns std::nullopt if no processing times have been registered.
+  std::optional<absl::Duration> EstimateProcessingTime(int32 batch_size) const {
+    int32 lower_size = 0, upper_size = 0;
+    absl::Duration lower_time, upper_time;
+    {
+      mutex_lock l(mu_);
+      for (const auto& [size, stats] : batch_size_stats_by_batch_size_) {
+        std::optional<absl::Duration> time = stats.processing_time().mean();
+        if (!time.has_value()) continue;
+        if (size <= batch_size && size > lower_size) {
+          lower_size = size;
+          lower_time = *time;
+        }
+        if (size >= batch_size && (upper_size == 0 || size < upper_size)) {
+          upper_size = size;
+          upper_time = *time;
+        }
+      }
+    }
+
+    if (lower_size == 0 && upper_size == 0) return std::nullopt;
+    if (upper_size == 0) return lower_time * batch_size / lower_size;
+    if (lower_size == 0 || lower_size == upper_size) return upper_time;
+    return lower_time + (upper_time - lower_time) * (batch_size - lower_size) /
+                            (upper_size - lower_size);
+  }
+
   // Registers that the model server has processed a batch of size `size`
   // non-padding tasks for this model, updating the current cumulative
   // processed size.
@@ -73,6 +73,25 @@ TEST(BatchStatsTest, ProcessedSizeIsCorrect) {
   ASSERT_EQ(stats.cumulative_processed_size(), 12);
 }
 
+TEST(BatchStatsTest, EstimateProcessingTimeStartsWithNoEstimate) {
+  ModelBatchStats stats;
+  stats.batch_size(4).tpu_cost().Register(absl::Milliseconds(1));
+
+  ASSERT_FALSE(stats.EstimateProcessingTime(4).has_value());
+}
+
+TEST(BatchStatsTest, EstimateProcessingTimeInterpolates) {
+  ModelBatchStats stats;
+  stats.batch_size(2).processing_time().Register(absl::Microseconds(200));
+  stats.batch_size(8).processing_time().Register(absl::Microseconds(500));
+
+  EXPECT_EQ(*stats.EstimateProcessingTime(1), absl::Microseconds(200));
+  EXPECT_EQ(*stats.EstimateProcessingTime(2), absl::Microseconds(200));
+  EXPECT_EQ(*stats.EstimateProcessingTime(4), absl::Microseconds(300));
+  EXPECT_EQ(*stats.EstimateProcessingTime(8), absl::Microseconds(500));
+  EXPECT_EQ(*stats.EstimateProcessingTime(16), absl::Microseconds(1000));
+}
+
 }  // namespace
 
 }  // namespace tensorflow::serving
@@ -25,6 +25,7 @@ limitations under the License.
 #include <functional>
 #include <list>
 #include <memory>
+#include <optional>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -36,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/batching_util/batch_input_task.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler_utils.h"
+#include "tensorflow/core/kernels/batching_util/batch_stats.h"
 #include "tensorflow/core/kernels/batching_util/periodic_function.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
@@ -269,6 +271,22 @@ class SharedBatchScheduler
     // effective only when enable_priority_queue is true.
     MixedPriorityBatchingPolicy mixed_priority_batching_policy =
         MixedPriorityBatchingPolicy::kLowPriorityPaddingWithMaxBatchSize;
+
+    // If positive, the queue closes the open batch as soon as growing it any
+    // further is estimated to make its oldest task complete more than this
+    // many microseconds after it was enqueued. Batches thus stop at the
+    // largest size that still meets the deadline, which maximizes throughput
+    // without violating the latency SLO. Processing times are estimated from
+    // the batches the queue has processed so far, so until the first batch
+    // completes, only `batch_timeout_micros` and `max_execution_batch_size`
+    // apply. Both keep applying as upper bounds afterwards.
+    int64_t latency_slo_micros = 0;
+
+    // Where the processing time of each batch is registered to, and estimated
+    // from, when `latency_slo_micros` is positive. Sharing it between the
+    // queues of a model lets them learn from each other's batches. If null,
+    // the queue keeps its own statistics. Must outlive the queue.
+    ModelBatchStats* batch_stats = nullptr;
   };
   Status AddQueue(const QueueOptions& options,
                   ProcessBatchCallback process_batch_callback,
@@ -364,7 +382,8 @@ class Queue {
       int max_execution_batch_size,
       std::vector<std::unique_ptr<TaskType>>* output_tasks)>;
   Queue(const typename SharedBatchScheduler<TaskType>::QueueOptions& options,
-        Env* env, ProcessBatchCallback process_batch_callback,
+        Env* env, int num_batch_threads,
+        ProcessBatchCallback process_batch_callback,
         SchedulableBatchCallback schedulable_batch_callback);
 
   // Illegal to destruct unless the queue is empty.
@@ -476,6 +495,13 @@ class Queue {
   bool IsOpenBatchSchedulableAfterEagerSplit() const
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Returns false iff a batch of `batch_size`, if closed now, is estimated to
+  // complete after the latency SLO of the oldest task in the open batch. This
+  // includes the time it waits for a batch thread when the batches of this
+  // queue which are in flight or closed occupy all of them.
+  bool MeetsLatencySlo(size_t batch_size) const
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Determines whether the low priority tasks in `low_priority_tasks_` can form
   // a batch on their own. If yes, returns a batch that is ready to be
   // processed. Otherwise, returns an empty unique_ptr.
@@ -529,6 +555,9 @@ class Queue {
   // The environment to use.
   Env* env_;
 
+  // The number of threads of the scheduler which process batches.
+  const int num_batch_threads_;
+
   // The maximum batch size to be executed by `Queue::ProcessBatch`.
   // See the comment of QueueOptions and helper function
   // `GetMaxExecutionBatchSize` for more details on what it means.
@@ -542,6 +571,12 @@ class Queue {
   // schedulable.
   SchedulableBatchCallback schedulable_batch_callback_;
 
+  // The processing time statistics used to meet `latency_slo_micros`. Points
+  // to `options_.batch_stats` or `owned_batch_stats_`; null iff the latency
+  // SLO is disabled.
+  std::unique_ptr<ModelBatchStats> owned_batch_stats_;
+  ModelBatchStats* batch_stats_ = nullptr;
+
   mutable mutex mu_;
 
   // Whether this queue can accept new tasks. This variable is monotonic: it
@@ -707,6 +742,11 @@ Status SharedBatchScheduler<TaskType>::AddQueueAfterRewritingOptions(
         "max_enqueued_batches must be positive; was ",
         options.max_enqueued_batches);
   }
+  if (options.latency_slo_micros < 0) {
+    return errors::InvalidArgument(
+        "latency_slo_micros must be non-negative; was ",
+        options.latency_slo_micros);
+  }
 
   if (options.enable_large_batch_splitting &&
       options.split_input_task_func == nullptr) {
@@ -738,8 +778,8 @@ Status SharedBatchScheduler<TaskType>::AddQueueAfterRewritingOptions(
   };
   auto internal_queue =
       std::unique_ptr<internal::Queue<TaskType>>(new internal::Queue<TaskType>(
-          options, options_.env, process_batch_callback,
-          schedulable_batch_callback));
+          options, options_.env, options_.num_batch_threads,
+          process_batch_callback, schedulable_batch_callback));
   auto handle = std::unique_ptr<BatchScheduler<TaskType>>(
       new internal::QueueHandle<TaskType>(this->shared_from_this(),
                                           internal_queue.get()));
@@ -876,13 +916,22 @@ namespace internal {
 template <typename TaskType>
 Queue<TaskType>::Queue(
     const typename SharedBatchScheduler<TaskType>::QueueOptions& options,
-    Env* env, ProcessBatchCallback process_batch_callback,
+    Env* env, int num_batch_threads,
+    ProcessBatchCallback process_batch_callback,
     SchedulableBatchCallback schedulable_batch_callback)
     : options_(options),
       env_(env),
+      num_batch_threads_(num_batch_threads),
       max_execution_batch_size_(GetMaxExecutionBatchSize(options_)),
       process_batch_callback_(process_batch_callback),
       schedulable_batch_callback_(schedulable_batch_callback) {
+  if (options_.latency_slo_micros > 0) {
+    batch_stats_ = options_.batch_stats;
+    if (batch_stats_ == nullptr) {
+      owned_batch_stats_ = std::make_unique<ModelBatchStats>();
+      batch_stats_ = owned_batch_stats_.get();
+    }
+  }
   // Set the higher 32 bits of traceme_context_id_counter_ to be the creation
   // time of the queue. This prevents the batches in different queues to have
   // the same traceme_context_id_counter_.
@@ -947,8 +996,11 @@ Status Queue<TaskType>::ScheduleWithLazySplit(std::unique_ptr<TaskType>* task) {
     input_batch->ToTaskHandles(&task_handles);
 
     for (int i = 0; i < task_handles.size(); ++i) {
-      if (task_handle_batches_.back()->size() + task_handles[i]->size() >
-          options_.max_execution_batch_size) {
+      const size_t new_batch_size =
+          task_handle_batches_.back()->size() + task_handles[i]->size();
+      if (new_batch_size > options_.max_execution_batch_size ||
+          (!task_handle_batches_.back()->empty() &&
+           !MeetsLatencySlo(new_batch_size))) {
         StartNewBatch();
       }
       if (task_handle_batches_.back()->empty()) {
@@ -1028,8 +1080,10 @@ Status Queue<TaskType>::ScheduleWithoutOrEagerSplitImpl(
   }
 
   for (int i = 0; i < output_tasks.size(); ++i) {
-    if (batches.back()->size() + output_tasks[i]->size() >
-        max_execution_batch_size()) {
+    const size_t new_batch_size =
+        batches.back()->size() + output_tasks[i]->size();
+    if (new_batch_size > max_execution_batch_size() ||
+        (!batches.back()->empty() && !MeetsLatencySlo(new_batch_size))) {
       StartNewBatch();
     }
     if (batches.back()->empty()) {
@@ -1335,6 +1389,12 @@ void Queue<TaskType>::ProcessBatch(
       tsl::profiler::ContextType::kSharedBatchScheduler,
       batch->traceme_context_id());
 
+  size_t batch_size = batch->size();
+  for (const std::unique_ptr<TaskType>& task : padding_task) {
+    batch_size += task->size();
+  }
+  const uint64 start_time_micros = env_->NowMicros();
+
   if (std::holds_alternative<ProcessBatchCallbackWithoutPaddingTasks>(
           process_batch_callback_)) {
     std::get<ProcessBatchCallbackWithoutPaddingTasks>(process_batch_callback_)(
@@ -1344,6 +1404,15 @@ void Queue<TaskType>::ProcessBatch(
         std::move(batch), std::move(padding_task));
   }
 
+  const uint64 end_time_micros = env_->NowMicros();
+  if (batch_stats_ != nullptr && end_time_micros > start_time_micros) {
+    batch_stats_
+        ->batch_size(GetNextAllowedBatchSize(
+            batch_size, options_.allowed_batch_sizes, options_.disable_padding))
+        .processing_time()
+        .Register(absl::Microseconds(end_time_micros - start_time_micros));
+  }
+
   {
     mutex_lock l(mu_);
     --num_batches_being_processed_;
@@ -1419,7 +1488,8 @@ bool Queue<TaskType>::IsOpenBatchSchedulableAfterEagerSplit() const {
   }
   return closed_ || open_batch->size() >= max_execution_batch_size() ||
          env_->NowMicros() >=
-             open_batch_start_time_micros_ + options_.batch_timeout_micros;
+             open_batch_start_time_micros_ + options_.batch_timeout_micros ||
+         !MeetsLatencySlo(open_batch->size() + 1);
 }
 
 template <typename TaskType>
@@ -1434,7 +1504,33 @@ bool Queue<TaskType>::IsOpenBatchSchedulable() const {
   }
   return closed_ || open_batch->size() >= max_execution_batch_size() ||
          env_->NowMicros() >=
-             open_batch_start_time_micros_ + options_.batch_timeout_micros;
+             open_batch_start_time_micros_ + options_.batch_timeout_micros ||
+         !MeetsLatencySlo(open_batch->size() + 1);
+}
+
+template <typename TaskType>
+bool Queue<TaskType>::MeetsLatencySlo(size_t batch_size) const {
+  if (batch_stats_ == nullptr) {
+    return true;
+  }
+  const std::optional<absl::Duration> processing_time =
+      batch_stats_->EstimateProcessingTime(GetNextAllowedBatchSize(
+          batch_size, options_.allowed_batch_sizes, options_.disable_padding));
+  if (!processing_time.has_value()) {
+    return true;
+  }
+  // The open batch waits for a batch ahead of it to complete for each round
+  // of `num_batch_threads_` batches ahead of it, each of which is assumed to
+  // take about as long as the open batch.
+  const size_t num_closed_batches = options_.enable_lazy_split
+                                        ? task_handle_batches_.size() - 1
+                                        : GetBatches().size() - 1;
+  const int64_t num_batches_ahead =
+      num_batches_being_processed_ + num_closed_batches;
+  const int64_t num_rounds_to_wait = num_batches_ahead / num_batch_threads_;
+  return env_->NowMicros() + absl::ToInt64Microseconds(*processing_time) *
+                                 (num_rounds_to_wait + 1) <=
+         open_batch_start_time_micros_ + options_.latency_slo_micros;
 }
 
 template <typename TaskType>
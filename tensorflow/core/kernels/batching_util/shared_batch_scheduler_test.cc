@@ -15,8 +15,11 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/batching_util/shared_batch_scheduler.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstddef>
 #include <memory>
+#include <random>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <tuple>
@@ -26,8 +29,10 @@ limitations under the License.
 #include "absl/base/call_once.h"
 #include "absl/container/fixed_array.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
+#include "tensorflow/core/kernels/batching_util/batch_stats.h"
 #include "tensorflow/core/kernels/batching_util/fake_clock_env.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
@@ -1052,6 +1057,194 @@ TEST_P(SharedBatchSchedulerTest, ZeroQueueRewrittenToOneQueue) {
   }
 }
 
+TEST_P(SharedBatchSchedulerTest, InvalidLatencySlo) {
+  auto callback = [](std::unique_ptr<Batch<FakeTask>> batch) {
+    // do nothing.
+  };
+
+  auto scheduler = CreateSharedBatchScheduler(2);
+
+  QueueOptions options = CreateQueueOptions(
+      /*max_execution_batch_size=*/10, /*input_batch_size_limit=*/10,
+      /*batch_timeout_micros=*/100 * 1000, /*max_enqueued_batches=*/2);
+  options.latency_slo_micros = -1;
+  std::unique_ptr<Queue> queue;
+  EXPECT_THAT(scheduler->AddQueue(options, callback, &queue),
+              testing::StatusIs(error::INVALID_ARGUMENT,
+                                "latency_slo_micros must be non-negative; "
+                                "was -1"));
+}
+
+TEST_P(SharedBatchSchedulerTest, LearnsProcessingTimeWithLatencySlo) {
+  // Set up a fake clock, which only advances when we explicitly tell it to.
+  test_util::FakeClockEnv env(Env::Default());
+  Notification start_teardown, stop_teardown;
+  std::unique_ptr<Thread> teardown_thread =
+      CreateFakeClockAdvancerThread(&env, &start_teardown, &stop_teardown);
+
+  ModelBatchStats batch_stats;
+  {
+    Notification batch_processed;
+    // Processing a batch takes 100us per task.
+    auto callback = [&](std::unique_ptr<Batch<FakeTask>> batch) {
+      env.AdvanceByMicroseconds(100 * batch->size());
+      batch_processed.Notify();
+    };
+
+    auto scheduler = CreateSharedBatchScheduler(1, &env);
+
+    QueueOptions options = CreateQueueOptions(
+        /*max_execution_batch_size=*/10, /*input_batch_size_limit=*/10,
+        /*batch_timeout_micros=*/100, /*max_enqueued_batches=*/2);
+    options.latency_slo_micros = 1000;
+    options.batch_stats = &batch_stats;
+    auto queue = CreateQueue(scheduler, options, callback);
+
+    // Without any processing time to go by, the batch is closed by the
+    // timeout.
+    for (int i = 0; i < 3; ++i) {
+      TF_ASSERT_OK(ScheduleTask(1, queue.get()));
+    }
+    env.AdvanceByMicroseconds(100);
+    batch_processed.WaitForNotification();
+
+    // Wait for the processing time to be registered before the clock starts
+    // advancing on its own.
+    queue.reset();
+    start_teardown.Notify();
+  }
+  stop_teardown.Notify();
+
+  EXPECT_EQ(batch_stats.batch_size(3).processing_time().mean(),
+            absl::Microseconds(300));
+}
+
+TEST_P(SharedBatchSchedulerTest, ClosesBatchesToMeetLatencySlo) {
+  // Set up a fake clock, which only advances when we explicitly tell it to.
+  test_util::FakeClockEnv env(Env::Default());
+  Notification start_teardown, stop_teardown;
+  std::unique_ptr<Thread> teardown_thread =
+      CreateFakeClockAdvancerThread(&env, &start_teardown, &stop_teardown);
+
+  // Processing a batch is known to take 100us per task.
+  ModelBatchStats batch_stats;
+  batch_stats.batch_size(1).processing_time().Register(absl::Microseconds(100));
+  batch_stats.batch_size(10).processing_time().Register(
+      absl::Microseconds(1000));
+  {
+    mutex mu;
+    std::vector<size_t> batch_sizes;
+    Notification first_batch_processed, second_batch_processed;
+    auto callback = [&](std::unique_ptr<Batch<FakeTask>> batch) {
+      mutex_lock l(mu);
+      batch_sizes.push_back(batch->size());
+      if (!first_batch_processed.HasBeenNotified()) {
+        first_batch_processed.Notify();
+      } else {
+        second_batch_processed.Notify();
+      }
+    };
+
+    auto scheduler = CreateSharedBatchScheduler(1, &env);
+
+    QueueOptions options = CreateQueueOptions(
+        /*max_execution_batch_size=*/10, /*input_batch_size_limit=*/10,
+        /*batch_timeout_micros=*/1000 * 1000, /*max_enqueued_batches=*/4);
+    options.latency_slo_micros = 550;
+    options.batch_stats = &batch_stats;
+    auto queue = CreateQueue(scheduler, options, callback);
+
+    // A batch of 6 tasks would take 600us, so the sixth task closes the
+    // batch of the first five, well before the timeout.
+    for (int i = 0; i < 6; ++i) {
+      TF_ASSERT_OK(ScheduleTask(1, queue.get()));
+    }
+    first_batch_processed.WaitForNotification();
+
+    // The sixth task waits for more tasks for as long as a batch of two still
+    // meets its SLO, i.e. until 350us after it was enqueued.
+    env.AdvanceByMicroseconds(340);
+    Env::Default()->SleepForMicroseconds(10 * 1000 /* 10 milliseconds */);
+    EXPECT_FALSE(second_batch_processed.HasBeenNotified());
+    env.AdvanceByMicroseconds(20);
+    second_batch_processed.WaitForNotification();
+
+    {
+      mutex_lock l(mu);
+      EXPECT_THAT(batch_sizes, ::testing::ElementsAre(5, 1));
+    }
+
+    start_teardown.Notify();
+  }
+  stop_teardown.Notify();
+}
+
+TEST_P(SharedBatchSchedulerTest, LatencySloAccountsForQueueingDelay) {
+  // Set up a fake clock, which only advances when we explicitly tell it to.
+  test_util::FakeClockEnv env(Env::Default());
+  Notification start_teardown, stop_teardown;
+  std::unique_ptr<Thread> teardown_thread =
+      CreateFakeClockAdvancerThread(&env, &start_teardown, &stop_teardown);
+
+  // Processing a batch is known to take 100us per task.
+  ModelBatchStats batch_stats;
+  batch_stats.batch_size(1).processing_time().Register(absl::Microseconds(100));
+  batch_stats.batch_size(10).processing_time().Register(
+      absl::Microseconds(1000));
+  {
+    mutex mu;
+    std::vector<size_t> batch_sizes;
+    Notification first_batch_started, finish_first_batch;
+    auto callback = [&](std::unique_ptr<Batch<FakeTask>> batch) {
+      {
+        mutex_lock l(mu);
+        batch_sizes.push_back(batch->size());
+      }
+      if (!first_batch_started.HasBeenNotified()) {
+        first_batch_started.Notify();
+        finish_first_batch.WaitForNotification();
+      }
+    };
+
+    // A single batch thread, which the first batch keeps busy.
+    auto scheduler = CreateSharedBatchScheduler(1, &env);
+
+    QueueOptions options = CreateQueueOptions(
+        /*max_execution_batch_size=*/10, /*input_batch_size_limit=*/10,
+        /*batch_timeout_micros=*/1000 * 1000, /*max_enqueued_batches=*/8);
+    options.latency_slo_micros = 550;
+    options.batch_stats = &batch_stats;
+    auto queue = CreateQueue(scheduler, options, callback);
+
+    // As in ClosesBatchesToMeetLatencySlo, the sixth task closes the batch of
+    // the first five.
+    for (int i = 0; i < 6; ++i) {
+      TF_ASSERT_OK(ScheduleTask(1, queue.get()));
+    }
+    first_batch_started.WaitForNotification();
+
+    // Each batch now first waits for the batches ahead of it, which are
+    // assumed to take as long as itself. With one batch ahead, a batch of two
+    // takes 400us and one of three 600us, so the eighth task closes the batch
+    // of the sixth and seventh. With two and three batches ahead, even a batch
+    // of two misses the SLO, so the ninth and tenth tasks close a batch each.
+    for (int i = 0; i < 4; ++i) {
+      TF_ASSERT_OK(ScheduleTask(1, queue.get()));
+    }
+    finish_first_batch.Notify();
+
+    // Closing the queue schedules the open batch of the tenth task.
+    queue.reset();
+    {
+      mutex_lock l(mu);
+      EXPECT_THAT(batch_sizes, ::testing::ElementsAre(5, 2, 1, 1, 1));
+    }
+
+    start_teardown.Notify();
+  }
+  stop_teardown.Notify();
+}
+
 // TODO(b/161857471):
 // Add test coverage when input-split and no-split returns differently.
 INSTANTIATE_TEST_SUITE_P(
@@ -1615,6 +1808,109 @@ INSTANTIATE_TEST_SUITE_P(
                       std::make_tuple(/*enable_input_batch_split=*/false,
                                       /*enable_lazy_split=*/false)));
 
+// A task that remembers when it was enqueued, to measure its latency.
+class TimedTask : public BatchTask {
+ public:
+  explicit TimedTask(uint64 enqueue_time_micros)
+      : enqueue_time_micros_(enqueue_time_micros) {}
+
+  size_t size() const override { return 1; }
+
+  uint64 enqueue_time_micros() const { return enqueue_time_micros_; }
+
+ private:
+  const uint64 enqueue_time_micros_;
+};
+
+// Open-loop benchmark of a queue serving tasks that arrive with exponentially
+// distributed inter-arrival times at `state.range(0)` queries per second, with
+// a latency SLO of 10ms. Processing a batch of n tasks takes 1ms + 100us * n.
+// If `state.range(1)` is zero, batches are closed by a 5ms timeout only;
+// otherwise they are closed to meet the latency SLO, with the same timeout as
+// an upper bound. Reports the 99th percentile latency, the fraction of tasks
+// violating the SLO and the mean batch size.
+void BM_LatencySloOpenLoop(::testing::benchmark::State& state) {
+  using TimedScheduler = SharedBatchScheduler<TimedTask>;
+  constexpr int kNumTasks = 2000;
+  constexpr int64_t kLatencySloMicros = 10 * 1000;
+  const int qps = state.range(0);
+  const bool latency_slo_aware = state.range(1) != 0;
+
+  std::vector<int64_t> latencies_micros;
+  int64_t num_batches = 0;
+  for (auto s : state) {
+    state.PauseTiming();
+    mutex mu;
+    latencies_micros.clear();
+    num_batches = 0;
+
+    TimedScheduler::Options options;
+    options.num_batch_threads = 4;
+    std::shared_ptr<TimedScheduler> scheduler;
+    TF_CHECK_OK(TimedScheduler::Create(options, &scheduler));
+
+    TimedScheduler::QueueOptions queue_options;
+    queue_options.max_execution_batch_size = 64;
+    queue_options.input_batch_size_limit = 64;
+    queue_options.batch_timeout_micros = kLatencySloMicros / 2;
+    queue_options.max_enqueued_batches = INT_MAX;
+    if (latency_slo_aware) {
+      queue_options.latency_slo_micros = kLatencySloMicros;
+    }
+    std::unique_ptr<BatchScheduler<TimedTask>> queue;
+    TF_CHECK_OK(scheduler->AddQueue(
+        queue_options,
+        [&](std::unique_ptr<Batch<TimedTask>> batch) {
+          Env::Default()->SleepForMicroseconds(1000 + 100 * batch->size());
+          const uint64 now_micros = Env::Default()->NowMicros();
+          mutex_lock l(mu);
+          ++num_batches;
+          for (int i = 0; i < batch->num_tasks(); ++i) {
+            latencies_micros.push_back(now_micros -
+                                       batch->task(i).enqueue_time_micros());
+          }
+        },
+        &queue));
+    state.ResumeTiming();
+
+    std::mt19937 random_engine(/*seed=*/42);
+    std::exponential_distribution<double> inter_arrival_micros(qps / 1e6);
+    uint64 next_arrival_micros = Env::Default()->NowMicros();
+    for (int i = 0; i < kNumTasks; ++i) {
+      next_arrival_micros +=
+          static_cast<uint64>(inter_arrival_micros(random_engine));
+      const uint64 now_micros = Env::Default()->NowMicros();
+      if (next_arrival_micros > now_micros) {
+        Env::Default()->SleepForMicroseconds(next_arrival_micros - now_micros);
+      }
+      auto task = std::make_unique<TimedTask>(Env::Default()->NowMicros());
+      TF_CHECK_OK(queue->Schedule(&task));
+    }
+    // Destroying the queue waits for all the tasks to be processed.
+    queue.reset();
+  }
+
+  std::sort(latencies_micros.begin(), latencies_micros.end());
+  const int64_t p99_latency_micros =
+      latencies_micros[latencies_micros.size() * 99 / 100];
+  const int64_t num_slo_violations =
+      latencies_micros.end() -
+      std::upper_bound(latencies_micros.begin(), latencies_micros.end(),
+                       kLatencySloMicros);
+  state.SetLabel(absl::StrCat(
+      latency_slo_aware ? "LatencySloAware" : "TimeoutOnly",
+      " p99_latency_us=", p99_latency_micros, " slo_violation_ratio=",
+      static_cast<double>(num_slo_violations) / latencies_micros.size(),
+      " mean_batch_size=",
+      static_cast<double>(latencies_micros.size()) / num_batches));
+}
+BENCHMARK(BM_LatencySloOpenLoop)
+    ->ArgPair(2000, 0)
+    ->ArgPair(2000, 1)
+    ->ArgPair(8000, 0)
+    ->ArgPair(8000, 1)
+    ->UseRealTime();
+
 #ifdef PLATFORM_GOOGLE
 // This benchmark relies on https://github.com/google/benchmark features,
 // (in particular, `Benchmark::ThreadRange`) not available in open-sourced TF
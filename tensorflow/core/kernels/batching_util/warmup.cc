@@ -68,15 +68,30 @@ WarmupStateRegistry& GetGlobalWarmupStateRegistry() {
   return *registry;
 }
 
-bool ShouldWarmupAllBatchSizes(const OpKernelContext* c) {
+namespace {
+
+const WarmupStateRegistry::PerModelData* LookupPerModelData(
+    const OpKernelContext* c) {
   auto metadata = c->session_metadata();
   if (metadata == nullptr || metadata->name().empty()) {
-    return false;
+    return nullptr;
   }
   serving::WarmupStateRegistry::Key key(metadata->name(), metadata->version());
-  auto per_model_data = serving::GetGlobalWarmupStateRegistry().Lookup(key);
+  return serving::GetGlobalWarmupStateRegistry().Lookup(key);
+}
+
+}  // namespace
+
+bool ShouldWarmupAllBatchSizes(const OpKernelContext* c) {
+  auto per_model_data = LookupPerModelData(c);
   return per_model_data && per_model_data->warmup_all_batch_sizes;
 }
 
+bool ShouldWarmupEachBatchSizeOnce(const OpKernelContext* c) {
+  auto per_model_data = LookupPerModelData(c);
+  return per_model_data && per_model_data->warmup_all_batch_sizes &&
+         per_model_data->warmup_each_batch_size_once;
+}
+
 }  // namespace serving
 }  // namespace tensorflow
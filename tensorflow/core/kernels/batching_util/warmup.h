@@ -59,6 +59,13 @@ class WarmupStateRegistry {
     // for all `allowed_batch_sizes` of that batch op. This removes the
     // need to issue separate warmup requests for each batch size.
     bool warmup_all_batch_sizes = false;
+
+    // If true, together with `warmup_all_batch_sizes`, batch ops only warm up
+    // all `allowed_batch_sizes` on the first warm-up request of each input
+    // signature, i.e. of each shape of the inputs without the batch dimension.
+    // Later warm-up requests with the same signature are processed like
+    // demand requests, which makes replaying large warm-up sets cheaper.
+    bool warmup_each_batch_size_once = false;
   };
 
   // RAII handle for registered models.
@@ -126,6 +133,10 @@ WarmupStateRegistry& GetGlobalWarmupStateRegistry();
 // based on the state of WarmupStateRegistry.
 bool ShouldWarmupAllBatchSizes(const OpKernelContext* c);
 
+// Utility function that returns whether or not to warmup all batch sizes only
+// once per input signature, based on the state of WarmupStateRegistry.
+bool ShouldWarmupEachBatchSizeOnce(const OpKernelContext* c);
+
 }  // namespace serving
 }  // namespace tensorflow
 
@@ -0,0 +1,216 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/nn_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+// Queries and keys are processed in blocks of this many rows. A block of
+// scores is kQueryBlockSize x kKeyBlockSize floats, 64KB.
+constexpr int64_t kQueryBlockSize = 64;
+constexpr int64_t kKeyBlockSize = 256;
+
+using RowMajorMatrix =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ConstMatrixMap = Eigen::Map<const RowMajorMatrix>;
+using MatrixMap = Eigen::Map<RowMajorMatrix>;
+
+}  // namespace
+
+// CPU kernel for _FusedScaledDotProductAttention.
+//
+// Each work unit is a block of up to kQueryBlockSize queries of one batch
+// entry. It goes over the keys and values in blocks of kKeyBlockSize rows
+// and keeps a running maximum and sum of the exponentiated scores of each
+// query, rescaling the partial output whenever the maximum grows ("online
+// softmax"). Only a block of scores exists at any time, so the memory used
+// is linear in the sequence length.
+class FusedScaledDotProductAttentionOp : public OpKernel {
+ public:
+  explicit FusedScaledDotProductAttentionOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("scale", &scale_));
+    OP_REQUIRES_OK(context, context->GetAttr("causal", &causal_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& query = context->input(0);
+    const Tensor& key = context->input(1);
+    const Tensor& value = context->input(2);
+
+    const int rank = query.dims();
+    OP_REQUIRES(context, rank >= 2,
+                errors::InvalidArgument("query must be at least 2-D, got ",
+                                        query.shape().DebugString()));
+    OP_REQUIRES(context, key.dims() == rank && value.dims() == rank,
+                errors::InvalidArgument(
+                    "query, key and value must have the same rank, got ",
+                    query.shape().DebugString(), ", ",
+                    key.shape().DebugString(), " and ",
+                    value.shape().DebugString()));
+    for (int d = 0; d < rank - 2; ++d) {
+      OP_REQUIRES(context,
+                  key.dim_size(d) == query.dim_size(d) &&
+                      value.dim_size(d) == query.dim_size(d),
+                  errors::InvalidArgument(
+                      "query, key and value must have the same batch "
+                      "dimensions, got ",
+                      query.shape().DebugString(), ", ",
+                      key.shape().DebugString(), " and ",
+                      value.shape().DebugString()));
+    }
+    const int64_t num_queries = query.dim_size(rank - 2);
+    const int64_t num_keys = key.dim_size(rank - 2);
+    const int64_t depth = query.dim_size(rank - 1);
+    const int64_t value_depth = value.dim_size(rank - 1);
+    OP_REQUIRES(context, key.dim_size(rank - 1) == depth,
+                errors::InvalidArgument(
+                    "query and key must have the same depth, got ",
+                    query.shape().DebugString(), " and ",
+                    key.shape().DebugString()));
+    OP_REQUIRES(context, value.dim_size(rank - 2) == num_keys,
+                errors::InvalidArgument(
+                    "key and value must have the same length, got ",
+                    key.shape().DebugString(), " and ",
+                    value.shape().DebugString()));
+
+    TensorShape output_shape = query.shape();
+    output_shape.set_dim(rank - 1, value_depth);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(0, output_shape, &output));
+    if (output->NumElements() == 0) return;
+
+    const int64_t batch_size = output->NumElements() /
+                               (num_queries * value_depth);
+    const int64_t num_query_blocks =
+        (num_queries + kQueryBlockSize - 1) / kQueryBlockSize;
+    // Query i attends to keys [0, i + causal_offset].
+    const int64_t causal_offset = num_keys - num_queries;
+    const float scale = scale_;
+    const bool causal = causal_;
+    const float* query_data = query.flat<float>().data();
+    const float* key_data = key.flat<float>().data();
+    const float* value_data = value.flat<float>().data();
+    float* output_data = output->flat<float>().data();
+
+    auto attend = [&](int64_t start, int64_t limit) {
+      RowMajorMatrix scaled_queries(kQueryBlockSize, depth);
+      RowMajorMatrix scores(kQueryBlockSize, kKeyBlockSize);
+      RowMajorMatrix acc(kQueryBlockSize, value_depth);
+      std::vector<float> row_max(kQueryBlockSize);
+      std::vector<float> row_sum(kQueryBlockSize);
+      for (int64_t unit = start; unit < limit; ++unit) {
+        const int64_t b = unit / num_query_blocks;
+        const int64_t q_begin = (unit % num_query_blocks) * kQueryBlockSize;
+        const int64_t rows = std::min(kQueryBlockSize, num_queries - q_begin);
+        const float* keys = key_data + b * num_keys * depth;
+        const float* values = value_data + b * num_keys * value_depth;
+
+        scaled_queries.topRows(rows) =
+            ConstMatrixMap(query_data + (b * num_queries + q_begin) * depth,
+                           rows, depth) *
+            scale;
+        acc.topRows(rows).setZero();
+        std::fill_n(row_max.begin(), rows,
+                    -std::numeric_limits<float>::infinity());
+        std::fill_n(row_sum.begin(), rows, 0.0f);
+
+        // Keys past the last one any query of the block attends to are
+        // skipped.
+        int64_t k_end = num_keys;
+        if (causal) {
+          k_end = std::clamp<int64_t>(q_begin + rows + causal_offset, 0,
+                                      num_keys);
+        }
+        for (int64_t k_begin = 0; k_begin < k_end; k_begin += kKeyBlockSize) {
+          const int64_t cols = std::min(kKeyBlockSize, k_end - k_begin);
+          auto block_scores = scores.topLeftCorner(rows, cols);
+          block_scores.noalias() =
+              scaled_queries.topRows(rows) *
+              ConstMatrixMap(keys + k_begin * depth, cols, depth).transpose();
+          for (int64_t i = 0; i < rows; ++i) {
+            int64_t valid = cols;
+            if (causal) {
+              valid = std::clamp<int64_t>(
+                  q_begin + i + causal_offset + 1 - k_begin, 0, cols);
+            }
+            auto row = block_scores.row(i);
+            if (valid == 0) {
+              row.setZero();
+              continue;
+            }
+            const float new_max =
+                std::max(row_max[i], row.head(valid).maxCoeff());
+            const float correction = std::exp(row_max[i] - new_max);
+            row.head(valid) = (row.head(valid).array() - new_max).exp();
+            row.tail(cols - valid).setZero();
+            row_sum[i] = row_sum[i] * correction + row.head(valid).sum();
+            row_max[i] = new_max;
+            acc.row(i) *= correction;
+          }
+          acc.topRows(rows).noalias() +=
+              block_scores *
+              ConstMatrixMap(values + k_begin * value_depth, cols, value_depth);
+        }
+
+        MatrixMap out(
+            output_data + (b * num_queries + q_begin) * value_depth, rows,
+            value_depth);
+        for (int64_t i = 0; i < rows; ++i) {
+          // Queries without any key to attend to produce zeros.
+          if (row_sum[i] == 0.0f) {
+            out.row(i).setZero();
+          } else {
+            out.row(i) = acc.row(i) / row_sum[i];
+          }
+        }
+      }
+    };
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    const int64_t cost_per_unit =
+        kQueryBlockSize * num_keys * (depth + value_depth) * 2;
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          batch_size * num_query_blocks, cost_per_unit, attend);
+  }
+
+ private:
+  float scale_;
+  bool causal_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("_FusedScaledDotProductAttention")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<float>("T"),
+                        FusedScaledDotProductAttentionOp);
+
+}  // namespace tensorflow
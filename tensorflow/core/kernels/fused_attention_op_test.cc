@@ -0,0 +1,271 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// softmax(scale * q @ k^T) @ v for [batch, length, depth] tensors, computed
+// in double precision with the whole score matrix.
+Tensor ReferenceAttention(const Tensor& query, const Tensor& key,
+                          const Tensor& value, float scale, bool causal) {
+  const auto q = query.tensor<float, 3>();
+  const auto k = key.tensor<float, 3>();
+  const auto v = value.tensor<float, 3>();
+  const int64_t batch = query.dim_size(0);
+  const int64_t num_queries = query.dim_size(1);
+  const int64_t num_keys = key.dim_size(1);
+  const int64_t depth = query.dim_size(2);
+  const int64_t value_depth = value.dim_size(2);
+  Tensor output(DT_FLOAT, TensorShape({batch, num_queries, value_depth}));
+  auto out = output.tensor<float, 3>();
+  std::vector<double> scores(num_keys);
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t i = 0; i < num_queries; ++i) {
+      const int64_t keys =
+          causal ? std::clamp<int64_t>(i + num_keys - num_queries + 1, 0,
+                                       num_keys)
+                 : num_keys;
+      double max_score = -INFINITY;
+      for (int64_t j = 0; j < keys; ++j) {
+        double dot = 0;
+        for (int64_t d = 0; d < depth; ++d) dot += q(b, i, d) * k(b, j, d);
+        scores[j] = dot * scale;
+        max_score = std::max(max_score, scores[j]);
+      }
+      double sum = 0;
+      for (int64_t j = 0; j < keys; ++j) {
+        scores[j] = std::exp(scores[j] - max_score);
+        sum += scores[j];
+      }
+      for (int64_t d = 0; d < value_depth; ++d) {
+        double acc = 0;
+        for (int64_t j = 0; j < keys; ++j) acc += scores[j] * v(b, j, d);
+        out(b, i, d) = keys == 0 ? 0.0f : acc / sum;
+      }
+    }
+  }
+  return output;
+}
+
+class FusedScaledDotProductAttentionOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(float scale, bool causal) {
+    TF_ASSERT_OK(
+        NodeDefBuilder("attention", "_FusedScaledDotProductAttention")
+            .Input(FakeInput(DT_FLOAT))
+            .Input(FakeInput(DT_FLOAT))
+            .Input(FakeInput(DT_FLOAT))
+            .Attr("scale", scale)
+            .Attr("causal", causal)
+            .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs the op on random [batch, length, depth] inputs and checks it
+  // against ReferenceAttention.
+  void RunAndCheck(int64_t batch, int64_t num_queries, int64_t num_keys,
+                   int64_t depth, int64_t value_depth, bool causal) {
+    const float scale = 1.0f / std::sqrt(static_cast<float>(depth));
+    MakeOp(scale, causal);
+    // Scores spread over a wide range, so that the running maximum of the
+    // softmax changes between key blocks.
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-4.0f, 4.0f);
+    auto random = [&](int) { return uniform(rng); };
+    AddInput<float>(TensorShape({batch, num_queries, depth}), random);
+    AddInput<float>(TensorShape({batch, num_keys, depth}), random);
+    AddInput<float>(TensorShape({batch, num_keys, value_depth}), random);
+    TF_ASSERT_OK(RunOpKernel());
+    test::ExpectTensorNear<float>(
+        ReferenceAttention(GetInput(0), GetInput(1), GetInput(2), scale,
+                           causal),
+        *GetOutput(0), 1e-4);
+  }
+};
+
+TEST_F(FusedScaledDotProductAttentionOpTest, Small) {
+  RunAndCheck(/*batch=*/2, /*num_queries=*/3, /*num_keys=*/5, /*depth=*/4,
+              /*value_depth=*/6, /*causal=*/false);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, ManyBlocks) {
+  RunAndCheck(3, 150, 700, 32, 16, /*causal=*/false);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, Causal) {
+  RunAndCheck(2, 300, 300, 16, 16, /*causal=*/true);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, CausalWithCache) {
+  // The queries are the last ones of the sequence, and attend to the keys
+  // before them.
+  RunAndCheck(2, 70, 600, 16, 8, /*causal=*/true);
+  RunAndCheck(2, 1, 600, 16, 8, /*causal=*/true);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, CausalQueriesWithoutKeys) {
+  // The first 50 queries have no key to attend to and are zero.
+  RunAndCheck(1, 100, 50, 8, 8, /*causal=*/true);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, HeadDimensions) {
+  MakeOp(0.5f, /*causal=*/false);
+  AddInputFromArray<float>(TensorShape({1, 2, 1, 2}), {1, 0, 0, 1});
+  AddInputFromArray<float>(TensorShape({1, 2, 2, 2}),
+                           {2, 0, 0, 0, 0, 0, 0, 2});
+  AddInputFromArray<float>(TensorShape({1, 2, 2, 1}), {1, 3, 5, 7});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Each query scores its keys 1 and 0.
+  const float p = 1.0f / (1.0f + std::exp(-1.0f));
+  Tensor expected(DT_FLOAT, TensorShape({1, 2, 1, 1}));
+  test::FillValues<float>(&expected,
+                          {p * 1 + (1 - p) * 3, p * 7 + (1 - p) * 5});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-6);
+}
+
+TEST_F(FusedScaledDotProductAttentionOpTest, MismatchedBatch) {
+  MakeOp(1.0f, /*causal=*/false);
+  AddInputFromArray<float>(TensorShape({2, 3, 4}), std::vector<float>(24));
+  AddInputFromArray<float>(TensorShape({1, 3, 4}), std::vector<float>(12));
+  AddInputFromArray<float>(TensorShape({1, 3, 4}), std::vector<float>(12));
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "same batch dimensions")) << s;
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+Tensor RandomInput(int batch, int heads, int length, int depth) {
+  Tensor input(DT_FLOAT, TensorShape({batch, heads, length, depth}));
+  input.flat<float>().setRandom();
+  return input;
+}
+
+// BatchMatMulV2 -> Mul -> Softmax -> BatchMatMulV2, which materializes the
+// [batch, heads, length, length] scores.
+static Graph* UnfusedAttention(int batch, int heads, int length, int depth) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Node* scores;
+  TF_CHECK_OK(
+      NodeBuilder(g->NewName("scores"), "BatchMatMulV2")
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Attr("adj_y", true)
+          .Finalize(g, &scores));
+  Node* scaled;
+  TF_CHECK_OK(NodeBuilder(g->NewName("scaled"), "Mul")
+                  .Input(scores)
+                  .Input(test::graph::Constant(
+                      g, test::AsScalar<float>(
+                             1.0f / std::sqrt(static_cast<float>(depth)))))
+                  .Finalize(g, &scaled));
+  Node* probs;
+  TF_CHECK_OK(NodeBuilder(g->NewName("probs"), "Softmax")
+                  .Input(scaled)
+                  .Finalize(g, &probs));
+  TF_CHECK_OK(
+      NodeBuilder(g->NewName("attention"), "BatchMatMulV2")
+          .Input(probs)
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Finalize(g, nullptr));
+  return g;
+}
+
+static Graph* FusedAttention(int batch, int heads, int length, int depth,
+                             bool causal) {
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(
+      NodeBuilder(g->NewName("attention"), "_FusedScaledDotProductAttention")
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Input(test::graph::Constant(g, RandomInput(batch, heads, length,
+                                                      depth)))
+          .Attr("scale", 1.0f / std::sqrt(static_cast<float>(depth)))
+          .Attr("causal", causal)
+          .Finalize(g, nullptr));
+  return g;
+}
+
+// Items are query-key pairs.
+#define BM_FusedAttention(B, H, S, D)                                        \
+  static void BM_FusedAttention_##B##_##H##_##S##_##D(                       \
+      ::testing::benchmark::State& state) {                                  \
+    test::Benchmark("cpu", FusedAttention(B, H, S, D, /*causal=*/false),     \
+                    /*old_benchmark_api*/ false)                             \
+        .Run(state);                                                         \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * B *   \
+                            H * S * S);                                      \
+  }                                                                          \
+  BENCHMARK(BM_FusedAttention_##B##_##H##_##S##_##D)->UseRealTime();         \
+  static void BM_FusedCausalAttention_##B##_##H##_##S##_##D(                 \
+      ::testing::benchmark::State& state) {                                  \
+    test::Benchmark("cpu", FusedAttention(B, H, S, D, /*causal=*/true),      \
+                    /*old_benchmark_api*/ false)                             \
+        .Run(state);                                                         \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * B *   \
+                            H * S * S);                                      \
+  }                                                                          \
+  BENCHMARK(BM_FusedCausalAttention_##B##_##H##_##S##_##D)->UseRealTime();
+
+#define BM_UnfusedAttention(B, H, S, D)                                      \
+  static void BM_UnfusedAttention_##B##_##H##_##S##_##D(                     \
+      ::testing::benchmark::State& state) {                                  \
+    test::Benchmark("cpu", UnfusedAttention(B, H, S, D),                     \
+                    /*old_benchmark_api*/ false)                             \
+        .Run(state);                                                         \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * B *   \
+                            H * S * S);                                      \
+  }                                                                          \
+  BENCHMARK(BM_UnfusedAttention_##B##_##H##_##S##_##D)->UseRealTime();
+
+BM_FusedAttention(1, 8, 512, 64);
+BM_FusedAttention(1, 8, 1024, 64);
+BM_FusedAttention(1, 8, 2048, 64);
+BM_FusedAttention(1, 8, 4096, 64);
+BM_FusedAttention(1, 8, 8192, 64);
+
+// The unfused scores take 2GB at length 8192, which is left out.
+BM_UnfusedAttention(1, 8, 512, 64);
+BM_UnfusedAttention(1, 8, 1024, 64);
+BM_UnfusedAttention(1, 8, 2048, 64);
+BM_UnfusedAttention(1, 8, 4096, 64);
+
+}  // namespace
+}  // namespace tensorflow
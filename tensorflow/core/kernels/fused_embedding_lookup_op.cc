@@ -0,0 +1,225 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "absl/base/prefetch.h"
+#include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+enum class EmbeddingCombiner { kSum, kMean, kSqrtN };
+
+// How many ids ahead of the current one the embedding row is prefetched.
+constexpr int64_t kPrefetchDistance = 4;
+
+// out[0:size] += weight * row[0:size].
+inline void AccumulateRow(const float* row, float weight, float* out,
+                          int64_t size) {
+  using Packet = typename Eigen::internal::packet_traits<float>::type;
+  constexpr int64_t kPacketSize =
+      Eigen::internal::unpacket_traits<Packet>::size;
+  const Packet weights = Eigen::internal::pset1<Packet>(weight);
+  int64_t j = 0;
+  for (; j + kPacketSize <= size; j += kPacketSize) {
+    Eigen::internal::pstoreu(
+        out + j, Eigen::internal::pmadd(
+                     weights, Eigen::internal::ploadu<Packet>(row + j),
+                     Eigen::internal::ploadu<Packet>(out + j)));
+  }
+  for (; j < size; ++j) out[j] += weight * row[j];
+}
+
+}  // namespace
+
+// CPU kernel for _FusedEmbeddingLookupSparse. Each output row is the combined
+// embedding of one segment: the rows of `params` selected by the segment's
+// ids are accumulated directly into the output, without materializing the
+// gathered [nnz, dim] embeddings.
+template <typename Tidx, typename Tsegmentids>
+class FusedEmbeddingLookupSparseOp : public OpKernel {
+ public:
+  explicit FusedEmbeddingLookupSparseOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    string combiner;
+    OP_REQUIRES_OK(context, context->GetAttr("combiner", &combiner));
+    if (combiner == "sum") {
+      combiner_ = EmbeddingCombiner::kSum;
+    } else if (combiner == "mean") {
+      combiner_ = EmbeddingCombiner::kMean;
+    } else if (combiner == "sqrtn") {
+      combiner_ = EmbeddingCombiner::kSqrtN;
+    } else {
+      context->CtxFailure(
+          errors::InvalidArgument("Unsupported combiner: ", combiner));
+      return;
+    }
+    int num_weights;
+    OP_REQUIRES_OK(context, context->GetAttr("num_weights", &num_weights));
+    OP_REQUIRES(context, num_weights <= 1,
+                errors::InvalidArgument(
+                    "At most one weights input is supported, got ",
+                    num_weights));
+    has_weights_ = num_weights == 1;
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& params = context->input(0);
+    const Tensor& ids = context->input(1);
+    const Tensor& segment_ids = context->input(2);
+
+    OP_REQUIRES(context, TensorShapeUtils::IsVectorOrHigher(params.shape()),
+                errors::InvalidArgument("params must be at least 1-D, got ",
+                                        params.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(ids.shape()),
+                errors::InvalidArgument("ids must be a vector, got ",
+                                        ids.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(segment_ids.shape()),
+                errors::InvalidArgument("segment_ids must be a vector, got ",
+                                        segment_ids.shape().DebugString()));
+    const int64_t nnz = ids.NumElements();
+    OP_REQUIRES(context, segment_ids.NumElements() == nnz,
+                errors::InvalidArgument(
+                    "segment_ids and ids should have same size: ",
+                    segment_ids.NumElements(), " vs. ", nnz));
+    const float* weights = nullptr;
+    if (has_weights_) {
+      const Tensor& weights_tensor = context->input(3);
+      OP_REQUIRES(context,
+                  TensorShapeUtils::IsVector(weights_tensor.shape()) &&
+                      weights_tensor.NumElements() == nnz,
+                  errors::InvalidArgument(
+                      "weights must be a vector of the same size as ids, "
+                      "got shape ",
+                      weights_tensor.shape().DebugString()));
+      weights = weights_tensor.flat<float>().data();
+    }
+
+    const int64_t num_rows = params.dim_size(0);
+    TensorShape row_shape = params.shape();
+    row_shape.RemoveDim(0);
+    const int64_t row_size = row_shape.num_elements();
+
+    // Validates ids and segment ids, and finds where each segment starts.
+    // Segment ids must be sorted; segments without ids produce zero rows.
+    const Tidx* ids_data = ids.flat<Tidx>().data();
+    const Tsegmentids* segment_ids_data =
+        segment_ids.flat<Tsegmentids>().data();
+    const int64_t num_segments =
+        nnz == 0 ? 0 : static_cast<int64_t>(segment_ids_data[nnz - 1]) + 1;
+    OP_REQUIRES(context, num_segments >= 0,
+                errors::InvalidArgument("segment ids must be >= 0"));
+    std::vector<int64_t> segment_begin(num_segments + 1, nnz);
+    int64_t next_segment = 0;
+    int64_t previous_segment = 0;
+    for (int64_t i = 0; i < nnz; ++i) {
+      const int64_t id = static_cast<int64_t>(ids_data[i]);
+      OP_REQUIRES(context, id >= 0 && id < num_rows,
+                  errors::InvalidArgument("ids[", i, "] = ", id,
+                                          " is not in [0, ", num_rows, ")"));
+      const int64_t segment = static_cast<int64_t>(segment_ids_data[i]);
+      OP_REQUIRES(context,
+                  segment >= previous_segment && segment < num_segments,
+                  errors::InvalidArgument(
+                      "segment ids are not sorted: segment_ids[", i,
+                      "] = ", segment, " is not in [", previous_segment, ", ",
+                      num_segments, ")"));
+      previous_segment = segment;
+      while (next_segment <= segment) segment_begin[next_segment++] = i;
+    }
+
+    TensorShape output_shape = row_shape;
+    OP_REQUIRES_OK(context, output_shape.InsertDimWithStatus(0, num_segments));
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(0, output_shape, &output));
+    if (output->NumElements() == 0) return;
+
+    const float* params_data = params.flat<float>().data();
+    float* output_data = output->flat<float>().data();
+    const EmbeddingCombiner combiner = combiner_;
+    auto combine_segments = [&](int64_t start, int64_t limit) {
+      for (int64_t s = start; s < limit; ++s) {
+        float* out = output_data + s * row_size;
+        std::memset(out, 0, row_size * sizeof(float));
+        const int64_t begin = segment_begin[s];
+        const int64_t end = segment_begin[s + 1];
+        float weight_sum = 0.0f;
+        for (int64_t i = begin; i < end; ++i) {
+          if (i + kPrefetchDistance < end) {
+            absl::PrefetchToLocalCache(
+                params_data +
+                static_cast<int64_t>(ids_data[i + kPrefetchDistance]) *
+                    row_size);
+          }
+          const float weight = weights == nullptr ? 1.0f : weights[i];
+          AccumulateRow(
+              params_data + static_cast<int64_t>(ids_data[i]) * row_size,
+              weight, out, row_size);
+          weight_sum += combiner == EmbeddingCombiner::kSqrtN
+                            ? weight * weight
+                            : weight;
+        }
+        // Like the unfused graph, a zero weight sum leaves the row at zero.
+        if (combiner == EmbeddingCombiner::kSum || weight_sum == 0.0f) {
+          continue;
+        }
+        const float scale = combiner == EmbeddingCombiner::kMean
+                                ? 1.0f / weight_sum
+                                : 1.0f / std::sqrt(weight_sum);
+        for (int64_t j = 0; j < row_size; ++j) out[j] *= scale;
+      }
+    };
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    const int64_t cost_per_segment = (nnz / num_segments + 1) * row_size * 2;
+    Shard(worker_threads.num_threads, worker_threads.workers, num_segments,
+          cost_per_segment, combine_segments);
+  }
+
+ private:
+  EmbeddingCombiner combiner_;
+  bool has_weights_;
+};
+
+#define REGISTER_FUSED_EMBEDDING_LOOKUP(Tidx, Tsegmentids)                \
+  REGISTER_KERNEL_BUILDER(Name("_FusedEmbeddingLookupSparse")             \
+                              .Device(DEVICE_CPU)                         \
+                              .TypeConstraint<float>("T")                 \
+                              .TypeConstraint<Tidx>("Tidx")               \
+                              .TypeConstraint<Tsegmentids>("Tsegmentids"), \
+                          FusedEmbeddingLookupSparseOp<Tidx, Tsegmentids>);
+
+REGISTER_FUSED_EMBEDDING_LOOKUP(int32, int32);
+REGISTER_FUSED_EMBEDDING_LOOKUP(int32, int64_t);
+REGISTER_FUSED_EMBEDDING_LOOKUP(int64_t, int32);
+REGISTER_FUSED_EMBEDDING_LOOKUP(int64_t, int64_t);
+#undef REGISTER_FUSED_EMBEDDING_LOOKUP
+
+}  // namespace tensorflow
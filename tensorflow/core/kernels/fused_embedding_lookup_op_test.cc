@@ -0,0 +1,228 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class FusedEmbeddingLookupSparseOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& combiner, bool weighted) {
+    NodeDefBuilder builder("lookup", "_FusedEmbeddingLookupSparse");
+    builder.Input(FakeInput(DT_FLOAT))
+        .Input(FakeInput(DT_INT64))
+        .Input(FakeInput(DT_INT32))
+        .Input(FakeInput(weighted ? 1 : 0, DT_FLOAT))
+        .Attr("combiner", combiner);
+    TF_ASSERT_OK(builder.Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // params is [4, 3] with params[r, c] = 10 * r + c.
+  void AddParams() {
+    AddInputFromArray<float>(TensorShape({4, 3}),
+                             {0, 1, 2, 10, 11, 12, 20, 21, 22, 30, 31, 32});
+  }
+};
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, Sum) {
+  MakeOp("sum", /*weighted=*/false);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({5}), {1, 3, 1, 0, 2});
+  AddInputFromArray<int32>(TensorShape({5}), {0, 0, 0, 2, 2});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Segment 1 has no ids and is zero.
+  Tensor expected(DT_FLOAT, TensorShape({3, 3}));
+  test::FillValues<float>(&expected, {50, 53, 56, 0, 0, 0, 20, 22, 24});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, Mean) {
+  MakeOp("mean", /*weighted=*/false);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({3}), {1, 3, 2});
+  AddInputFromArray<int32>(TensorShape({3}), {0, 0, 1});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(DT_FLOAT, TensorShape({2, 3}));
+  test::FillValues<float>(&expected, {20, 21, 22, 20, 21, 22});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, WeightedSqrtN) {
+  MakeOp("sqrtn", /*weighted=*/true);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({3}), {1, 2, 3});
+  AddInputFromArray<int32>(TensorShape({3}), {0, 0, 1});
+  AddInputFromArray<float>(TensorShape({3}), {3, 4, 0});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Segment 0: (3 * params[1] + 4 * params[2]) / sqrt(3^2 + 4^2). Segment 1
+  // has a zero weight sum and stays zero.
+  Tensor expected(DT_FLOAT, TensorShape({2, 3}));
+  test::FillValues<float>(&expected,
+                          {110 / 5.0f, 117 / 5.0f, 124 / 5.0f, 0, 0, 0});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, IdOutOfRange) {
+  MakeOp("sum", /*weighted=*/false);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({2}), {1, 4});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 1});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "is not in [0, 4)")) << s;
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, UnsortedSegmentIds) {
+  MakeOp("sum", /*weighted=*/false);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({2}), {1, 2});
+  AddInputFromArray<int32>(TensorShape({2}), {1, 0});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(s)) << s;
+  EXPECT_TRUE(absl::StrContains(s.message(), "segment ids are not sorted"))
+      << s;
+}
+
+TEST_F(FusedEmbeddingLookupSparseOpTest, SegmentIdPastTheLastSegment) {
+  // The number of segments comes from the last segment id, so an earlier
+  // larger id must not be used to index the segments.
+  MakeOp("sum", /*weighted=*/false);
+  AddParams();
+  AddInputFromArray<int64_t>(TensorShape({3}), {1, 2, 3});
+  AddInputFromArray<int32>(TensorShape({3}), {0, 5, 2});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(s)) << s;
+  EXPECT_TRUE(absl::StrContains(s.message(), "segment ids are not sorted"))
+      << s;
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+// Ids for `batch` examples with `ids_per_example` ids each, drawn from a
+// power-law distribution over `vocab` rows, as is typical for categorical
+// features.
+void PowerLawIds(int batch, int ids_per_example, int vocab, Tensor* ids,
+                 Tensor* segment_ids) {
+  std::mt19937 rng(/*seed=*/1234);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const int nnz = batch * ids_per_example;
+  *ids = Tensor(DT_INT64, TensorShape({nnz}));
+  *segment_ids = Tensor(DT_INT32, TensorShape({nnz}));
+  for (int i = 0; i < nnz; ++i) {
+    // Inverse CDF sampling of a Zipf-like distribution with exponent ~1.
+    const double u = uniform(rng);
+    const int64_t id = static_cast<int64_t>(std::pow(vocab, u)) - 1;
+    ids->flat<int64_t>()(i) = std::min<int64_t>(id, vocab - 1);
+    segment_ids->flat<int32>()(i) = i / ids_per_example;
+  }
+}
+
+Tensor RandomParams(int vocab, int dim) {
+  Tensor params(DT_FLOAT, TensorShape({vocab, dim}));
+  params.flat<float>().setRandom();
+  return params;
+}
+
+// Unique -> GatherV2 -> SparseSegmentMean, as built by
+// tf.nn.embedding_lookup_sparse.
+static Graph* UnfusedEmbeddingLookup(int batch, int ids_per_example, int vocab,
+                                     int dim) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor ids, segment_ids;
+  PowerLawIds(batch, ids_per_example, vocab, &ids, &segment_ids);
+  Node* unique;
+  TF_CHECK_OK(NodeBuilder(g->NewName("unique"), "Unique")
+                  .Input(test::graph::Constant(g, ids))
+                  .Finalize(g, &unique));
+  Node* gather;
+  TF_CHECK_OK(NodeBuilder(g->NewName("gather"), "GatherV2")
+                  .Input(test::graph::Constant(g, RandomParams(vocab, dim)))
+                  .Input(unique, 0)
+                  .Input(test::graph::Constant(g, test::AsScalar<int32>(0)))
+                  .Finalize(g, &gather));
+  TF_CHECK_OK(NodeBuilder(g->NewName("mean"), "SparseSegmentMean")
+                  .Input(gather)
+                  .Input(unique, 1)
+                  .Input(test::graph::Constant(g, segment_ids))
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+static Graph* FusedEmbeddingLookup(int batch, int ids_per_example, int vocab,
+                                   int dim) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor ids, segment_ids;
+  PowerLawIds(batch, ids_per_example, vocab, &ids, &segment_ids);
+  TF_CHECK_OK(NodeBuilder(g->NewName("lookup"), "_FusedEmbeddingLookupSparse")
+                  .Input(test::graph::Constant(g, RandomParams(vocab, dim)))
+                  .Input(test::graph::Constant(g, ids))
+                  .Input(test::graph::Constant(g, segment_ids))
+                  .Input(std::vector<NodeBuilder::NodeOut>())
+                  .Attr("combiner", "mean")
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+#define BM_EmbeddingLookup(B, L, V, D)                                       \
+  static void BM_UnfusedEmbeddingLookup_##B##_##L##_##V##_##D(               \
+      ::testing::benchmark::State& state) {                                  \
+    test::Benchmark("cpu", UnfusedEmbeddingLookup(B, L, V, D),               \
+                    /*old_benchmark_api*/ false)                             \
+        .Run(state);                                                         \
+    state.SetItemsProcessed(state.iterations() * B * L);                     \
+  }                                                                          \
+  BENCHMARK(BM_UnfusedEmbeddingLookup_##B##_##L##_##V##_##D)                 \
+      ->UseRealTime();                                                       \
+  static void BM_FusedEmbeddingLookup_##B##_##L##_##V##_##D(                 \
+      ::testing::benchmark::State& state) {                                  \
+    test::Benchmark("cpu", FusedEmbeddingLookup(B, L, V, D),                 \
+                    /*old_benchmark_api*/ false)                             \
+        .Run(state);                                                         \
+    state.SetItemsProcessed(state.iterations() * B * L);                     \
+  }                                                                          \
+  BENCHMARK(BM_FusedEmbeddingLookup_##B##_##L##_##V##_##D)->UseRealTime();
+
+BM_EmbeddingLookup(256, 10, 100000, 16);
+BM_EmbeddingLookup(256, 10, 100000, 64);
+BM_EmbeddingLookup(1024, 20, 100000, 32);
+BM_EmbeddingLookup(1024, 20, 1000000, 64);
+BM_EmbeddingLookup(4096, 50, 1000000, 32);
+BM_EmbeddingLookup(4096, 50, 1000000, 128);
+
+}  // namespace
+}  // namespace tensorflow
@@ -15,16 +15,27 @@ limitations under the License.
 
 // Tests kernels of lookup ops.
 
+#include <atomic>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
 #include "tensorflow/core/framework/fake_input.h"
 #include "tensorflow/core/framework/lookup_interface.h"
 #include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/shape_inference_testutil.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/lookup_table_op.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 namespace {
@@ -100,5 +111,273 @@ TEST_F(LookupOpsTest, AnonymousHashTable_RefCounting) {
   EXPECT_FALSE(alive);
 }
 
+Tensor Int64Vector(const std::vector<int64_t>& values) {
+  return test::AsTensor<int64_t>(values, {static_cast<int64_t>(values.size())});
+}
+
+TEST(ConcurrentMutableHashTableTest, InsertFindRemove) {
+  lookup::ConcurrentMutableHashTable<int64_t, float> table(nullptr, nullptr);
+  TF_ASSERT_OK(table.Insert(nullptr, Int64Vector({-3, 0, 7, 0}),
+                            test::AsTensor<float>({1, 2, 3, 4})));
+  EXPECT_EQ(table.size(), 3);
+
+  Tensor values(DT_FLOAT, TensorShape({4}));
+  TF_ASSERT_OK(table.Find(nullptr, Int64Vector({0, 7, 5, -3}), &values,
+                          test::AsScalar<float>(-1)));
+  test::ExpectTensorEqual<float>(values, test::AsTensor<float>({4, 3, -1, 1}));
+
+  TF_ASSERT_OK(table.Remove(nullptr, Int64Vector({7, 5})));
+  EXPECT_EQ(table.size(), 2);
+  // Per-key defaults.
+  TF_ASSERT_OK(table.Find(nullptr, Int64Vector({0, 7, 5, -3}), &values,
+                          test::AsTensor<float>({10, 20, 30, 40})));
+  test::ExpectTensorEqual<float>(values, test::AsTensor<float>({4, 20, 30, 1}));
+}
+
+TEST(ConcurrentMutableHashTableTest, GrowsAndImports) {
+  lookup::ConcurrentMutableHashTable<int64_t, int64_t> table(nullptr, nullptr);
+  const int64_t n = 100000;
+  std::vector<int64_t> keys(n);
+  std::vector<int64_t> expected(n);
+  for (int64_t i = 0; i < n; ++i) {
+    keys[i] = i * 7919 - n;
+    expected[i] = -i;
+  }
+  TF_ASSERT_OK(table.Insert(nullptr, Int64Vector(keys), Int64Vector(expected)));
+  EXPECT_EQ(table.size(), n);
+  Tensor values(DT_INT64, TensorShape({n}));
+  TF_ASSERT_OK(table.Find(nullptr, Int64Vector(keys), &values,
+                          test::AsScalar<int64_t>(1)));
+  test::ExpectTensorEqual<int64_t>(values, Int64Vector(expected));
+
+  // Importing replaces the contents.
+  TF_ASSERT_OK(table.ImportValues(nullptr, Int64Vector({keys[0], 5}),
+                                  Int64Vector({42, 43})));
+  EXPECT_EQ(table.size(), 2);
+  Tensor imported(DT_INT64, TensorShape({3}));
+  TF_ASSERT_OK(table.Find(nullptr, Int64Vector({keys[0], keys[1], 5}),
+                          &imported, test::AsScalar<int64_t>(1)));
+  test::ExpectTensorEqual<int64_t>(imported, Int64Vector({42, 1, 43}));
+}
+
+TEST(ConcurrentMutableHashTableTest, ConcurrentReadersAndWriters) {
+  lookup::ConcurrentMutableHashTable<int64_t, int64_t> table(nullptr, nullptr);
+  constexpr int kNumReaders = 4;
+  constexpr int kNumWriters = 2;
+  constexpr int64_t kNumKeys = 1 << 16;
+  constexpr int kBatchSize = 64;
+  // Writers only store values that encode their key, so any value a reader
+  // sees must decode to the key it looked up.
+  auto value_for = [](int64_t key, int version) {
+    return key * 1000 + version;
+  };
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> torn_reads(0);
+  thread::ThreadPool pool(Env::Default(), "lookup_test",
+                          kNumReaders + kNumWriters);
+  BlockingCounter writers_done(kNumWriters);
+  BlockingCounter readers_done(kNumReaders);
+  for (int r = 0; r < kNumReaders; ++r) {
+    pool.Schedule([&, r]() {
+      std::mt19937_64 rng(r);
+      Tensor keys(DT_INT64, TensorShape({kBatchSize}));
+      Tensor values(DT_INT64, TensorShape({kBatchSize}));
+      while (!done.load()) {
+        for (int i = 0; i < kBatchSize; ++i) {
+          keys.flat<int64_t>()(i) = rng() % kNumKeys;
+        }
+        TF_CHECK_OK(table.Find(nullptr, keys, &values,
+                               test::AsScalar<int64_t>(-1)));
+        for (int i = 0; i < kBatchSize; ++i) {
+          const int64_t value = values.flat<int64_t>()(i);
+          if (value != -1 && value / 1000 != keys.flat<int64_t>()(i)) {
+            ++torn_reads;
+          }
+        }
+      }
+      readers_done.DecrementCount();
+    });
+  }
+  for (int w = 0; w < kNumWriters; ++w) {
+    pool.Schedule([&, w]() {
+      std::mt19937_64 rng(kNumReaders + w);
+      Tensor keys(DT_INT64, TensorShape({kBatchSize}));
+      Tensor values(DT_INT64, TensorShape({kBatchSize}));
+      for (int version = 0; version < 1000; ++version) {
+        for (int i = 0; i < kBatchSize; ++i) {
+          const int64_t key = rng() % kNumKeys;
+          keys.flat<int64_t>()(i) = key;
+          values.flat<int64_t>()(i) = value_for(key, version);
+        }
+        if (version % 4 == 3) {
+          TF_CHECK_OK(table.Remove(nullptr, keys));
+        } else {
+          TF_CHECK_OK(table.Insert(nullptr, keys, values));
+        }
+      }
+      writers_done.DecrementCount();
+    });
+  }
+  writers_done.Wait();
+  done = true;
+  readers_done.Wait();
+  EXPECT_EQ(torn_reads.load(), 0);
+  EXPECT_LE(table.size(), kNumKeys);
+}
+
+TEST(ConcurrentMutableHashTableTest, FreesRetiredSlotsUnderSteadyReads) {
+  lookup::ConcurrentMutableHashTable<int64_t, int64_t> table(nullptr, nullptr);
+  const int64_t initial_memory = table.MemoryUsed();
+  constexpr int kNumReaders = 4;
+  std::atomic<bool> done(false);
+  thread::ThreadPool pool(Env::Default(), "lookup_test", kNumReaders);
+  BlockingCounter readers_done(kNumReaders);
+  for (int r = 0; r < kNumReaders; ++r) {
+    pool.Schedule([&]() {
+      Tensor keys = Int64Vector({1, 2, 3, 4});
+      Tensor values(DT_INT64, TensorShape({4}));
+      while (!done.load()) {
+        TF_CHECK_OK(table.Find(nullptr, keys, &values,
+                               test::AsScalar<int64_t>(-1)));
+      }
+      readers_done.DecrementCount();
+    });
+  }
+
+  // Every import retires the slot arrays of all shards. They must be freed
+  // although some lookup is always in flight.
+  const Tensor no_keys = Int64Vector({});
+  for (int i = 0; i < 1000; ++i) {
+    TF_EXPECT_OK(table.ImportValues(nullptr, no_keys, no_keys));
+  }
+  for (int i = 0; i < 10000 && table.MemoryUsed() > 3 * initial_memory; ++i) {
+    TF_EXPECT_OK(table.Remove(nullptr, no_keys));
+    Env::Default()->SleepForMicroseconds(100);
+  }
+  EXPECT_LE(table.MemoryUsed(), 3 * initial_memory);
+  done = true;
+  readers_done.Wait();
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+// The locking scheme MutableHashTableOfScalars uses, as a baseline: lookups
+// take a shared lock and updates an exclusive lock on the whole table.
+class LockedHashTable {
+ public:
+  LockedHashTable(OpKernelContext* ctx, OpKernel* kernel) {}
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) {
+    const auto key_values = key.flat<int64_t>();
+    auto value_values = value->flat<float>();
+    const float default_val = default_value.scalar<float>()();
+    tf_shared_lock l(mu_);
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      auto it = table_.find(key_values(i));
+      value_values(i) = it == table_.end() ? default_val : it->second;
+    }
+    return absl::OkStatus();
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) {
+    const auto key_values = keys.flat<int64_t>();
+    const auto value_values = values.flat<float>();
+    mutex_lock l(mu_);
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      table_[key_values(i)] = value_values(i);
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  mutex mu_;
+  std::unordered_map<int64_t, float> table_ TF_GUARDED_BY(mu_);
+};
+
+// Runs `num_threads` threads that each issue batches of 64 lookups, with
+// `write_percent` percent of the batches being inserts instead.
+template <typename Table>
+void BM_MixedReadWrite(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  const int write_percent = state.range(1);
+  constexpr int64_t kNumKeys = 1 << 20;
+  constexpr int kBatchSize = 64;
+  constexpr int kBatchesPerThread = 256;
+
+  Table table(nullptr, nullptr);
+  {
+    std::vector<int64_t> keys(kNumKeys);
+    for (int64_t i = 0; i < kNumKeys; ++i) keys[i] = i;
+    TF_CHECK_OK(table.Insert(
+        nullptr, Int64Vector(keys),
+        test::AsTensor<float>(std::vector<float>(kNumKeys, 1.0f))));
+  }
+
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  for (auto s : state) {
+    BlockingCounter counter(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&, t]() {
+        std::mt19937_64 rng(t);
+        Tensor keys(DT_INT64, TensorShape({kBatchSize}));
+        Tensor values(DT_FLOAT, TensorShape({kBatchSize}));
+        values.flat<float>().setConstant(2.0f);
+        const Tensor default_value = test::AsScalar<float>(0.0f);
+        for (int b = 0; b < kBatchesPerThread; ++b) {
+          for (int i = 0; i < kBatchSize; ++i) {
+            keys.flat<int64_t>()(i) = rng() % kNumKeys;
+          }
+          if (static_cast<int>(rng() % 100) < write_percent) {
+            TF_CHECK_OK(table.Insert(nullptr, keys, values));
+          } else {
+            TF_CHECK_OK(table.Find(nullptr, keys, &values, default_value));
+          }
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads *
+                          kBatchesPerThread * kBatchSize);
+}
+
+void BM_MixedReadWrite_Locked(::testing::benchmark::State& state) {
+  BM_MixedReadWrite<LockedHashTable>(state);
+}
+BENCHMARK(BM_MixedReadWrite_Locked)
+    ->UseRealTime()
+    ->ArgPair(1, 0)
+    ->ArgPair(1, 10)
+    ->ArgPair(4, 0)
+    ->ArgPair(4, 1)
+    ->ArgPair(4, 10)
+    ->ArgPair(4, 50)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1)
+    ->ArgPair(16, 10)
+    ->ArgPair(16, 50);
+
+void BM_MixedReadWrite_Concurrent(::testing::benchmark::State& state) {
+  BM_MixedReadWrite<lookup::ConcurrentMutableHashTable<int64_t, float>>(state);
+}
+BENCHMARK(BM_MixedReadWrite_Concurrent)
+    ->UseRealTime()
+    ->ArgPair(1, 0)
+    ->ArgPair(1, 10)
+    ->ArgPair(4, 0)
+    ->ArgPair(4, 1)
+    ->ArgPair(4, 10)
+    ->ArgPair(4, 50)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1)
+    ->ArgPair(16, 10)
+    ->ArgPair(16, 50);
+
 }  // namespace
 }  // namespace tensorflow
@@ -1118,38 +1118,43 @@ REGISTER_KERNEL(tstring, tstring);
 
 #undef REGISTER_KERNEL
 
-// Register the MutableHashTable op.
-#define REGISTER_KERNEL(key_dtype, value_dtype)                                \
+// Register the MutableHashTable op. Integral keys with numeric values use
+// ConcurrentMutableHashTable, whose lookups do not block on updates.
+#define REGISTER_KERNEL_WITH_TABLE(key_dtype, value_dtype, Table)              \
   REGISTER_KERNEL_BUILDER(                                                     \
       Name("MutableHashTable")                                                 \
           .Device(DEVICE_CPU)                                                  \
           .TypeConstraint<key_dtype>("key_dtype")                              \
           .TypeConstraint<value_dtype>("value_dtype"),                         \
-      LookupTableOp<lookup::MutableHashTableOfScalars<key_dtype, value_dtype>, \
-                    key_dtype, value_dtype>)                                   \
+      LookupTableOp<Table<key_dtype, value_dtype>, key_dtype, value_dtype>)    \
   REGISTER_KERNEL_BUILDER(                                                     \
       Name("MutableHashTableV2")                                               \
           .Device(DEVICE_CPU)                                                  \
           .TypeConstraint<key_dtype>("key_dtype")                              \
           .TypeConstraint<value_dtype>("value_dtype"),                         \
-      LookupTableOp<lookup::MutableHashTableOfScalars<key_dtype, value_dtype>, \
-                    key_dtype, value_dtype>)                                   \
+      LookupTableOp<Table<key_dtype, value_dtype>, key_dtype, value_dtype>)    \
   REGISTER_KERNEL_BUILDER(                                                     \
       Name("AnonymousMutableHashTable")                                        \
           .Device(DEVICE_CPU)                                                  \
           .TypeConstraint<key_dtype>("key_dtype")                              \
           .TypeConstraint<value_dtype>("value_dtype"),                         \
-      AnonymousLookupTableOp<                                                  \
-          lookup::MutableHashTableOfScalars<key_dtype, value_dtype>,           \
-          key_dtype, value_dtype>)
-
-REGISTER_KERNEL(int32, double);
-REGISTER_KERNEL(int32, float);
-REGISTER_KERNEL(int32, int32);
-REGISTER_KERNEL(int64_t, double);
-REGISTER_KERNEL(int64_t, float);
-REGISTER_KERNEL(int64_t, int32);
-REGISTER_KERNEL(int64_t, int64_t);
+      AnonymousLookupTableOp<Table<key_dtype, value_dtype>, key_dtype,         \
+                             value_dtype>)
+
+#define REGISTER_KERNEL(key_dtype, value_dtype)      \
+  REGISTER_KERNEL_WITH_TABLE(key_dtype, value_dtype, \
+                             lookup::MutableHashTableOfScalars)
+#define REGISTER_CONCURRENT_KERNEL(key_dtype, value_dtype) \
+  REGISTER_KERNEL_WITH_TABLE(key_dtype, value_dtype,       \
+                             lookup::ConcurrentMutableHashTable)
+
+REGISTER_CONCURRENT_KERNEL(int32, double);
+REGISTER_CONCURRENT_KERNEL(int32, float);
+REGISTER_CONCURRENT_KERNEL(int32, int32);
+REGISTER_CONCURRENT_KERNEL(int64_t, double);
+REGISTER_CONCURRENT_KERNEL(int64_t, float);
+REGISTER_CONCURRENT_KERNEL(int64_t, int32);
+REGISTER_CONCURRENT_KERNEL(int64_t, int64_t);
 REGISTER_KERNEL(int64_t, tstring);
 REGISTER_KERNEL(int64_t, Variant);
 REGISTER_KERNEL(tstring, bool);
@@ -1158,6 +1163,8 @@ REGISTER_KERNEL(tstring, float);
 REGISTER_KERNEL(tstring, int32);
 REGISTER_KERNEL(tstring, int64_t);
 
+#undef REGISTER_CONCURRENT_KERNEL
+#undef REGISTER_KERNEL_WITH_TABLE
 #undef REGISTER_KERNEL
 
 // Register the MutableHashTableOfTensors op.
@@ -16,6 +16,13 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_LOOKUP_TABLE_OP_H_
 #define TENSORFLOW_CORE_KERNELS_LOOKUP_TABLE_OP_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/lookup_interface.h"
@@ -30,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/map_util.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/thread_annotations.h"
 
 namespace tensorflow {
@@ -345,6 +353,461 @@ class HashTable : public InitializableLookupTable {
   absl::flat_hash_map<K, V> table_;
 };
 
+// Mutable hash table for integral keys and trivially copyable scalar values
+// that is optimized for read-heavy workloads with concurrent updates, such as
+// embedding id maps that are looked up on every step and grown online.
+//
+// Keys are split over kNumShards shards by hash. Each shard is an open
+// addressing table with linear probing whose slots are guarded by a sequence
+// lock, so lookups never take a lock: a reader retries a slot if a writer
+// modified it concurrently. Writers serialize on a per-shard mutex, so updates
+// to different shards proceed in parallel. When a shard grows it is rebuilt
+// into a new slot array which is published atomically; the old array is freed
+// once every lookup that could still be reading it has finished, which is
+// tracked with epochs (see ReclaimRetiredSlots).
+//
+// Insert, Remove and ImportValues apply their keys shard by shard, so a
+// concurrent Find may observe a batch partially applied. ExportValues returns
+// a consistent snapshot.
+template <class K, class V>
+class ConcurrentMutableHashTable final : public LookupInterface {
+  static_assert(std::is_integral<K>::value, "Integral key type expected.");
+  static_assert(std::is_trivially_copyable<V>::value,
+                "Trivially copyable value type expected.");
+
+ public:
+  static constexpr int kNumShards = 32;
+
+  ConcurrentMutableHashTable(OpKernelContext* ctx, OpKernel* kernel) {
+    for (Shard& shard : shards_) {
+      mutex_lock l(shard.mu);
+      shard.owned = std::make_unique<SlotArray>(kMinShardCapacity);
+      shard.slots.store(shard.owned.get());
+    }
+  }
+
+  size_t size() const override {
+    int64_t size = 0;
+    for (const Shard& shard : shards_) {
+      size += shard.size.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) override {
+    const auto key_values = key.flat<K>();
+    auto value_values = value->flat<V>();
+    const auto default_flat = default_value.flat<V>();
+    const bool is_full_size_default =
+        value_values.size() == default_flat.size();
+
+    ReaderGuard guard(this);
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      const K k = SubtleMustCopyIfIntegral(key_values(i));
+      const uint64_t hash = Hash(k);
+      const SlotArray* slots = shards_[ShardIndex(hash)].slots.load();
+      if (!slots->Find(hash, k, &value_values(i))) {
+        value_values(i) =
+            is_full_size_default ? default_flat(i) : default_flat(0);
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat<V>();
+    std::vector<std::vector<int64_t>> ids = GroupByShard(key_values);
+    for (int s = 0; s < kNumShards; ++s) {
+      if (ids[s].empty()) continue;
+      Shard* shard = &shards_[s];
+      mutex_lock l(shard->mu);
+      Reserve(shard, ids[s].size());
+      for (int64_t i : ids[s]) {
+        InsertLocked(shard, SubtleMustCopyIfIntegral(key_values(i)),
+                     value_values(i));
+      }
+    }
+    ReclaimRetiredSlots();
+    return absl::OkStatus();
+  }
+
+  Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    const auto key_values = keys.flat<K>();
+    std::vector<std::vector<int64_t>> ids = GroupByShard(key_values);
+    for (int s = 0; s < kNumShards; ++s) {
+      if (ids[s].empty()) continue;
+      Shard* shard = &shards_[s];
+      mutex_lock l(shard->mu);
+      for (int64_t i : ids[s]) {
+        RemoveLocked(shard, SubtleMustCopyIfIntegral(key_values(i)));
+      }
+    }
+    ReclaimRetiredSlots();
+    return absl::OkStatus();
+  }
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat<V>();
+    std::vector<std::vector<int64_t>> ids = GroupByShard(key_values);
+    for (int s = 0; s < kNumShards; ++s) {
+      Shard* shard = &shards_[s];
+      // The new contents are built in a fresh array, so lookups see either
+      // the old or the new contents of the shard.
+      mutex_lock l(shard->mu);
+      Rebuild(shard, /*clear=*/true, ids[s].size());
+      for (int64_t i : ids[s]) {
+        InsertLocked(shard, SubtleMustCopyIfIntegral(key_values(i)),
+                     value_values(i));
+      }
+    }
+    ReclaimRetiredSlots();
+    return absl::OkStatus();
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override {
+    std::vector<K> keys;
+    std::vector<V> values;
+    Snapshot(&keys, &values);
+    const int64_t size = keys.size();
+    Tensor* keys_tensor;
+    Tensor* values_tensor;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({size}), &keys_tensor));
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("values", TensorShape({size}), &values_tensor));
+    std::copy(keys.begin(), keys.end(), keys_tensor->flat<K>().data());
+    std::copy(values.begin(), values.end(), values_tensor->flat<V>().data());
+    return absl::OkStatus();
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const final { return TensorShape(); }
+
+  TensorShape value_shape() const override { return TensorShape(); }
+
+  int64_t MemoryUsed() const override {
+    int64_t ret = sizeof(ConcurrentMutableHashTable);
+    for (const Shard& shard : shards_) {
+      mutex_lock l(shard.mu);
+      ret += (shard.owned->mask + 1) * sizeof(Slot);
+    }
+    // Retired arrays are still allocated until the lookups that may read them
+    // have finished.
+    mutex_lock l(retired_mu_);
+    for (const RetiredSlots& retired : retired_) {
+      ret += (retired.slots->mask + 1) * sizeof(Slot);
+    }
+    return ret;
+  }
+
+  Status AsGraphDef(GraphDefBuilder* builder, Node** out) const override {
+    std::vector<K> keys;
+    std::vector<V> values;
+    Snapshot(&keys, &values);
+    const int64_t size = keys.size();
+    Tensor keys_tensor(key_dtype(), TensorShape({size}));
+    Tensor values_tensor(value_dtype(), TensorShape({size}));
+    std::copy(keys.begin(), keys.end(), keys_tensor.flat<K>().data());
+    std::copy(values.begin(), values.end(), values_tensor.flat<V>().data());
+
+    // Serialized like MutableHashTableOfScalars, so that the restored table
+    // is again a MutableHashTableV2.
+    Node* table = ops::SourceOp(
+        "MutableHashTableV2",
+        builder->opts()
+            .WithName(UniqueNodeName("MutableHashTableFromGraphDef"))
+            .WithAttr("use_node_name_sharing", true)
+            .WithAttr("key_dtype", key_dtype())
+            .WithAttr("value_dtype", value_dtype()));
+    Node* keys_node =
+        ops::SourceOp("Const", builder->opts()
+                                   .WithAttr("dtype", key_dtype())
+                                   .WithAttr("value", keys_tensor));
+    Node* values_node =
+        ops::SourceOp("Const", builder->opts()
+                                   .WithAttr("dtype", value_dtype())
+                                   .WithAttr("value", values_tensor));
+    Node* import_table =
+        ops::TernaryOp("LookupTableImportV2", table, keys_node, values_node,
+                       builder->opts()
+                           .WithAttr("Tin", key_dtype())
+                           .WithAttr("Tout", value_dtype()));
+    *out = ops::UnaryOp("Identity", table,
+                        builder->opts().WithControlInput(import_table));
+    return absl::OkStatus();
+  }
+
+ private:
+  static constexpr int kShardBits = 5;
+  static_assert(kNumShards == 1 << kShardBits, "kNumShards mismatch.");
+  static constexpr int64_t kMinShardCapacity = 16;
+
+  enum SlotState : uint8_t { kEmpty = 0, kFull = 1, kDeleted = 2 };
+
+  // A key/value pair guarded by a sequence lock. `sequence` is odd while a
+  // writer is modifying the slot.
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint8_t> state;
+    std::atomic<K> key;
+    std::atomic<V> value;
+
+    // Returns a consistent copy of the slot's state, key and value.
+    void Read(uint8_t* s, K* k, V* v) const {
+      while (true) {
+        const uint32_t before = sequence.load(std::memory_order_acquire);
+        *s = state.load(std::memory_order_relaxed);
+        *k = key.load(std::memory_order_relaxed);
+        *v = value.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((before & 1) == 0 &&
+            sequence.load(std::memory_order_relaxed) == before) {
+          return;
+        }
+      }
+    }
+
+    // Must only be called by the writer that owns the slot's shard.
+    void Write(uint8_t s, K k, V v) {
+      const uint32_t before = sequence.load(std::memory_order_relaxed);
+      sequence.store(before + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      state.store(s, std::memory_order_relaxed);
+      key.store(k, std::memory_order_relaxed);
+      value.store(v, std::memory_order_relaxed);
+      sequence.store(before + 2, std::memory_order_release);
+    }
+  };
+
+  // A power-of-two sized array of slots. At most half of the slots are ever
+  // non-empty, so every probe sequence ends at an empty slot.
+  struct SlotArray {
+    explicit SlotArray(int64_t capacity)
+        : mask(capacity - 1), slots(std::make_unique<Slot[]>(capacity)) {}
+
+    bool Find(uint64_t hash, K k, V* v) const {
+      for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        uint8_t slot_state;
+        K slot_key;
+        V slot_value;
+        slots[i].Read(&slot_state, &slot_key, &slot_value);
+        if (slot_state == kEmpty) return false;
+        if (slot_state == kFull && slot_key == k) {
+          *v = slot_value;
+          return true;
+        }
+      }
+    }
+
+    const uint64_t mask;
+    const std::unique_ptr<Slot[]> slots;
+  };
+
+  struct Shard {
+    mutable mutex mu;
+    // The array lookups read from; always equal to `owned.get()`.
+    std::atomic<SlotArray*> slots{nullptr};
+    std::unique_ptr<SlotArray> owned TF_GUARDED_BY(mu);
+    // Number of full and deleted slots in `owned`.
+    int64_t used TF_GUARDED_BY(mu) = 0;
+    // Number of full slots in `owned`.
+    std::atomic<int64_t> size{0};
+  };
+
+  // Registers a lookup in the current epoch for its duration, so that the
+  // slot arrays it may read are not freed, see ReclaimRetiredSlots.
+  class ReaderGuard {
+   public:
+    explicit ReaderGuard(ConcurrentMutableHashTable* table) : table_(table) {
+      while (true) {
+        epoch_ = table_->epoch_.load();
+        table_->active_readers_[epoch_ & 1].fetch_add(1);
+        // If the epoch advanced meanwhile, the reclaimer may not have seen
+        // this lookup, so register again in the new epoch.
+        if (table_->epoch_.load() == epoch_) return;
+        table_->active_readers_[epoch_ & 1].fetch_sub(1);
+      }
+    }
+    ~ReaderGuard() { table_->active_readers_[epoch_ & 1].fetch_sub(1); }
+
+   private:
+    ConcurrentMutableHashTable* const table_;
+    uint64_t epoch_;
+  };
+
+  // A slot array replaced in `epoch`, which lookups may still be reading.
+  struct RetiredSlots {
+    std::unique_ptr<SlotArray> slots;
+    uint64_t epoch;
+  };
+
+  static uint64_t Hash(K k) {
+    // The splitmix64 finalizer. The top bits select the shard and the bottom
+    // bits the slot, so both need to be well mixed.
+    uint64_t h = static_cast<uint64_t>(k);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+  }
+
+  static int ShardIndex(uint64_t hash) { return hash >> (64 - kShardBits); }
+
+  // Returns the positions of `key_values` owned by each shard, in order.
+  template <typename Keys>
+  static std::vector<std::vector<int64_t>> GroupByShard(
+      const Keys& key_values) {
+    std::vector<std::vector<int64_t>> ids(kNumShards);
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      ids[ShardIndex(Hash(key_values(i)))].push_back(i);
+    }
+    return ids;
+  }
+
+  // Makes room for `num_keys` more keys in the shard.
+  void Reserve(Shard* shard, int64_t num_keys)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    if ((shard->used + num_keys) * 2 > shard->owned->mask + 1) {
+      Rebuild(shard, /*clear=*/false, num_keys);
+    }
+  }
+
+  // Replaces the shard's slot array with one that has room for `num_keys`
+  // more keys, copying the live entries over unless `clear` is true. The old
+  // array is retired, since lookups may still be reading it.
+  void Rebuild(Shard* shard, bool clear, int64_t num_keys)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    const int64_t live = clear ? 0 : shard->size.load();
+    int64_t capacity = kMinShardCapacity;
+    while (capacity < 4 * (live + num_keys)) capacity *= 2;
+    auto rebuilt = std::make_unique<SlotArray>(capacity);
+    if (!clear) {
+      const SlotArray& old = *shard->owned;
+      for (uint64_t i = 0; i <= old.mask; ++i) {
+        if (old.slots[i].state.load(std::memory_order_relaxed) != kFull) {
+          continue;
+        }
+        const K k = old.slots[i].key.load(std::memory_order_relaxed);
+        const uint64_t hash = Hash(k);
+        uint64_t j = hash & rebuilt->mask;
+        while (rebuilt->slots[j].state.load(std::memory_order_relaxed) !=
+               kEmpty) {
+          j = (j + 1) & rebuilt->mask;
+        }
+        rebuilt->slots[j].Write(
+            kFull, k, old.slots[i].value.load(std::memory_order_relaxed));
+      }
+    }
+    shard->used = live;
+    if (clear) shard->size.store(0, std::memory_order_relaxed);
+    shard->slots.store(rebuilt.get());
+    std::unique_ptr<SlotArray> retired = std::move(shard->owned);
+    shard->owned = std::move(rebuilt);
+    // The epoch is read after the new array is published, so lookups that
+    // started in a later epoch can't see the retired one.
+    mutex_lock l(retired_mu_);
+    retired_.push_back({std::move(retired), epoch_.load()});
+  }
+
+  void InsertLocked(Shard* shard, K k, V v)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    SlotArray& slots = *shard->owned;
+    Slot* tombstone = nullptr;
+    for (uint64_t i = Hash(k) & slots.mask;; i = (i + 1) & slots.mask) {
+      Slot& slot = slots.slots[i];
+      const uint8_t state = slot.state.load(std::memory_order_relaxed);
+      if (state == kFull && slot.key.load(std::memory_order_relaxed) == k) {
+        slot.Write(kFull, k, v);
+        return;
+      }
+      if (state == kDeleted && tombstone == nullptr) tombstone = &slot;
+      if (state == kEmpty) {
+        if (tombstone != nullptr) {
+          tombstone->Write(kFull, k, v);
+        } else {
+          slot.Write(kFull, k, v);
+          ++shard->used;
+        }
+        shard->size.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  void RemoveLocked(Shard* shard, K k) TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    SlotArray& slots = *shard->owned;
+    for (uint64_t i = Hash(k) & slots.mask;; i = (i + 1) & slots.mask) {
+      Slot& slot = slots.slots[i];
+      const uint8_t state = slot.state.load(std::memory_order_relaxed);
+      if (state == kEmpty) return;
+      if (state == kFull && slot.key.load(std::memory_order_relaxed) == k) {
+        slot.Write(kDeleted, k, slot.value.load(std::memory_order_relaxed));
+        shard->size.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  // Copies out all entries with every shard locked.
+  void Snapshot(std::vector<K>* keys, std::vector<V>* values) const {
+    std::vector<mutex_lock> locks;
+    locks.reserve(kNumShards);
+    for (const Shard& shard : shards_) locks.emplace_back(shard.mu);
+    keys->reserve(size());
+    values->reserve(size());
+    for (const Shard& shard : shards_) {
+      const SlotArray& slots = *shard.slots.load();
+      for (uint64_t i = 0; i <= slots.mask; ++i) {
+        if (slots.slots[i].state.load(std::memory_order_relaxed) == kFull) {
+          keys->push_back(slots.slots[i].key.load(std::memory_order_relaxed));
+          values->push_back(
+              slots.slots[i].value.load(std::memory_order_relaxed));
+        }
+      }
+    }
+  }
+
+  // Frees the retired slot arrays that no lookup can still be reading.
+  //
+  // Lookups register in the current epoch, counted by the parity of the
+  // epoch. The epoch advances from `e` to `e + 1` once the lookups of epoch
+  // `e - 1` have finished; new lookups register in `e + 1`, so the count of
+  // the other parity drains even under steady read traffic. An array retired
+  // in epoch `r` was replaced before any lookup of a later epoch started, and
+  // every lookup of epoch `r` or earlier has finished once the epoch reaches
+  // `r + 2`, so it can then be freed.
+  void ReclaimRetiredSlots() {
+    mutex_lock l(retired_mu_);
+    if (retired_.empty()) return;
+    for (int i = 0; i < 2; ++i) {
+      const uint64_t epoch = epoch_.load();
+      if (active_readers_[(epoch + 1) & 1].load() != 0) break;
+      epoch_.store(epoch + 1);
+    }
+    const uint64_t epoch = epoch_.load();
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [epoch](const RetiredSlots& retired) {
+                                    return retired.epoch + 2 <= epoch;
+                                  }),
+                   retired_.end());
+  }
+
+  Shard shards_[kNumShards];
+  // Only advanced by ReclaimRetiredSlots, with `retired_mu_` held.
+  std::atomic<uint64_t> epoch_{0};
+  // Number of lookups in flight by the parity of the epoch they started in.
+  std::atomic<int64_t> active_readers_[2] = {};
+  mutable mutex retired_mu_;
+  std::vector<RetiredSlots> retired_ TF_GUARDED_BY(retired_mu_);
+};
+
 }  // namespace lookup
 
 }  // namespace tensorflow
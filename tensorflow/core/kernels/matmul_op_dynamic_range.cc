@@ -0,0 +1,284 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/core/kernels/matmul_op_dynamic_range.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+// The x86 kernels are compiled for their instruction sets with function
+// attributes and picked at runtime, since the default build only targets AVX.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TF_DYNAMIC_RANGE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace tensorflow {
+namespace dynamic_range {
+namespace {
+
+// A tile kernel multiplies up to kTileRows rows of `a` with kTileChannels
+// channels of `b`: each slice of a row is loaded once for both channels, and
+// each slice of a channel once for all the rows.
+constexpr int kTileRows = 4;
+constexpr int kTileChannels = 2;
+
+// Sets sums[r * kTileChannels + j] to the dot product of row `r` of the
+// `kRows` rows of `a` [kRows, k] with channel `j` of {b0, b1}.
+using Int8TileFn = void (*)(const int8_t* a, int64_t k, const int8_t* b0,
+                            const int8_t* b1, int32_t* sums);
+
+template <int kRows>
+void Int8TileGeneric(const int8_t* a, int64_t k, const int8_t* b0,
+                     const int8_t* b1, int32_t* sums) {
+  for (int r = 0; r < kRows; ++r) {
+    sums[r * kTileChannels] = DotProductInt8(a + r * k, b0, k);
+    sums[r * kTileChannels + 1] = DotProductInt8(a + r * k, b1, k);
+  }
+}
+
+#if defined(TF_DYNAMIC_RANGE_X86_KERNELS)
+__attribute__((target("avx2"))) inline int32_t HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// The unsigned-by-signed multiply instructions need one unsigned operand:
+// a * b == |a| * (sign(a) * b), and both factors stay within int8/uint8.
+template <int kRows>
+__attribute__((target("avx2"))) void Int8TileAvx2(const int8_t* a, int64_t k,
+                                                  const int8_t* b0,
+                                                  const int8_t* b1,
+                                                  int32_t* sums) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[kRows][kTileChannels];
+  for (int r = 0; r < kRows; ++r) {
+    acc[r][0] = _mm256_setzero_si256();
+    acc[r][1] = _mm256_setzero_si256();
+  }
+  int64_t i = 0;
+  for (; i + 32 <= k; i += 32) {
+    const __m256i vb0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0 + i));
+    const __m256i vb1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1 + i));
+    for (int r = 0; r < kRows; ++r) {
+      const __m256i va =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + r * k + i));
+      const __m256i abs_a = _mm256_sign_epi8(va, va);
+      // Pairwise products are at most 2 * 127 * 127 and do not saturate int16.
+      const __m256i pairs0 =
+          _mm256_maddubs_epi16(abs_a, _mm256_sign_epi8(vb0, va));
+      const __m256i pairs1 =
+          _mm256_maddubs_epi16(abs_a, _mm256_sign_epi8(vb1, va));
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(pairs0, ones));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(pairs1, ones));
+    }
+  }
+  for (int r = 0; r < kRows; ++r) {
+    sums[r * kTileChannels] = HorizontalSum(acc[r][0]) +
+                              DotProductInt8(a + r * k + i, b0 + i, k - i);
+    sums[r * kTileChannels + 1] = HorizontalSum(acc[r][1]) +
+                                  DotProductInt8(a + r * k + i, b1 + i, k - i);
+  }
+}
+
+// Like Int8TileAvx2, with vpdpbusd accumulating the products in one step.
+template <int kRows>
+__attribute__((target("avx2,avx512f,avx512vl,avx512vnni"))) void
+Int8TileAvx512Vnni(const int8_t* a, int64_t k, const int8_t* b0,
+                   const int8_t* b1, int32_t* sums) {
+  __m256i acc[kRows][kTileChannels];
+  for (int r = 0; r < kRows; ++r) {
+    acc[r][0] = _mm256_setzero_si256();
+    acc[r][1] = _mm256_setzero_si256();
+  }
+  int64_t i = 0;
+  for (; i + 32 <= k; i += 32) {
+    const __m256i vb0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b0 + i));
+    const __m256i vb1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b1 + i));
+    for (int r = 0; r < kRows; ++r) {
+      const __m256i va =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + r * k + i));
+      const __m256i abs_a = _mm256_sign_epi8(va, va);
+      acc[r][0] = _mm256_dpbusd_epi32(acc[r][0], abs_a,
+                                      _mm256_sign_epi8(vb0, va));
+      acc[r][1] = _mm256_dpbusd_epi32(acc[r][1], abs_a,
+                                      _mm256_sign_epi8(vb1, va));
+    }
+  }
+  for (int r = 0; r < kRows; ++r) {
+    sums[r * kTileChannels] = HorizontalSum(acc[r][0]) +
+                              DotProductInt8(a + r * k + i, b0 + i, k - i);
+    sums[r * kTileChannels + 1] = HorizontalSum(acc[r][1]) +
+                                  DotProductInt8(a + r * k + i, b1 + i, k - i);
+  }
+}
+#endif  // TF_DYNAMIC_RANGE_X86_KERNELS
+
+// Returns the tile kernels for 1 to kTileRows rows for the CPU.
+const Int8TileFn* SelectInt8Tiles() {
+#if defined(TF_DYNAMIC_RANGE_X86_KERNELS)
+  static constexpr Int8TileFn kAvx512VnniTiles[kTileRows] = {
+      Int8TileAvx512Vnni<1>, Int8TileAvx512Vnni<2>, Int8TileAvx512Vnni<3>,
+      Int8TileAvx512Vnni<4>};
+  static constexpr Int8TileFn kAvx2Tiles[kTileRows] = {
+      Int8TileAvx2<1>, Int8TileAvx2<2>, Int8TileAvx2<3>, Int8TileAvx2<4>};
+  if (port::TestCPUFeature(port::CPUFeature::AVX512_VNNI) &&
+      port::TestCPUFeature(port::CPUFeature::AVX512VL)) {
+    return kAvx512VnniTiles;
+  }
+  if (port::TestCPUFeature(port::CPUFeature::AVX2)) return kAvx2Tiles;
+#endif
+  static constexpr Int8TileFn kGenericTiles[kTileRows] = {
+      Int8TileGeneric<1>, Int8TileGeneric<2>, Int8TileGeneric<3>,
+      Int8TileGeneric<4>};
+  return kGenericTiles;
+}
+
+}  // namespace
+
+void QuantizedMatMul(const int8_t* a, const float* a_scales, int64_t m,
+                     const int8_t* b, const float* b_scales, int64_t n,
+                     int64_t k, int64_t channel_begin, int64_t channel_end,
+                     float* output) {
+  static const Int8TileFn* const tiles = SelectInt8Tiles();
+  int32_t sums[kTileRows * kTileChannels];
+  for (int64_t block_begin = channel_begin; block_begin < channel_end;
+       block_begin += kChannelBlock) {
+    const int64_t block_end =
+        std::min(channel_end, block_begin + kChannelBlock);
+    for (int64_t row = 0; row < m; row += kTileRows) {
+      const int rows = static_cast<int>(std::min<int64_t>(kTileRows, m - row));
+      for (int64_t c = block_begin; c < block_end; c += kTileChannels) {
+        // A last odd channel is computed twice and stored once.
+        const int channels =
+            static_cast<int>(std::min<int64_t>(kTileChannels, block_end - c));
+        const int8_t* b0 = b + c * k;
+        tiles[rows - 1](a + row * k, k, b0, channels == 2 ? b0 + k : b0, sums);
+        for (int r = 0; r < rows; ++r) {
+          float* out = output + (row + r) * n + c;
+          for (int j = 0; j < channels; ++j) {
+            out[j] = static_cast<float>(sums[r * kTileChannels + j]) *
+                     a_scales[row + r] * b_scales[c + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace dynamic_range
+
+// CPU kernel for _DynamicRangeQuantizedMatMul: quantizes each row of `a` to
+// int8, multiplies it with the per-channel int8 weights in int32 and rescales
+// the result with both scales.
+class DynamicRangeQuantizedMatMulOp : public OpKernel {
+ public:
+  explicit DynamicRangeQuantizedMatMulOp(OpKernelConstruction* context)
+      : OpKernel(context) {}
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& a = context->input(0);
+    const Tensor& weights = context->input(1);
+    const Tensor& weight_scales = context->input(2);
+
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(a.shape()),
+                errors::InvalidArgument("a must be a matrix, got shape ",
+                                        a.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(weights.shape()),
+                errors::InvalidArgument("weights must be a matrix, got shape ",
+                                        weights.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(weight_scales.shape()),
+                errors::InvalidArgument(
+                    "weight_scales must be a vector, got shape ",
+                    weight_scales.shape().DebugString()));
+
+    const int64_t m = a.dim_size(0);
+    const int64_t k = a.dim_size(1);
+    const int64_t n = weights.dim_size(0);
+    OP_REQUIRES(context, weights.dim_size(1) == k,
+                errors::InvalidArgument(
+                    "Matrix size-incompatible: a: ", a.shape().DebugString(),
+                    ", weights: ", weights.shape().DebugString()));
+    OP_REQUIRES(context, weight_scales.dim_size(0) == n,
+                errors::InvalidArgument(
+                    "weight_scales must have one entry per output channel: ",
+                    weight_scales.shape().DebugString(), " vs. ", n,
+                    " channels"));
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(0, TensorShape({m, n}), &output));
+    if (output->NumElements() == 0) return;
+
+    Tensor quantized_a;
+    OP_REQUIRES_OK(context, context->allocate_temp(DT_INT8, a.shape(),
+                                                   &quantized_a));
+    Tensor a_scales;
+    OP_REQUIRES_OK(context, context->allocate_temp(DT_FLOAT, TensorShape({m}),
+                                                   &a_scales));
+
+    const float* a_data = a.flat<float>().data();
+    int8_t* quantized_a_data = quantized_a.flat<int8>().data();
+    float* a_scales_data = a_scales.flat<float>().data();
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    Shard(worker_threads.num_threads, worker_threads.workers, m, 3 * k,
+          [&](int64_t start, int64_t limit) {
+            dynamic_range::QuantizeRowsSymmetric(
+                a_data + start * k, limit - start, k,
+                quantized_a_data + start * k, a_scales_data + start);
+          });
+
+    const int8_t* weights_data = weights.flat<int8>().data();
+    const float* weight_scales_data = weight_scales.flat<float>().data();
+    float* output_data = output->flat<float>().data();
+    const int64_t num_blocks =
+        (n + dynamic_range::kChannelBlock - 1) / dynamic_range::kChannelBlock;
+    Shard(worker_threads.num_threads, worker_threads.workers, num_blocks,
+          m * k * dynamic_range::kChannelBlock,
+          [&](int64_t start, int64_t limit) {
+            dynamic_range::QuantizedMatMul(
+                quantized_a_data, a_scales_data, m, weights_data,
+                weight_scales_data, n, k,
+                start * dynamic_range::kChannelBlock,
+                std::min(n, limit * dynamic_range::kChannelBlock),
+                output_data);
+          });
+  }
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("_DynamicRangeQuantizedMatMul").Device(DEVICE_CPU),
+    DynamicRangeQuantizedMatMulOp);
+
+}  // namespace tensorflow
@@ -0,0 +1,100 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_MATMUL_OP_DYNAMIC_RANGE_H_
+#define TENSORFLOW_CORE_KERNELS_MATMUL_OP_DYNAMIC_RANGE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__ARM_FEATURE_DOTPROD)
+#include <arm_neon.h>
+#endif
+
+namespace tensorflow {
+namespace dynamic_range {
+
+// Quantized values are restricted to [-127, 127] so that negating a value
+// never overflows. The x86 kernels of QuantizedMatMul rely on this.
+inline constexpr int kMaxQuantizedValue = 127;
+
+// Quantizes `rows` rows of `cols` floats symmetrically to int8 with one scale
+// per row, so that input[r, c] ~= output[r, c] * scales[r]. All-zero rows get
+// a scale of zero.
+inline void QuantizeRowsSymmetric(const float* input, int64_t rows,
+                                  int64_t cols, int8_t* output,
+                                  float* scales) {
+  for (int64_t r = 0; r < rows; ++r) {
+    const float* in_row = input + r * cols;
+    int8_t* out_row = output + r * cols;
+    float max_abs = 0.0f;
+    for (int64_t c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs, std::abs(in_row[c]));
+    }
+    if (max_abs == 0.0f) {
+      std::fill(out_row, out_row + cols, 0);
+      scales[r] = 0.0f;
+      continue;
+    }
+    const float scale = max_abs / kMaxQuantizedValue;
+    const float inverse_scale = kMaxQuantizedValue / max_abs;
+    for (int64_t c = 0; c < cols; ++c) {
+      const float q = std::round(in_row[c] * inverse_scale);
+      out_row[c] = static_cast<int8_t>(std::min<float>(
+          kMaxQuantizedValue, std::max<float>(-kMaxQuantizedValue, q)));
+    }
+    scales[r] = scale;
+  }
+}
+
+// Returns sum(a[i] * b[i]) for int8 values, accumulated in int32. Uses the ARM
+// dot-product extension when the build targets it.
+inline int32_t DotProductInt8(const int8_t* a, const int8_t* b, int64_t size) {
+  int64_t i = 0;
+  int32_t result = 0;
+#if defined(__ARM_FEATURE_DOTPROD)
+  int32x4_t acc = vdupq_n_s32(0);
+  for (; i + 16 <= size; i += 16) {
+    acc = vdotq_s32(acc, vld1q_s8(a + i), vld1q_s8(b + i));
+  }
+  result = vaddvq_s32(acc);
+#endif
+  for (; i < size; ++i) {
+    result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+  }
+  return result;
+}
+
+// Number of output channels computed together, so that a block of weight rows
+// stays in cache while all quantized rows of `a` stream past it.
+inline constexpr int64_t kChannelBlock = 16;
+
+// Computes output[r, c] = a_scales[r] * b_scales[c] * sum_i(a[r, i] * b[c, i])
+// for the `m` rows of `a` [m, k] and the channels [channel_begin, channel_end)
+// of `b` [n, k], into `output` [m, n]. The int8 values must be in
+// [-127, 127]. The channels are processed by blocks of kChannelBlock, and the
+// products are accumulated in int32 a tile of rows and channels at a time,
+// with an AVX-512 VNNI or AVX2 kernel when the CPU supports it, whatever the
+// build targets.
+void QuantizedMatMul(const int8_t* a, const float* a_scales, int64_t m,
+                     const int8_t* b, const float* b_scales, int64_t n,
+                     int64_t k, int64_t channel_begin, int64_t channel_end,
+                     float* output);
+
+}  // namespace dynamic_range
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_MATMUL_OP_DYNAMIC_RANGE_H_
@@ -0,0 +1,221 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/matmul_op_dynamic_range.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Quantizes float weights [k, n] the same way the remapper does: transposed to
+// [n, k] with one symmetric scale per output channel.
+void QuantizeWeights(const Tensor& weights, Tensor* quantized,
+                     Tensor* scales) {
+  const int64_t k = weights.dim_size(0);
+  const int64_t n = weights.dim_size(1);
+  Tensor transposed(DT_FLOAT, TensorShape({n, k}));
+  auto w = weights.matrix<float>();
+  auto t = transposed.matrix<float>();
+  for (int64_t i = 0; i < k; ++i) {
+    for (int64_t j = 0; j < n; ++j) t(j, i) = w(i, j);
+  }
+  *quantized = Tensor(DT_INT8, TensorShape({n, k}));
+  *scales = Tensor(DT_FLOAT, TensorShape({n}));
+  dynamic_range::QuantizeRowsSymmetric(
+      transposed.flat<float>().data(), n, k, quantized->flat<int8>().data(),
+      scales->flat<float>().data());
+}
+
+Tensor RandomTensor(const TensorShape& shape, float stddev) {
+  static std::mt19937 rng(/*seed=*/1234);
+  std::normal_distribution<float> dist(0.0f, stddev);
+  Tensor t(DT_FLOAT, shape);
+  for (int64_t i = 0; i < t.NumElements(); ++i) t.flat<float>()(i) = dist(rng);
+  return t;
+}
+
+class DynamicRangeQuantizedMatMulOpTest : public OpsTestBase {
+ protected:
+  void MakeOp() {
+    TF_ASSERT_OK(NodeDefBuilder("matmul", "_DynamicRangeQuantizedMatMul")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT8))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Checks the quantized product against the float product. The error bound
+  // is relative to the largest output magnitude: per-row and per-channel int8
+  // quantization keep the relative error at around 1%.
+  void RunAccuracyTest(int64_t m, int64_t k, int64_t n) {
+    Tensor a = RandomTensor(TensorShape({m, k}), 1.0f);
+    Tensor b = RandomTensor(TensorShape({k, n}), 0.1f);
+    Tensor quantized, scales;
+    QuantizeWeights(b, &quantized, &scales);
+
+    MakeOp();
+    AddInputFromArray<float>(a.shape(), a.flat<float>());
+    AddInputFromArray<int8>(quantized.shape(), quantized.flat<int8>());
+    AddInputFromArray<float>(scales.shape(), scales.flat<float>());
+    TF_ASSERT_OK(RunOpKernel());
+    const Tensor& output = *GetOutput(0);
+    ASSERT_EQ(output.shape(), TensorShape({m, n}));
+
+    auto a_mat = a.matrix<float>();
+    auto b_mat = b.matrix<float>();
+    auto out = output.matrix<float>();
+    float max_abs = 0.0f;
+    float max_error = 0.0f;
+    for (int64_t i = 0; i < m; ++i) {
+      for (int64_t j = 0; j < n; ++j) {
+        float expected = 0.0f;
+        for (int64_t l = 0; l < k; ++l) expected += a_mat(i, l) * b_mat(l, j);
+        max_abs = std::max(max_abs, std::abs(expected));
+        max_error = std::max(max_error, std::abs(expected - out(i, j)));
+      }
+    }
+    EXPECT_LE(max_error, 0.02f * max_abs)
+        << "m=" << m << " k=" << k << " n=" << n;
+  }
+};
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, SingleRow) {
+  RunAccuracyTest(1, 256, 64);
+}
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, Batch) {
+  RunAccuracyTest(32, 512, 40);
+}
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, UnalignedDepth) {
+  RunAccuracyTest(5, 37, 19);
+}
+
+// Rows and channels that do not fill the last tile and channel block.
+TEST_F(DynamicRangeQuantizedMatMulOpTest, PartialTiles) {
+  RunAccuracyTest(7, 100, 35);
+}
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, ZeroRow) {
+  MakeOp();
+  AddInputFromArray<float>(TensorShape({2, 3}), {0, 0, 0, 1, -2, 0.5});
+  AddInputFromArray<int8>(TensorShape({2, 3}), {127, 0, -127, 64, 64, 64});
+  AddInputFromArray<float>(TensorShape({2}), {0.01, 0.5});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Row 1 quantizes to {64, -127, 32} with scale 2 / 127.
+  Tensor expected(DT_FLOAT, TensorShape({2, 2}));
+  const float a_scale = 2.0f / 127;
+  test::FillValues<float>(
+      &expected, {0, 0, (64 * 127 - 32 * 127) * a_scale * 0.01f,
+                  (64 - 127 + 32) * 64 * a_scale * 0.5f});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, MismatchedDepth) {
+  MakeOp();
+  AddInputFromArray<float>(TensorShape({1, 4}), {1, 2, 3, 4});
+  AddInputFromArray<int8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<float>(TensorShape({2}), {1, 1});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "Matrix size-incompatible"))
+      << s;
+}
+
+TEST_F(DynamicRangeQuantizedMatMulOpTest, MismatchedScales) {
+  MakeOp();
+  AddInputFromArray<float>(TensorShape({1, 3}), {1, 2, 3});
+  AddInputFromArray<int8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<float>(TensorShape({3}), {1, 1, 1});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "one entry per output channel"))
+      << s;
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+// Float MatMul with constant weights, the baseline for the quantized op.
+static Graph* FloatMatMul(int m, int k, int n) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor a = RandomTensor(TensorShape({m, k}), 1.0f);
+  Tensor b = RandomTensor(TensorShape({k, n}), 0.1f);
+  test::graph::Matmul(g, test::graph::Constant(g, a),
+                      test::graph::Constant(g, b), false, false);
+  return g;
+}
+
+static Graph* DynamicRangeQuantizedMatMul(int m, int k, int n) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor a = RandomTensor(TensorShape({m, k}), 1.0f);
+  Tensor b = RandomTensor(TensorShape({k, n}), 0.1f);
+  Tensor quantized, scales;
+  QuantizeWeights(b, &quantized, &scales);
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_DynamicRangeQuantizedMatMul")
+                  .Input(test::graph::Constant(g, a))
+                  .Input(test::graph::Constant(g, quantized))
+                  .Input(test::graph::Constant(g, scales))
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+#define BM_DynamicRangeMatMul(M, K, N)                                    \
+  static void BM_FloatMatMul_##M##_##K##_##N(                             \
+      ::testing::benchmark::State& state) {                               \
+    test::Benchmark("cpu", FloatMatMul(M, K, N),                          \
+                    /*old_benchmark_api*/ false)                          \
+        .Run(state);                                                      \
+    state.SetItemsProcessed(state.iterations() * M * K * N * 2);          \
+  }                                                                       \
+  BENCHMARK(BM_FloatMatMul_##M##_##K##_##N)->MeasureProcessCPUTime();     \
+  static void BM_DynamicRangeQuantizedMatMul_##M##_##K##_##N(             \
+      ::testing::benchmark::State& state) {                               \
+    test::Benchmark("cpu", DynamicRangeQuantizedMatMul(M, K, N),          \
+                    /*old_benchmark_api*/ false)                          \
+        .Run(state);                                                      \
+    state.SetItemsProcessed(state.iterations() * M * K * N * 2);          \
+  }                                                                       \
+  BENCHMARK(BM_DynamicRangeQuantizedMatMul_##M##_##K##_##N)               \
+      ->MeasureProcessCPUTime();
+
+BM_DynamicRangeMatMul(1, 512, 512);
+BM_DynamicRangeMatMul(8, 512, 512);
+BM_DynamicRangeMatMul(32, 512, 512);
+BM_DynamicRangeMatMul(1, 1024, 1024);
+BM_DynamicRangeMatMul(8, 1024, 1024);
+BM_DynamicRangeMatMul(32, 1024, 1024);
+BM_DynamicRangeMatMul(128, 1024, 1024);
+BM_DynamicRangeMatMul(1, 4096, 1024);
+BM_DynamicRangeMatMul(16, 4096, 1024);
+
+}  // namespace
+}  // namespace tensorflow
@@ -23,6 +23,7 @@ limitations under the License.
 #include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -37,10 +38,12 @@ limitations under the License.
 #include "tensorflow/core/framework/type_traits.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/fill_functor.h"
+#include "tensorflow/core/kernels/matmul_op_prepacked.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/platform/bfloat16.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/matmul_autotune.h"
 #include "tensorflow/core/util/matmul_bcast.h"
@@ -908,6 +911,10 @@ class BaseBatchMatMulOp : public OpKernel {
       OP_REQUIRES_OK(context, context->GetAttr("grad_x", &grad_input_1_));
       OP_REQUIRES_OK(context, context->GetAttr("grad_y", &grad_input_2_));
     }
+    if (context->HasAttr(kPrepackRhsAttr)) {
+      OP_REQUIRES_OK(context,
+                     context->GetAttr(kPrepackRhsAttr, &prepack_rhs_));
+    }
   }
 
   ~BaseBatchMatMulOp() override {}
@@ -979,6 +986,15 @@ class BaseBatchMatMulOp : public OpKernel {
                     in1_reshaped.data() != nullptr &&
                     out_reshaped.data() != nullptr,
                 absl::InternalError("Null data pointer encountered."));
+    if constexpr (std::is_same_v<Device, CPUDevice> &&
+                  std::is_same_v<Ta, float> && std::is_same_v<Tb, float> &&
+                  std::is_same_v<Tout, float>) {
+      if (prepack_rhs_ &&
+          TryPrepackedMatMul(ctx, in0_reshaped, in1_reshaped, bcast,
+                             &out_reshaped)) {
+        return;
+      }
+    }
     if constexpr (std::is_same_v<Device, CPUDevice> && std::is_same_v<Ta, Tb> &&
                   (std::is_same_v<Ta, bfloat16> ||
                    std::is_same_v<Ta, Eigen::half>)) {
@@ -1032,6 +1048,57 @@ class BaseBatchMatMulOp : public OpKernel {
   bool grad_input_1_ = false;
   bool grad_input_2_ = false;
 
+  // Set by the remapper when In[1] is a constant. The packed copy is keyed on
+  // the buffer and geometry of In[1], which are fixed for a Const. The buffer
+  // it was packed from is held by `packed_rhs_source_`, so that its address
+  // can't be reused by another tensor while the packed copy is cached.
+  bool prepack_rhs_ = false;
+  mutex prepack_mu_;
+  std::shared_ptr<const PrepackedMatMulRhs> packed_rhs_
+      TF_GUARDED_BY(prepack_mu_);
+  Tensor packed_rhs_source_ TF_GUARDED_BY(prepack_mu_);
+
+  // Multiplies by the cached packed copy of the constant In[1], packing it on
+  // first use. Returns false if the shapes are not eligible (broadcast or
+  // transposed In[0], or too many rows for packing to matter), in which case
+  // the caller falls back to the regular Eigen path.
+  bool TryPrepackedMatMul(OpKernelContext* ctx, const Tensor& in_x,
+                          const Tensor& in_y, const MatMulBCast& bcast,
+                          Tensor* out) {
+    if (adj_x_ || trans_x_ || bcast.y_batch_size() != 1) return false;
+    // With a single In[1] matrix, the In[0] batches fold into the rows of one
+    // [rows, k] x [k, n] product.
+    const int64_t rows = out->dim_size(0) * out->dim_size(1);
+    if (rows > kMaxPrepackedMatMulRows) return false;
+
+    const bool transpose = adj_y_ || trans_y_;
+    const int64_t k = in_y.dim_size(transpose ? 2 : 1);
+    const int64_t n = in_y.dim_size(transpose ? 1 : 2);
+    const float* rhs = in_y.flat<float>().data();
+    std::shared_ptr<const PrepackedMatMulRhs> packed;
+    {
+      mutex_lock l(prepack_mu_);
+      if (packed_rhs_ == nullptr ||
+          !packed_rhs_source_.SharesBufferWith(in_y) ||
+          !packed_rhs_->IsPackedFrom(rhs, k, n, transpose)) {
+        packed_rhs_ =
+            std::make_shared<const PrepackedMatMulRhs>(rhs, k, n, transpose);
+        packed_rhs_source_ = in_y;
+      }
+      packed = packed_rhs_;
+    }
+
+    const float* lhs = in_x.flat<float>().data();
+    float* dst = out->flat<float>().data();
+    auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          packed->num_panels(), rows * k * PrepackedMatMulRhs::kPanelWidth,
+          [&packed, lhs, rows, dst](int64_t start, int64_t limit) {
+            packed->Multiply(lhs, rows, dst, start, limit);
+          });
+    return true;
+  }
+
   // Cast `t` from `SrcT` to `DstT`.
   template <typename SrcT, typename DstT>
   Tensor CastTensor(const Tensor& t) {
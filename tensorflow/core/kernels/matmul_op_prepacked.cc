@@ -0,0 +1,136 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/matmul_op_prepacked.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace tensorflow {
+
+namespace {
+
+using Packet = PrepackedMatMulRhs::Packet;
+constexpr int kPacketSize = PrepackedMatMulRhs::kPacketSize;
+constexpr int kPanelWidth = PrepackedMatMulRhs::kPanelWidth;
+constexpr int kRowBlock = PrepackedMatMulRhs::kRowBlock;
+
+// Computes a [rows, kPanelWidth] block of the output from `rows` consecutive
+// rows of the left-hand side and one packed panel. `rows` is at most
+// kRowBlock; the accumulators live in registers for the whole k loop.
+template <int kRows>
+void PanelMicroKernel(const float* lhs, int64_t lhs_stride, const float* panel,
+                      int64_t k, float* out, int64_t out_stride,
+                      int64_t out_cols) {
+  using Eigen::internal::pload;
+  using Eigen::internal::pmadd;
+  using Eigen::internal::pset1;
+  using Eigen::internal::pstoreu;
+
+  Packet acc0[kRows];
+  Packet acc1[kRows];
+  for (int r = 0; r < kRows; ++r) {
+    acc0[r] = pset1<Packet>(0.0f);
+    acc1[r] = pset1<Packet>(0.0f);
+  }
+  for (int64_t kk = 0; kk < k; ++kk) {
+    const Packet b0 = pload<Packet>(panel + kk * kPanelWidth);
+    const Packet b1 = pload<Packet>(panel + kk * kPanelWidth + kPacketSize);
+    for (int r = 0; r < kRows; ++r) {
+      const Packet a = pset1<Packet>(lhs[r * lhs_stride + kk]);
+      acc0[r] = pmadd(a, b0, acc0[r]);
+      acc1[r] = pmadd(a, b1, acc1[r]);
+    }
+  }
+
+  if (out_cols == kPanelWidth) {
+    for (int r = 0; r < kRows; ++r) {
+      pstoreu(out + r * out_stride, acc0[r]);
+      pstoreu(out + r * out_stride + kPacketSize, acc1[r]);
+    }
+  } else {
+    // Tail panel: only the first `out_cols` columns are valid.
+    EIGEN_ALIGN_MAX float tmp[kPanelWidth];
+    for (int r = 0; r < kRows; ++r) {
+      pstoreu(tmp, acc0[r]);
+      pstoreu(tmp + kPacketSize, acc1[r]);
+      std::memcpy(out + r * out_stride, tmp, out_cols * sizeof(float));
+    }
+  }
+}
+
+}  // namespace
+
+PrepackedMatMulRhs::PrepackedMatMulRhs(const float* rhs, int64_t k, int64_t n,
+                                       bool transpose)
+    : source_(rhs),
+      k_(k),
+      n_(n),
+      transpose_(transpose),
+      num_panels_((n + kPanelWidth - 1) / kPanelWidth),
+      packed_(num_panels_ * k * kPanelWidth, 0.0f) {
+  for (int64_t p = 0; p < num_panels_; ++p) {
+    float* panel = packed_.data() + p * k * kPanelWidth;
+    const int64_t col_begin = p * kPanelWidth;
+    const int64_t cols = std::min<int64_t>(kPanelWidth, n - col_begin);
+    if (!transpose) {
+      for (int64_t kk = 0; kk < k; ++kk) {
+        std::memcpy(panel + kk * kPanelWidth, rhs + kk * n + col_begin,
+                    cols * sizeof(float));
+      }
+    } else {
+      for (int64_t c = 0; c < cols; ++c) {
+        const float* src = rhs + (col_begin + c) * k;
+        for (int64_t kk = 0; kk < k; ++kk) {
+          panel[kk * kPanelWidth + c] = src[kk];
+        }
+      }
+    }
+  }
+}
+
+void PrepackedMatMulRhs::Multiply(const float* lhs, int64_t m, float* out,
+                                  int64_t panel_begin,
+                                  int64_t panel_end) const {
+  for (int64_t p = panel_begin; p < panel_end; ++p) {
+    const float* panel = packed_.data() + p * k_ * kPanelWidth;
+    const int64_t col_begin = p * kPanelWidth;
+    const int64_t cols = std::min<int64_t>(kPanelWidth, n_ - col_begin);
+    int64_t row = 0;
+    for (; row + kRowBlock <= m; row += kRowBlock) {
+      PanelMicroKernel<kRowBlock>(lhs + row * k_, k_, panel, k_,
+                                  out + row * n_ + col_begin, n_, cols);
+    }
+    switch (m - row) {
+      case 3:
+        PanelMicroKernel<3>(lhs + row * k_, k_, panel, k_,
+                            out + row * n_ + col_begin, n_, cols);
+        break;
+      case 2:
+        PanelMicroKernel<2>(lhs + row * k_, k_, panel, k_,
+                            out + row * n_ + col_begin, n_, cols);
+        break;
+      case 1:
+        PanelMicroKernel<1>(lhs + row * k_, k_, panel, k_,
+                            out + row * n_ + col_begin, n_, cols);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+}  // namespace tensorflow
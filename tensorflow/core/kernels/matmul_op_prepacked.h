@@ -0,0 +1,82 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_MATMUL_OP_PREPACKED_H_
+#define TENSORFLOW_CORE_KERNELS_MATMUL_OP_PREPACKED_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+
+namespace tensorflow {
+
+// Internal attribute set by the grappler remapper on MatMul, BatchMatMul and
+// BatchMatMulV2 nodes whose right-hand side is a constant. The CPU kernel then
+// packs the weights once and reuses the packed buffer on every step.
+inline constexpr char kPrepackRhsAttr[] = "_prepack_rhs";
+
+// Row counts (after folding the batch dimensions of the left-hand side) above
+// which Eigen's own packing is amortized and the prepacked path is not used.
+inline constexpr int64_t kMaxPrepackedMatMulRows = 64;
+
+// Right-hand side of a float matrix product, stored as column panels of
+// `kPanelWidth` columns. Within a panel the k rows are contiguous, so the
+// micro-kernel streams a single panel with unit stride regardless of the
+// original layout. The last panel is zero-padded.
+//
+// Instances are immutable after construction and may be shared between
+// concurrent Compute() calls.
+class PrepackedMatMulRhs {
+ public:
+  using Packet = Eigen::internal::packet_traits<float>::type;
+  static constexpr int kPacketSize =
+      Eigen::internal::unpacket_traits<Packet>::size;
+  static constexpr int kPanelWidth = 2 * kPacketSize;
+  static constexpr int kRowBlock = 4;
+
+  // Packs `rhs`, a row-major [k, n] matrix, or a row-major [n, k] matrix if
+  // `transpose` is true.
+  PrepackedMatMulRhs(const float* rhs, int64_t k, int64_t n, bool transpose);
+
+  // Returns true if this was packed from the given buffer and geometry. The
+  // caller must keep the source buffer alive while it relies on this, since a
+  // freed buffer's address may be reused by other data.
+  bool IsPackedFrom(const float* rhs, int64_t k, int64_t n,
+                    bool transpose) const {
+    return rhs == source_ && k == k_ && n == n_ && transpose == transpose_;
+  }
+
+  int64_t k() const { return k_; }
+  int64_t n() const { return n_; }
+  int64_t num_panels() const { return num_panels_; }
+
+  // Computes columns of panels [panel_begin, panel_end) of
+  // out[m, n] = lhs[m, k] * rhs, where `lhs` and `out` are row-major.
+  void Multiply(const float* lhs, int64_t m, float* out, int64_t panel_begin,
+                int64_t panel_end) const;
+
+ private:
+  const float* const source_;
+  const int64_t k_;
+  const int64_t n_;
+  const bool transpose_;
+  const int64_t num_panels_;
+  std::vector<float, Eigen::aligned_allocator<float>> packed_;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_MATMUL_OP_PREPACKED_H_
@@ -21,9 +21,13 @@ limitations under the License.
 #include "tensorflow/cc/ops/nn_ops_internal.h"
 #include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/ops_util.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/kernels/matmul_op_prepacked.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
@@ -420,6 +424,107 @@ using FusedBiasAddDataTypes = ::testing::Types<float, Eigen::half>;
 INSTANTIATE_TYPED_TEST_SUITE_P(Test, FusedMatMulWithBiasOpTest,
                                FusedBiasAddDataTypes);
 
+// Tests the CPU path that multiplies by a cached packed copy of a constant
+// right-hand side (see matmul_op_prepacked.h).
+class PrepackedMatMulOpTest : public OpsTestBase {
+ protected:
+  void RunTest(const string& op, const TensorShape& x_shape,
+               const TensorShape& y_shape, bool transpose_y) {
+    Tensor x(DT_FLOAT, x_shape);
+    x.flat<float>().setRandom();
+    Tensor y(DT_FLOAT, y_shape);
+    y.flat<float>().setRandom();
+
+    NodeDefBuilder builder("matmul", op);
+    builder.Input(FakeInput(DT_FLOAT)).Input(FakeInput(DT_FLOAT));
+    builder.Attr(op == "MatMul" ? "transpose_b" : "adj_y", transpose_y);
+    builder.Attr(kPrepackRhsAttr, true);
+    TF_ASSERT_OK(builder.Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<float>(x.shape(), x.flat<float>());
+    AddInputFromArray<float>(y.shape(), y.flat<float>());
+
+    // Reference product with In[0] batches folded into rows.
+    const int64_t k = x_shape.dim_size(x_shape.dims() - 1);
+    const int64_t rows = x.NumElements() / k;
+    const int64_t n = y_shape.dim_size(transpose_y ? y_shape.dims() - 2
+                                                   : y_shape.dims() - 1);
+    TensorShape out_shape = x_shape;
+    out_shape.set_dim(out_shape.dims() - 1, n);
+    Tensor expected(DT_FLOAT, out_shape);
+    const float* x_data = x.flat<float>().data();
+    const float* y_data = y.flat<float>().data();
+    float* expected_data = expected.flat<float>().data();
+    for (int64_t i = 0; i < rows; ++i) {
+      for (int64_t j = 0; j < n; ++j) {
+        float sum = 0.0f;
+        for (int64_t l = 0; l < k; ++l) {
+          sum += x_data[i * k + l] *
+                 (transpose_y ? y_data[j * k + l] : y_data[l * n + j]);
+        }
+        expected_data[i * n + j] = sum;
+      }
+    }
+
+    // The second run multiplies by the weights packed during the first one.
+    for (int step = 0; step < 2; ++step) {
+      TF_ASSERT_OK(RunOpKernel());
+      test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-4,
+                        /*rtol=*/1e-4);
+    }
+  }
+};
+
+TEST_F(PrepackedMatMulOpTest, MatMulSingleRow) {
+  RunTest("MatMul", TensorShape({1, 64}), TensorShape({64, 40}), false);
+}
+
+TEST_F(PrepackedMatMulOpTest, MatMulRowTail) {
+  RunTest("MatMul", TensorShape({7, 33}), TensorShape({33, 19}), false);
+}
+
+TEST_F(PrepackedMatMulOpTest, MatMulTransposeB) {
+  RunTest("MatMul", TensorShape({16, 48}), TensorShape({23, 48}), true);
+}
+
+TEST_F(PrepackedMatMulOpTest, BatchMatMulV2BroadcastRhs) {
+  RunTest("BatchMatMulV2", TensorShape({3, 5, 24}), TensorShape({1, 24, 17}),
+          false);
+}
+
+TEST_F(PrepackedMatMulOpTest, BatchMatMulV2AdjointRhs) {
+  RunTest("BatchMatMulV2", TensorShape({2, 4, 24}), TensorShape({17, 24}),
+          true);
+}
+
+TEST_F(PrepackedMatMulOpTest, FallsBackForLargeBatch) {
+  RunTest("MatMul", TensorShape({kMaxPrepackedMatMulRows + 1, 16}),
+          TensorShape({16, 16}), false);
+}
+
+TEST_F(PrepackedMatMulOpTest, RepacksForNewRhsBuffer) {
+  TF_ASSERT_OK(NodeDefBuilder("matmul", "MatMul")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr(kPrepackRhsAttr, true)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<float>(TensorShape({1, 2}), {1, 2});
+  AddInputFromArray<float>(TensorShape({2, 2}), {1, 0, 0, 1});
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<float>(*GetOutput(0),
+                                 test::AsTensor<float>({1, 2}, {1, 2}));
+
+  // In[1] with the same shape in another buffer is packed again.
+  Tensor* y = new Tensor(DT_FLOAT, TensorShape({2, 2}));
+  test::FillValues<float>(y, {0, 1, 1, 0});
+  tensors_.push_back(y);
+  inputs_[1] = TensorValue(y);
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<float>(*GetOutput(0),
+                                 test::AsTensor<float>({2, 1}, {1, 2}));
+}
+
 //----------------------------------------------------------------------------//
 // Performance benchmarks are below.                                          //
 //----------------------------------------------------------------------------//
@@ -545,6 +650,61 @@ BM_Matmul(2000, 1, 2000, true, true);
 
 // LINT.ThenChange(//tensorflow/core/kernels/mkl/mkl_matmul_op_benchmark.cc)
 
+// Benchmarks for MatMul with constant weights prepacked by the kernel, the
+// serving case the remapper marks with `_prepack_rhs`. Compare against the
+// BM_Matmul results with the same shapes.
+static Graph* PrepackedMatmul(int m, int k, int n, bool transpose_b) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor in0(DT_FLOAT, TensorShape({m, k}));
+  in0.flat<float>().setRandom();
+  Tensor in1(DT_FLOAT, transpose_b ? TensorShape({n, k}) : TensorShape({k, n}));
+  in1.flat<float>().setRandom();
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "MatMul")
+                  .Input(test::graph::Constant(g, in0))
+                  .Input(test::graph::Constant(g, in1))
+                  .Attr("transpose_a", false)
+                  .Attr("transpose_b", transpose_b)
+                  .Attr(kPrepackRhsAttr, true)
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+#define BM_PrepackedMatmul(M, K, N, TB)                                  \
+  static void BM_PrepackedMatmul##_##M##_##K##_##N##_##TB(               \
+      ::testing::benchmark::State& state) {                              \
+    test::Benchmark("cpu", PrepackedMatmul(M, K, N, TB),                 \
+                    /*old_benchmark_api*/ false)                         \
+        .Run(state);                                                     \
+    state.SetItemsProcessed(state.iterations() * M * K * N * 2);         \
+  }                                                                      \
+  BENCHMARK(BM_PrepackedMatmul##_##M##_##K##_##N##_##TB)                 \
+      ->MeasureProcessCPUTime();
+
+BM_Matmul(2, 512, 512, false, false);
+BM_Matmul(4, 512, 512, false, false);
+BM_Matmul(32, 512, 512, false, false);
+BM_Matmul(2, 1024, 1024, false, false);
+BM_Matmul(4, 1024, 1024, false, false);
+BM_Matmul(32, 1024, 1024, false, false);
+BM_Matmul(32, 1024, 1024, false, true);
+
+BM_PrepackedMatmul(1, 512, 512, false);
+BM_PrepackedMatmul(2, 512, 512, false);
+BM_PrepackedMatmul(4, 512, 512, false);
+BM_PrepackedMatmul(8, 512, 512, false);
+BM_PrepackedMatmul(16, 512, 512, false);
+BM_PrepackedMatmul(32, 512, 512, false);
+BM_PrepackedMatmul(1, 1024, 1024, false);
+BM_PrepackedMatmul(2, 1024, 1024, false);
+BM_PrepackedMatmul(4, 1024, 1024, false);
+BM_PrepackedMatmul(8, 1024, 1024, false);
+BM_PrepackedMatmul(16, 1024, 1024, false);
+BM_PrepackedMatmul(32, 1024, 1024, false);
+BM_PrepackedMatmul(1, 1024, 1024, true);
+BM_PrepackedMatmul(8, 1024, 1024, true);
+BM_PrepackedMatmul(16, 1024, 1024, true);
+BM_PrepackedMatmul(32, 1024, 1024, true);
+
 // Benchmarks for batched matmul with broadcasting.
 Node* BroadcastTo(Graph* g, Node* input, Node* shape) {
   Node* ret;
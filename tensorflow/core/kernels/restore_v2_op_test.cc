@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 
 #include <complex>
+#include <cstdlib>
 #include <functional>
 #include <memory>
 #include <string>
@@ -352,6 +353,12 @@ class RestoreV2OpTest : public OpsTestBase {
 
 // The intended use case (write in V2, read in V2).
 TEST_F(RestoreV2OpTest, RestoreAfterSaveV2) { RunTest("SaveV2"); }
+// SaveV2 writes the tensors to several data files in parallel.
+TEST_F(RestoreV2OpTest, RestoreAfterSaveV2WithMultipleDataFiles) {
+  setenv("TF_CHECKPOINT_NUM_DATA_FILES", "4", /*overwrite=*/1);
+  RunTest("SaveV2");
+  unsetenv("TF_CHECKPOINT_NUM_DATA_FILES");
+}
 // For backward compatibility.
 TEST_F(RestoreV2OpTest, RestoreAfterSaveSlicesV1) { RunTest("SaveSlices"); }
 TEST_F(RestoreV2OpTest, RestoreAfterSaveV1) { RunTest("Save"); }
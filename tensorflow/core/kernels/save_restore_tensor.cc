@@ -272,6 +272,12 @@ struct RestoreOp {
   RestoreOp(RestoreOp&&) = default;
   RestoreOp& operator=(RestoreOp&&) = default;
 
+  // Whether the op restores a full tensor that can be copied straight from
+  // the checkpoint into the output.
+  bool is_direct() const {
+    return shape_and_slice.empty() && DataTypeCanUseMemcpy(dtype);
+  }
+
   bool is_large_shape(BundleReader* reader) const {
     TensorShape restored_full_shape;
 
@@ -405,11 +411,42 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
     return errors::InvalidArgument(error_msg);
   }
 
-  // Split restore ops into two groups: large and small. We schedule
-  // large ops first, to prevent them from waiting on the small op.
+  // Full tensors of memcpy-able types are read straight into their outputs
+  // by BundleReader::LookupMany(), which spreads the reads and checksums of
+  // all of them over a pool. The remaining ops are restored one by one below.
+  std::vector<string> direct_names;
+  std::vector<Tensor*> direct_outputs;
+  for (RestoreOp& restore_op : restore_ops) {
+    if (!restore_op.is_direct()) continue;
+    TensorShape restored_full_shape;
+    TF_RETURN_IF_ERROR(default_reader.LookupTensorShape(
+        restore_op.tensor_name, &restored_full_shape));
+    Tensor* restored_tensor;
+    TF_RETURN_IF_ERROR(context->allocate_output(
+        restore_op.idx, restored_full_shape, &restored_tensor));
+    direct_names.push_back(restore_op.tensor_name);
+    direct_outputs.push_back(restored_tensor);
+  }
+  if (!direct_names.empty()) {
+    const int num_threads =
+        context->session_config() != nullptr &&
+                context->session_config()->intra_op_parallelism_threads() > 0
+            ? context->session_config()->intra_op_parallelism_threads()
+            : 8;
+    VLOG(1) << "Restoring " << direct_names.size() << " tensors with "
+            << num_threads << " threads";
+    thread::ThreadPool reader_pool(Env::Default(), "restore_tensors",
+                                   num_threads);
+    TF_RETURN_IF_ERROR(
+        default_reader.LookupMany(direct_names, direct_outputs, &reader_pool));
+  }
+
+  // Split the remaining restore ops into two groups: large and small. We
+  // schedule large ops first, to prevent them from waiting on the small op.
   std::vector<RestoreOp*> large_restore_ops;
   std::vector<RestoreOp*> small_restore_ops;
   for (RestoreOp& restore_op : restore_ops) {
+    if (restore_op.is_direct()) continue;
     if (restore_op.is_large_shape(&default_reader)) {
       large_restore_ops.push_back(&restore_op);
     } else {
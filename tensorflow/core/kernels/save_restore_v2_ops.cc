@@ -33,6 +33,7 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"  // IWYU pragma: keep
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/saved_tensor_slice_util.h"
 #include "tensorflow/core/util/tensor_bundle/naming.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
@@ -90,12 +91,31 @@ void ValidateInputs(bool is_save_op, OpKernelContext* context,
   }
 }
 
+// Each data file is written by its own thread.
+constexpr int64_t kMaxNumDataFiles = 64;
+
 }  // namespace
 
 // Saves a list of named tensors using the tensor bundle library.
 class SaveV2 : public OpKernel {
  public:
-  explicit SaveV2(OpKernelConstruction* context) : OpKernel(context) {}
+  explicit SaveV2(OpKernelConstruction* context) : OpKernel(context) {
+    // Number of data files the bundle is written to in parallel; see
+    // BundleWriter::Options::num_data_files.
+    int64_t num_data_files;
+    OP_REQUIRES_OK(context, ReadInt64FromEnvVar("TF_CHECKPOINT_NUM_DATA_FILES",
+                                                1, &num_data_files));
+    OP_REQUIRES(context, num_data_files > 0,
+                errors::InvalidArgument(
+                    "TF_CHECKPOINT_NUM_DATA_FILES must be positive, got ",
+                    num_data_files));
+    if (num_data_files > kMaxNumDataFiles) {
+      LOG(WARNING) << "TF_CHECKPOINT_NUM_DATA_FILES=" << num_data_files
+                   << " is too large, using " << kMaxNumDataFiles;
+      num_data_files = kMaxNumDataFiles;
+    }
+    writer_options_.num_data_files = num_data_files;
+  }
 
   void Compute(OpKernelContext* context) override {
     const Tensor& prefix = context->input(0);
@@ -111,7 +131,7 @@ class SaveV2 : public OpKernel {
     const auto& tensor_names_flat = tensor_names.flat<tstring>();
     const auto& shape_and_slices_flat = shape_and_slices.flat<tstring>();
 
-    BundleWriter writer(Env::Default(), prefix_string);
+    BundleWriter writer(Env::Default(), prefix_string, writer_options_);
     OP_REQUIRES_OK(context, writer.status());
     VLOG(1) << "BundleWriter, prefix_string: " << prefix_string;
 
@@ -182,6 +202,9 @@ class SaveV2 : public OpKernel {
       checkpoint_callback_manager->Unref();
     }
   }
+
+ private:
+  BundleWriter::Options writer_options_;
 };
 REGISTER_KERNEL_BUILDER(Name("SaveV2").Device(DEVICE_CPU), SaveV2);
 
@@ -0,0 +1,206 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_SPARSE_BLOCKED_CSR_H_
+#define TENSORFLOW_CORE_KERNELS_SPARSE_BLOCKED_CSR_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A block compressed sparse row (BSR) copy of a CSR matrix. The nonzero
+// entries are grouped into dense `block_rows` x `block_cols` tiles, so that the
+// product with a dense matrix can be computed by small register-blocked
+// micro-kernels instead of one scalar multiply-add per nonzero. Entries of a
+// tile which are not present in the CSR matrix are stored as explicit zeros.
+template <typename T>
+struct BlockedCSRMatrix {
+  int block_rows = 0;
+  int block_cols = 0;
+  int64_t num_rows = 0;
+  int64_t num_cols = 0;
+  // Tiles of block row `i` are [block_row_ptrs[i], block_row_ptrs[i + 1]).
+  std::vector<int32> block_row_ptrs;
+  // Block column index of each tile, sorted within a block row.
+  std::vector<int32> block_col_indices;
+  // Row-major `block_rows` x `block_cols` values of each tile.
+  std::vector<T> block_values;
+
+  int64_t num_block_rows() const {
+    return static_cast<int64_t>(block_row_ptrs.size()) - 1;
+  }
+};
+
+// Converts the `num_rows` x `num_cols` CSR matrix given by `row_ptrs`,
+// `col_indices` and `values` to a BlockedCSRMatrix with the given block shape.
+// Gives up and returns false as soon as the stored tiles would hold more than
+// `max_fill_ratio` times as many entries as the CSR matrix has nonzeros, since
+// the explicit zeros then cost more than blocking saves.
+template <typename T>
+bool ConvertCSRToBlockedCSR(int64_t num_rows, int64_t num_cols,
+                            const int32* row_ptrs, const int32* col_indices,
+                            const T* values, int block_rows, int block_cols,
+                            double max_fill_ratio, BlockedCSRMatrix<T>* out) {
+  const int64_t nnz = row_ptrs[num_rows] - row_ptrs[0];
+  const int64_t block_size = block_rows * block_cols;
+  const int64_t max_blocks =
+      static_cast<int64_t>(max_fill_ratio * nnz / block_size);
+  const int64_t num_block_rows = (num_rows + block_rows - 1) / block_rows;
+  const int64_t num_block_cols = (num_cols + block_cols - 1) / block_cols;
+
+  out->block_rows = block_rows;
+  out->block_cols = block_cols;
+  out->num_rows = num_rows;
+  out->num_cols = num_cols;
+  out->block_row_ptrs.assign(num_block_rows + 1, 0);
+  out->block_col_indices.clear();
+
+  // First pass: find the sorted set of nonzero tiles of each block row.
+  // `tile_of_block_col` maps a block column to the last block row which used
+  // it, which avoids clearing a dense marker array for each block row.
+  std::vector<int64_t> tile_of_block_col(num_block_cols, -1);
+  for (int64_t block_row = 0; block_row < num_block_rows; ++block_row) {
+    const int64_t tiles_begin = out->block_col_indices.size();
+    const int64_t row_end = std::min(num_rows, (block_row + 1) * block_rows);
+    for (int64_t row = block_row * block_rows; row < row_end; ++row) {
+      for (int32 i = row_ptrs[row]; i < row_ptrs[row + 1]; ++i) {
+        const int32 block_col = col_indices[i] / block_cols;
+        if (tile_of_block_col[block_col] != block_row) {
+          tile_of_block_col[block_col] = block_row;
+          out->block_col_indices.push_back(block_col);
+        }
+      }
+    }
+    if (static_cast<int64_t>(out->block_col_indices.size()) > max_blocks) {
+      return false;
+    }
+    std::sort(out->block_col_indices.begin() + tiles_begin,
+              out->block_col_indices.end());
+    out->block_row_ptrs[block_row + 1] = out->block_col_indices.size();
+  }
+
+  // Second pass: scatter the values into their tiles. `tile_of_block_col` now
+  // maps a block column to its tile in the current block row.
+  out->block_values.assign(out->block_col_indices.size() * block_size, T(0));
+  for (int64_t block_row = 0; block_row < num_block_rows; ++block_row) {
+    for (int32 tile = out->block_row_ptrs[block_row];
+         tile < out->block_row_ptrs[block_row + 1]; ++tile) {
+      tile_of_block_col[out->block_col_indices[tile]] = tile;
+    }
+    const int64_t row_end = std::min(num_rows, (block_row + 1) * block_rows);
+    for (int64_t row = block_row * block_rows; row < row_end; ++row) {
+      const int64_t row_in_block = row - block_row * block_rows;
+      for (int32 i = row_ptrs[row]; i < row_ptrs[row + 1]; ++i) {
+        const int32 col = col_indices[i];
+        const int64_t tile = tile_of_block_col[col / block_cols];
+        out->block_values[tile * block_size + row_in_block * block_cols +
+                          col % block_cols] += values[i];
+      }
+    }
+  }
+  return true;
+}
+
+namespace blocked_csr_internal {
+
+// Computes block rows [block_row_begin, block_row_end) of `c = a * b`, where
+// `b` and `c` are row-major with `n` columns. The output columns are processed
+// in tiles of kTileCols, and the kBlockRows x kTileCols accumulator of a tile
+// is kept in registers while all tiles of the block row are applied to it.
+template <typename T, int kBlockRows, int kBlockCols>
+void BlockedCSRMatMulRange(const BlockedCSRMatrix<T>& a, const T* b, int64_t n,
+                           int64_t block_row_begin, int64_t block_row_end,
+                           T* c) {
+  // One cache line of output per accumulator row.
+  constexpr int kTileCols = 64 / sizeof(T);
+  constexpr int kBlockSize = kBlockRows * kBlockCols;
+  const int32* block_col_indices = a.block_col_indices.data();
+  const T* block_values = a.block_values.data();
+
+  for (int64_t block_row = block_row_begin; block_row < block_row_end;
+       ++block_row) {
+    const int64_t row_begin = block_row * kBlockRows;
+    const int num_valid_rows =
+        static_cast<int>(std::min<int64_t>(kBlockRows, a.num_rows - row_begin));
+    const int32 tiles_begin = a.block_row_ptrs[block_row];
+    const int32 tiles_end = a.block_row_ptrs[block_row + 1];
+
+    for (int64_t col_begin = 0; col_begin < n; col_begin += kTileCols) {
+      const int num_valid_cols =
+          static_cast<int>(std::min<int64_t>(kTileCols, n - col_begin));
+      T acc[kBlockRows][kTileCols] = {};
+
+      for (int32 tile = tiles_begin; tile < tiles_end; ++tile) {
+        const int64_t k_begin =
+            static_cast<int64_t>(block_col_indices[tile]) * kBlockCols;
+        const int num_valid_k = static_cast<int>(
+            std::min<int64_t>(kBlockCols, a.num_cols - k_begin));
+        const T* a_tile =
+            block_values + static_cast<int64_t>(tile) * kBlockSize;
+        for (int k = 0; k < num_valid_k; ++k) {
+          const T* b_row = b + (k_begin + k) * n + col_begin;
+          if (num_valid_cols == kTileCols) {
+            for (int r = 0; r < kBlockRows; ++r) {
+              const T a_value = a_tile[r * kBlockCols + k];
+              for (int j = 0; j < kTileCols; ++j) {
+                acc[r][j] += a_value * b_row[j];
+              }
+            }
+          } else {
+            for (int r = 0; r < kBlockRows; ++r) {
+              const T a_value = a_tile[r * kBlockCols + k];
+              for (int j = 0; j < num_valid_cols; ++j) {
+                acc[r][j] += a_value * b_row[j];
+              }
+            }
+          }
+        }
+      }
+
+      for (int r = 0; r < num_valid_rows; ++r) {
+        std::copy_n(acc[r], num_valid_cols,
+                    c + (row_begin + r) * n + col_begin);
+      }
+    }
+  }
+}
+
+}  // namespace blocked_csr_internal
+
+// Computes block rows [block_row_begin, block_row_end) of `c = a * b`, i.e.
+// rows [block_row_begin * a.block_rows, block_row_end * a.block_rows) clamped
+// to a.num_rows. `b` is a row-major a.num_cols x n matrix and `c` a row-major
+// a.num_rows x n matrix. Only 4x4 and 1x4 blocks are supported.
+template <typename T>
+void BlockedCSRMatMul(const BlockedCSRMatrix<T>& a, const T* b, int64_t n,
+                      int64_t block_row_begin, int64_t block_row_end, T* c) {
+  if (a.block_rows == 4 && a.block_cols == 4) {
+    blocked_csr_internal::BlockedCSRMatMulRange<T, 4, 4>(
+        a, b, n, block_row_begin, block_row_end, c);
+  } else {
+    DCHECK(a.block_rows == 1 && a.block_cols == 4);
+    blocked_csr_internal::BlockedCSRMatMulRange<T, 1, 4>(
+        a, b, n, block_row_begin, block_row_end, c);
+  }
+}
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_SPARSE_BLOCKED_CSR_H_
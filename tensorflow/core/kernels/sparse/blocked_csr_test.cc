@@ -0,0 +1,264 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/sparse/blocked_csr.h"
+
+#include <random>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+#include "Eigen/SparseCore"  // from @eigen_archive
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+template <typename T>
+struct CSRMatrix {
+  int64_t num_rows;
+  int64_t num_cols;
+  std::vector<int32> row_ptrs;
+  std::vector<int32> col_indices;
+  std::vector<T> values;
+};
+
+// Returns a random CSR matrix in which each entry is zero with probability
+// `sparsity`. If `block_structured` is true, the nonzeros come in dense 4x4
+// blocks instead.
+template <typename T>
+CSRMatrix<T> RandomCSRMatrix(int64_t num_rows, int64_t num_cols,
+                             double sparsity, bool block_structured) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const int64_t num_block_cols = (num_cols + 3) / 4;
+  std::vector<bool> block_is_nonzero(num_block_cols);
+
+  CSRMatrix<T> m{num_rows, num_cols, {0}, {}, {}};
+  for (int64_t row = 0; row < num_rows; ++row) {
+    if (block_structured && row % 4 == 0) {
+      for (int64_t i = 0; i < num_block_cols; ++i) {
+        block_is_nonzero[i] = uniform(rng) >= sparsity;
+      }
+    }
+    for (int64_t col = 0; col < num_cols; ++col) {
+      const bool is_nonzero = block_structured ? block_is_nonzero[col / 4]
+                                               : uniform(rng) >= sparsity;
+      if (is_nonzero) {
+        m.col_indices.push_back(col);
+        m.values.push_back(static_cast<T>(uniform(rng) - 0.5));
+      }
+    }
+    m.row_ptrs.push_back(m.col_indices.size());
+  }
+  return m;
+}
+
+template <typename T>
+std::vector<T> RandomDenseMatrix(int64_t num_rows, int64_t num_cols) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<T> m(num_rows * num_cols);
+  for (T& value : m) value = static_cast<T>(uniform(rng));
+  return m;
+}
+
+template <typename T>
+std::vector<T> ReferenceMatMul(const CSRMatrix<T>& a, const std::vector<T>& b,
+                               int64_t n) {
+  std::vector<T> c(a.num_rows * n, T(0));
+  for (int64_t row = 0; row < a.num_rows; ++row) {
+    for (int32 i = a.row_ptrs[row]; i < a.row_ptrs[row + 1]; ++i) {
+      for (int64_t j = 0; j < n; ++j) {
+        c[row * n + j] += a.values[i] * b[a.col_indices[i] * n + j];
+      }
+    }
+  }
+  return c;
+}
+
+template <typename T>
+bool ToBlockedCSR(const CSRMatrix<T>& a, int block_rows, int block_cols,
+                  double max_fill_ratio, BlockedCSRMatrix<T>* out) {
+  return ConvertCSRToBlockedCSR(a.num_rows, a.num_cols, a.row_ptrs.data(),
+                                a.col_indices.data(), a.values.data(),
+                                block_rows, block_cols, max_fill_ratio, out);
+}
+
+TEST(BlockedCSRTest, ConvertsToBlocks) {
+  // [[1 0 0 0 0 2]
+  //  [0 0 0 0 0 0]
+  //  [0 3 0 0 0 0]
+  //  [0 0 0 0 0 0]
+  //  [0 0 0 0 4 0]]
+  CSRMatrix<float> a{5, 6, {0, 2, 2, 3, 3, 4}, {0, 5, 1, 4}, {1, 2, 3, 4}};
+  BlockedCSRMatrix<float> blocked;
+  ASSERT_TRUE(ToBlockedCSR(a, 4, 4, 100.0, &blocked));
+
+  EXPECT_EQ(blocked.num_block_rows(), 2);
+  EXPECT_EQ(blocked.block_row_ptrs, std::vector<int32>({0, 2, 3}));
+  EXPECT_EQ(blocked.block_col_indices, std::vector<int32>({0, 1, 1}));
+  std::vector<float> expected_values(3 * 16, 0.0f);
+  expected_values[0 * 16 + 0 * 4 + 0] = 1;
+  expected_values[0 * 16 + 2 * 4 + 1] = 3;
+  expected_values[1 * 16 + 0 * 4 + 1] = 2;
+  expected_values[2 * 16 + 0 * 4 + 0] = 4;
+  EXPECT_EQ(blocked.block_values, expected_values);
+}
+
+TEST(BlockedCSRTest, RejectsMatricesAboveMaxFillRatio) {
+  // Both block shapes store a diagonal matrix with a fill ratio of 4.
+  CSRMatrix<float> a{8, 8, {0}, {}, {}};
+  for (int i = 0; i < 8; ++i) {
+    a.row_ptrs.push_back(i + 1);
+    a.col_indices.push_back(i);
+    a.values.push_back(1.0f);
+  }
+  BlockedCSRMatrix<float> blocked;
+  EXPECT_FALSE(ToBlockedCSR(a, 4, 4, 2.0, &blocked));
+  EXPECT_TRUE(ToBlockedCSR(a, 4, 4, 4.0, &blocked));
+  EXPECT_TRUE(ToBlockedCSR(a, 1, 4, 4.0, &blocked));
+  EXPECT_FALSE(ToBlockedCSR(a, 1, 4, 3.0, &blocked));
+}
+
+template <typename T>
+void TestMatMulMatchesReference(int block_rows, int block_cols,
+                                bool block_structured) {
+  // Sizes which are not multiples of the block or column tile sizes.
+  for (const int64_t n : {1, 8, 19, 35}) {
+    SCOPED_TRACE(absl::StrCat("n = ", n));
+    const CSRMatrix<T> a =
+        RandomCSRMatrix<T>(/*num_rows=*/37, /*num_cols=*/23, /*sparsity=*/0.7,
+                           block_structured);
+    const std::vector<T> b = RandomDenseMatrix<T>(a.num_cols, n);
+    BlockedCSRMatrix<T> blocked;
+    ASSERT_TRUE(ToBlockedCSR(a, block_rows, block_cols,
+                             /*max_fill_ratio=*/100.0, &blocked));
+
+    std::vector<T> c(a.num_rows * n, T(-1));
+    // Compute the result in two parts to check partial block row ranges.
+    BlockedCSRMatMul(blocked, b.data(), n, 0, 3, c.data());
+    BlockedCSRMatMul(blocked, b.data(), n, 3, blocked.num_block_rows(),
+                     c.data());
+
+    const std::vector<T> expected = ReferenceMatMul(a, b, n);
+    for (int64_t i = 0; i < c.size(); ++i) {
+      EXPECT_NEAR(c[i], expected[i], 1e-5) << "at index " << i;
+    }
+  }
+}
+
+TEST(BlockedCSRTest, MatMulMatchesReference4x4) {
+  TestMatMulMatchesReference<float>(4, 4, /*block_structured=*/false);
+  TestMatMulMatchesReference<float>(4, 4, /*block_structured=*/true);
+  TestMatMulMatchesReference<double>(4, 4, /*block_structured=*/true);
+}
+
+TEST(BlockedCSRTest, MatMulMatchesReference1x4) {
+  TestMatMulMatchesReference<float>(1, 4, /*block_structured=*/false);
+  TestMatMulMatchesReference<float>(1, 4, /*block_structured=*/true);
+  TestMatMulMatchesReference<double>(1, 4, /*block_structured=*/false);
+}
+
+TEST(BlockedCSRTest, EmptyMatrix) {
+  CSRMatrix<float> a{6, 5, {0, 0, 0, 0, 0, 0, 0}, {}, {}};
+  BlockedCSRMatrix<float> blocked;
+  ASSERT_TRUE(ToBlockedCSR(a, 4, 4, 2.0, &blocked));
+  const std::vector<float> b = RandomDenseMatrix<float>(5, 20);
+  std::vector<float> c(6 * 20, -1.0f);
+  BlockedCSRMatMul(blocked, b.data(), 20, 0, blocked.num_block_rows(),
+                   c.data());
+  EXPECT_EQ(c, std::vector<float>(6 * 20, 0.0f));
+}
+
+// Sparsity sweep of a 1024x1024 by 1024x64 product, comparing the blocked
+// kernels against Eigen.
+//
+// Args: sparsity in percent, whether the nonzeros are 4x4-block structured,
+// and the kernel: 0 for Eigen, 1 for what CSRMatMul would choose (the blocked
+// kernels with its fill-ratio cutoff, else Eigen), and 2 for the 1x4 blocked
+// kernel without a cutoff.
+void BM_BlockedCSRMatMul(::testing::benchmark::State& state) {
+  const double sparsity = state.range(0) / 100.0;
+  const bool block_structured = state.range(1);
+  const int kernel = state.range(2);
+  constexpr int64_t kSize = 1024;
+  constexpr int64_t kRhsCols = 64;
+
+  const CSRMatrix<float> a =
+      RandomCSRMatrix<float>(kSize, kSize, sparsity, block_structured);
+  const std::vector<float> b = RandomDenseMatrix<float>(kSize, kRhsCols);
+  std::vector<float> c(kSize * kRhsCols);
+
+  BlockedCSRMatrix<float> blocked;
+  bool use_blocked = false;
+  if (kernel == 1) {
+    if (ToBlockedCSR(a, 4, 4, 2.0, &blocked)) {
+      state.SetLabel("4x4");
+      use_blocked = true;
+    } else if (ToBlockedCSR(a, 1, 4, 2.0, &blocked)) {
+      state.SetLabel("1x4");
+      use_blocked = true;
+    } else {
+      state.SetLabel("eigen");
+    }
+  } else if (kernel == 2) {
+    // Each tile holds at least one nonzero, so the fill ratio is at most 4.
+    ASSERT_TRUE(ToBlockedCSR(a, 1, 4, 4.0, &blocked));
+    const double fill_ratio =
+        static_cast<double>(blocked.block_values.size()) / a.values.size();
+    state.SetLabel(absl::StrCat("1x4, fill ratio ", fill_ratio));
+    use_blocked = true;
+  }
+
+  using SparseMatrix = Eigen::SparseMatrix<float, Eigen::RowMajor>;
+  using Matrix =
+      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  Eigen::Map<const SparseMatrix> a_map(kSize, kSize, a.values.size(),
+                                       a.row_ptrs.data(), a.col_indices.data(),
+                                       a.values.data());
+  Eigen::Map<const Matrix> b_map(b.data(), kSize, kRhsCols);
+  Eigen::Map<Matrix> c_map(c.data(), kSize, kRhsCols);
+
+  for (auto s : state) {
+    if (use_blocked) {
+      BlockedCSRMatMul(blocked, b.data(), kRhsCols, 0,
+                       blocked.num_block_rows(), c.data());
+    } else {
+      c_map.noalias() = a_map * b_map;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          a.values.size() * kRhsCols);
+}
+
+BENCHMARK(BM_BlockedCSRMatMul)
+    ->Args({80, 0, 0})
+    ->Args({80, 0, 1})
+    ->Args({80, 1, 0})
+    ->Args({80, 1, 1})
+    ->Args({90, 0, 0})
+    ->Args({90, 0, 1})
+    ->Args({90, 0, 2})
+    ->Args({90, 1, 0})
+    ->Args({90, 1, 1})
+    ->Args({95, 0, 0})
+    ->Args({95, 0, 1})
+    ->Args({95, 1, 0})
+    ->Args({95, 1, 1});
+
+}  // namespace
+}  // namespace tensorflow
@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/topk_op_cpu_select.h"
 #include "tensorflow/core/lib/gtl/top_n.h"
 #include "tensorflow/core/util/work_sharder.h"
 
@@ -161,70 +162,87 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
       return OkStatus();
     }
 
-    auto SortIndices = [&](int64_t start_batch, int64_t limit_batch) {
-      for (int32_t b = start_batch; b < limit_batch; ++b) {
-        const T* input_data = &input(b, 0);
-        const auto stable_comp = [input_data](const int32_t a,
-                                              const int32_t b) {
-          if (input_data[b] < input_data[a]) {
-            return true;
-          } else if (input_data[b] > input_data[a]) {
-            return false;
-          } else {
-            return a < b;
-          }
-        };
-        const auto comp = [input_data](const int32_t a, const int32_t b) {
-          return input_data[b] < input_data[a];
-        };
-        // TODO(ebrevdo): For large k < num_cols, instead of using
-        // TopN, it may be faster to create a temporary vector of
-        // values 0..num_cols - 1 and then use std::partial_sort_copy
-        // of this into indices. Choosing the appropriate minimum k or
-        // ratio of k/num_cols will require some experimentation.
-        if (k == num_cols) {
-          auto* begin = &indices(b, 0);
-          auto* end = &indices(b, k);
-          // Set the initial array of indices 0 ... k - 1.
-          std::iota(begin, end, 0);
-          // We want an in-place sort, but we can cheat because we're sorting
-          // indices that started out sorted.  First, do a std::sort, which
-          // is notably faster than std::stable_sort.
-          std::sort(begin, end, comp);
-          // Then, for runs of adjacent elements that were equal, sort the
-          // indices in those runs in increasing order.
-          for (auto* run_begin = begin; run_begin != end;) {
-            auto* run_end = run_begin + 1;
-            if (run_end == end) break;
-            if (input_data[*run_begin] == input_data[*run_end]) {
-              while (++run_end != end) {
-                if (input_data[*run_begin] != input_data[*run_end]) break;
-              }
-              std::sort(run_begin, run_end);
+    auto SortRow = [&](int64_t b) {
+      const T* input_data = &input(b, 0);
+      const auto stable_comp = [input_data](const int32_t a, const int32_t b) {
+        if (input_data[b] < input_data[a]) {
+          return true;
+        } else if (input_data[b] > input_data[a]) {
+          return false;
+        } else {
+          return a < b;
+        }
+      };
+      const auto comp = [input_data](const int32_t a, const int32_t b) {
+        return input_data[b] < input_data[a];
+      };
+      // TODO(ebrevdo): For large k < num_cols, instead of using
+      // TopN, it may be faster to create a temporary vector of
+      // values 0..num_cols - 1 and then use std::partial_sort_copy
+      // of this into indices. Choosing the appropriate minimum k or
+      // ratio of k/num_cols will require some experimentation.
+      if (k == num_cols) {
+        auto* begin = &indices(b, 0);
+        auto* end = &indices(b, k);
+        // Set the initial array of indices 0 ... k - 1.
+        std::iota(begin, end, 0);
+        // We want an in-place sort, but we can cheat because we're sorting
+        // indices that started out sorted.  First, do a std::sort, which
+        // is notably faster than std::stable_sort.
+        std::sort(begin, end, comp);
+        // Then, for runs of adjacent elements that were equal, sort the
+        // indices in those runs in increasing order.
+        for (auto* run_begin = begin; run_begin != end;) {
+          auto* run_end = run_begin + 1;
+          if (run_end == end) break;
+          if (input_data[*run_begin] == input_data[*run_end]) {
+            while (++run_end != end) {
+              if (input_data[*run_begin] != input_data[*run_end]) break;
             }
-            run_begin = run_end;
+            std::sort(run_begin, run_end);
+          }
+          run_begin = run_end;
+        }
+      } else {
+        // Use the TopN heap object to sort.
+        gtl::TopN<Tidx, decltype(stable_comp)> filter(k, stable_comp);
+        filter.reserve(num_cols);
+        for (Tidx c = 0; c < num_cols; ++c) {
+          filter.push(c);
+        }
+
+        int32_t i = 0;
+        if (sorted) {
+          std::unique_ptr<std::vector<Tidx>> top_k(filter.Extract());
+          for (auto top_k_it = top_k->begin(); top_k_it != top_k->end();
+               ++top_k_it, ++i) {
+            indices(b, i) = *top_k_it;
           }
         } else {
-          // Use the TopN heap object to sort.
-          gtl::TopN<Tidx, decltype(stable_comp)> filter(k, stable_comp);
-          filter.reserve(num_cols);
-          for (Tidx c = 0; c < num_cols; ++c) {
-            filter.push(c);
+          for (auto top_k_it = filter.unsorted_begin();
+               top_k_it != filter.unsorted_end(); ++top_k_it, ++i) {
+            indices(b, i) = *top_k_it;
           }
+        }
+      }
+    };
 
-          int32_t i = 0;
-          if (sorted) {
-            std::unique_ptr<std::vector<Tidx>> top_k(filter.Extract());
-            for (auto top_k_it = top_k->begin(); top_k_it != top_k->end();
-                 ++top_k_it, ++i) {
-              indices(b, i) = *top_k_it;
-            }
-          } else {
-            for (auto top_k_it = filter.unsorted_begin();
-                 top_k_it != filter.unsorted_end(); ++top_k_it, ++i) {
-              indices(b, i) = *top_k_it;
-            }
-          }
+    // Large rows with a small k are narrowed down to a few candidates with a
+    // vectorized threshold filter first. When there are fewer rows than
+    // threads, each row's filter is split across the threads instead.
+    const bool use_select =
+        topk_op_internal::UseThresholdSelect<T>(k, num_cols);
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    thread::ThreadPool* row_workers =
+        use_select && num_rows < worker_threads.num_threads
+            ? worker_threads.workers
+            : nullptr;
+    auto SortIndices = [&](int64_t start_batch, int64_t limit_batch) {
+      for (int64_t b = start_batch; b < limit_batch; ++b) {
+        if (!use_select || !topk_op_internal::SelectTopK(
+                               &input(b, 0), num_cols, k, row_workers,
+                               &indices(b, 0))) {
+          SortRow(b);
         }
         // Now that the indices are sorted, copy the values over in
         // sorted order.
@@ -232,6 +250,10 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
                        [b, &input](const Tidx loc) { return input(b, loc); });
       }  // for (Tidx b = ...
     };
+    if (row_workers != nullptr) {
+      SortIndices(0, num_rows);
+      return OkStatus();
+    }
 
     // Guesstimate of cost; 4*N*log(K) where N == num_cols.
     // If K == N, assume the cost is N*log(K + 1).
@@ -241,13 +263,18 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
         cmp_cost *
         static_cast<double>(num_cols *
                             Eigen::numext::log2(static_cast<float>(k + 1)));
-    const double sort_cost = (k == num_cols) ? base_cost : 4 * base_cost;
+    double sort_cost = (k == num_cols) ? base_cost : 4 * base_cost;
+    if (use_select) {
+      // One vectorized pass over the row plus sorting the candidates.
+      sort_cost = num_cols * Eigen::TensorOpCost::AddCost<T>() +
+                  topk_op_internal::kCandidatesPerK * k * cmp_cost *
+                      Eigen::numext::log2(static_cast<float>(k + 1));
+    }
     const double copy_cost = 2 * k * Eigen::TensorOpCost::AddCost<T>();
     const double total_cost = sort_cost + copy_cost;
     const int64_t final_cost = (total_cost >= static_cast<double>(kint64max))
                                    ? kint64max
                                    : static_cast<int64_t>(total_cost);
-    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
     Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
           final_cost, SortIndices);
 
@@ -0,0 +1,221 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_TOPK_OP_CPU_SELECT_H_
+#define TENSORFLOW_CORE_KERNELS_TOPK_OP_CPU_SELECT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace topk_op_internal {
+
+// Rows with fewer columns than this use the heap based TopK.
+inline constexpr int64_t kMinSelectCols = 1 << 15;
+
+// Threshold selection is used when k is at most this fraction of the row.
+inline constexpr int64_t kMinColsPerK = 64;
+
+// The threshold is chosen so that about kCandidatesPerK * k elements of the
+// row pass the filter; it is estimated from the kSampleRank-th largest element
+// of a sample of the row.
+inline constexpr int64_t kCandidatesPerK = 4;
+inline constexpr int64_t kSampleRank = 16;
+inline constexpr int64_t kMinSampleSize = 1024;
+inline constexpr int64_t kSampleRunLength = 16;
+
+// Selection gives up, and the caller falls back to the heap, if more than
+// this many candidates per k pass the filter, e.g. because of many ties.
+inline constexpr int64_t kMaxCandidatesPerK = 64;
+
+// Columns filtered per thread when a row is split across threads.
+inline constexpr int64_t kMinColsPerBlock = 1 << 16;
+
+// Whether rows of `num_cols` elements of type T should use SelectTopK. Small
+// types are excluded since they have too many ties for a threshold to
+// separate the top k.
+template <typename T>
+bool UseThresholdSelect(int k, int64_t num_cols) {
+  constexpr bool kSupportedType =
+      std::is_floating_point<T>::value || sizeof(T) >= 4;
+  return kSupportedType && num_cols >= kMinSelectCols &&
+         static_cast<int64_t>(k) * kMinColsPerK <= num_cols;
+}
+
+// Returns the `rank`-th largest (counting from 1) of a sample of about
+// `sample_size` elements of `row`, or the smallest sampled element if there
+// are fewer than `rank`. NaNs are left out of the sample.
+template <typename T>
+T SampleThreshold(const T* row, int64_t num_cols, int64_t sample_size,
+                  int64_t rank, std::vector<T>* heap) {
+  // The sample is made of runs of kSampleRunLength consecutive elements, so
+  // that it touches few cache lines.
+  const int64_t num_runs =
+      std::max<int64_t>(1, sample_size / kSampleRunLength);
+  const int64_t stride = num_cols / num_runs;
+  // Min-heap of the `rank` largest sampled elements. The rank is small, so
+  // almost all elements are rejected by a single comparison.
+  const auto greater = [](const T& a, const T& b) { return b < a; };
+  heap->clear();
+  for (int64_t j = 0; j < num_runs; ++j) {
+    // Jitter the position of the run within each stride so that periodic
+    // rows are still sampled evenly.
+    const int64_t begin =
+        j * stride + (static_cast<uint64_t>(j) * 0x9E3779B9) %
+                         std::max<int64_t>(1, stride - kSampleRunLength);
+    const int64_t end = std::min(num_cols, begin + kSampleRunLength);
+    for (int64_t i = begin; i < end; ++i) {
+      const T value = row[i];
+      if (value != value) continue;
+      if (static_cast<int64_t>(heap->size()) < rank) {
+        heap->push_back(value);
+        std::push_heap(heap->begin(), heap->end(), greater);
+      } else if (heap->front() < value) {
+        std::pop_heap(heap->begin(), heap->end(), greater);
+        heap->back() = value;
+        std::push_heap(heap->begin(), heap->end(), greater);
+      }
+    }
+  }
+  return heap->empty() ? row[0] : heap->front();
+}
+
+// Appends the positions in [begin, end) of the elements of `row` that are not
+// less than `threshold`, NaNs included, to `candidates` in increasing order.
+template <typename T, typename Tidx>
+void FilterCandidates(const T* row, int64_t begin, int64_t end, T threshold,
+                      std::vector<Tidx>* candidates) {
+  int64_t i = begin;
+  if constexpr (std::is_same<T, float>::value ||
+                std::is_same<T, double>::value) {
+    using Packet = typename Eigen::internal::packet_traits<T>::type;
+    constexpr int64_t kPacketSize =
+        Eigen::internal::unpacket_traits<Packet>::size;
+    constexpr int64_t kBlockSize = 4 * kPacketSize;
+    const Packet t = Eigen::internal::pset1<Packet>(threshold);
+    // Marks the lanes of `x` that pass the filter, i.e. are not less than
+    // the threshold.
+    auto keep = [&t](const Packet& x) {
+      return Eigen::internal::pandnot(Eigen::internal::ptrue(x),
+                                      Eigen::internal::pcmp_lt(x, t));
+    };
+    // Almost all blocks have no candidates, so they are tested four packets
+    // at a time and only the rare hits are scanned element by element.
+    for (; i + kBlockSize <= end; i += kBlockSize) {
+      const T* block = row + i;
+      const Packet any = Eigen::internal::por(
+          Eigen::internal::por(
+              keep(Eigen::internal::ploadu<Packet>(block)),
+              keep(Eigen::internal::ploadu<Packet>(block + kPacketSize))),
+          Eigen::internal::por(
+              keep(Eigen::internal::ploadu<Packet>(block + 2 * kPacketSize)),
+              keep(Eigen::internal::ploadu<Packet>(block + 3 * kPacketSize))));
+      if (!Eigen::internal::predux_any(any)) continue;
+      for (int64_t j = i; j < i + kBlockSize; ++j) {
+        if (!(row[j] < threshold)) candidates->push_back(static_cast<Tidx>(j));
+      }
+    }
+  }
+  for (; i < end; ++i) {
+    if (!(row[i] < threshold)) candidates->push_back(static_cast<Tidx>(i));
+  }
+}
+
+// Writes the positions of the k largest elements of `row` to `indices`, in
+// decreasing order of value and increasing order of position among equal
+// values, which is the order the heap based TopK produces.
+//
+// A threshold is estimated from a sample of the row, the elements not less
+// than it are collected with a vectorized pass, and only those are sorted.
+// If `workers` is not null, the filter pass is split across its threads.
+//
+// Returns false without writing `indices` if the row contains NaNs or the
+// threshold does not narrow the row down well enough; the caller then has to
+// use another method.
+template <typename T, typename Tidx>
+bool SelectTopK(const T* row, int64_t num_cols, int k,
+                thread::ThreadPool* workers, Tidx* indices) {
+  const int64_t target = kCandidatesPerK * k;
+  const int64_t sample_size = std::min(
+      num_cols,
+      std::max(kMinSampleSize, (kSampleRank * num_cols + target - 1) / target));
+  const int64_t max_candidates = kMaxCandidatesPerK * k;
+
+  int64_t num_blocks = 1;
+  if (workers != nullptr) {
+    num_blocks = std::max<int64_t>(
+        1, std::min<int64_t>(workers->NumThreads(),
+                             num_cols / kMinColsPerBlock));
+  }
+  const int64_t block_size = (num_cols + num_blocks - 1) / num_blocks;
+  std::vector<std::vector<Tidx>> block_candidates(num_blocks);
+  auto filter_blocks = [&](T threshold, int64_t start, int64_t limit) {
+    for (int64_t b = start; b < limit; ++b) {
+      block_candidates[b].clear();
+      FilterCandidates(row, b * block_size,
+                       std::min(num_cols, (b + 1) * block_size), threshold,
+                       &block_candidates[b]);
+    }
+  };
+
+  std::vector<T> sample;
+  std::vector<Tidx> candidates;
+  // Rank in the sample that corresponds to about `target` candidates in the
+  // row. If that threshold is too high, retry once with a lower one.
+  const int64_t first_rank =
+      std::max<int64_t>(1, (target * sample_size + num_cols - 1) / num_cols);
+  for (int64_t sample_rank : {first_rank, kCandidatesPerK * first_rank}) {
+    const T threshold =
+        SampleThreshold(row, num_cols, sample_size, sample_rank, &sample);
+    if (num_blocks == 1) {
+      filter_blocks(threshold, 0, 1);
+    } else {
+      workers->ParallelFor(num_blocks, block_size * 4,
+                           [&](int64_t start, int64_t limit) {
+                             filter_blocks(threshold, start, limit);
+                           });
+    }
+    candidates.clear();
+    for (const std::vector<Tidx>& block : block_candidates) {
+      candidates.insert(candidates.end(), block.begin(), block.end());
+    }
+    const int64_t num_candidates = candidates.size();
+    if (num_candidates > max_candidates) return false;
+    if (num_candidates >= k) break;
+  }
+  if (static_cast<int64_t>(candidates.size()) < k) return false;
+
+  for (const Tidx c : candidates) {
+    if (row[c] != row[c]) return false;
+  }
+  std::partial_sort(candidates.begin(), candidates.begin() + k,
+                    candidates.end(), [row](const Tidx a, const Tidx b) {
+                      if (row[b] < row[a]) return true;
+                      if (row[a] < row[b]) return false;
+                      return a < b;
+                    });
+  std::copy(candidates.begin(), candidates.begin() + k, indices);
+  return true;
+}
+
+}  // namespace topk_op_internal
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_TOPK_OP_CPU_SELECT_H_
@@ -0,0 +1,230 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/topk_op_cpu_select.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/gtl/top_n.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace {
+
+// Positions of the k largest elements of `row`, largest first and lower
+// positions first among equal values.
+template <typename T>
+std::vector<int32> ReferenceTopK(const std::vector<T>& row, int k) {
+  std::vector<int32> indices(row.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::stable_sort(indices.begin(), indices.end(),
+                   [&row](int32 a, int32 b) { return row[b] < row[a]; });
+  indices.resize(k);
+  return indices;
+}
+
+class TopKOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(DataType dtype) {
+    TF_ASSERT_OK(NodeDefBuilder("topk", "TopKV2")
+                     .Input(FakeInput(dtype))
+                     .Input(FakeInput(DT_INT32))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs TopKV2 on `rows` rows of `row` values each and checks the result
+  // against ReferenceTopK.
+  template <typename T>
+  void RunAndCheck(const std::vector<std::vector<T>>& rows, int k) {
+    MakeOp(DataTypeToEnum<T>::v());
+    const int64_t num_cols = rows[0].size();
+    std::vector<T> flat;
+    for (const auto& row : rows) {
+      flat.insert(flat.end(), row.begin(), row.end());
+    }
+    AddInputFromArray<T>(
+        TensorShape({static_cast<int64_t>(rows.size()), num_cols}), flat);
+    AddInputFromArray<int32>(TensorShape({}), {k});
+    TF_ASSERT_OK(RunOpKernel());
+
+    const auto values = GetOutput(0)->matrix<T>();
+    const auto indices = GetOutput(1)->matrix<int32>();
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const std::vector<int32> expected = ReferenceTopK(rows[r], k);
+      for (int i = 0; i < k; ++i) {
+        ASSERT_EQ(indices(r, i), expected[i]) << "row " << r << " rank " << i;
+        ASSERT_EQ(values(r, i), rows[r][expected[i]]);
+      }
+    }
+  }
+};
+
+TEST_F(TopKOpTest, LargeRowsFloat) {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+  std::vector<std::vector<float>> rows(3, std::vector<float>(100000));
+  for (auto& row : rows) {
+    for (float& x : row) x = normal(rng);
+  }
+  ASSERT_TRUE(topk_op_internal::UseThresholdSelect<float>(100, 100000));
+  RunAndCheck(rows, 100);
+}
+
+TEST_F(TopKOpTest, LargeRowsWithTies) {
+  // Many equal values around the threshold; ties must keep the lower
+  // positions first, as in the heap based path.
+  std::mt19937 rng(2);
+  std::vector<std::vector<int32>> rows(2, std::vector<int32>(65536));
+  for (auto& row : rows) {
+    for (int32& x : row) x = rng() % 3000;
+  }
+  RunAndCheck(rows, 500);
+}
+
+TEST_F(TopKOpTest, LargeRowsAllEqual) {
+  // Too many ties for the threshold filter, which falls back to the heap.
+  RunAndCheck(std::vector<std::vector<double>>(1, std::vector<double>(40000)),
+              64);
+}
+
+TEST_F(TopKOpTest, LargeRowsSorted) {
+  std::vector<std::vector<float>> rows(2, std::vector<float>(50000));
+  std::iota(rows[0].begin(), rows[0].end(), 0.0f);
+  std::iota(rows[1].rbegin(), rows[1].rend(), 0.0f);
+  RunAndCheck(rows, 700);
+}
+
+TEST(TopKSelectTest, NaNFallsBack) {
+  std::vector<float> row(40000);
+  std::iota(row.begin(), row.end(), 0.0f);
+  row[123] = std::numeric_limits<float>::quiet_NaN();
+  std::vector<int32> indices(10);
+  EXPECT_FALSE(topk_op_internal::SelectTopK(row.data(), row.size(), 10,
+                                            /*workers=*/nullptr,
+                                            indices.data()));
+}
+
+TEST(TopKSelectTest, SplitAcrossThreads) {
+  thread::ThreadPool pool(Env::Default(), "topk_test", 4);
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> uniform;
+  std::vector<double> row(1 << 18);
+  for (double& x : row) x = uniform(rng);
+  std::vector<int64_t> indices(1000);
+  ASSERT_TRUE(topk_op_internal::SelectTopK(row.data(), row.size(), 1000,
+                                           &pool, indices.data()));
+  const std::vector<int32> expected = ReferenceTopK(row, 1000);
+  EXPECT_TRUE(std::equal(indices.begin(), indices.end(), expected.begin()));
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+Tensor RandomScores(int rows, int cols) {
+  Tensor scores(DT_FLOAT, TensorShape({rows, cols}));
+  scores.flat<float>().setRandom();
+  return scores;
+}
+
+static Graph* TopKV2(int rows, int cols, int k) {
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(NodeBuilder(g->NewName("topk"), "TopKV2")
+                  .Input(test::graph::Constant(g, RandomScores(rows, cols)))
+                  .Input(test::graph::Constant(g, test::AsScalar<int32>(k)))
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+#define BM_TopKV2(R, C, K)                                               \
+  static void BM_TopKV2_##R##_##C##_##K(                                 \
+      ::testing::benchmark::State& state) {                              \
+    test::Benchmark("cpu", TopKV2(R, C, K), /*old_benchmark_api*/ false) \
+        .Run(state);                                                     \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *   \
+                            R * C);                                      \
+  }                                                                      \
+  BENCHMARK(BM_TopKV2_##R##_##C##_##K)->UseRealTime();
+
+BM_TopKV2(1, 1000000, 100);
+BM_TopKV2(1, 1000000, 1000);
+BM_TopKV2(8, 1000000, 100);
+BM_TopKV2(8, 1000000, 1000);
+BM_TopKV2(128, 100000, 100);
+BM_TopKV2(128, 10000, 100);
+
+// Single row top-k with the heap the op uses for rows that are not selected
+// by UseThresholdSelect, against the threshold selection.
+void BM_TopKRowHeap(::testing::benchmark::State& state) {
+  const int cols = state.range(0);
+  const int k = state.range(1);
+  Tensor scores = RandomScores(1, cols);
+  const float* row = scores.flat<float>().data();
+  const auto comp = [row](int32 a, int32 b) {
+    if (row[b] < row[a]) return true;
+    if (row[a] < row[b]) return false;
+    return a < b;
+  };
+  for (auto s : state) {
+    gtl::TopN<int32, decltype(comp)> filter(k, comp);
+    filter.reserve(cols);
+    for (int32 c = 0; c < cols; ++c) filter.push(c);
+    std::unique_ptr<std::vector<int32>> top_k(filter.Extract());
+    tensorflow::testing::DoNotOptimize(top_k->data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * cols);
+}
+BENCHMARK(BM_TopKRowHeap)
+    ->ArgPair(100000, 100)
+    ->ArgPair(1000000, 100)
+    ->ArgPair(1000000, 1000);
+
+void BM_TopKRowSelect(::testing::benchmark::State& state) {
+  const int cols = state.range(0);
+  const int k = state.range(1);
+  Tensor scores = RandomScores(1, cols);
+  const float* row = scores.flat<float>().data();
+  std::vector<int32> indices(k);
+  for (auto s : state) {
+    CHECK(topk_op_internal::SelectTopK(row, cols, k, /*workers=*/nullptr,
+                                       indices.data()));
+    tensorflow::testing::DoNotOptimize(indices.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * cols);
+}
+BENCHMARK(BM_TopKRowSelect)
+    ->ArgPair(100000, 100)
+    ->ArgPair(1000000, 100)
+    ->ArgPair(1000000, 1000);
+
+}  // namespace
+}  // namespace tensorflow
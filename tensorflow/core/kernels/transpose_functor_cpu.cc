@@ -15,7 +15,10 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <complex>
+#include <cstring>
+#include <type_traits>
 
 #include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
 #include "tensorflow/core/framework/attr_value.pb.h"
@@ -68,12 +71,225 @@ void TransposeSimple(const CPUDevice& device, const Tensor& in,
   device.parallelFor(in.NumElements(), cost, std::move(transpose_fn));
 }
 
+// Tensors with fewer elements than this are transposed with Eigen.
+constexpr int64_t kMinBlockedTransposeElements = 4096;
+
+// Transposes that keep the input innermost dimension copy runs of at least
+// this many bytes; shorter runs are transposed with Eigen.
+constexpr int64_t kMinBlockedTransposeRunBytes = 32;
+
+// Writes the transpose of the rows x cols matrix at "src", whose rows are
+// "src_stride" elements apart, to "dst", whose rows are "dst_stride" elements
+// apart: dst[c * dst_stride + r] = src[r * src_stride + c].
+//
+// 4 and 8 byte elements are moved through registers in square blocks of one
+// packet per row, transposed with Eigen's ptranspose.
+template <typename T>
+void TransposeTile(const T* src, int64_t src_stride, T* dst,
+                   int64_t dst_stride, int64_t rows, int64_t cols) {
+  int64_t r = 0;
+  if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+    // The elements are only moved, so they can be handled as floating point
+    // packets whatever their type.
+    using Scalar = std::conditional_t<sizeof(T) == 4, float, double>;
+    using Packet = typename Eigen::internal::packet_traits<Scalar>::type;
+    constexpr int64_t kPacketSize =
+        Eigen::internal::unpacket_traits<Packet>::size;
+    if constexpr (kPacketSize > 1) {
+      const Scalar* s = reinterpret_cast<const Scalar*>(src);
+      Scalar* d = reinterpret_cast<Scalar*>(dst);
+      for (; r + kPacketSize <= rows; r += kPacketSize) {
+        int64_t c = 0;
+        for (; c + kPacketSize <= cols; c += kPacketSize) {
+          Eigen::internal::PacketBlock<Packet, kPacketSize> block;
+          for (int i = 0; i < kPacketSize; ++i) {
+            block.packet[i] = Eigen::internal::ploadu<Packet>(
+                s + (r + i) * src_stride + c);
+          }
+          Eigen::internal::ptranspose(block);
+          for (int i = 0; i < kPacketSize; ++i) {
+            Eigen::internal::pstoreu(d + (c + i) * dst_stride + r,
+                                     block.packet[i]);
+          }
+        }
+        for (; c < cols; ++c) {
+          for (int64_t i = r; i < r + kPacketSize; ++i) {
+            dst[c * dst_stride + i] = src[i * src_stride + c];
+          }
+        }
+      }
+    }
+  }
+  // Remaining rows, and all rows of other element sizes. Reading along a row
+  // of the source keeps the reads sequential; the few destination rows of the
+  // tile stay in cache.
+  for (int64_t c = 0; c < cols; ++c) {
+    for (int64_t i = r; i < rows; ++i) {
+      dst[c * dst_stride + i] = src[i * src_stride + c];
+    }
+  }
+}
+
+// Transposes "in" into "out" without Eigen, for tensors of trivially copyable
+// types of any rank. Returns false, without writing "out", if the tensor is
+// better left to Eigen.
+//
+// Dimensions of size 1 are dropped and input dimensions that stay adjacent in
+// the output are merged. If the innermost dimension stays innermost, the
+// output is a permutation of contiguous runs, which are copied. Otherwise the
+// input innermost dimension and the dimension that becomes innermost in the
+// output form a batch of 2-D transposes, which are split into cache sized
+// tiles sharded over the device threads.
+template <typename T>
+bool TransposeBlocked(const CPUDevice& device, const Tensor& in,
+                      const absl::Span<const int32> perm, Tensor* out) {
+  if (in.NumElements() < kMinBlockedTransposeElements) return false;
+
+  // Drops the dimensions of size 1, then merges dimensions.
+  TensorShape squeezed_shape;
+  internal::TransposePermsVec squeezed_perm;
+  internal::TransposePermsVec squeezed_index(in.dims(), -1);
+  for (int i = 0; i < in.dims(); ++i) {
+    if (in.dim_size(i) != 1) {
+      squeezed_index[i] = squeezed_shape.dims();
+      squeezed_shape.AddDim(in.dim_size(i));
+    }
+  }
+  for (int i = 0; i < in.dims(); ++i) {
+    if (squeezed_index[perm[i]] >= 0) {
+      squeezed_perm.push_back(squeezed_index[perm[i]]);
+    }
+  }
+  const T* src = reinterpret_cast<const T*>(in.tensor_data().data());
+  T* dst = reinterpret_cast<T*>(const_cast<char*>(out->tensor_data().data()));
+  if (squeezed_shape.dims() <= 1) {
+    std::copy_n(src, in.NumElements(), dst);
+    return true;
+  }
+  internal::TransposePermsVec positions;
+  internal::TransposeDimsVec dims;
+  internal::ReduceTransposeDimensions(squeezed_shape, squeezed_perm,
+                                      &positions, &dims);
+  const int n = dims.size();
+  if (n == 1) {
+    std::copy_n(src, in.NumElements(), dst);
+    return true;
+  }
+  // ReduceTransposeDimensions gives the output position of each merged input
+  // dimension; p[i] is the input dimension at output position i.
+  internal::TransposePermsVec p(n);
+  for (int k = 0; k < n; ++k) p[positions[k]] = k;
+
+  // in_strides[i] and out_strides[i] are the strides of output dimension i,
+  // which is input dimension p[i], in the input and the output.
+  internal::TransposeDimsVec input_strides(n, 1);
+  for (int k = n - 2; k >= 0; --k) {
+    input_strides[k] = input_strides[k + 1] * dims[k + 1];
+  }
+  internal::TransposeDimsVec out_dims(n), in_strides(n), out_strides(n, 1);
+  for (int i = 0; i < n; ++i) {
+    out_dims[i] = dims[p[i]];
+    in_strides[i] = input_strides[p[i]];
+  }
+  for (int i = n - 2; i >= 0; --i) {
+    out_strides[i] = out_strides[i + 1] * out_dims[i + 1];
+  }
+
+  if (p[n - 1] == n - 1) {
+    // Copies runs of the innermost dimension, iterating over the other
+    // output dimensions in order.
+    const int64_t run = dims[n - 1];
+    if (run * static_cast<int64_t>(sizeof(T)) < kMinBlockedTransposeRunBytes) {
+      return false;
+    }
+    const int64_t num_runs = in.NumElements() / run;
+    auto copy_runs = [&](int64_t begin, int64_t end) {
+      internal::TransposeDimsVec index(n - 1);
+      int64_t in_offset = 0;
+      int64_t t = begin;
+      for (int i = n - 2; i >= 0; --i) {
+        index[i] = t % out_dims[i];
+        t /= out_dims[i];
+        in_offset += index[i] * in_strides[i];
+      }
+      for (int64_t r = begin; r < end; ++r) {
+        std::copy_n(src + in_offset, run, dst + r * run);
+        for (int i = n - 2; i >= 0; --i) {
+          in_offset += in_strides[i];
+          if (++index[i] < out_dims[i]) break;
+          in_offset -= index[i] * in_strides[i];
+          index[i] = 0;
+        }
+      }
+    };
+    const Eigen::TensorOpCost cost(run * sizeof(T), run * sizeof(T), n);
+    device.parallelFor(num_runs, cost, std::move(copy_runs));
+    return true;
+  }
+
+  // Output dimension "cols_dim" is the input innermost dimension and output
+  // dimension n - 1 is input dimension p[n - 1]: each tile reads "rows"
+  // along the latter and writes "cols" along the former.
+  int cols_dim = 0;
+  while (p[cols_dim] != n - 1) ++cols_dim;
+  const int64_t rows = out_dims[n - 1];
+  const int64_t cols = out_dims[cols_dim];
+  const int64_t src_stride = in_strides[n - 1];
+  const int64_t dst_stride = out_strides[cols_dim];
+  internal::TransposeDimsVec batch_dims, batch_in_strides, batch_out_strides;
+  for (int i = 0; i < n - 1; ++i) {
+    if (i == cols_dim) continue;
+    batch_dims.push_back(out_dims[i]);
+    batch_in_strides.push_back(in_strides[i]);
+    batch_out_strides.push_back(out_strides[i]);
+  }
+  const int64_t batch_size = in.NumElements() / (rows * cols);
+
+  // Square tiles of up to 16KB.
+  constexpr int64_t kTileSize =
+      std::max<int64_t>(16, std::min<int64_t>(128, 256 / sizeof(T)));
+  const int64_t row_tiles = (rows + kTileSize - 1) / kTileSize;
+  const int64_t col_tiles = (cols + kTileSize - 1) / kTileSize;
+  auto transpose_tiles = [&](int64_t begin, int64_t end) {
+    for (int64_t tile = begin; tile < end; ++tile) {
+      // Tiles along the output rows are innermost, so that consecutive tiles
+      // continue the same output rows.
+      const int64_t row_tile = tile % row_tiles;
+      const int64_t col_tile = (tile / row_tiles) % col_tiles;
+      int64_t b = tile / (row_tiles * col_tiles);
+      int64_t in_offset = 0;
+      int64_t out_offset = 0;
+      for (int i = batch_dims.size() - 1; i >= 0; --i) {
+        const int64_t index = b % batch_dims[i];
+        b /= batch_dims[i];
+        in_offset += index * batch_in_strides[i];
+        out_offset += index * batch_out_strides[i];
+      }
+      const int64_t r = row_tile * kTileSize;
+      const int64_t c = col_tile * kTileSize;
+      TransposeTile(src + in_offset + r * src_stride + c, src_stride,
+                    dst + out_offset + c * dst_stride + r, dst_stride,
+                    std::min(kTileSize, rows - r),
+                    std::min(kTileSize, cols - c));
+    }
+  };
+  const int64_t tile_bytes = kTileSize * kTileSize * sizeof(T);
+  const Eigen::TensorOpCost cost(tile_bytes, tile_bytes,
+                                 kTileSize * kTileSize);
+  device.parallelFor(batch_size * row_tiles * col_tiles, cost,
+                     std::move(transpose_tiles));
+  return true;
+}
+
 }  // namespace
 
 template <typename T, bool conjugate>
 struct Transpose<CPUDevice, T, conjugate> {
   static void run(const CPUDevice& d, const Tensor& in,
                   const absl::Span<const int32> perm, Tensor* out) {
+    if constexpr (!conjugate && std::is_trivially_copyable<T>::value) {
+      if (TransposeBlocked<T>(d, in, perm, out)) return;
+    }
     switch (in.dims()) {
       case 2:
         internal::TransposeUsingEigen<CPUDevice, T, 2>(d, in, perm, conjugate,
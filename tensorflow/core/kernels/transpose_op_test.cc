@@ -0,0 +1,172 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Transposes `in` one element at a time.
+template <typename T>
+Tensor ReferenceTranspose(const Tensor& in, const std::vector<int32>& perm) {
+  TensorShape out_shape;
+  for (int32 d : perm) out_shape.AddDim(in.dim_size(d));
+  Tensor out(in.dtype(), out_shape);
+  const auto in_strides = ComputeStride<int64_t>(in.shape());
+  const auto out_strides = ComputeStride<int64_t>(out_shape);
+  const auto src = in.flat<T>();
+  auto dst = out.flat<T>();
+  for (int64_t o = 0; o < out.NumElements(); ++o) {
+    int64_t i = 0;
+    int64_t t = o;
+    for (int d = 0; d < in.dims(); ++d) {
+      i += (t / out_strides[d]) * in_strides[perm[d]];
+      t %= out_strides[d];
+    }
+    dst(o) = src(i);
+  }
+  return out;
+}
+
+class TransposeOpTest : public OpsTestBase {
+ protected:
+  // Transposes a tensor of the given shape holding 0, 1, 2, ... and checks
+  // the result against ReferenceTranspose.
+  template <typename T>
+  void RunAndCheck(const TensorShape& shape, const std::vector<int32>& perm) {
+    TF_ASSERT_OK(NodeDefBuilder("transpose", "Transpose")
+                     .Input(FakeInput(DataTypeToEnum<T>::v()))
+                     .Input(FakeInput(DT_INT32))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInput<T>(shape, [](int i) { return static_cast<T>(i); });
+    AddInputFromArray<int32>(TensorShape({static_cast<int64_t>(perm.size())}),
+                             perm);
+    TF_ASSERT_OK(RunOpKernel());
+    test::ExpectTensorEqual<T>(ReferenceTranspose<T>(*GetInput(0), perm),
+                               *GetOutput(0));
+  }
+};
+
+TEST_F(TransposeOpTest, NHWCToNCHW) {
+  RunAndCheck<float>(TensorShape({2, 17, 19, 35}), {0, 3, 1, 2});
+}
+
+TEST_F(TransposeOpTest, NCHWToNHWC) {
+  RunAndCheck<float>(TensorShape({2, 35, 17, 19}), {0, 2, 3, 1});
+}
+
+TEST_F(TransposeOpTest, AttentionHeads) {
+  // [batch, seq, heads, head_dim] -> [batch, heads, seq, head_dim], which
+  // keeps the innermost dimension, and the transposed keys.
+  RunAndCheck<float>(TensorShape({2, 33, 4, 16}), {0, 2, 1, 3});
+  RunAndCheck<float>(TensorShape({2, 33, 4, 16}), {0, 2, 3, 1});
+}
+
+TEST_F(TransposeOpTest, Matrix) {
+  RunAndCheck<double>(TensorShape({131, 257}), {1, 0});
+}
+
+TEST_F(TransposeOpTest, ElementSizes) {
+  RunAndCheck<uint8>(TensorShape({3, 67, 45}), {2, 0, 1});
+  RunAndCheck<int16>(TensorShape({3, 67, 45}), {1, 2, 0});
+  RunAndCheck<int64_t>(TensorShape({3, 67, 45}), {2, 1, 0});
+  RunAndCheck<complex64>(TensorShape({3, 67, 45}), {0, 2, 1});
+  RunAndCheck<complex128>(TensorShape({3, 67, 45}), {1, 0, 2});
+}
+
+TEST_F(TransposeOpTest, HighRank) {
+  RunAndCheck<float>(TensorShape({3, 5, 2, 7, 4, 9}), {4, 1, 5, 0, 3, 2});
+  RunAndCheck<int32>(TensorShape({3, 5, 2, 7, 4, 9}), {5, 3, 1, 4, 2, 0});
+}
+
+TEST_F(TransposeOpTest, MergedAndUnitDimensions) {
+  // Dimensions 1 and 2 stay adjacent and dimension 3 has size 1.
+  RunAndCheck<float>(TensorShape({9, 10, 11, 1, 12}), {4, 3, 1, 2, 0});
+}
+
+//----------------------------------------------------------------------------//
+// Performance benchmarks are below.                                          //
+//----------------------------------------------------------------------------//
+
+static Graph* Transpose(const TensorShape& shape,
+                        const std::vector<int32>& perm) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor in(DT_FLOAT, shape);
+  in.flat<float>().setRandom();
+  TF_CHECK_OK(NodeBuilder(g->NewName("transpose"), "Transpose")
+                  .Input(test::graph::Constant(g, in))
+                  .Input(test::graph::Constant(g, test::AsTensor<int32>(perm)))
+                  .Finalize(g, nullptr));
+  return g;
+}
+
+#define BM_Transpose4D(NAME, D0, D1, D2, D3, P0, P1, P2, P3)               \
+  static void BM_Transpose_##NAME##_##D0##_##D1##_##D2##_##D3(             \
+      ::testing::benchmark::State& state) {                                \
+    test::Benchmark("cpu",                                                 \
+                    Transpose(TensorShape({D0, D1, D2, D3}),               \
+                              {P0, P1, P2, P3}),                           \
+                    /*old_benchmark_api*/ false)                           \
+        .Run(state);                                                       \
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * 2 * \
+                            D0 * D1 * D2 * D3 * sizeof(float));            \
+  }                                                                        \
+  BENCHMARK(BM_Transpose_##NAME##_##D0##_##D1##_##D2##_##D3)->UseRealTime();
+
+// Layout conversions of convolution activations.
+BM_Transpose4D(NHWCToNCHW, 32, 56, 56, 64, 0, 3, 1, 2);
+BM_Transpose4D(NHWCToNCHW, 32, 14, 14, 512, 0, 3, 1, 2);
+BM_Transpose4D(NCHWToNHWC, 32, 64, 56, 56, 0, 2, 3, 1);
+BM_Transpose4D(NCHWToNHWC, 32, 512, 14, 14, 0, 2, 3, 1);
+
+// [batch, seq, heads, head_dim] to [batch, heads, seq, head_dim], and to
+// [batch, heads, head_dim, seq] for the keys.
+BM_Transpose4D(AttentionHeads, 8, 512, 16, 64, 0, 2, 1, 3);
+BM_Transpose4D(AttentionHeads, 32, 128, 12, 64, 0, 2, 1, 3);
+BM_Transpose4D(AttentionKeys, 8, 512, 16, 64, 0, 2, 3, 1);
+BM_Transpose4D(AttentionKeys, 32, 128, 12, 64, 0, 2, 3, 1);
+
+void BM_TransposeMatrix(::testing::benchmark::State& state) {
+  const int rows = state.range(0);
+  const int cols = state.range(1);
+  test::Benchmark("cpu", Transpose(TensorShape({rows, cols}), {1, 0}),
+                  /*old_benchmark_api*/ false)
+      .Run(state);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * 2 *
+                          rows * cols * sizeof(float));
+}
+BENCHMARK(BM_TransposeMatrix)
+    ->UseRealTime()
+    ->ArgPair(1024, 1024)
+    ->ArgPair(4096, 4096)
+    ->ArgPair(1000, 3000);
+
+}  // namespace
+}  // namespace tensorflow
@@ -13,9 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
@@ -23,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/kernels/unique_op_parallel.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/platform/bfloat16.h"
@@ -68,6 +72,14 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
   using map_type = std::unordered_map<bfloat16, TIndex>;
 };
 
+// Element types that are uniquified with `ParallelUnique()` when the input is
+// large enough.
+template <typename T>
+struct UniqueOpSupportsParallel
+    : std::integral_constant<bool, std::is_same<T, int32>::value ||
+                                       std::is_same<T, int64_t>::value ||
+                                       std::is_same<T, tstring>::value> {};
+
 // `UniqueOp` computes the unique elements in the input tensor.
 //
 // * `T` is the element type.
@@ -143,6 +155,8 @@ class UniqueOp : public OpKernel {
     auto idx_vec = idx->template vec<TIndex>();
 
     int64_t uniq_size;
+    // Filled in by the parallel path, which counts as it goes.
+    std::vector<TIndex> counts;
     if (new_sizes[0] == 1 && new_sizes[2] == 1) {
       // Specialized and faster implementation when unique is run over single
       // elements. Here we put T directly into the map rather than ints pointing
@@ -150,26 +164,44 @@ class UniqueOp : public OpKernel {
       auto Tin = input.flat<T>();
       const int64_t N = static_cast<int64_t>(Tin.size());
 
-      typename UniqueOpHashMap<T, TIndex>::map_type uniq;
-      uniq.reserve(2 * N);
-      for (Eigen::Index i = 0, j = 0; i < N; ++i) {
-        auto it = uniq.emplace(Tin(i), j);
-        idx_vec(i) = it.first->second;
-        if (it.second) {
-          ++j;
+      // Integers from a small range and large inputs do not go through the
+      // serial hash map below. Both paths produce the input position of each
+      // unique element, in order of first occurrence.
+      std::vector<int64_t> first_positions;
+      if (ComputeFirstPositions(context, Tin.data(), N, idx_vec.data(),
+                                &first_positions,
+                                num_outputs() > 2 ? &counts : nullptr)) {
+        uniq_size = static_cast<int64_t>(first_positions.size());
+        TensorShape output_shape(input.shape());
+        output_shape.set_dim(axis, uniq_size);
+        Tensor* output = nullptr;
+        OP_REQUIRES_OK(context,
+                       context->allocate_output(0, output_shape, &output));
+        auto Tout = output->flat<T>();
+        for (int64_t i = 0; i < uniq_size; ++i) {
+          Tout(i) = Tin(first_positions[i]);
+        }
+      } else {
+        typename UniqueOpHashMap<T, TIndex>::map_type uniq;
+        uniq.reserve(2 * N);
+        for (Eigen::Index i = 0, j = 0; i < N; ++i) {
+          auto it = uniq.emplace(Tin(i), j);
+          idx_vec(i) = it.first->second;
+          if (it.second) {
+            ++j;
+          }
         }
-      }
-
-      uniq_size = static_cast<int64_t>(uniq.size());
-      TensorShape output_shape(input.shape());
-      output_shape.set_dim(axis, uniq_size);
-      Tensor* output = nullptr;
-      OP_REQUIRES_OK(context,
-                     context->allocate_output(0, output_shape, &output));
-      auto Tout = output->flat<T>();
 
-      for (const auto& it : uniq) {
-        Tout(it.second) = it.first;
+        uniq_size = static_cast<int64_t>(uniq.size());
+        TensorShape output_shape(input.shape());
+        output_shape.set_dim(axis, uniq_size);
+        Tensor* output = nullptr;
+        OP_REQUIRES_OK(context,
+                       context->allocate_output(0, output_shape, &output));
+        auto Tout = output->flat<T>();
+        for (const auto& it : uniq) {
+          Tout(it.second) = it.first;
+        }
       }
     } else {
       // General implementation when unique is run over multiple elements.
@@ -230,13 +262,50 @@ class UniqueOp : public OpKernel {
       OP_REQUIRES_OK(context, context->allocate_output(
                                   2, TensorShape({uniq_size}), &output));
       auto count_output_vec = output->template vec<TIndex>();
-      count_output_vec.setZero();
-      const int N = idx_vec.size();
-      for (int64_t i = 0; i < N; ++i) {
-        count_output_vec(idx_vec(i))++;
+      if (!counts.empty()) {
+        std::copy(counts.begin(), counts.end(), count_output_vec.data());
+      } else {
+        count_output_vec.setZero();
+        const int N = idx_vec.size();
+        for (int64_t i = 0; i < N; ++i) {
+          count_output_vec(idx_vec(i))++;
+        }
       }
     }
   }
+
+ private:
+  // Uniquifies a vector without the serial hash map if a faster algorithm
+  // applies, and returns false otherwise:
+  //
+  // * Integers whose values span a range not much larger than the input use a
+  //   direct-addressed table.
+  // * Large int32, int64 and string inputs are partitioned by hash and the
+  //   partitions are uniquified concurrently. This also fills `counts` if it is
+  //   not null.
+  static bool ComputeFirstPositions(OpKernelContext* context, const T* input,
+                                    int64_t n, TIndex* idx,
+                                    std::vector<int64_t>* first_positions,
+                                    std::vector<TIndex>* counts) {
+    if constexpr (std::is_integral<T>::value) {
+      T min_value;
+      if (unique_op_internal::HasDenseRange(input, n, &min_value)) {
+        unique_op_internal::DenseUnique(input, n, min_value, idx,
+                                        first_positions);
+        return true;
+      }
+    }
+    if constexpr (UniqueOpSupportsParallel<T>::value) {
+      if (n < unique_op_internal::kMinParallelUniqueSize) return false;
+      auto* worker_threads = context->device()->tensorflow_cpu_worker_threads();
+      if (worker_threads->num_threads <= 1) return false;
+      unique_op_internal::ParallelUnique<
+          T, TIndex, typename UniqueOpHashMap<T, TIndex>::map_type>(
+          input, n, worker_threads->workers, idx, first_positions, counts);
+      return true;
+    }
+    return false;
+  }
 };
 
 #define REGISTER_UNIQUE(type)                                      \
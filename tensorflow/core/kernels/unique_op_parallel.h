@@ -0,0 +1,240 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_UNIQUE_OP_PARALLEL_H_
+#define TENSORFLOW_CORE_KERNELS_UNIQUE_OP_PARALLEL_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace unique_op_internal {
+
+// Inputs with fewer elements than this are uniquified serially.
+inline constexpr int64_t kMinParallelUniqueSize = 1 << 16;
+
+// Integer inputs whose value range is at most this many times their size are
+// uniquified with a direct-addressed table instead of a hash map.
+inline constexpr int64_t kDenseRangeFactor = 2;
+
+// Upper bound on the direct-addressed table, in entries.
+inline constexpr int64_t kMaxDenseRange = 1 << 24;
+
+// Hash used to assign elements to partitions. Partitions are taken from the
+// top bits, so the hash must mix well into them.
+inline uint64_t PartitionHash(int32_t value) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(value)) *
+         0x9E3779B97F4A7C15ULL;
+}
+inline uint64_t PartitionHash(int64_t value) {
+  return static_cast<uint64_t>(value) * 0x9E3779B97F4A7C15ULL;
+}
+inline uint64_t PartitionHash(const tstring& value) {
+  return Hash64(value.data(), value.size());
+}
+
+// Returns the [min, max] range of `input` if it is small enough for
+// DenseUnique() and false otherwise.
+template <typename T>
+bool HasDenseRange(const T* input, int64_t n, T* min_value) {
+  static_assert(std::is_integral<T>::value, "Integer type expected.");
+  if (n == 0) return false;
+  T lo = input[0];
+  T hi = input[0];
+  for (int64_t i = 1; i < n; ++i) {
+    lo = std::min(lo, input[i]);
+    hi = std::max(hi, input[i]);
+  }
+  // Unsigned subtraction cannot overflow even for the full int64 range.
+  const uint64_t range = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo);
+  if (range >= static_cast<uint64_t>(
+                   std::min(kMaxDenseRange, kDenseRangeFactor * n))) {
+    return false;
+  }
+  *min_value = lo;
+  return true;
+}
+
+// Uniquifies integers in [min_value, min_value + kDenseRangeFactor * n) with
+// a table indexed by value. Writes the index of each element's unique value to
+// `idx` and appends the input position of each unique value, in order of first
+// occurrence, to `first_positions`.
+template <typename T, typename TIndex>
+void DenseUnique(const T* input, int64_t n, T min_value, TIndex* idx,
+                 std::vector<int64_t>* first_positions) {
+  const uint64_t base = static_cast<uint64_t>(min_value);
+  std::vector<TIndex> table(std::min(kMaxDenseRange, kDenseRangeFactor * n),
+                            TIndex(-1));
+  TIndex next = 0;
+  for (int64_t i = 0; i < n; ++i) {
+    TIndex& slot = table[static_cast<uint64_t>(input[i]) - base];
+    if (slot < 0) {
+      slot = next++;
+      first_positions->push_back(i);
+    }
+    idx[i] = slot;
+  }
+}
+
+// Uniquifies `input` on `workers` with a partitioned hash table build:
+//
+//  1. Elements are assigned to partitions by hash, and their positions are
+//     scattered into per-partition lists that stay in input order.
+//  2. Each partition builds its own `Map` (from element to partition-local id)
+//     concurrently, so no locking is needed.
+//  3. The first occurrences from all partitions are ranked by input position,
+//     which gives the same output order as the serial algorithm (order of
+//     first occurrence), and the local ids are remapped to those ranks.
+//
+// Writes the index of each element's unique value to `idx`, and the input
+// position of each unique value in output order to `first_positions`. If
+// `counts` is not null, it receives the number of occurrences of each unique
+// value.
+template <typename T, typename TIndex, typename Map>
+void ParallelUnique(const T* input, int64_t n, thread::ThreadPool* workers,
+                    TIndex* idx, std::vector<int64_t>* first_positions,
+                    std::vector<TIndex>* counts) {
+  // At most 256 partitions, so that a partition id fits in a byte.
+  int partition_bits = 1;
+  while ((1 << partition_bits) < 4 * workers->NumThreads() &&
+         partition_bits < 8) {
+    ++partition_bits;
+  }
+  const int num_partitions = 1 << partition_bits;
+  const int shift = 64 - partition_bits;
+
+  const int64_t num_blocks =
+      std::min<int64_t>(4 * workers->NumThreads(),
+                        (n + kMinParallelUniqueSize / 4 - 1) /
+                            (kMinParallelUniqueSize / 4));
+  const int64_t block_size = (n + num_blocks - 1) / num_blocks;
+  auto for_each_block = [&](int64_t cost_per_element, auto&& fn) {
+    workers->ParallelFor(num_blocks, block_size * cost_per_element,
+                         [&](int64_t start, int64_t limit) {
+                           for (int64_t b = start; b < limit; ++b) {
+                             fn(b, b * block_size,
+                                std::min(n, (b + 1) * block_size));
+                           }
+                         });
+  };
+
+  // 1. Partition histogram per block, then scatter positions in input order.
+  std::vector<uint8_t> partition_of(n);
+  std::vector<int64_t> offsets(num_blocks * num_partitions, 0);
+  for_each_block(8, [&](int64_t b, int64_t begin, int64_t end) {
+    int64_t* hist = offsets.data() + b * num_partitions;
+    for (int64_t i = begin; i < end; ++i) {
+      const uint8_t p = static_cast<uint8_t>(PartitionHash(input[i]) >> shift);
+      partition_of[i] = p;
+      ++hist[p];
+    }
+  });
+  std::vector<int64_t> partition_begin(num_partitions + 1, 0);
+  int64_t running = 0;
+  for (int p = 0; p < num_partitions; ++p) {
+    partition_begin[p] = running;
+    for (int64_t b = 0; b < num_blocks; ++b) {
+      const int64_t count = offsets[b * num_partitions + p];
+      offsets[b * num_partitions + p] = running;
+      running += count;
+    }
+  }
+  partition_begin[num_partitions] = running;
+  std::vector<int64_t> positions(n);
+  for_each_block(2, [&](int64_t b, int64_t begin, int64_t end) {
+    int64_t* cursor = offsets.data() + b * num_partitions;
+    for (int64_t i = begin; i < end; ++i) {
+      positions[cursor[partition_of[i]]++] = i;
+    }
+  });
+
+  // 2. Per-partition hash tables. `idx` temporarily holds local ids.
+  std::vector<std::vector<int64_t>> local_first(num_partitions);
+  std::vector<std::vector<TIndex>> local_counts(num_partitions);
+  std::vector<uint8_t> is_first(n, 0);
+  workers->ParallelFor(
+      num_partitions, 32 * n / num_partitions,
+      [&](int64_t start, int64_t limit) {
+        for (int64_t p = start; p < limit; ++p) {
+          const int64_t begin = partition_begin[p];
+          const int64_t end = partition_begin[p + 1];
+          Map uniq;
+          uniq.reserve(end - begin);
+          std::vector<int64_t>& first = local_first[p];
+          std::vector<TIndex>& count = local_counts[p];
+          for (int64_t j = begin; j < end; ++j) {
+            const int64_t i = positions[j];
+            auto it = uniq.emplace(input[i], static_cast<TIndex>(first.size()));
+            if (it.second) {
+              first.push_back(i);
+              count.push_back(0);
+              is_first[i] = 1;
+            }
+            idx[i] = it.first->second;
+            ++count[it.first->second];
+          }
+        }
+      });
+
+  // 3. Rank first occurrences by input position.
+  std::vector<int64_t> block_uniques(num_blocks + 1, 0);
+  for_each_block(1, [&](int64_t b, int64_t begin, int64_t end) {
+    int64_t count = 0;
+    for (int64_t i = begin; i < end; ++i) count += is_first[i];
+    block_uniques[b + 1] = count;
+  });
+  for (int64_t b = 0; b < num_blocks; ++b) {
+    block_uniques[b + 1] += block_uniques[b];
+  }
+  first_positions->resize(block_uniques[num_blocks]);
+  for_each_block(1, [&](int64_t b, int64_t begin, int64_t end) {
+    int64_t rank = block_uniques[b];
+    for (int64_t i = begin; i < end; ++i) {
+      if (is_first[i]) (*first_positions)[rank++] = i;
+    }
+  });
+
+  std::vector<std::vector<TIndex>> global_id(num_partitions);
+  for (int p = 0; p < num_partitions; ++p) {
+    global_id[p].resize(local_first[p].size());
+  }
+  if (counts != nullptr) counts->resize(first_positions->size());
+  const int64_t num_uniques = first_positions->size();
+  workers->ParallelFor(num_uniques, 4, [&](int64_t start, int64_t limit) {
+    for (int64_t g = start; g < limit; ++g) {
+      const int64_t i = (*first_positions)[g];
+      const uint8_t p = partition_of[i];
+      global_id[p][idx[i]] = static_cast<TIndex>(g);
+      if (counts != nullptr) (*counts)[g] = local_counts[p][idx[i]];
+    }
+  });
+
+  for_each_block(2, [&](int64_t b, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      idx[i] = global_id[partition_of[i]][idx[i]];
+    }
+  });
+}
+
+}  // namespace unique_op_internal
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_UNIQUE_OP_PARALLEL_H_
@@ -13,13 +13,22 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
@@ -27,8 +36,11 @@ limitations under the License.
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/kernels/unique_op_parallel.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
@@ -37,6 +49,139 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+// Reference implementation: unique values in order of first occurrence.
+template <typename T>
+void SerialUnique(const std::vector<T>& input, std::vector<T>* values,
+                  std::vector<int64_t>* idx, std::vector<int64_t>* counts) {
+  std::unordered_map<T, int64_t> ids;
+  for (const T& x : input) {
+    auto it = ids.emplace(x, values->size());
+    if (it.second) {
+      values->push_back(x);
+      counts->push_back(0);
+    }
+    idx->push_back(it.first->second);
+    ++(*counts)[it.first->second];
+  }
+}
+
+template <typename T, typename Map>
+void ExpectParallelUniqueMatchesSerial(const std::vector<T>& input,
+                                       int num_threads) {
+  thread::ThreadPool pool(Env::Default(), "unique_test", num_threads);
+  const int64_t n = input.size();
+  std::vector<int64_t> idx(n);
+  std::vector<int64_t> first_positions;
+  std::vector<int64_t> counts;
+  unique_op_internal::ParallelUnique<T, int64_t, Map>(
+      input.data(), n, &pool, idx.data(), &first_positions, &counts);
+
+  std::vector<T> expected_values;
+  std::vector<int64_t> expected_idx;
+  std::vector<int64_t> expected_counts;
+  SerialUnique(input, &expected_values, &expected_idx, &expected_counts);
+  ASSERT_EQ(first_positions.size(), expected_values.size());
+  for (size_t g = 0; g < first_positions.size(); ++g) {
+    EXPECT_EQ(input[first_positions[g]], expected_values[g]) << g;
+  }
+  EXPECT_EQ(idx, expected_idx);
+  EXPECT_EQ(counts, expected_counts);
+}
+
+TEST(ParallelUniqueTest, Int64AcrossCardinalities) {
+  std::mt19937_64 rng(/*seed=*/42);
+  for (int64_t cardinality : {1, 17, 4096, 1 << 20}) {
+    std::vector<int64_t> input(300000);
+    for (int64_t& x : input) {
+      // Spread values out so that the dense-range path would not apply.
+      x = static_cast<int64_t>(rng() % cardinality) * 1000003 - 7;
+    }
+    ExpectParallelUniqueMatchesSerial<int64_t,
+                                      absl::flat_hash_map<int64_t, int64_t>>(
+        input, /*num_threads=*/8);
+  }
+}
+
+TEST(ParallelUniqueTest, Int32) {
+  std::mt19937 rng(/*seed=*/42);
+  std::vector<int32> input(100000);
+  for (int32& x : input) x = static_cast<int32>(rng());
+  ExpectParallelUniqueMatchesSerial<int32, absl::flat_hash_map<int32, int64_t>>(
+      input, /*num_threads=*/3);
+}
+
+TEST(ParallelUniqueTest, Strings) {
+  std::mt19937 rng(/*seed=*/42);
+  std::vector<tstring> input(70000);
+  for (tstring& x : input) x = std::to_string(rng() % 5000);
+  ExpectParallelUniqueMatchesSerial<
+      tstring, absl::flat_hash_map<absl::string_view, int64_t>>(
+      input, /*num_threads=*/4);
+}
+
+TEST(ParallelUniqueTest, DenseRange) {
+  const std::vector<int64_t> input = {5, -3, 5, 0, -3, 7, 7, 7, 2};
+  int64_t min_value;
+  ASSERT_TRUE(unique_op_internal::HasDenseRange(input.data(), input.size(),
+                                                &min_value));
+  EXPECT_EQ(min_value, -3);
+  std::vector<int64_t> idx(input.size());
+  std::vector<int64_t> first_positions;
+  unique_op_internal::DenseUnique(input.data(), input.size(), min_value,
+                                  idx.data(), &first_positions);
+  EXPECT_EQ(first_positions, std::vector<int64_t>({0, 1, 3, 5, 8}));
+  EXPECT_EQ(idx, std::vector<int64_t>({0, 1, 0, 2, 1, 3, 3, 3, 4}));
+
+  // The range of these values does not even fit in int64.
+  const std::vector<int64_t> wide = {std::numeric_limits<int64_t>::min(),
+                                     std::numeric_limits<int64_t>::max()};
+  EXPECT_FALSE(
+      unique_op_internal::HasDenseRange(wide.data(), wide.size(), &min_value));
+}
+
+class UniqueOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(DataType type) {
+    TF_ASSERT_OK(NodeDefBuilder("unique", "UniqueWithCounts")
+                     .Input(FakeInput(type))
+                     .Attr("out_idx", DT_INT32)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(UniqueOpTest, SmallRangeInt32) {
+  MakeOp(DT_INT32);
+  AddInputFromArray<int32>(TensorShape({8}), {4, 1, 4, 2, 1, 4, 8, 2});
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(0), test::AsTensor<int32>({4, 1, 2, 8}, TensorShape({4})));
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(1),
+      test::AsTensor<int32>({0, 1, 0, 2, 1, 0, 3, 2}, TensorShape({8})));
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(2), test::AsTensor<int32>({3, 2, 2, 1}, TensorShape({4})));
+}
+
+TEST_F(UniqueOpTest, WideRangeInt64) {
+  MakeOp(DT_INT64);
+  AddInputFromArray<int64_t>(
+      TensorShape({5}),
+      {std::numeric_limits<int64_t>::max(), 0,
+       std::numeric_limits<int64_t>::min(), 0,
+       std::numeric_limits<int64_t>::max()});
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<int64_t>(
+      *GetOutput(0), test::AsTensor<int64_t>(
+                         {std::numeric_limits<int64_t>::max(), 0,
+                          std::numeric_limits<int64_t>::min()},
+                         TensorShape({3})));
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(1), test::AsTensor<int32>({0, 1, 2, 1, 0}, TensorShape({5})));
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(2), test::AsTensor<int32>({2, 2, 1}, TensorShape({3})));
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -149,6 +294,47 @@ void BM_Unique_STRING(::testing::benchmark::State& state) {
                           sizeof(tstring));
 }
 
+// Int64 ids drawn from `cardinality` values spread over the whole int64 range,
+// as in embedding lookups with hashed feature ids. Uses the default executor
+// so that the kernel gets the intra-op thread pool.
+void BM_Unique_INT64_Cardinality(::testing::benchmark::State& state) {
+  const int dim = state.range(0);
+  const int cardinality = state.range(1);
+
+  Graph* g = new Graph(OpRegistry::Global());
+
+  std::mt19937_64 rng(/*seed=*/1);
+  std::vector<uint64_t> ids(cardinality);
+  for (uint64_t& id : ids) id = rng();
+  Tensor input(DT_INT64, TensorShape({dim}));
+  auto input_flat = input.flat<int64_t>();
+  for (int i = 0; i < dim; ++i) {
+    input_flat(i) = static_cast<int64_t>(ids[rng() % cardinality]);
+  }
+
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "UniqueWithCounts")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, nullptr));
+  FixupSourceAndSinkEdges(g);
+
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * dim);
+}
+
+BENCHMARK(BM_Unique_INT64_Cardinality)
+    ->UseRealTime()
+    ->ArgPair(64 * 1024, 16)
+    ->ArgPair(64 * 1024, 4 * 1024)
+    ->ArgPair(64 * 1024, 64 * 1024)
+    ->ArgPair(1024 * 1024, 16)
+    ->ArgPair(1024 * 1024, 4 * 1024)
+    ->ArgPair(1024 * 1024, 256 * 1024)
+    ->ArgPair(1024 * 1024, 1024 * 1024)
+    ->ArgPair(8 * 1024 * 1024, 4 * 1024)
+    ->ArgPair(8 * 1024 * 1024, 1024 * 1024)
+    ->ArgPair(8 * 1024 * 1024, 8 * 1024 * 1024);
+
 BENCHMARK(BM_Unique_INT32)
     ->UseRealTime()
     ->ArgPair(32, 1024 * 1024)
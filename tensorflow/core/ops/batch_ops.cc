@@ -88,6 +88,12 @@ REGISTER_OP("BatchFunction")
     // NOTE: Support for `enable_large_batch_splitting == true` is still
     // developed in progress.
     .Attr("enable_large_batch_splitting: bool = false")
+    // If non-empty, inputs are grouped by the size of their dimension 1 (e.g.
+    // a sequence length) into buckets, each bucket with its own batching
+    // queue, and padded with zeros along dimension 1 up to the bucket length.
+    // The entries must be positive and increase monotonically; inputs longer
+    // than the last entry are rejected.
+    .Attr("length_buckets: list(int) = []")
     // TODO(apassos): Fix this shape inference function. It requires shape
     // inference of function calls.
     .SetShapeFn(shape_inference::UnknownShape)
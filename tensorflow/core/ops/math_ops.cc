@@ -937,6 +937,39 @@ _FusedConv2D output.
 expected to create these operators.
 )doc");
 
+REGISTER_OP("_DynamicRangeQuantizedMatMul")
+    .Input("a: float")
+    .Input("weights: int8")
+    .Input("weight_scales: float")
+    .Output("product: float")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle a;
+      ShapeHandle weights;
+      ShapeHandle weight_scales;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 2, &a));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &weights));
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &weight_scales));
+      DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->Merge(c->Dim(a, 1), c->Dim(weights, 1), &unused));
+      DimensionHandle output_channels;
+      TF_RETURN_IF_ERROR(c->Merge(c->Dim(weights, 0), c->Dim(weight_scales, 0),
+                                  &output_channels));
+      c->set_output(0, c->Matrix(c->Dim(a, 0), output_channels));
+      return absl::OkStatus();
+    })
+    .Doc(R"doc(
+Performs a float MatMul against int8 weights quantized per output channel.
+
+`weights` holds one row of `k` int8 values per output channel, i.e. the
+transpose of the float `b` it replaces, and `weight_scales` holds the
+per-channel scale so that `b[:, j] ~= weights[j, :] * weight_scales[j]`. Each
+row of `a` is quantized symmetrically to int8 at runtime, the product is
+accumulated in int32 and rescaled to float.
+
+*NOTE*: Do not invoke this operator directly in Python. Grappler is
+expected to create these operators.
+)doc");
+
 // --------------------------------------------------------------------------
 
 // For operations where the output is a reduction function along some
@@ -1473,6 +1506,40 @@ REGISTER_OP("SparseSegmentSqrtNGradV2")
     .Attr("Tsegmentids: {int32, int64} = DT_INT32")
     .SetShapeFn(SparseSegmentReductionGradV2ShapeFn);
 
+REGISTER_OP("_FusedEmbeddingLookupSparse")
+    .Input("params: T")
+    .Input("ids: Tidx")
+    .Input("segment_ids: Tsegmentids")
+    .Input("weights: num_weights * T")
+    .Output("output: T")
+    .Attr("T: {float}")
+    .Attr("Tidx: {int32, int64} = DT_INT32")
+    .Attr("Tsegmentids: {int32, int64} = DT_INT32")
+    .Attr("num_weights: int >= 0 = 0")
+    .Attr("combiner: {'sum', 'mean', 'sqrtn'} = 'sum'")
+    .SetShapeFn([](InferenceContext* c) {
+      TF_RETURN_IF_ERROR(SparseSegmentReductionShapeFn(c));
+      int num_weights;
+      TF_RETURN_IF_ERROR(c->GetAttr("num_weights", &num_weights));
+      for (int i = 0; i < num_weights; ++i) {
+        ShapeHandle weights;
+        TF_RETURN_IF_ERROR(c->WithRank(c->input(3 + i), 1, &weights));
+        TF_RETURN_IF_ERROR(c->Merge(weights, c->input(1), &weights));
+      }
+      return absl::OkStatus();
+    })
+    .Doc(R"doc(
+Computes combined embeddings of sparse features in one pass.
+
+Equivalent to `SparseSegmentSum/Mean/SqrtN(Gather(params, ids), range(nnz),
+segment_ids)`, with each gathered row scaled by `weights` if given. With
+weights, "mean" divides by the sum of the weights and "sqrtn" by the square
+root of the sum of their squares; segments whose sum is zero are zero.
+
+*NOTE*: Do not invoke this operator directly in Python. Grappler is
+expected to create these operators.
+)doc");
+
 REGISTER_OP("All")
     .Input("input: bool")
     .Input("reduction_indices: Tidx")
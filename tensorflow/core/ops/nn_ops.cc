@@ -1301,6 +1301,51 @@ REGISTER_OP("LogSoftmax")
 
 // --------------------------------------------------------------------------
 
+REGISTER_OP("_FusedScaledDotProductAttention")
+    .Input("query: T")
+    .Input("key: T")
+    .Input("value: T")
+    .Output("output: T")
+    .Attr("T: {float}")
+    .Attr("scale: float = 1.0")
+    .Attr("causal: bool = false")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle query, key, value;
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 2, &query));
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(1), 2, &key));
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(2), 2, &value));
+      // query is [..., Sq, D], key is [..., Sk, D] and value is [..., Sk, Dv]
+      // with the same batch dimensions.
+      ShapeHandle batch, key_batch, value_batch;
+      TF_RETURN_IF_ERROR(c->Subshape(query, 0, -2, &batch));
+      TF_RETURN_IF_ERROR(c->Subshape(key, 0, -2, &key_batch));
+      TF_RETURN_IF_ERROR(c->Subshape(value, 0, -2, &value_batch));
+      TF_RETURN_IF_ERROR(c->Merge(batch, key_batch, &batch));
+      TF_RETURN_IF_ERROR(c->Merge(batch, value_batch, &batch));
+      DimensionHandle unused;
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(query, -1), c->Dim(key, -1), &unused));
+      TF_RETURN_IF_ERROR(
+          c->Merge(c->Dim(key, -2), c->Dim(value, -2), &unused));
+      ShapeHandle out;
+      TF_RETURN_IF_ERROR(c->Concatenate(
+          batch, c->Matrix(c->Dim(query, -2), c->Dim(value, -1)), &out));
+      c->set_output(0, out);
+      return absl::OkStatus();
+    })
+    .Doc(R"doc(
+Computes softmax(scale * query @ key^T) @ value without materializing the
+[..., Sq, Sk] attention scores.
+
+With `causal`, query i only attends to keys j <= i + Sk - Sq, i.e. the last
+query attends to all keys; queries without any key produce zeros.
+
+*NOTE*: Do not invoke this operator directly in Python. Grappler is
+expected to create these operators.
+)doc");
+
+// --------------------------------------------------------------------------
+
 REGISTER_OP("SoftmaxCrossEntropyWithLogits")
     .Input("features: T")
     .Input("labels: T")
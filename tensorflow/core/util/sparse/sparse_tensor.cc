@@ -15,6 +15,12 @@ limitations under the License.
 
 #include "tensorflow/core/util/sparse/sparse_tensor.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
 #include "tensorflow/core/lib/strings/strcat.h"
 
 namespace tensorflow {
@@ -308,5 +314,114 @@ Status SparseTensor::IndicesValid() const {
   }
 }
 
+bool SparseTensor::LinearizeIndices(const VarDimArray& order,
+                                    std::vector<int64_t>* keys) const {
+  const int dims = order.size();
+  ShapeArray strides(dims);
+  int64_t num_elements = 1;
+  for (int d = dims - 1; d >= 0; --d) {
+    const int64_t dim_size = shape_[order[d]];
+    strides[d] = num_elements;
+    if (dim_size < 0 ||
+        (dim_size > 0 &&
+         num_elements > std::numeric_limits<int64_t>::max() / dim_size)) {
+      return false;
+    }
+    num_elements *= dim_size;
+  }
+
+  const auto ix_t = ix_.matrix<int64_t>();
+  const int64_t num_entries = ix_t.dimension(0);
+  keys->assign(num_entries, 0);
+  int64_t* const keys_ptr = keys->data();
+  // Accumulate one dimension at a time, so that the inner loop is a strided
+  // load and a multiply-add without dependencies across iterations. The keys
+  // are computed with unsigned arithmetic, as they may wrap around for out of
+  // bounds indices, in which case they are not used.
+  bool in_bounds = true;
+  for (int d = 0; d < dims; ++d) {
+    const int dim = order[d];
+    const uint64 dim_size = static_cast<uint64>(shape_[dim]);
+    const uint64 stride = static_cast<uint64>(strides[d]);
+    for (int64_t n = 0; n < num_entries; ++n) {
+      const uint64 index = static_cast<uint64>(ix_t(n, dim));
+      in_bounds &= index < dim_size;
+      keys_ptr[n] = static_cast<int64_t>(static_cast<uint64>(keys_ptr[n]) +
+                                         index * stride);
+    }
+  }
+  return in_bounds;
+}
+
+void SparseTensor::DelinearizeIndices(const VarDimArray& order,
+                                      const std::vector<int64_t>& keys) {
+  auto ix_t = ix_.matrix<int64_t>();
+  const int dims = order.size();
+  for (std::size_t n = 0; n < keys.size(); ++n) {
+    int64_t key = keys[n];
+    for (int d = dims - 1; d > 0; --d) {
+      const int64_t dim_size = shape_[order[d]];
+      ix_t(n, order[d]) = key % dim_size;
+      key /= dim_size;
+    }
+    if (dims > 0) {
+      ix_t(n, order[0]) = key;
+    }
+  }
+}
+
+void SparseTensor::SortByKey(std::vector<int64_t>* keys,
+                             std::vector<int64_t>* reorder) {
+  const std::size_t num_keys = keys->size();
+  DCHECK_EQ(num_keys, reorder->size());
+
+  // The histograms of a radix sort pass cost more than they save on small
+  // inputs.
+  constexpr std::size_t kMinRadixSortSize = 1024;
+  if (num_keys < kMinRadixSortSize) {
+    const std::vector<int64_t>& unsorted_keys = *keys;
+    std::stable_sort(reorder->begin(), reorder->end(),
+                     [&unsorted_keys](int64_t a, int64_t b) {
+                       return unsorted_keys[a] < unsorted_keys[b];
+                     });
+    std::vector<int64_t> sorted_keys(num_keys);
+    for (std::size_t n = 0; n < num_keys; ++n) {
+      sorted_keys[n] = unsorted_keys[(*reorder)[n]];
+    }
+    keys->swap(sorted_keys);
+    return;
+  }
+
+  // Least significant digit radix sort, skipping the digits that are zero for
+  // all keys.
+  constexpr int kRadixBits = 11;
+  constexpr int64_t kRadixMask = (int64_t{1} << kRadixBits) - 1;
+  const int64_t max_key = *std::max_element(keys->begin(), keys->end());
+  std::vector<int64_t> keys_buffer(num_keys);
+  std::vector<int64_t> reorder_buffer(num_keys);
+  std::vector<std::size_t> offsets(kRadixMask + 1);
+  for (int shift = 0; shift < 64 && (max_key >> shift) > 0;
+       shift += kRadixBits) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (const int64_t key : *keys) {
+      ++offsets[(key >> shift) & kRadixMask];
+    }
+    std::size_t offset = 0;
+    for (std::size_t& bucket_offset : offsets) {
+      const std::size_t bucket_size = bucket_offset;
+      bucket_offset = offset;
+      offset += bucket_size;
+    }
+    for (std::size_t n = 0; n < num_keys; ++n) {
+      const int64_t key = (*keys)[n];
+      const std::size_t position = offsets[(key >> shift) & kRadixMask]++;
+      keys_buffer[position] = key;
+      reorder_buffer[position] = (*reorder)[n];
+    }
+    keys->swap(keys_buffer);
+    reorder->swap(reorder_buffer);
+  }
+}
+
 }  // namespace sparse
 }  // namespace tensorflow
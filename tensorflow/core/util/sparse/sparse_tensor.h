@@ -214,6 +214,25 @@ class SparseTensor {
   template <bool standard_order>
   Status IndicesValidHelper() const;
 
+  // Computes the linearized key of each index for `order`, i.e. its offset in
+  // a dense row-major tensor whose dimensions are `shape_` permuted by
+  // `order`. Sorting the keys sorts the indices lexicographically by `order`.
+  // Returns false, leaving `keys` unspecified, if an index is out of bounds or
+  // the number of elements of `shape_` does not fit in an `int64_t`.
+  bool LinearizeIndices(const VarDimArray& order,
+                        std::vector<int64_t>* keys) const;
+
+  // Overwrites the indices with the ones corresponding to `keys`, which must
+  // have been computed by `LinearizeIndices(order, ...)`.
+  void DelinearizeIndices(const VarDimArray& order,
+                          const std::vector<int64_t>& keys);
+
+  // Sorts `keys` in ascending order, which must be non-negative, and applies
+  // the same permutation to `reorder`. The sort is stable, and uses a radix
+  // sort for large inputs.
+  static void SortByKey(std::vector<int64_t>* keys,
+                        std::vector<int64_t>* reorder);
+
   // Helper for ToDense<T>()
   template <typename T>
   bool ValidateAndInitializeToDense(Tensor* out, bool initialize);
@@ -280,24 +299,35 @@ inline void SparseTensor::Reorder(const VarDimArray& order) {
   std::vector<int64_t> reorder(num_entries());
   std::iota(reorder.begin(), reorder.end(), 0);
 
+  // If the indices are within bounds, sort their linearized keys instead of
+  // comparing the index rows lexicographically: each comparison and move only
+  // touches a single contiguous int64, and the keys can be radix sorted. The
+  // sorted indices are then recomputed from the sorted keys.
+  std::vector<int64_t> keys;
+  const bool linearized = LinearizeIndices(order, &keys);
+
   // Sort to get order of indices
-  switch (order.size()) {
+  if (linearized) {
+    SortByKey(&keys, &reorder);
+  } else {
+    switch (order.size()) {
 #define CASE_SORT(ORDER_SIZE)                                    \
   case ORDER_SIZE: {                                             \
     FixedDimComparator<ORDER_SIZE> sorter(ix_t, order, shape()); \
     std::sort(reorder.begin(), reorder.end(), sorter);           \
     break;                                                       \
   }
-    CASE_SORT(0);
-    CASE_SORT(1);
-    CASE_SORT(2);
-    CASE_SORT(3);
-    CASE_SORT(4);
-    CASE_SORT(5);
+      CASE_SORT(0);
+      CASE_SORT(1);
+      CASE_SORT(2);
+      CASE_SORT(3);
+      CASE_SORT(4);
+      CASE_SORT(5);
 #undef CASE_SORT
-    default: {
-      DimComparator sorter(ix_t, order, shape());
-      std::sort(reorder.begin(), reorder.end(), sorter);
+      default: {
+        DimComparator sorter(ix_t, order, shape());
+        std::sort(reorder.begin(), reorder.end(), sorter);
+      }
     }
   }
 
@@ -319,11 +349,16 @@ inline void SparseTensor::Reorder(const VarDimArray& order) {
   for (std::size_t n = 0; n + 1 < permutation.size(); ++n) {
     while (n != permutation[n]) {
       std::size_t r = permutation[n];
-      std::swap_ranges(&(ix_t(n, 0)), &(ix_t(n + 1, 0)), &(ix_t(r, 0)));
+      if (!linearized) {
+        std::swap_ranges(&(ix_t(n, 0)), &(ix_t(n + 1, 0)), &(ix_t(r, 0)));
+      }
       std::swap(vals_t(n), vals_t(r));
       std::swap(permutation[n], permutation[r]);
     }
   }
+  if (linearized) {
+    DelinearizeIndices(order, keys);
+  }
 
   order_ = ShapeArray(order.begin(), order.end());
 }
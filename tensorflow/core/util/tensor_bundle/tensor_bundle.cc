@@ -15,12 +15,15 @@ limitations under the License.
 
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <utility>
 
 #include "absl/base/call_once.h"
+#include "absl/crc/crc32c.h"
 #include "absl/synchronization/mutex.h"
 #include "xla/tsl/util/byte_swap_array.h"
 #include "tensorflow/core/framework/register_types.h"
@@ -81,6 +84,8 @@ const int64_t kLargeTensorThreshold = static_cast<int64_t>(1) << 32;
 const int kMaxFileReadThreads = 8;
 // Minimum size of a file section handled by each thread.
 const int64_t kMinSectionSize = static_cast<int64_t>(1) << 31;
+// Maximum number of bytes fetched by each read of BundleReader::LookupMany().
+const int64_t kLookupManyChunkSize = 16 << 20;
 
 namespace {
 
@@ -424,8 +429,60 @@ Status PadAlignment(tsl::BufferedWritableFile* out, int alignment,
   return status;
 }
 
+// Appends the data of "val" to "out", whose current size is "size", and
+// records its offset, size and checksum in "entry".  Then pads "out" to the
+// requested alignment and updates "size".
+Status AppendTensorData(const Tensor& val, int alignment,
+                        tsl::BufferedWritableFile* out, int64_t* size,
+                        BundleEntryProto* entry) {
+  entry->set_offset(*size);
+  size_t data_bytes_written = 0;
+  uint32 crc32c = 0;
+  out->reset_crc32();
+  if (val.dtype() == DT_STRING) {
+    TF_RETURN_IF_ERROR(
+        WriteStringTensor(val, out, &data_bytes_written, &crc32c));
+  } else if (val.dtype() == DT_VARIANT) {
+    TF_RETURN_IF_ERROR(
+        WriteVariantTensor(val, out, &data_bytes_written, &crc32c));
+  } else {
+    TF_RETURN_IF_ERROR(WriteTensor(val, out, &data_bytes_written));
+    crc32c = out->crc32();
+  }
+  entry->set_size(data_bytes_written);
+  entry->set_crc32c(crc32c::Mask(crc32c));
+  *size += data_bytes_written;
+  return PadAlignment(out, alignment, size);
+}
+
 }  // namespace
 
+struct BundleWriter::DataFile {
+  // A tensor queued for writing, with the entry that describes it.
+  struct Pending {
+    BundleEntryProto* entry;
+    Tensor val;
+  };
+  // Where a tensor was written, copied into its entry by Finish().
+  struct Written {
+    BundleEntryProto* entry;
+    int64_t offset;
+    int64_t size;
+    uint32 masked_crc32c;
+  };
+
+  std::string path;  // Temporary path, renamed by Finish().
+  std::unique_ptr<tsl::BufferedWritableFile> out;
+  int64_t size = 0;  // Number of bytes written into out.
+  int64_t queued_bytes = 0;  // Only used by the thread calling Add().
+
+  absl::Mutex mu;
+  std::deque<Pending> queue TF_GUARDED_BY(mu);
+  bool writing TF_GUARDED_BY(mu) = false;
+  std::vector<Written> written TF_GUARDED_BY(mu);
+  Status status TF_GUARDED_BY(mu);
+};
+
 BundleWriter::BundleWriter(Env* env, StringPiece prefix, const Options& options)
     : env_(env), options_(options), prefix_(prefix), out_(nullptr), size_(0) {
   status_ = env_->HasAtomicMove(prefix_, &use_temp_file_);
@@ -443,6 +500,17 @@ BundleWriter::BundleWriter(Env* env, StringPiece prefix, const Options& options)
   if (!status_.ok() && !errors::IsAlreadyExists(status_)) {
     return;
   }
+  status_ = absl::OkStatus();
+
+  if (options_.num_data_files > 1 && use_temp_file_) {
+    // Data files are created as tensors are added, so that each file holds
+    // at least one tensor.
+    write_pool_ = std::make_unique<thread::ThreadPool>(
+        env_, "bundle_writer", options_.num_data_files);
+    VLOG(1) << "Writing up to " << options_.num_data_files
+            << " data files for " << prefix_;
+    return;
+  }
 
   std::unique_ptr<WritableFile> wrapper;
   status_ = env_->NewWritableFile(data_path_, &wrapper);
@@ -465,31 +533,87 @@ Status BundleWriter::Add(StringPiece key, const Tensor& val) {
   BundleEntryProto* entry = &entries_[key_string];
   entry->set_dtype(val.dtype());
   val.shape().AsProto(entry->mutable_shape());
-  entry->set_shard_id(0);
-  entry->set_offset(size_);
 
-  // Updates the data file.
-  size_t data_bytes_written = 0;
-  uint32 crc32c = 0;
-  out_->reset_crc32();
-  if (val.dtype() == DT_STRING) {
-    status_ = WriteStringTensor(val, out_.get(), &data_bytes_written, &crc32c);
-  } else if (val.dtype() == DT_VARIANT) {
-    status_ = WriteVariantTensor(val, out_.get(), &data_bytes_written, &crc32c);
-  } else {
-    status_ = WriteTensor(val, out_.get(), &data_bytes_written);
-    crc32c = out_->crc32();
+  if (write_pool_ == nullptr) {
+    // Updates the data file.
+    entry->set_shard_id(0);
+    status_ = AppendTensorData(val, options_.data_alignment, out_.get(),
+                               &size_, entry);
+    return status_;
   }
 
-  if (status_.ok()) {
-    entry->set_size(data_bytes_written);
-    entry->set_crc32c(crc32c::Mask(crc32c));
-    size_ += data_bytes_written;
-    status_ = PadAlignment(out_.get(), options_.data_alignment, &size_);
+  // Queues the tensor to a new data file while there are fewer than
+  // num_data_files, and otherwise to the one with the fewest bytes queued.
+  if (static_cast<int>(data_files_.size()) < options_.num_data_files) {
+    status_ = AddDataFile();
+    if (!status_.ok()) return status_;
+  }
+  const int num_data_files = static_cast<int>(data_files_.size());
+  int shard_id = num_data_files - 1;
+  for (int i = 0; i < num_data_files; ++i) {
+    if (data_files_[i]->queued_bytes < data_files_[shard_id]->queued_bytes) {
+      shard_id = i;
+    }
+  }
+  entry->set_shard_id(shard_id);
+  DataFile* file = data_files_[shard_id].get();
+  file->queued_bytes += val.TotalBytes();
+  bool start_writing;
+  {
+    absl::MutexLock l(&file->mu);
+    file->queue.push_back({entry, val});
+    start_writing = !file->writing;
+    file->writing = true;
+  }
+  if (start_writing) {
+    const int data_alignment = options_.data_alignment;
+    write_pool_->Schedule(
+        [file, data_alignment] { WriteQueuedTensors(file, data_alignment); });
   }
   return status_;
 }
 
+Status BundleWriter::AddDataFile() {
+  auto file = std::make_unique<DataFile>();
+  file->path =
+      strings::StrCat(DataFilename(prefix_, data_files_.size(),
+                                   options_.num_data_files),
+                      ".tempstate", random::New64());
+  std::unique_ptr<WritableFile> wrapper;
+  TF_RETURN_IF_ERROR(env_->NewWritableFile(file->path, &wrapper));
+  file->out = std::make_unique<tsl::BufferedWritableFile>(
+      std::move(wrapper), 8 << 20 /* 8MB write buffer */);
+  VLOG(1) << "Writing to file " << file->path;
+  data_files_.push_back(std::move(file));
+  return absl::OkStatus();
+}
+
+void BundleWriter::WriteQueuedTensors(DataFile* file, int data_alignment) {
+  while (true) {
+    DataFile::Pending pending;
+    {
+      absl::MutexLock l(&file->mu);
+      if (file->queue.empty()) {
+        file->writing = false;
+        return;
+      }
+      pending = std::move(file->queue.front());
+      file->queue.pop_front();
+      if (!file->status.ok()) continue;  // Drops the rest of the queue.
+    }
+    // Only this thread writes to the file until the queue is empty.
+    BundleEntryProto location;
+    Status status = AppendTensorData(pending.val, data_alignment,
+                                     file->out.get(), &file->size, &location);
+    // Releases the snapshot as soon as it is written.
+    pending.val = Tensor();
+    absl::MutexLock l(&file->mu);
+    file->status.Update(status);
+    file->written.push_back({pending.entry, location.offset(),
+                             location.size(), location.crc32c()});
+  }
+}
+
 Status BundleWriter::AddSlice(StringPiece full_tensor_key,
                               const TensorShape& full_tensor_shape,
                               const TensorSlice& slice_spec,
@@ -533,7 +657,35 @@ Status BundleWriter::AddSlice(StringPiece full_tensor_key,
 
 // TODO(zongheng): on metadata write failure or !status_.ok(), consider removing
 // the orphaned data file.
+BundleWriter::~BundleWriter() = default;
+
 Status BundleWriter::Finish() {
+  int num_shards = 1;
+  if (write_pool_ != nullptr) {
+    // Keeps the format of a bundle without tensors, which has one data file.
+    if (data_files_.empty() && status_.ok()) status_ = AddDataFile();
+    write_pool_ = nullptr;  // Waits for the queued tensors to be written.
+    num_shards = static_cast<int>(data_files_.size());
+    for (const auto& file : data_files_) {
+      absl::MutexLock l(&file->mu);
+      status_.Update(file->status);
+      status_.Update(file->out->Close());
+      for (const DataFile::Written& written : file->written) {
+        written.entry->set_offset(written.offset);
+        written.entry->set_size(written.size);
+        written.entry->set_crc32c(written.masked_crc32c);
+      }
+    }
+    for (int i = 0; i < num_shards; ++i) {
+      const std::string& path = data_files_[i]->path;
+      if (status_.ok()) {
+        status_ = env_->RenameFile(path, DataFilename(prefix_, i, num_shards));
+      } else {
+        env_->DeleteFile(path).IgnoreError();
+      }
+    }
+    data_files_.clear();
+  }
   if (out_) {
     status_.Update(out_->Close());
     out_ = nullptr;
@@ -559,7 +711,7 @@ Status BundleWriter::Finish() {
     table::TableBuilder builder(options, file.get());
     // Header entry.
     BundleHeaderProto header;
-    header.set_num_shards(1);
+    header.set_num_shards(num_shards);
     header.set_endianness(BundleHeaderProto::LITTLE);
     if (!port::kLittleEndian) header.set_endianness(BundleHeaderProto::BIG);
     VersionDef* version = header.mutable_version();
@@ -785,7 +937,8 @@ BundleReader::BundleReader(Env* env, StringPiece prefix, Options options)
       iter_(nullptr),
       need_to_swap_bytes_(false),
       enable_multi_threading_for_testing_(
-          options.enable_multi_threading_for_testing) {
+          options.enable_multi_threading_for_testing),
+      mmap_data_files_(options.mmap_data_files) {
   if (cache_ == nullptr) {
     // Make a cache for use just by this BundleReader.
     owned_cache_ = std::make_unique<BundleCache>(env);
@@ -1033,6 +1186,189 @@ Status BundleReader::Lookup(StringPiece key, Tensor* val) {
   }
 }
 
+Status BundleReader::LookupMany(absl::Span<const std::string> keys,
+                                absl::Span<Tensor* const> vals,
+                                thread::ThreadPool* pool) {
+  if (keys.size() != vals.size()) {
+    return errors::InvalidArgument("LookupMany got ", keys.size(),
+                                   " keys but ", vals.size(), " tensors");
+  }
+
+  // A tensor whose bytes are copied straight from its data file.
+  struct DirectRead {
+    const std::string* key;
+    BundleEntryProto entry;
+    char* buffer;
+    uint32 crc32c = 0;  // Of the restored bytes.
+  };
+  std::vector<DirectRead> reads;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    CHECK(vals[i] != nullptr);
+    BundleEntryProto entry;
+    TF_RETURN_IF_ERROR(GetBundleEntryProto(keys[i], &entry));
+    if (!entry.slices().empty() || !DataTypeCanUseMemcpy(entry.dtype()) ||
+        need_to_swap_bytes_) {
+      TF_RETURN_IF_ERROR(Lookup(keys[i], vals[i]));
+      continue;
+    }
+    Tensor* val = vals[i];
+    if (val->NumElements() == 0) {
+      *val = Tensor(entry.dtype(), TensorShape(entry.shape()));
+    }
+    if (entry.size() != val->TotalBytes()) {
+      return errors::DataLoss("Invalid size in bundle entry: key ", keys[i],
+                              "; stored size ", entry.size(),
+                              "; expected size ", val->TotalBytes());
+    }
+    char* buffer = const_cast<char*>(val->tensor_data().data());
+    reads.push_back({&keys[i], std::move(entry), buffer});
+  }
+  std::sort(reads.begin(), reads.end(),
+            [](const DirectRead& a, const DirectRead& b) {
+              if (a.entry.shard_id() != b.entry.shard_id()) {
+                return a.entry.shard_id() < b.entry.shard_id();
+              }
+              return a.entry.offset() < b.entry.offset();
+            });
+
+  // Data files of the shards that are read; region is null for files that
+  // are not memory mapped.
+  struct DataFile {
+    const ReadOnlyMemoryRegion* region = nullptr;
+    RandomAccessFile* file = nullptr;
+  };
+  absl::flat_hash_map<int32_t, DataFile> files;
+  for (const DirectRead& read : reads) {
+    auto inserted = files.try_emplace(read.entry.shard_id());
+    if (!inserted.second) continue;
+    DataFile& data_file = inserted.first->second;
+    const std::string fname =
+        DataFilename(prefix_, read.entry.shard_id(), num_shards_);
+    if (mmap_data_files_ &&
+        cache_->GetMappedFile(fname, &data_file.region).ok()) {
+      continue;
+    }
+    data_file.region = nullptr;
+    TF_RETURN_IF_ERROR(cache_->GetFile(fname, &data_file.file));
+  }
+
+  // Splits the tensors into chunks of at most kLookupManyChunkSize bytes.
+  // Consecutive chunks that lie within kLookupManyChunkSize bytes of the same
+  // file are grouped into a task, which fetches them with a single read.
+  struct Chunk {
+    DirectRead* read;
+    int64_t begin;  // Within the tensor data.
+    int64_t size;
+    uint32 crc32c = 0;
+  };
+  struct Task {
+    size_t begin_chunk;
+    size_t end_chunk;
+  };
+  std::vector<Chunk> chunks;
+  std::vector<Task> tasks;
+  for (DirectRead& read : reads) {
+    const int64_t size = read.entry.size();
+    for (int64_t begin = 0; begin < size; begin += kLookupManyChunkSize) {
+      const int64_t chunk_size = std::min(kLookupManyChunkSize, size - begin);
+      bool extends_task = false;
+      if (!tasks.empty()) {
+        const Chunk& first = chunks[tasks.back().begin_chunk];
+        extends_task = first.read->entry.shard_id() == read.entry.shard_id() &&
+                       read.entry.offset() + begin + chunk_size -
+                               (first.read->entry.offset() + first.begin) <=
+                           kLookupManyChunkSize;
+      }
+      chunks.push_back({&read, begin, chunk_size});
+      if (extends_task) {
+        tasks.back().end_chunk = chunks.size();
+      } else {
+        tasks.push_back({chunks.size() - 1, chunks.size()});
+      }
+    }
+  }
+
+  auto run_task = [&](const Task& task) -> Status {
+    const Chunk& first = chunks[task.begin_chunk];
+    const Chunk& last = chunks[task.end_chunk - 1];
+    const DataFile& data_file = files.at(first.read->entry.shard_id());
+    const int64_t span_begin = first.read->entry.offset() + first.begin;
+    const int64_t span_size =
+        last.read->entry.offset() + last.begin + last.size - span_begin;
+    const char* span;
+    std::unique_ptr<char[]> scratch;
+    if (data_file.region != nullptr) {
+      const int64_t file_size = data_file.region->length();
+      if (span_begin < 0 || span_begin + span_size > file_size) {
+        // Reports a truncated file as the read below would.
+        return errors::OutOfRange("TensorBundle at ", prefix_, " shard ",
+                                  first.read->entry.shard_id(), ": bytes [",
+                                  span_begin, ", ", span_begin + span_size,
+                                  ") are past the end of the data file of ",
+                                  file_size, " bytes");
+      }
+      span = static_cast<const char*>(data_file.region->data()) + span_begin;
+    } else {
+      // A single chunk is read straight into the tensor buffer.
+      char* dst;
+      if (task.end_chunk - task.begin_chunk == 1) {
+        dst = first.read->buffer + first.begin;
+      } else {
+        scratch.reset(new char[span_size]);
+        dst = scratch.get();
+      }
+      StringPiece sp;
+      TF_RETURN_IF_ERROR(data_file.file->Read(span_begin, span_size, &sp, dst));
+      span = sp.data();
+    }
+    for (size_t c = task.begin_chunk; c < task.end_chunk; ++c) {
+      Chunk& chunk = chunks[c];
+      char* dst = chunk.read->buffer + chunk.begin;
+      const char* src =
+          span + (chunk.read->entry.offset() + chunk.begin - span_begin);
+      if (src != dst) memcpy(dst, src, chunk.size);
+      // Checksums the restored bytes while they are still in cache.
+      chunk.crc32c = crc32c::Value(dst, chunk.size);
+    }
+    return absl::OkStatus();
+  };
+
+  std::vector<Status> statuses(tasks.size());
+  if (pool != nullptr && tasks.size() > 1) {
+    pool->ParallelFor(tasks.size(), kLookupManyChunkSize,
+                      [&](int64_t start, int64_t limit) {
+                        for (int64_t t = start; t < limit; ++t) {
+                          statuses[t] = run_task(tasks[t]);
+                        }
+                      });
+  } else {
+    for (size_t t = 0; t < tasks.size(); ++t) {
+      statuses[t] = run_task(tasks[t]);
+    }
+  }
+  for (const Status& status : statuses) {
+    TF_RETURN_IF_ERROR(status);
+  }
+
+  // The chunks of each tensor are consecutive, so the checksum of a tensor is
+  // the concatenation of the checksums of its chunks.
+  for (const Chunk& chunk : chunks) {
+    chunk.read->crc32c = static_cast<uint32>(absl::ConcatCrc32c(
+        static_cast<absl::crc32c_t>(chunk.read->crc32c),
+        static_cast<absl::crc32c_t>(chunk.crc32c), chunk.size));
+  }
+  for (const DirectRead& read : reads) {
+    if (crc32c::Unmask(read.entry.crc32c()) != read.crc32c) {
+      return errors::DataLoss(
+          "TensorBundle at ", prefix_, " shard ", read.entry.shard_id(), " (",
+          read.entry.size(), " bytes): Checksum does not match: stored ",
+          strings::Printf("%08u", crc32c::Unmask(read.entry.crc32c())),
+          " vs. calculated on the restored bytes ", read.crc32c);
+    }
+  }
+  return absl::OkStatus();
+}
+
 Status BundleReader::ReadCurrent(Tensor* val) {
   CHECK(val != nullptr);
   BundleEntryProto entry;
@@ -1225,17 +1561,18 @@ string BundleReader::DebugString() {
 
 BundleCache::BundleCache(Env* env) : env_(env) {}
 
+BundleCache::FileState* BundleCache::GetFileState(const std::string& name) {
+  absl::MutexLock l(&mu_);
+  auto& slot = opened_files_[name];
+  if (slot == nullptr) {
+    slot = std::make_unique<FileState>();
+  }
+  return slot.get();
+}
+
 BundleCache::FileState* BundleCache::EnsureOpened(std::string name) {
   // Get the file, opening it if necessary.
-  FileState* f;
-  {
-    absl::MutexLock l(&mu_);
-    auto& slot = opened_files_[name];
-    if (slot == nullptr) {
-      slot = std::make_unique<FileState>();
-    }
-    f = slot.get();
-  }
+  FileState* f = GetFileState(name);
 
   // Open the file or wait for a concurrent open to complete. We do not hold
   // mu_ here to avoid blocking threads reading from other files.
@@ -1252,6 +1589,18 @@ Status BundleCache::GetFile(const std::string& fname, RandomAccessFile** file) {
   return f->open_status;
 }
 
+Status BundleCache::GetMappedFile(const std::string& fname,
+                                  const ReadOnlyMemoryRegion** region) {
+  FileState* f = GetFileState(fname);
+  // As in EnsureOpened(), concurrent callers wait for the mapping without
+  // holding mu_.
+  absl::call_once(f->map_once, [this, &fname, f] {
+    f->map_status = env_->NewReadOnlyMemoryRegionFromFile(fname, &f->region);
+  });
+  *region = f->region.get();
+  return f->map_status;
+}
+
 namespace {
 inline char* AlignedMalloc(size_t size) {
   char* buffer = static_cast<char*>(port::AlignedMalloc(size, 64));
@@ -72,6 +72,7 @@ limitations under the License.
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_slice.h"
@@ -84,6 +85,7 @@ limitations under the License.
 #include "tensorflow/core/platform/file_system.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/platform/tstring.h"
 #include "tensorflow/core/protobuf/tensor_bundle.pb.h"
 #include "tensorflow/core/util/tensor_slice_set.h"
@@ -119,12 +121,26 @@ class BundleWriter {
     // Alignment, in bytes, for tensor data.
     // Must be >= 1. The default size of 1 densely packs tensors.
     int data_alignment{1};
+
+    // Maximum number of data files the tensors are spread over.  If greater
+    // than 1, each data file is written and checksummed by its own background
+    // thread: Add() only queues a reference to the tensor, and Finish() waits
+    // for the queued tensors to be written.  Only used on filesystems with
+    // atomic moves, since the files are renamed once their number is known;
+    // elsewhere a single data file is written.
+    int num_data_files{1};
   };
   BundleWriter(Env* env, absl::string_view prefix,
                const Options& options = Options());
+  ~BundleWriter();
 
   // Adds the tensor "val" under key "key".
   // Across calls "key" must be unique but can be added in any order.
+  //
+  // With more than one data file, "val" is written after Add() returns, so
+  // its buffer must not be modified in place until Finish() returns.
+  // Resource variables copy a buffer that is still referenced before
+  // updating it, so a value read from one is a valid snapshot.
   Status Add(absl::string_view key, const Tensor& val);
 
   // Partitioned variables support.
@@ -153,6 +169,15 @@ class BundleWriter {
   Status status() const { return status_; }
 
  private:
+  // A data file written in the background; see Options::num_data_files.
+  struct DataFile;
+
+  // Creates the next background data file in data_files_.
+  Status AddDataFile();
+
+  // Writes the tensors queued to "file" until its queue is empty.
+  static void WriteQueuedTensors(DataFile* file, int data_alignment);
+
   Env* const env_;  // Not owned.
   const Options options_;
   const std::string prefix_;
@@ -164,6 +189,11 @@ class BundleWriter {
   std::map<std::string, BundleEntryProto> entries_;
   Status status_;
 
+  // Used instead of out_ when writing more than one data file.  The pool is
+  // declared last so that it is joined before the files are destroyed.
+  std::vector<std::unique_ptr<DataFile>> data_files_;
+  std::unique_ptr<thread::ThreadPool> write_pool_;
+
   BundleWriter(const BundleWriter&) = delete;
   void operator=(const BundleWriter&) = delete;
 };
@@ -212,6 +242,10 @@ class BundleReader {
 
     // For tests only.
     bool enable_multi_threading_for_testing = false;
+
+    // Whether LookupMany() memory maps the data files.  Files on filesystems
+    // that do not support memory mapping are read instead.
+    bool mmap_data_files = true;
   };
   BundleReader(Env* env, absl::string_view prefix, Options options);
 
@@ -264,6 +298,20 @@ class BundleReader {
   // REQUIRES: status().ok()
   Status Lookup(absl::string_view key, Tensor* val) TF_MUST_USE_RESULT;
 
+  // Looks up the tensors keyed by "keys" into "vals", as if by calling
+  // "Lookup()" on each pair, with the same requirements on "vals".
+  //
+  // The data of full tensors of memcpy-able types is copied straight from the
+  // data files into the tensor buffers, in file order.  Large tensors are
+  // split into chunks and neighbouring small tensors are fetched together;
+  // the chunks are read and checksummed with the threads of "pool", or on
+  // the calling thread if "pool" is null.  Other tensors are looked up one by
+  // one with "Lookup()".
+  // REQUIRES: status().ok() && keys.size() == vals.size()
+  Status LookupMany(absl::Span<const std::string> keys,
+                    absl::Span<Tensor* const> vals,
+                    thread::ThreadPool* pool) TF_MUST_USE_RESULT;
+
   // Looks up the tensor pointed to by the internal iterator.
   //
   // On error, "val" may contain nonsense data.
@@ -359,6 +407,7 @@ class BundleReader {
   friend class TensorBundleAlignmentTest;  // For testing data alignment.
 
   bool enable_multi_threading_for_testing_ = false;
+  bool mmap_data_files_ = true;
 
   BundleReader(const BundleReader&) = delete;
   void operator=(const BundleReader&) = delete;
@@ -401,6 +450,12 @@ class BundleCache {
   // while the BundleCache lives.
   Status GetFile(const std::string& fname, RandomAccessFile** file);
 
+  // Get a read-only memory mapping of fname. The result will remain valid
+  // while the BundleCache lives. Fails if the filesystem of fname does not
+  // support memory mapping.
+  Status GetMappedFile(const std::string& fname,
+                       const ReadOnlyMemoryRegion** region);
+
  private:
   // State for each opened file (opened on first read).
   struct FileState {
@@ -408,8 +463,14 @@ class BundleCache {
 
     std::unique_ptr<RandomAccessFile> file;
     Status open_status;  // Records any error encountered on open
+
+    absl::once_flag map_once;  // Ensures file is mapped at most once.
+
+    std::unique_ptr<ReadOnlyMemoryRegion> region;
+    Status map_status;  // Records any error encountered on mapping
   };
 
+  FileState* GetFileState(const std::string& name);
   FileState* EnsureOpened(std::string name);
 
   Env* const env_;
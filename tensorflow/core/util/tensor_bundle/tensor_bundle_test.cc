@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
+#include <memory>
 #include <random>
 #include <string>
 #include <vector>
@@ -36,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/lib/io/table_builder.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/protobuf/error_codes.pb.h"
@@ -1151,6 +1153,233 @@ TEST(TensorBundleTest, LargeVariableLoadingTest) {
   }
 }
 
+TEST(TensorBundleTest, ParallelDataFiles) {
+  Env* env = Env::Default();
+  BundleWriter::Options options;
+  options.num_data_files = 3;
+  std::vector<Tensor> expected;
+  {
+    BundleWriter writer(env, Prefix("parallel0"), options);
+    TF_ASSERT_OK(writer.status());
+    for (int i = 0; i < 8; ++i) {
+      expected.push_back(Constant<float>(i, TensorShape({(i + 1) * 1000})));
+      TF_EXPECT_OK(writer.Add(strings::StrCat("float", i), expected.back()));
+    }
+    TF_EXPECT_OK(
+        writer.Add("string", test::AsTensor<tstring>({"hello", "world"})));
+    TF_EXPECT_OK(writer.AddSlice("partitioned", TensorShape({4, 3}),
+                                 TensorSlice::ParseOrDie("0,2:-"),
+                                 Constant_2x3<int32>(5)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  // Fewer tensors than data files.
+  {
+    BundleWriter writer(env, Prefix("parallel1"), options);
+    TF_EXPECT_OK(writer.Add("double", Constant_2x3<double>(1.5)));
+    TF_EXPECT_OK(writer.AddSlice("partitioned", TensorShape({4, 3}),
+                                 TensorSlice::ParseOrDie("2,2:-"),
+                                 Constant_2x3<int32>(6)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  bool has_atomic_move;
+  TF_ASSERT_OK(env->HasAtomicMove(Prefix("parallel0"), &has_atomic_move));
+  if (has_atomic_move) {
+    for (int i = 0; i < 3; ++i) {
+      TF_EXPECT_OK(env->FileExists(DataFilename(Prefix("parallel0"), i, 3)));
+    }
+    for (int i = 0; i < 2; ++i) {
+      TF_EXPECT_OK(env->FileExists(DataFilename(Prefix("parallel1"), i, 2)));
+    }
+  }
+
+  {
+    BundleReader reader(env, Prefix("parallel0"));
+    TF_ASSERT_OK(reader.status());
+    for (int i = 0; i < 8; ++i) {
+      Expect<float>(&reader, strings::StrCat("float", i), expected[i]);
+    }
+    Expect<tstring>(&reader, "string",
+                    test::AsTensor<tstring>({"hello", "world"}));
+  }
+
+  TF_ASSERT_OK(MergeBundles(env, {Prefix("parallel0"), Prefix("parallel1")},
+                            Prefix("parallel_merged")));
+  BundleReader reader(env, Prefix("parallel_merged"));
+  TF_ASSERT_OK(reader.status());
+  for (int i = 0; i < 8; ++i) {
+    Expect<float>(&reader, strings::StrCat("float", i), expected[i]);
+  }
+  Expect<double>(&reader, "double", Constant_2x3<double>(1.5));
+  Tensor partitioned(DT_INT32, TensorShape({4, 3}));
+  TF_ASSERT_OK(reader.Lookup("partitioned", &partitioned));
+  test::ExpectTensorEqual<int32>(
+      partitioned,
+      test::AsTensor<int32>({5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6}, {4, 3}));
+}
+
+TEST(TensorBundleTest, ParallelDataFilesEmpty) {
+  BundleWriter::Options options;
+  options.num_data_files = 4;
+  BundleWriter writer(Env::Default(), Prefix("parallel_empty"), options);
+  TF_ASSERT_OK(writer.Finish());
+  BundleReader reader(Env::Default(), Prefix("parallel_empty"));
+  TF_ASSERT_OK(reader.status());
+  EXPECT_TRUE(AllTensorKeys(&reader).empty());
+  TF_EXPECT_OK(
+      Env::Default()->FileExists(DataFilename(Prefix("parallel_empty"), 0, 1)));
+}
+
+// Looks up "keys" of the bundle at "prefix" with LookupMany() and checks the
+// results against Lookup().
+void ExpectLookupManyMatchesLookup(const string& prefix,
+                                   const std::vector<string>& keys,
+                                   bool mmap_data_files,
+                                   thread::ThreadPool* pool) {
+  BundleReader::Options options;
+  options.mmap_data_files = mmap_data_files;
+  BundleReader reader(Env::Default(), prefix, options);
+  TF_ASSERT_OK(reader.status());
+  std::vector<Tensor> vals;
+  std::vector<Tensor*> val_ptrs;
+  for (const string& key : keys) {
+    DataType dtype;
+    TensorShape shape;
+    TF_ASSERT_OK(reader.LookupDtypeAndShape(key, &dtype, &shape));
+    vals.emplace_back(dtype, shape);
+  }
+  for (Tensor& val : vals) val_ptrs.push_back(&val);
+  TF_ASSERT_OK(reader.LookupMany(keys, val_ptrs, pool));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    Tensor expected(vals[i].dtype(), vals[i].shape());
+    TF_ASSERT_OK(reader.Lookup(keys[i], &expected));
+    test::ExpectEqual(vals[i], expected);
+  }
+}
+
+TEST(TensorBundleTest, LookupMany) {
+  Env* env = Env::Default();
+  {
+    BundleWriter writer(env, Prefix("many0"));
+    TF_EXPECT_OK(writer.Add("float_2x3", Constant_2x3<float>(1.5)));
+    TF_EXPECT_OK(writer.Add("int_100x100", Constant_100x100<int32>(7)));
+    TF_EXPECT_OK(writer.Add("string", test::AsTensor<tstring>({"a", "bc"})));
+    TF_EXPECT_OK(writer.Add("empty", Constant<float>(0, TensorShape({0, 3}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  {
+    BundleWriter writer(env, Prefix("many1"));
+    TF_EXPECT_OK(writer.Add("double_100x100", Constant_100x100<double>(2.5)));
+    TF_EXPECT_OK(writer.AddSlice("partitioned", TensorShape({4, 3}),
+                                 TensorSlice::ParseOrDie("0,2:-"),
+                                 Constant_2x3<float>(3)));
+    TF_EXPECT_OK(writer.AddSlice("partitioned", TensorShape({4, 3}),
+                                 TensorSlice::ParseOrDie("2,2:-"),
+                                 Constant_2x3<float>(4)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  TF_ASSERT_OK(
+      MergeBundles(env, {Prefix("many0"), Prefix("many1")}, Prefix("many")));
+
+  // Keys out of file order, from both shards, including a string tensor and a
+  // partitioned tensor that are looked up one by one.
+  const std::vector<string> keys = {"int_100x100", "partitioned", "empty",
+                                    "double_100x100", "string", "float_2x3"};
+  thread::ThreadPool pool(env, "lookup_many", 4);
+  for (bool mmap_data_files : {false, true}) {
+    ExpectLookupManyMatchesLookup(Prefix("many"), keys, mmap_data_files,
+                                  &pool);
+    ExpectLookupManyMatchesLookup(Prefix("many"), keys, mmap_data_files,
+                                  nullptr);
+  }
+
+  BundleReader reader(env, Prefix("many"));
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  std::vector<Tensor*> vals = {&val};
+  EXPECT_TRUE(errors::IsNotFound(reader.LookupMany({"missing"}, vals, &pool)));
+}
+
+TEST(TensorBundleTest, LookupManyLargeTensors) {
+  // Tensors larger than a read chunk, between small tensors that are read
+  // together.
+  Env* env = Env::Default();
+  std::vector<string> keys;
+  std::vector<Tensor> expected;
+  {
+    BundleWriter writer(env, Prefix("many_large"));
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform;
+    for (int64_t size : {10, (5 << 20) + 3, 20, 30, 8 << 20, 40}) {
+      Tensor t(DT_FLOAT, TensorShape({size}));
+      for (int64_t i = 0; i < size; ++i) t.flat<float>()(i) = uniform(rng);
+      keys.push_back(strings::StrCat("t", keys.size()));
+      expected.push_back(t);
+      TF_EXPECT_OK(writer.Add(keys.back(), t));
+    }
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  thread::ThreadPool pool(env, "lookup_many", 4);
+  for (bool mmap_data_files : {false, true}) {
+    BundleReader::Options options;
+    options.mmap_data_files = mmap_data_files;
+    BundleReader reader(env, Prefix("many_large"), options);
+    TF_ASSERT_OK(reader.status());
+    std::vector<Tensor> vals;
+    std::vector<Tensor*> val_ptrs;
+    for (const Tensor& t : expected) vals.emplace_back(DT_FLOAT, t.shape());
+    for (Tensor& val : vals) val_ptrs.push_back(&val);
+    TF_ASSERT_OK(reader.LookupMany(keys, val_ptrs, &pool));
+    for (size_t i = 0; i < keys.size(); ++i) {
+      test::ExpectTensorEqual<float>(vals[i], expected[i]);
+    }
+  }
+}
+
+TEST(TensorBundleTest, LookupManyErrors) {
+  Env* env = Env::Default();
+  const string datafile = DataFilename(Prefix("many_bad"), 0, 1);
+  auto write_bundle = [env]() {
+    BundleWriter writer(env, Prefix("many_bad"));
+    TF_EXPECT_OK(writer.Add("a", Constant_2x3<float>(1)));
+    TF_EXPECT_OK(writer.Add("b", Constant_100x100<float>(2)));
+    TF_ASSERT_OK(writer.Finish());
+  };
+  auto lookup_many = [env](bool mmap_data_files) {
+    BundleReader::Options options;
+    options.mmap_data_files = mmap_data_files;
+    BundleReader reader(env, Prefix("many_bad"), options);
+    TF_CHECK_OK(reader.status());
+    thread::ThreadPool pool(env, "lookup_many", 2);
+    Tensor a(DT_FLOAT, TensorShape({2, 3}));
+    Tensor b(DT_FLOAT, TensorShape({100, 100}));
+    std::vector<Tensor*> vals = {&a, &b};
+    return reader.LookupMany({"a", "b"}, vals, &pool);
+  };
+
+  for (bool mmap_data_files : {false, true}) {
+    // Corrupts the last byte of "b".
+    write_bundle();
+    string data;
+    TF_ASSERT_OK(ReadFileToString(env, datafile, &data));
+    data.back() = ~data.back();
+    TF_ASSERT_OK(WriteStringToFile(env, datafile, data));
+    Status status = lookup_many(mmap_data_files);
+    EXPECT_TRUE(errors::IsDataLoss(status)) << status;
+    EXPECT_TRUE(absl::StrContains(status.message(), "Checksum does not match"))
+        << status;
+
+    // Truncates the data file by one byte.
+    write_bundle();
+    TF_ASSERT_OK(ReadFileToString(env, datafile, &data));
+    data.pop_back();
+    TF_ASSERT_OK(WriteStringToFile(env, datafile, data));
+    status = lookup_many(mmap_data_files);
+    EXPECT_TRUE(errors::IsOutOfRange(status)) << status;
+  }
+}
+
 absl::Status CreateFile(Env* env, const std::string& fname) {
   std::unique_ptr<WritableFile> file;
   TF_RETURN_IF_ERROR(env->NewWritableFile(fname, &file));
@@ -1321,4 +1550,106 @@ static void BM_BundleWriterLargeTensor(::testing::benchmark::State& state) {
 BENCHMARK(BM_BundleWriterLargeTensor)->Arg(1 << 10);
 BENCHMARK(BM_BundleWriterLargeTensor)->Arg(4 << 10);
 
+// Time a training loop is blocked by a checkpoint: the variables are added to
+// the writer, a few steps of compute run and the writer is finished. With more
+// than one data file the steps overlap with writing the data.
+//
+// With "async" set, the writer is finished on another thread, as when the
+// Python checkpoint saves asynchronously, and the loop does not wait for it.
+// The thread is joined outside the timed region, so this measures the steps
+// slowed down by a save in the background; the synchronous runs include the
+// whole save.
+static void BM_BundleWriterStepTime(::testing::benchmark::State& state) {
+  const int num_data_files = state.range(0);
+  const int64_t mb = state.range(1);
+  const bool async = state.range(2) != 0;
+  std::vector<Tensor> variables;
+  for (int i = 0; i < 8; ++i) {
+    variables.push_back(Constant(1.f, TensorShape{mb * (1 << 18)}));
+  }
+  Tensor activations = Constant(0.5f, TensorShape{1 << 20});
+  BundleWriter::Options options;
+  options.num_data_files = num_data_files;
+  for (auto s : state) {
+    BundleWriter writer(Env::Default(), Prefix("step_time"), options);
+    for (int i = 0; i < variables.size(); ++i) {
+      TF_CHECK_OK(writer.Add(strings::StrCat("var", i), variables[i]));
+    }
+    std::unique_ptr<Thread> finish;
+    if (async) {
+      finish.reset(Env::Default()->StartThread(
+          ThreadOptions(), "finish",
+          [&writer]() { TF_CHECK_OK(writer.Finish()); }));
+    }
+    for (int step = 0; step < 10; ++step) {
+      auto x = activations.flat<float>();
+      x = (x * 0.9f + 0.1f).tanh();
+    }
+    tensorflow::testing::DoNotOptimize(activations.flat<float>().data());
+    if (async) {
+      state.PauseTiming();
+      finish.reset();
+      state.ResumeTiming();
+    } else {
+      TF_CHECK_OK(writer.Finish());
+    }
+  }
+}
+
+BENCHMARK(BM_BundleWriterStepTime)
+    ->Args({1, 32, 0})
+    ->Args({4, 32, 0})
+    ->Args({4, 32, 1})
+    ->Args({1, 128, 0})
+    ->Args({4, 128, 0})
+    ->Args({4, 128, 1})
+    ->UseRealTime();
+
+// Restores "num_tensors" float tensors of "kb" KiB each, with Lookup() on each
+// tensor if "lookup_many" is 0, or a single LookupMany() on 8 threads.
+static void BM_BundleRestore(::testing::benchmark::State& state) {
+  const int num_tensors = state.range(0);
+  const int64_t kb = state.range(1);
+  const bool lookup_many = state.range(2) != 0;
+  std::vector<string> keys;
+  {
+    BundleWriter writer(Env::Default(), Prefix("restore"));
+    const Tensor t = Constant(1.f, TensorShape{kb * 256});
+    for (int i = 0; i < num_tensors; ++i) {
+      keys.push_back(strings::StrCat("t", i));
+      TF_CHECK_OK(writer.Add(keys.back(), t));
+    }
+    TF_CHECK_OK(writer.Finish());
+  }
+  std::vector<Tensor> vals;
+  std::vector<Tensor*> val_ptrs;
+  for (int i = 0; i < num_tensors; ++i) {
+    vals.emplace_back(DT_FLOAT, TensorShape{kb * 256});
+  }
+  for (Tensor& val : vals) val_ptrs.push_back(&val);
+  thread::ThreadPool pool(Env::Default(), "restore", 8);
+  for (auto s : state) {
+    BundleReader reader(Env::Default(), Prefix("restore"));
+    TF_CHECK_OK(reader.status());
+    if (lookup_many) {
+      TF_CHECK_OK(reader.LookupMany(keys, val_ptrs, &pool));
+    } else {
+      for (int i = 0; i < num_tensors; ++i) {
+        TF_CHECK_OK(reader.Lookup(keys[i], val_ptrs[i]));
+      }
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_tensors * kb * 1024);
+}
+
+BENCHMARK(BM_BundleRestore)
+    ->Args({1000, 4, 0})
+    ->Args({1000, 4, 1})
+    ->Args({100, 1024, 0})
+    ->Args({100, 1024, 1})
+    ->Args({4, 64 << 10, 0})
+    ->Args({4, 64 << 10, 1})
+    ->UseRealTime();
+
 }  // namespace tensorflow
@@ -23,6 +23,7 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "tensorflow/lite/core/api/profiler.h"
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/graph_info.h"
 #include "tensorflow/lite/simple_memory_arena.h"
@@ -205,6 +206,7 @@ TfLiteStatus ArenaPlanner::PlanAllocations() {
   // Invalidate any existing data.
   const size_t num_tensors = graph_info_->num_tensors();
   TF_LITE_ENSURE_STATUS(ResetAllocations());
+  plan_cache_.clear();
   // Maybe other verb instead of 'Assigned'
   alloc_node_.assign(num_tensors, kNodeNotAssigned);
   dealloc_node_.assign(num_tensors, kNodeNotAssigned);
@@ -361,8 +363,28 @@ TfLiteStatus ArenaPlanner::ExecuteAllocations(int first_node, int last_node) {
   }
 
   std::vector<int32_t> tensors_allocated;
-  TF_LITE_ENSURE_STATUS(
-      CalculateAllocations(first_node, last_node, &tensors_allocated));
+  auto* profiler = reinterpret_cast<Profiler*>(context_->profiler);
+  // Plans made from scratch are cached by the sizes they depend on.
+  const bool cacheable =
+      first_node == 0 && last_active_node_ == kLastActiveNodeUndefined;
+  std::vector<size_t> plan_key;
+  bool restored = false;
+  if (cacheable) {
+    plan_key = PlanCacheKey(last_node);
+    restored = RestoreCachedPlan(plan_key, &tensors_allocated);
+    TFLITE_ADD_RUNTIME_INSTRUMENTATION_EVENT(
+        profiler, "ArenaPlanner::PlanCache", plan_cache_hits_,
+        plan_cache_misses_);
+  }
+  if (!restored) {
+    TFLITE_SCOPED_TAGGED_DEFAULT_PROFILE(profiler,
+                                         "ArenaPlanner::CalculateAllocations");
+    TF_LITE_ENSURE_STATUS(
+        CalculateAllocations(first_node, last_node, &tensors_allocated));
+    if (cacheable) {
+      CachePlan(std::move(plan_key), tensors_allocated);
+    }
+  }
   bool arena_reallocated = false;
   TF_LITE_ENSURE_STATUS(Commit(&arena_reallocated));
 
@@ -541,10 +563,17 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
       }
     }
     if (tensor.allocation_type == kTfLiteArenaRw) {
-      TF_LITE_ENSURE_STATUS(
-          arena_.Allocate(context_, tensor_alignment_, tensor.bytes,
-                          tensor_index, alloc_node_[tensor_index],
-                          dealloc_node_[tensor_index], &allocs_[tensor_index]));
+      // Nodes which may run concurrently with the first or last node using the
+      // tensor also need its memory to stay untouched.
+      int32_t first_node = alloc_node_[tensor_index];
+      int32_t last_node = dealloc_node_[tensor_index];
+      first_node = graph_info_->concurrent_nodes(first_node).first;
+      if (last_node != kNodeNotAssigned) {
+        last_node = graph_info_->concurrent_nodes(last_node).second;
+      }
+      TF_LITE_ENSURE_STATUS(arena_.Allocate(
+          context_, tensor_alignment_, tensor.bytes, tensor_index, first_node,
+          last_node, &allocs_[tensor_index]));
     }
     // Check allocs_[].size to prevent from reallocation of persistent tensors.
     // Only allocate ArenaRwPersistent tensors which own their buffer.
@@ -563,6 +592,70 @@ TfLiteStatus ArenaPlanner::CalculateAllocations(
   return kTfLiteOk;
 }
 
+std::vector<size_t> ArenaPlanner::PlanCacheKey(int last_node) {
+  const std::vector<int32_t> tensors_to_allocate =
+      GetTensorsToAllocate(/*first_node=*/0, last_node);
+  const TfLiteTensor* tensors = graph_info_->tensors();
+  std::vector<size_t> key;
+  key.reserve(2 + 5 * tensors_to_allocate.size() + actual_tensor_id_.size());
+  key.push_back(last_node);
+  key.push_back(allocs_.size());
+  // The order of `tensors_to_allocate` is part of the key since it decides the
+  // allocation order of tensors which compare equal.
+  for (const int32_t tensor_index : tensors_to_allocate) {
+    const TfLiteTensor& tensor = tensors[tensor_index];
+    key.push_back(tensor_index);
+    key.push_back(tensor.allocation_type);
+    key.push_back(tensor.bytes);
+    // The concurrent nodes change with the inter-op levels without the plan
+    // being recomputed.
+    const int32_t alloc_node = alloc_node_[tensor_index];
+    const int32_t dealloc_node = dealloc_node_[tensor_index];
+    key.push_back(graph_info_->concurrent_nodes(alloc_node).first);
+    key.push_back(dealloc_node == kNodeNotAssigned
+                      ? dealloc_node
+                      : graph_info_->concurrent_nodes(dealloc_node).second);
+  }
+  // Sharing of buffers is only ever revoked after PlanAllocations().
+  const size_t shared_begin = key.size();
+  for (const auto& shared : actual_tensor_id_) {
+    key.push_back(shared.first);
+  }
+  std::sort(key.begin() + shared_begin, key.end());
+  return key;
+}
+
+bool ArenaPlanner::RestoreCachedPlan(const std::vector<size_t>& key,
+                                     std::vector<int32_t>* tensors_allocated) {
+  auto it = std::find_if(
+      plan_cache_.begin(), plan_cache_.end(),
+      [&key](const CachedPlan& plan) { return plan.key == key; });
+  if (it == plan_cache_.end()) {
+    ++plan_cache_misses_;
+    return false;
+  }
+  ++plan_cache_hits_;
+  plan_cache_.splice(plan_cache_.begin(), plan_cache_, it);
+  const CachedPlan& plan = plan_cache_.front();
+  allocs_ = plan.allocs;
+  arena_.RestorePlan(plan.arena_plan);
+  persistent_arena_.RestorePlan(plan.persistent_arena_plan);
+  actual_tensor_id_ = plan.actual_tensor_id;
+  *tensors_allocated = plan.tensors_allocated;
+  last_active_node_ = static_cast<int>(plan.key[0]);
+  return true;
+}
+
+void ArenaPlanner::CachePlan(std::vector<size_t> key,
+                             const std::vector<int32_t>& tensors_allocated) {
+  if (plan_cache_.size() >= kMaxCachedArenaPlans) {
+    plan_cache_.pop_back();
+  }
+  plan_cache_.push_front(CachedPlan{std::move(key), allocs_, arena_.GetPlan(),
+                                    persistent_arena_.GetPlan(),
+                                    actual_tensor_id_, tensors_allocated});
+}
+
 bool AreTensorsAllocatedInSameArena(int32_t root_tensor_index,
                                     int32_t tensor_index,
                                     const TfLiteTensor* tensors) {
@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <cstddef>
 #include <cstdint>
+#include <list>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
@@ -32,6 +33,10 @@ namespace tflite {
 
 constexpr const int kDefaultArenaAlignment = 64;
 
+// Maximum number of allocation plans ArenaPlanner keeps for previously seen
+// tensor sizes.
+constexpr const int kMaxCachedArenaPlans = 8;
+
 // A memory planner that makes all the allocations using arenas.
 //
 // Before a model is executed by the interpreter, this class determines when
@@ -45,6 +50,15 @@ constexpr const int kDefaultArenaAlignment = 64;
 // execution. Since dynamic tensors don't have sizes until after the
 // corresponding operation is executed, this class supports incremental
 // planning.
+//
+// Models whose input shapes change between invocations, e.g. with a variable
+// sequence length, replan all allocations after every resize. Since a plan made
+// from scratch only depends on the tensor sizes, the most recently used
+// kMaxCachedArenaPlans plans are cached, and switching back to a previously
+// seen shape restores its plan instead of recomputing it. Computing a plan is
+// profiled as "ArenaPlanner::CalculateAllocations", and every cache lookup adds
+// an "ArenaPlanner::PlanCache" runtime instrumentation event whose metadata are
+// the number of hits and misses so far.
 class ArenaPlanner : public MemoryPlanner {
  public:
   // Ownership of 'context' is not taken and it must remain util the
@@ -72,7 +86,41 @@ class ArenaPlanner : public MemoryPlanner {
   // Returns the base arena location for a given allocation type.
   std::intptr_t BasePointer(TfLiteAllocationType type);
 
+  // Number of times ExecuteAllocations restored a cached plan, or had to
+  // compute a plan which could then be cached.
+  int plan_cache_hits() const { return plan_cache_hits_; }
+  int plan_cache_misses() const { return plan_cache_misses_; }
+
  private:
+  // The result of allocating the tensors of nodes [0, last_node] right after
+  // ResetAllocations().
+  struct CachedPlan {
+    // Everything the plan depends on, see PlanCacheKey(). Starts with the
+    // `last_node` the plan was made for.
+    std::vector<size_t> key;
+    std::vector<ArenaAllocWithUsageInterval> allocs;
+    SimpleMemoryArena::Plan arena_plan;
+    SimpleMemoryArena::Plan persistent_arena_plan;
+    // NOLINTNEXTLINE - absl::flat_hash_map increases binary size by 106kB.
+    std::unordered_map<int32_t, int32_t> actual_tensor_id;
+    std::vector<int32_t> tensors_allocated;
+  };
+
+  // Returns the inputs of CalculateAllocations(0, last_node) which may change
+  // without PlanAllocations() being called: the allocation type, size and
+  // usage interval of each tensor to allocate, and the shared tensors.
+  std::vector<size_t> PlanCacheKey(int last_node);
+
+  // Restores the cached plan for `key` and marks it as most recently used.
+  // Returns false if there is none.
+  bool RestoreCachedPlan(const std::vector<size_t>& key,
+                         std::vector<int32_t>* tensors_allocated);
+
+  // Caches the current plan for `key`, evicting the least recently used plan
+  // if the cache is full.
+  void CachePlan(std::vector<size_t> key,
+                 const std::vector<int32_t>& tensors_allocated);
+
   // Check whether the input tensor's memory may be shared the output tensor.
   // tensor_changed: true if the output tensor modifies the tensor data. For
   // example, `Reshape` doesn't modify data but Add does.
@@ -166,6 +214,12 @@ class ArenaPlanner : public MemoryPlanner {
 
   // Store number of references to each tensor.
   std::vector<int> refcounts_;
+
+  // Plans for previously seen tensor sizes, most recently used first. Cleared
+  // by PlanAllocations().
+  std::list<CachedPlan> plan_cache_;
+  int plan_cache_hits_ = 0;
+  int plan_cache_misses_ = 0;
 };
 
 }  // namespace tflite
@@ -22,6 +22,7 @@ limitations under the License.
 #include <initializer_list>
 #include <memory>
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -30,6 +31,7 @@ limitations under the License.
 #include "absl/log/log.h"
 #include "tensorflow/lite/builtin_ops.h"
 #include "tensorflow/lite/c/c_api_types.h"
+#include "tensorflow/lite/core/api/profiler.h"
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/graph_info.h"
 
@@ -148,6 +150,24 @@ class TestGraph {
     variables_ = variables;
   }
 
+  // Marks the nodes at execution plan indices [first, last] as running
+  // concurrently.
+  void SetConcurrentNodes(size_t first, size_t last) {
+    if (concurrent_nodes_.empty()) {
+      for (size_t i = 0; i < nodes_.size(); ++i) {
+        concurrent_nodes_.push_back({i, i});
+      }
+    }
+    for (size_t i = first; i <= last; ++i) {
+      concurrent_nodes_[i] = {first, last};
+    }
+  }
+
+  std::pair<size_t, size_t> concurrent_nodes(size_t index) const {
+    if (index >= concurrent_nodes_.size()) return {index, index};
+    return concurrent_nodes_[index];
+  }
+
   void Swap(TestGraph* other) {
     std::swap(nodes_, other->nodes_);
     std::swap(tensors_, other->tensors_);
@@ -163,6 +183,7 @@ class TestGraph {
   std::vector<int> inputs_;
   std::vector<int> outputs_;
   std::vector<int> variables_;
+  std::vector<std::pair<size_t, size_t>> concurrent_nodes_;
 };
 
 // The GraphInfo for a TestGraph.
@@ -189,6 +210,9 @@ class TestGraphInfo : public GraphInfo {
   const std::vector<int>& variables() const override {
     return graph_->variables();
   }
+  std::pair<size_t, size_t> concurrent_nodes(size_t index) const override {
+    return graph_->concurrent_nodes(index);
+  }
 
  private:
   TestGraph* graph_;
@@ -211,6 +235,7 @@ class ArenaPlannerTest : public ::testing::Test {
   void SetGraph(TestGraph* graph, bool preserve_all_tensors = false) {
     graph_ = graph;
     context_.ReportError = ReportError;
+    context_.profiler = nullptr;
     planner_ = std::make_unique<ArenaPlanner>(
         &context_, std::unique_ptr<GraphInfo>(new TestGraphInfo(graph)),
         preserve_all_tensors, kTensorAlignment);
@@ -370,6 +395,103 @@ TEST_F(ArenaPlannerTest, AllocsCorrectlyReset) {
   EXPECT_EQ(GetOffset(1), 4);
 }
 
+// Records the tags of all events, and the metadata of the last plan cache
+// event.
+class PlanCacheProfiler : public Profiler {
+ public:
+  uint32_t BeginEvent(const char* tag, EventType event_type,
+                      int64_t event_metadata1,
+                      int64_t event_metadata2) override {
+    tags.push_back(tag);
+    if (tags.back() == "ArenaPlanner::PlanCache") {
+      hits = event_metadata1;
+      misses = event_metadata2;
+    }
+    return tags.size();
+  }
+  void EndEvent(uint32_t event_handle) override {}
+
+  std::vector<std::string> tags;
+  int64_t hits = -1;
+  int64_t misses = -1;
+};
+
+TEST_F(ArenaPlannerTest, RestoresCachedPlans) {
+  TestGraph graph({0, 1},
+                  {
+                      /* in, out, tmp */
+                      {{0, 1}, {2}, {}},     // First op
+                      {{2, 0}, {4, 5}, {}},  // Second op
+                      {{4, 5}, {3}, {}}      // Third op
+                  },
+                  {3});
+  SetGraph(&graph);
+  PlanCacheProfiler profiler;
+  context_.profiler = &profiler;
+  std::vector<TfLiteTensor>& tensors = *graph.tensors();
+  auto execute_with_sizes = [&](const std::vector<size_t>& sizes) {
+    ResetAllocations();
+    for (int i = 0; i < sizes.size(); ++i) tensors[i].bytes = sizes[i];
+    Execute(0, graph.nodes().size() - 1);
+    std::vector<std::ptrdiff_t> offsets;
+    for (int i = 0; i < sizes.size(); ++i) offsets.push_back(GetOffset(i));
+    return offsets;
+  };
+
+  const std::vector<size_t> small = {3, 6, 9, 12, 15, 18};
+  const std::vector<size_t> large = {30, 6, 90, 12, 150, 18};
+  const std::vector<std::ptrdiff_t> small_offsets = execute_with_sizes(small);
+  const std::vector<std::ptrdiff_t> large_offsets = execute_with_sizes(large);
+  EXPECT_EQ(planner_->plan_cache_hits(), 0);
+  EXPECT_EQ(planner_->plan_cache_misses(), 2);
+  EXPECT_NE(small_offsets, large_offsets);
+
+  profiler.tags.clear();
+  EXPECT_EQ(execute_with_sizes(small), small_offsets);
+  EXPECT_EQ(execute_with_sizes(large), large_offsets);
+  EXPECT_EQ(planner_->plan_cache_hits(), 2);
+  EXPECT_EQ(planner_->plan_cache_misses(), 2);
+  EXPECT_EQ(profiler.hits, 2);
+  EXPECT_EQ(profiler.misses, 2);
+  EXPECT_EQ(std::count(profiler.tags.begin(), profiler.tags.end(),
+                       "ArenaPlanner::CalculateAllocations"),
+            0);
+
+  // Replanning the graph invalidates the cache.
+  CHECK(planner_->PlanAllocations() == kTfLiteOk);
+  EXPECT_EQ(execute_with_sizes(small), small_offsets);
+  EXPECT_EQ(planner_->plan_cache_misses(), 3);
+  EXPECT_EQ(std::count(profiler.tags.begin(), profiler.tags.end(),
+                       "ArenaPlanner::CalculateAllocations"),
+            1);
+}
+
+TEST_F(ArenaPlannerTest, EvictsLeastRecentlyUsedPlan) {
+  TestGraph graph({0}, {{{0}, {1}, {}}, {{1}, {2}, {}}}, {2});
+  SetGraph(&graph);
+  std::vector<TfLiteTensor>& tensors = *graph.tensors();
+  auto execute_with_input_size = [&](size_t size) {
+    ResetAllocations();
+    tensors[0].bytes = size;
+    Execute(0, graph.nodes().size() - 1);
+  };
+
+  for (int i = 1; i <= kMaxCachedArenaPlans; ++i) {
+    execute_with_input_size(i);
+  }
+  // Use the first plan, so that the second one is evicted instead.
+  execute_with_input_size(1);
+  execute_with_input_size(kMaxCachedArenaPlans + 1);
+  EXPECT_EQ(planner_->plan_cache_hits(), 1);
+  EXPECT_EQ(planner_->plan_cache_misses(), kMaxCachedArenaPlans + 1);
+
+  execute_with_input_size(1);
+  EXPECT_EQ(planner_->plan_cache_hits(), 2);
+  execute_with_input_size(2);
+  EXPECT_EQ(planner_->plan_cache_hits(), 2);
+  EXPECT_EQ(planner_->plan_cache_misses(), kMaxCachedArenaPlans + 2);
+}
+
 TEST_F(ArenaPlannerTest, SimpleGraphInputsPreserved) {
   TestGraph graph({0, 1},
                   {
@@ -411,6 +533,35 @@ TEST_F(ArenaPlannerTest, SimpleGraphWithTemporary) {
   EXPECT_EQ(GetOffset(1), 4);
 }
 
+TEST_F(ArenaPlannerTest, ConcurrentNodesDoNotShareMemory) {
+  TestGraph graph({0},
+                  {
+                      /* in, out, tmp */
+                      {{0}, {1}, {4}},    // First branch, with temporary
+                      {{0}, {2}, {5}},    // Second branch, with temporary
+                      {{1, 2}, {3}, {}},  // Joins the branches
+                  },
+                  {3});
+  SetGraph(&graph);
+  Execute(0, graph.nodes().size() - 1);
+  // The temporaries of consecutive nodes share memory.
+  EXPECT_EQ(GetOffset(4), GetOffset(5));
+
+  graph.SetConcurrentNodes(0, 1);
+  ResetAllocations();
+  Execute(0, graph.nodes().size() - 1);
+  // The temporaries of concurrent nodes do not, and neither overlaps with the
+  // other branch's output.
+  for (int tensor : {4, 5}) {
+    for (int other : {1, 2, 4, 5}) {
+      if (tensor == other) continue;
+      EXPECT_TRUE(GetOffsetAfter(tensor) <= GetOffset(other) ||
+                  GetOffsetAfter(other) <= GetOffset(tensor))
+          << "tensors " << tensor << " and " << other << " overlap";
+    }
+  }
+}
+
 TEST_F(ArenaPlannerTest, SimpleGraphWithInplaceReshape) {
   TestGraph graph(
       {0, 1},
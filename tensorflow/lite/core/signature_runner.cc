@@ -15,9 +15,12 @@ limitations under the License.
 
 #include "tensorflow/lite/core/signature_runner.h"
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 #include "tensorflow/lite/core/c/c_api_types.h"
+#include "tensorflow/lite/core/c/common.h"
 
 namespace tflite {
 namespace impl {
@@ -91,6 +94,123 @@ TfLiteStatus SignatureRunner::Invoke() {
   return kTfLiteOk;
 }
 
+TfLiteStatus SignatureRunner::SetBatchSizeBuckets(
+    std::vector<int> batch_sizes) {
+  for (int batch_size : batch_sizes) {
+    if (batch_size <= 0) {
+      subgraph_->ReportError("Invalid batch size bucket %d", batch_size);
+      return kTfLiteError;
+    }
+  }
+  std::sort(batch_sizes.begin(), batch_sizes.end());
+  batch_sizes.erase(std::unique(batch_sizes.begin(), batch_sizes.end()),
+                    batch_sizes.end());
+  batch_size_buckets_ = std::move(batch_sizes);
+  return kTfLiteOk;
+}
+
+TfLiteStatus SignatureRunner::InvokeBatch(
+    const std::vector<BatchRequest>& requests) {
+  for (const BatchRequest& request : requests) {
+    if (request.inputs.size() != input_size() ||
+        request.outputs.size() != output_size()) {
+      subgraph_->ReportError(
+          "Batch request has %d inputs and %d outputs, expected %d and %d",
+          static_cast<int>(request.inputs.size()),
+          static_cast<int>(request.outputs.size()),
+          static_cast<int>(input_size()), static_cast<int>(output_size()));
+      return kTfLiteError;
+    }
+  }
+
+  const int num_requests = requests.size();
+  const int max_batch_size = batch_size_buckets_.empty()
+                                 ? num_requests
+                                 : batch_size_buckets_.back();
+  for (int first_request = 0; first_request < num_requests;
+       first_request += max_batch_size) {
+    const int batch_requests =
+        std::min(max_batch_size, num_requests - first_request);
+    int batch_size = batch_requests;
+    if (!batch_size_buckets_.empty()) {
+      batch_size = *std::lower_bound(batch_size_buckets_.begin(),
+                                     batch_size_buckets_.end(), batch_requests);
+    }
+    TF_LITE_ENSURE_STATUS(
+        InvokeBatchOfSize(requests, first_request, batch_requests, batch_size));
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus SignatureRunner::ResizeBatch(int batch_size) {
+  bool resized = false;
+  for (const auto& it : signature_def_->inputs) {
+    const TfLiteTensor* tensor = subgraph_->tensor(it.second);
+    if (tensor->dims->size == 0) {
+      subgraph_->ReportError("Input %s has no batch dimension",
+                             it.first.c_str());
+      return kTfLiteError;
+    }
+    if (tensor->dims->data[0] == batch_size) continue;
+    std::vector<int> new_size(tensor->dims->data,
+                              tensor->dims->data + tensor->dims->size);
+    new_size[0] = batch_size;
+    TF_LITE_ENSURE_STATUS(subgraph_->ResizeInputTensor(it.second, new_size));
+    resized = true;
+  }
+  if (resized) {
+    TF_LITE_ENSURE_STATUS(subgraph_->AllocateTensors());
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus SignatureRunner::InvokeBatchOfSize(
+    const std::vector<BatchRequest>& requests, int first_request,
+    int num_requests, int batch_size) {
+  TF_LITE_ENSURE_STATUS(ResizeBatch(batch_size));
+
+  int input = 0;
+  for (const auto& it : signature_def_->inputs) {
+    TfLiteTensor* tensor = subgraph_->tensor(it.second);
+    if (tensor->type == kTfLiteString) {
+      subgraph_->ReportError("String input %s can't be batched",
+                             it.first.c_str());
+      return kTfLiteError;
+    }
+    const size_t example_bytes = tensor->bytes / batch_size;
+    char* data = tensor->data.raw;
+    for (int i = 0; i < num_requests; ++i) {
+      std::memcpy(data + i * example_bytes,
+                  requests[first_request + i].inputs[input], example_bytes);
+    }
+    // Padding examples are zero so that they can't produce NaNs or traps.
+    std::memset(data + num_requests * example_bytes, 0,
+                (batch_size - num_requests) * example_bytes);
+    ++input;
+  }
+
+  TF_LITE_ENSURE_STATUS(Invoke());
+
+  int output = 0;
+  for (const auto& it : signature_def_->outputs) {
+    const TfLiteTensor* tensor = subgraph_->tensor(it.second);
+    if (tensor->type == kTfLiteString || tensor->dims->size == 0 ||
+        tensor->dims->data[0] != batch_size) {
+      subgraph_->ReportError("Output %s is not batched like the inputs",
+                             it.first.c_str());
+      return kTfLiteError;
+    }
+    const size_t example_bytes = tensor->bytes / batch_size;
+    const char* data = tensor->data.raw_const;
+    for (int i = 0; i < num_requests; ++i) {
+      std::memcpy(requests[first_request + i].outputs[output],
+                  data + i * example_bytes, example_bytes);
+    }
+    ++output;
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus SignatureRunner::SetCustomAllocationForInputTensor(
     const char* input_name, const TfLiteCustomAllocation& allocation,
     int64_t flags) {
@@ -145,10 +145,50 @@ class SignatureRunner {
   /// Updates allocations for all tensors, related to the given signature.
   TfLiteStatus AllocateTensors() { return subgraph_->AllocateTensors(); }
 
+  /// Resets all variable tensors of the signature, e.g. the states of
+  /// recurrent ops, to their default values. With
+  /// `InterpreterOptions::SetStreamingMode`, this starts a new stream.
+  /// WARNING: This is an experimental API and subject to change.
+  TfLiteStatus ResetVariableTensors() {
+    return subgraph_->ResetVariableTensors();
+  }
+
   /// Invokes the signature runner (run the graph identified by the given
   /// signature in dependency order).
   TfLiteStatus Invoke();
 
+  /// One request of a batched invocation, see `InvokeBatch`.
+  struct BatchRequest {
+    /// One example for each input, in the order of `input_names()`. An
+    /// example holds the data of the input tensor without its first (batch)
+    /// dimension.
+    std::vector<const void*> inputs;
+    /// Buffers receiving one example of each output, in the order of
+    /// `output_names()`.
+    std::vector<void*> outputs;
+  };
+
+  /// \brief Sets the batch sizes `InvokeBatch` runs the signature with.
+  ///
+  /// A batch of requests is padded up to the smallest of `batch_sizes` which
+  /// fits it, so that switching between the few distinct batch sizes reuses
+  /// their tensor allocations instead of replanning them for every number of
+  /// requests. Batches larger than the largest bucket are split. Without
+  /// buckets, every batch is run with exactly as many examples as requests.
+  /// \warning This is an experimental API and subject to change. \n
+  TfLiteStatus SetBatchSizeBuckets(std::vector<int> batch_sizes);
+
+  /// \brief Invokes the signature for a batch of independent requests.
+  ///
+  /// The examples of the requests are packed along the first dimension of the
+  /// inputs, the signature is invoked once per batch size bucket, and the
+  /// outputs are scattered back into the buffers of the requests. Requires
+  /// all inputs and outputs to have the batch as their first dimension, and
+  /// does not support string tensors. `AllocateTensors` must have been called
+  /// before; the inputs are resized as needed.
+  /// \warning This is an experimental API and subject to change. \n
+  TfLiteStatus InvokeBatch(const std::vector<BatchRequest>& requests);
+
   /// Attempts to cancel in flight invocation if any.
   /// This will not affect calls to `Invoke` that happened after this.
   /// Non blocking and thread safe.
@@ -231,6 +271,16 @@ class SignatureRunner {
   friend class ::tflite::SignatureRunnerJNIHelper;
   friend class ::tflite::TensorHandle;
 
+  // Resizes the first dimension of all inputs to `batch_size` and allocates
+  // the tensors if any input changed.
+  TfLiteStatus ResizeBatch(int batch_size);
+
+  // Packs `num_requests` requests starting at `first_request` into a batch of
+  // `batch_size` examples, invokes the signature and scatters the outputs.
+  TfLiteStatus InvokeBatchOfSize(const std::vector<BatchRequest>& requests,
+                                 int first_request, int num_requests,
+                                 int batch_size);
+
   // The SignatureDef object is owned by the interpreter.
   const internal::SignatureDef* signature_def_;
   // The Subgraph object is owned by the interpreter.
@@ -241,6 +291,9 @@ class SignatureRunner {
   std::vector<const char*> output_names_;
 
   bool allow_buffer_handle_output_ = false;
+
+  // Ascending batch sizes used by `InvokeBatch`.
+  std::vector<int> batch_size_buckets_;
 };
 
 }  // namespace impl
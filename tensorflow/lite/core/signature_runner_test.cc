@@ -96,6 +96,72 @@ TEST(SignatureRunnerTest, TestMultiSignatures) {
   ASSERT_EQ(sub_output->data.f[2], 3);
 }
 
+class SignatureRunnerInvokeBatchTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    model_ = FlatBufferModel::BuildFromFile(
+        "tensorflow/lite/testdata/multi_signatures.bin", &reporter_);
+    ASSERT_TRUE(model_);
+    ops::builtin::BuiltinOpResolver resolver;
+    ASSERT_EQ(InterpreterBuilder(*model_, resolver)(&interpreter_), kTfLiteOk);
+    runner_ = interpreter_->GetSignatureRunner("add");
+    ASSERT_NE(runner_, nullptr);
+    ASSERT_EQ(runner_->ResizeInputTensor("x", {1}), kTfLiteOk);
+    ASSERT_EQ(runner_->AllocateTensors(), kTfLiteOk);
+  }
+
+  // Runs the "add" signature, which adds 2 to every element, for requests
+  // with the given inputs and checks their outputs.
+  void InvokeAndCheck(const std::vector<float>& inputs) {
+    std::vector<float> outputs(inputs.size(), -1);
+    std::vector<SignatureRunner::BatchRequest> requests(inputs.size());
+    for (int i = 0; i < inputs.size(); ++i) {
+      requests[i].inputs = {&inputs[i]};
+      requests[i].outputs = {&outputs[i]};
+    }
+    ASSERT_EQ(runner_->InvokeBatch(requests), kTfLiteOk);
+    for (int i = 0; i < inputs.size(); ++i) {
+      EXPECT_EQ(outputs[i], inputs[i] + 2) << "request " << i;
+    }
+  }
+
+  TestErrorReporter reporter_;
+  std::unique_ptr<FlatBufferModel> model_;
+  std::unique_ptr<Interpreter> interpreter_;
+  SignatureRunner* runner_ = nullptr;
+};
+
+TEST_F(SignatureRunnerInvokeBatchTest, WithoutBuckets) {
+  InvokeAndCheck({1, 2, 3});
+  EXPECT_EQ(runner_->input_tensor("x")->dims->data[0], 3);
+  InvokeAndCheck({4});
+  EXPECT_EQ(runner_->input_tensor("x")->dims->data[0], 1);
+  InvokeAndCheck({});
+}
+
+TEST_F(SignatureRunnerInvokeBatchTest, PadsToBuckets) {
+  ASSERT_EQ(runner_->SetBatchSizeBuckets({4, 2}), kTfLiteOk);
+  InvokeAndCheck({1, 2, 3});
+  EXPECT_EQ(runner_->input_tensor("x")->dims->data[0], 4);
+  InvokeAndCheck({5});
+  EXPECT_EQ(runner_->input_tensor("x")->dims->data[0], 2);
+}
+
+TEST_F(SignatureRunnerInvokeBatchTest, SplitsBatchesLargerThanBuckets) {
+  ASSERT_EQ(runner_->SetBatchSizeBuckets({2, 4}), kTfLiteOk);
+  // Runs a batch of 4 followed by a padded batch of 2.
+  InvokeAndCheck({1, 2, 3, 4, 5});
+  EXPECT_EQ(runner_->input_tensor("x")->dims->data[0], 2);
+}
+
+TEST_F(SignatureRunnerInvokeBatchTest, RejectsInvalidRequests) {
+  EXPECT_EQ(runner_->SetBatchSizeBuckets({0, 2}), kTfLiteError);
+  float input = 1;
+  SignatureRunner::BatchRequest request;
+  request.inputs = {&input};
+  EXPECT_EQ(runner_->InvokeBatch({request}), kTfLiteError);
+}
+
 }  // namespace
 }  // namespace impl
 }  // namespace tflite
@@ -24,6 +24,7 @@ limitations under the License.
 #include <cstring>
 #include <iterator>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
 #include <unordered_set>
 #include <utility>
@@ -60,6 +61,10 @@ namespace tflite {
 
 namespace {
 
+// CPU backend context for the kernels running on the current thread, if it is
+// a worker of an inter-op thread pool. See `Subgraph::InvokeLevels`.
+thread_local TfLiteExternalContext* inter_op_cpu_backend_context = nullptr;
+
 struct TfLiteQuantizationDeleter {
   void operator()(TfLiteQuantization* q) {
     if (q) TfLiteQuantizationFree(q);
@@ -242,6 +247,10 @@ class InterpreterInfo : public GraphInfo {
     return subgraph_->variables();
   }
 
+  std::pair<size_t, size_t> concurrent_nodes(size_t index) const override {
+    return subgraph_->ConcurrentNodes(index);
+  }
+
  public:
   Subgraph* subgraph_;
 };
@@ -616,6 +625,10 @@ TfLiteStatus Subgraph::ReplaceNodeSubsetsWithDelegateKernels(
 
 TfLiteExternalContext* Subgraph::GetExternalContext(
     TfLiteExternalContextType type) {
+  if (type == kTfLiteCpuBackendContext &&
+      inter_op_cpu_backend_context != nullptr) {
+    return inter_op_cpu_backend_context;
+  }
   if (static_cast<int>(type) >= 0 && type < kTfLiteMaxExternalContexts) {
     return external_contexts_[type];
   }
@@ -1004,10 +1017,26 @@ TfLiteStatus Subgraph::AllocateTensors() {
   next_execution_plan_index_to_prepare_ = 0;
   next_execution_plan_index_to_plan_allocation_ = 0;
   next_original_execution_plan_index_to_prepare_ = 0;
+  // In streaming mode the variable tensors carry state between invocations,
+  // which must survive the replanning of the persistent arena.
+  std::vector<SavedVariableTensor> saved_variable_tensors;
+  if (IsStreamingMode() && variable_tensors_initialized_) {
+    saved_variable_tensors = SaveVariableTensors();
+  }
+  variable_tensors_initialized_ = false;
   if (memory_planner_) {
     TF_LITE_ENSURE_STATUS(memory_planner_->ResetAllocations());
   }
 
+  constant_node_states_.clear();
+  constant_tensors_.clear();
+  released_constant_tensors_.clear();
+  if (ShouldCacheConstantSubgraphs()) {
+    constant_node_states_.resize(nodes_and_registration_.size(),
+                                 ConstantNodeState::kNotConstant);
+  }
+
+  TF_LITE_ENSURE_STATUS(PlanInterOpLevels());
   TF_LITE_ENSURE_STATUS(PrepareOpsAndTensors());
 
   state_ = kStateInvokable;
@@ -1017,6 +1046,12 @@ TfLiteStatus Subgraph::AllocateTensors() {
   // variable tensors. They should call `ResetVariableTensors` directly
   // instead.
   ResetVariableTensors();
+  RestoreVariableTensors(saved_variable_tensors);
+  variable_tensors_initialized_ = true;
+
+  if (!constant_node_states_.empty()) {
+    TF_LITE_ENSURE_STATUS(InvokeConstantNodes());
+  }
 
   // Initialize the mapping between tensor index and the last execution plan
   // index that uses the tensor.
@@ -1046,6 +1081,41 @@ TfLiteStatus Subgraph::AllocateTensors() {
   return kTfLiteOk;
 }
 
+std::vector<Subgraph::SavedVariableTensor> Subgraph::SaveVariableTensors()
+    const {
+  std::vector<SavedVariableTensor> saved;
+  for (int i = 0; i < tensors_.size(); ++i) {
+    const TfLiteTensor& tensor = tensors_[i];
+    if (!tensor.is_variable ||
+        tensor.allocation_type != kTfLiteArenaRwPersistent ||
+        tensor.data.raw == nullptr || tensor.dims == nullptr) {
+      continue;
+    }
+    SavedVariableTensor saved_tensor;
+    saved_tensor.index = i;
+    saved_tensor.dims.assign(tensor.dims->data,
+                             tensor.dims->data + tensor.dims->size);
+    saved_tensor.data.assign(tensor.data.raw, tensor.data.raw + tensor.bytes);
+    saved.push_back(std::move(saved_tensor));
+  }
+  return saved;
+}
+
+void Subgraph::RestoreVariableTensors(
+    const std::vector<SavedVariableTensor>& saved) {
+  for (const SavedVariableTensor& saved_tensor : saved) {
+    TfLiteTensor& tensor = tensors_[saved_tensor.index];
+    if (!tensor.is_variable || tensor.data.raw == nullptr ||
+        tensor.bytes != saved_tensor.data.size() ||
+        !EqualArrayAndTfLiteIntArray(tensor.dims, saved_tensor.dims.size(),
+                                     saved_tensor.dims.data())) {
+      continue;
+    }
+    std::memcpy(tensor.data.raw, saved_tensor.data.data(),
+                saved_tensor.data.size());
+  }
+}
+
 // TODO(b/115961645): Support non-zero default values.
 TfLiteStatus Subgraph::ResetVariableTensors() {
   for (auto& tensor : tensors_) {
@@ -1512,6 +1582,12 @@ TfLiteStatus Subgraph::PrepareOpsStartingAt(
 
     *last_execution_plan_index_prepared = execution_plan_index;
 
+    // Nodes of the original execution plan which were delegated are never
+    // invoked.
+    if (!constant_node_states_.empty() && &execution_plan == &execution_plan_) {
+      UpdateConstantNode(node_index);
+    }
+
     // Discontinue if the node has dynamic outputs. Note that we don't
     // stop for dynamic temporary tensors since they won't affect the
     // sizes of other tensors in the graph.
@@ -1551,6 +1627,10 @@ TfLiteStatus Subgraph::PrepareOpsAndTensors() {
   TF_LITE_ENSURE_STATUS(
       PrepareOpsStartingAt(next_execution_plan_index_to_prepare_,
                            execution_plan_, &last_exec_plan_index_prepared));
+  if (!constant_node_states_.empty()) {
+    ReleaseInnerConstantTensors(next_execution_plan_index_to_prepare_,
+                                last_exec_plan_index_prepared);
+  }
   next_execution_plan_index_to_prepare_ = last_exec_plan_index_prepared + 1;
 
   if (!memory_planner_) {
@@ -1564,6 +1644,16 @@ TfLiteStatus Subgraph::PrepareOpsAndTensors() {
     memory_planner_->PlanAllocations();
   }
 
+  // The memory planner widens the lifetime of tensors to the levels of their
+  // nodes only while levels are invoked concurrently, so this can only be
+  // enabled when allocating from the start of the execution plan.
+  if (next_execution_plan_index_to_plan_allocation_ == 0) {
+    invoke_levels_concurrently_ =
+        !inter_op_level_starts_.empty() && !has_dynamic_tensors_ &&
+        next_execution_plan_index_to_prepare_ == execution_plan_.size() &&
+        !ShouldOptimizeMemoryForLargeTensors();
+  }
+
   // Execute arena allocations.
   TF_LITE_ENSURE_STATUS(memory_planner_->ExecuteAllocations(
       next_execution_plan_index_to_plan_allocation_,
@@ -1638,6 +1728,15 @@ TfLiteStatus Subgraph::InvokeImpl() {
       tflite::OnTfLiteSubgraphInvoke(name_.c_str(), subgraph_index_);
 #endif  // TF_LITE_TENSORFLOW_PROFILER
 
+  if (invoke_levels_concurrently_ && !profiler_ &&
+      next_execution_plan_index_to_prepare_ == execution_plan_.size()) {
+    status = InvokeLevels();
+#ifdef TF_LITE_TENSORFLOW_PROFILER
+    tflite::OnTfLiteSubgraphInvokeEnd(trace_subgraph);
+#endif  // TF_LITE_TENSORFLOW_PROFILER
+    return status;
+  }
+
   // Invocations are always done in node order.
   // Note that calling Invoke repeatedly will cause the original memory plan to
   // be reused, unless either ResizeInputTensor() or AllocateTensors() has been
@@ -1650,6 +1749,7 @@ TfLiteStatus Subgraph::InvokeImpl() {
                                     execution_plan_index);
     }
     int node_index = execution_plan_[execution_plan_index];
+    if (IsCachedConstantNode(node_index)) continue;
     TfLiteNode& node = nodes_and_registration_[node_index].first;
     const TfLiteRegistration& registration =
         nodes_and_registration_[node_index].second;
@@ -1672,37 +1772,7 @@ TfLiteStatus Subgraph::InvokeImpl() {
     TFLITE_SCOPED_TAGGED_OPERATOR_PROFILE(
         profile_op ? profiler_.get() : nullptr, op_name, node_index);
 
-    for (int i = 0; i < node.inputs->size; ++i) {
-      int tensor_index = node.inputs->data[i];
-      if (tensor_index == kTfLiteOptionalTensor) {
-        continue;
-      }
-      TfLiteTensor* tensor = &tensors_[tensor_index];
-      if (tensor->delegate && tensor->delegate != node.delegate &&
-          tensor->data_is_stale) {
-        TF_LITE_ENSURE_STATUS(EnsureTensorDataIsReadable(tensor_index));
-      }
-      if (tensor->data.raw == nullptr && tensor->bytes > 0) {
-        if (registration.builtin_code == kTfLiteBuiltinReshape && i == 1 &&
-            tensor->dims->size != 1) {
-          // In general, having a tensor here with no buffer will be an error.
-          // However, for the reshape operator, the second input tensor is
-          // sometimes only used for the shape, not for the data. Thus, null
-          // buffer is ok in this situation.
-          // The situation where null buffer is not ok for reshape operator is
-          // only when there are 2 inputs given to the node and the one
-          // corresponding to the shape (i == 1) is a vector that contains all
-          // dimensions. See `GetOutputShape()` function in
-          // `tensorflow/lite/kernels/reshape.cc`
-          continue;
-        } else {
-          // In all other cases, we need to return an error as otherwise we will
-          // trigger a null pointer dereference (likely).
-          ReportError("Input tensor %d lacks data", tensor_index);
-          return kTfLiteError;
-        }
-      }
-    }
+    TF_LITE_ENSURE_STATUS(EnsureNodeInputsReadable(node, registration));
     // Allocate dynamic tensors which memory is required to be allocated
     // before executing the node.
     MayAllocateOpOutput(&node);
@@ -1726,6 +1796,12 @@ TfLiteStatus Subgraph::InvokeImpl() {
                                "failed to invoke");
       return s == kTfLiteCancelled ? s : err;
     }
+    // Constant nodes prepared after `AllocateTensors` are cached once they
+    // were invoked.
+    if (node_index < constant_node_states_.size() &&
+        constant_node_states_[node_index] == ConstantNodeState::kPending) {
+      constant_node_states_[node_index] = ConstantNodeState::kCached;
+    }
 
     // Force execution prep for downstream ops if the latest op triggered the
     // resize of a dynamic tensor.
@@ -1759,6 +1835,433 @@ TfLiteStatus Subgraph::InvokeImpl() {
   return status;
 }
 
+TfLiteStatus Subgraph::EnsureNodeInputsReadable(
+    const TfLiteNode& node, const TfLiteRegistration& registration) {
+  for (int i = 0; i < node.inputs->size; ++i) {
+    int tensor_index = node.inputs->data[i];
+    if (tensor_index == kTfLiteOptionalTensor) {
+      continue;
+    }
+    TfLiteTensor* tensor = &tensors_[tensor_index];
+    if (tensor->delegate && tensor->delegate != node.delegate &&
+        tensor->data_is_stale) {
+      TF_LITE_ENSURE_STATUS(EnsureTensorDataIsReadable(tensor_index));
+    }
+    if (tensor->data.raw == nullptr && tensor->bytes > 0) {
+      if (registration.builtin_code == kTfLiteBuiltinReshape && i == 1 &&
+          tensor->dims->size != 1) {
+        // In general, having a tensor here with no buffer will be an error.
+        // However, for the reshape operator, the second input tensor is
+        // sometimes only used for the shape, not for the data. Thus, null
+        // buffer is ok in this situation.
+        // The situation where null buffer is not ok for reshape operator is
+        // only when there are 2 inputs given to the node and the one
+        // corresponding to the shape (i == 1) is a vector that contains all
+        // dimensions. See `GetOutputShape()` function in
+        // `tensorflow/lite/kernels/reshape.cc`
+        continue;
+      } else {
+        // In all other cases, we need to return an error as otherwise we will
+        // trigger a null pointer dereference (likely).
+        ReportError("Input tensor %d lacks data", tensor_index);
+        return kTfLiteError;
+      }
+    }
+  }
+  return kTfLiteOk;
+}
+
+std::pair<int, int> Subgraph::ConcurrentNodes(int execution_plan_index) const {
+  if (!invoke_levels_concurrently_ || execution_plan_index < 0 ||
+      execution_plan_index >= inter_op_levels_.size()) {
+    return {execution_plan_index, execution_plan_index};
+  }
+  const int level = inter_op_levels_[execution_plan_index];
+  return {inter_op_level_starts_[level], inter_op_level_starts_[level + 1] - 1};
+}
+
+bool Subgraph::MustInvokeAlone(int node_index) const {
+  const TfLiteNode& node = nodes_and_registration_[node_index].first;
+  const TfLiteRegistration& registration =
+      nodes_and_registration_[node_index].second;
+  // Delegate kernels and custom ops may share state across nodes.
+  if (node.delegate != nullptr || registration.custom_name != nullptr) {
+    return true;
+  }
+  switch (registration.builtin_code) {
+    // Ops which invoke other subgraphs.
+    case kTfLiteBuiltinCallOnce:
+    case kTfLiteBuiltinIf:
+    case kTfLiteBuiltinWhile:
+    case kTfLiteBuiltinStablehloComposite:
+    case kTfLiteBuiltinStablehloReduceWindow:
+    case kTfLiteBuiltinStablehloScatter:
+    case kTfLiteBuiltinStablehloWhile:
+      return true;
+    default:
+      break;
+  }
+  // Ops which read or write state that is not captured by the data
+  // dependencies, or tensors owned by a delegate.
+  for (const TfLiteIntArray* tensor_indices : {node.inputs, node.outputs}) {
+    for (int i = 0; i < tensor_indices->size; ++i) {
+      const int tensor_index = tensor_indices->data[i];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      const TfLiteTensor& tensor = tensors_[tensor_index];
+      if (tensor.is_variable || tensor.type == kTfLiteResource ||
+          tensor.type == kTfLiteVariant || tensor.delegate != nullptr) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Subgraph::IsConstantNode(int node_index) const {
+  if (MustInvokeAlone(node_index)) return false;
+  const TfLiteNode& node = nodes_and_registration_[node_index].first;
+  const TfLiteRegistration& registration =
+      nodes_and_registration_[node_index].second;
+  switch (registration.builtin_code) {
+    // Ops whose outputs differ between invocations.
+    case kTfLiteBuiltinMultinomial:
+    case kTfLiteBuiltinRandomStandardNormal:
+    case kTfLiteBuiltinRandomUniform:
+      return false;
+    default:
+      break;
+  }
+  bool has_inputs = false;
+  for (int i = 0; i < node.inputs->size; ++i) {
+    const int tensor_index = node.inputs->data[i];
+    if (tensor_index == kTfLiteOptionalTensor) continue;
+    const bool is_constant_output = tensor_index < constant_tensors_.size() &&
+                                    constant_tensors_[tensor_index];
+    // Persistent read-only tensors are computed by their producer in Prepare,
+    // e.g. a RESHAPE of a constant tensor.
+    const TfLiteAllocationType allocation_type =
+        tensors_[tensor_index].allocation_type;
+    if (allocation_type != kTfLiteMmapRo &&
+        allocation_type != kTfLitePersistentRo && !is_constant_output) {
+      return false;
+    }
+    has_inputs = true;
+  }
+  if (!has_inputs) return false;
+  // Dynamic and custom allocated outputs can't be moved to the persistent
+  // arena.
+  for (int i = 0; i < node.outputs->size; ++i) {
+    const int tensor_index = node.outputs->data[i];
+    if (tensor_index == kTfLiteOptionalTensor) continue;
+    const TfLiteAllocationType allocation_type =
+        tensors_[tensor_index].allocation_type;
+    if (allocation_type != kTfLiteArenaRw &&
+        allocation_type != kTfLiteArenaRwPersistent) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Subgraph::UpdateConstantNode(int node_index) {
+  if (node_index >= constant_node_states_.size()) return;
+  ConstantNodeState& state = constant_node_states_[node_index];
+  if (!IsConstantNode(node_index)) {
+    state = ConstantNodeState::kNotConstant;
+    return;
+  }
+  const TfLiteNode& node = nodes_and_registration_[node_index].first;
+  constant_tensors_.resize(tensors_.size(), false);
+  released_constant_tensors_.resize(tensors_.size(), false);
+  for (int i = 0; i < node.outputs->size; ++i) {
+    const int tensor_index = node.outputs->data[i];
+    if (tensor_index == kTfLiteOptionalTensor) continue;
+    constant_tensors_[tensor_index] = true;
+    // A node prepared again keeps its cached outputs where they are, since its
+    // inputs did not change, even if its Prepare moved them.
+    if (state == ConstantNodeState::kCached &&
+        released_constant_tensors_[tensor_index]) {
+      tensors_[tensor_index].allocation_type = kTfLiteArenaRw;
+    } else {
+      tensors_[tensor_index].allocation_type = kTfLiteArenaRwPersistent;
+      released_constant_tensors_[tensor_index] = false;
+    }
+  }
+  if (state == ConstantNodeState::kNotConstant) {
+    state = ConstantNodeState::kPending;
+  }
+}
+
+void Subgraph::ReleaseInnerConstantTensors(int first_execution_plan_index,
+                                           int last_execution_plan_index) {
+  // Nothing was prepared if the execution plan is empty.
+  last_execution_plan_index = std::min<int>(last_execution_plan_index,
+                                            execution_plan_.size() - 1);
+  // The outputs of the subgraph and the inputs of the nodes which are invoked
+  // must stay in persistent memory.
+  std::vector<bool> is_frontier(tensors_.size(), false);
+  for (const int tensor_index : outputs_) {
+    if (tensor_index == kTfLiteOptionalTensor) continue;
+    is_frontier[tensor_index] = true;
+  }
+  for (int execution_plan_index = 0;
+       execution_plan_index < execution_plan_.size(); ++execution_plan_index) {
+    const int node_index = execution_plan_[execution_plan_index];
+    // Nodes which were not prepared yet may turn out not to be constant.
+    if (execution_plan_index <= last_execution_plan_index &&
+        node_index < constant_node_states_.size() &&
+        constant_node_states_[node_index] != ConstantNodeState::kNotConstant) {
+      continue;
+    }
+    const TfLiteNode& node = nodes_and_registration_[node_index].first;
+    for (int i = 0; i < node.inputs->size; ++i) {
+      const int tensor_index = node.inputs->data[i];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      is_frontier[tensor_index] = true;
+    }
+  }
+
+  // Visit the nodes backwards, since the memory planner may let a node which
+  // runs in place share the buffer of its input with its output. The inputs
+  // of such a node with a frontier output must then stay persistent too.
+  for (int execution_plan_index = last_execution_plan_index;
+       execution_plan_index >= first_execution_plan_index;
+       --execution_plan_index) {
+    const int node_index = execution_plan_[execution_plan_index];
+    if (node_index >= constant_node_states_.size() ||
+        constant_node_states_[node_index] == ConstantNodeState::kNotConstant) {
+      continue;
+    }
+    const TfLiteNode& node = nodes_and_registration_[node_index].first;
+    const TfLiteRegistration& registration =
+        nodes_and_registration_[node_index].second;
+    bool has_frontier_output = false;
+    for (int i = 0; i < node.outputs->size; ++i) {
+      const int tensor_index = node.outputs->data[i];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      has_frontier_output |= is_frontier[tensor_index];
+    }
+    if (has_frontier_output &&
+        registration.inplace_operator != kTfLiteInplaceOpNone) {
+      for (int i = 0; i < node.inputs->size; ++i) {
+        const int tensor_index = node.inputs->data[i];
+        if (tensor_index == kTfLiteOptionalTensor) continue;
+        is_frontier[tensor_index] = true;
+      }
+    }
+    // Cached outputs stay where they were computed.
+    if (constant_node_states_[node_index] != ConstantNodeState::kPending) {
+      continue;
+    }
+    for (int i = 0; i < node.outputs->size; ++i) {
+      const int tensor_index = node.outputs->data[i];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      if (!is_frontier[tensor_index]) {
+        tensors_[tensor_index].allocation_type = kTfLiteArenaRw;
+        released_constant_tensors_[tensor_index] = true;
+      }
+    }
+  }
+}
+
+TfLiteStatus Subgraph::InvokeConstantNodes() {
+  int num_nodes = 0;
+  size_t num_bytes = 0;
+  for (int execution_plan_index = 0;
+       execution_plan_index < next_execution_plan_index_to_prepare_;
+       ++execution_plan_index) {
+    const int node_index = execution_plan_[execution_plan_index];
+    if (constant_node_states_[node_index] != ConstantNodeState::kPending) {
+      continue;
+    }
+    TfLiteNode& node = nodes_and_registration_[node_index].first;
+    const TfLiteRegistration& registration =
+        nodes_and_registration_[node_index].second;
+    if (OpInvoke(registration, &node) != kTfLiteOk) {
+      return ReportOpError(&context_, node, registration, node_index,
+                           "failed to invoke");
+    }
+    constant_node_states_[node_index] = ConstantNodeState::kCached;
+    ++num_nodes;
+    for (int i = 0; i < node.outputs->size; ++i) {
+      const int tensor_index = node.outputs->data[i];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      const TfLiteTensor& tensor = tensors_[tensor_index];
+      if (tensor.allocation_type == kTfLiteArenaRwPersistent) {
+        num_bytes += tensor.bytes;
+      }
+    }
+  }
+  if (num_nodes > 0) {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_INFO,
+                    "Cached the outputs of %d constant node(s) in %zu bytes "
+                    "of persistent memory.",
+                    num_nodes, num_bytes);
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus Subgraph::PlanInterOpLevels() {
+  inter_op_level_starts_.clear();
+  inter_op_levels_.clear();
+  invoke_levels_concurrently_ = false;
+  if (NumInterOpThreads() < 2) return kTfLiteOk;
+
+  // Control edges refer to node indices.
+  std::vector<std::vector<int>> control_predecessors;
+  if (control_edges_ != nullptr) {
+    control_predecessors.resize(nodes_and_registration_.size());
+    for (const ControlEdge& edge : *control_edges_) {
+      if (edge.first >= 0 && edge.first < control_predecessors.size() &&
+          edge.second >= 0 && edge.second < control_predecessors.size()) {
+        control_predecessors[edge.second].push_back(edge.first);
+      }
+    }
+  }
+
+  // A node's level is one more than the highest level of the nodes it depends
+  // on. Nodes which must run alone get a level of their own, which no node
+  // following them in the execution plan may precede.
+  std::vector<int> producer_level(tensors_.size(), -1);
+  std::vector<int> node_level(nodes_and_registration_.size(), -1);
+  std::vector<int> levels(execution_plan_.size());
+  int min_level = 0;
+  int num_levels = 0;
+  for (int i = 0; i < execution_plan_.size(); ++i) {
+    const int node_index = execution_plan_[i];
+    const TfLiteNode& node = nodes_and_registration_[node_index].first;
+    int level = min_level;
+    for (int j = 0; j < node.inputs->size; ++j) {
+      const int tensor_index = node.inputs->data[j];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      level = std::max(level, producer_level[tensor_index] + 1);
+    }
+    if (!control_predecessors.empty()) {
+      for (int predecessor : control_predecessors[node_index]) {
+        level = std::max(level, node_level[predecessor] + 1);
+      }
+    }
+    if (MustInvokeAlone(node_index)) {
+      level = num_levels;
+      min_level = level + 1;
+    }
+    for (int j = 0; j < node.outputs->size; ++j) {
+      const int tensor_index = node.outputs->data[j];
+      if (tensor_index == kTfLiteOptionalTensor) continue;
+      producer_level[tensor_index] = level;
+    }
+    node_level[node_index] = level;
+    levels[i] = level;
+    num_levels = std::max(num_levels, level + 1);
+  }
+  // Nothing to run concurrently.
+  if (num_levels == execution_plan_.size()) return kTfLiteOk;
+
+  // Stable-sort the execution plan by level. This is a valid execution order
+  // since every node has a higher level than the nodes it depends on.
+  std::vector<int> order(execution_plan_.size());
+  for (int i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&levels](int a, int b) { return levels[a] < levels[b]; });
+  bool plan_changed = false;
+  std::vector<int> new_plan(execution_plan_.size());
+  inter_op_levels_.resize(execution_plan_.size());
+  for (int i = 0; i < order.size(); ++i) {
+    plan_changed |= order[i] != i;
+    new_plan[i] = execution_plan_[order[i]];
+    inter_op_levels_[i] = levels[order[i]];
+    if (i == 0 || inter_op_levels_[i] != inter_op_levels_[i - 1]) {
+      inter_op_level_starts_.push_back(i);
+    }
+  }
+  inter_op_level_starts_.push_back(execution_plan_.size());
+
+  if (plan_changed) {
+    execution_plan_ = std::move(new_plan);
+    // The memory planner indexes tensor lifetimes by execution plan index.
+    if (memory_planner_) {
+      TF_LITE_ENSURE_STATUS(memory_planner_->PlanAllocations());
+    }
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus Subgraph::InvokeLevels() {
+  const int num_threads = NumInterOpThreads();
+  if (!inter_op_thread_pool_ ||
+      inter_op_thread_pool_->num_threads() != num_threads) {
+    inter_op_thread_pool_ = std::make_unique<InterOpThreadPool>(num_threads);
+    inter_op_cpu_backend_contexts_.clear();
+    for (int i = 1; i < num_threads; ++i) {
+      inter_op_cpu_backend_contexts_.push_back(
+          std::make_unique<ExternalCpuBackendContext>());
+    }
+  }
+  // Kernels lazily create the internal backend context with the number of
+  // threads at that time, so only existing ones need to be updated here.
+  for (const auto& cpu_backend_context : inter_op_cpu_backend_contexts_) {
+    if (cpu_backend_context->internal_backend_context() != nullptr) {
+      cpu_backend_context->internal_backend_context()->SetMaxNumThreads(
+          context_.recommended_num_threads);
+    }
+  }
+
+  // Returns the status of the node at `execution_plan_index`.
+  auto invoke_node = [this](int execution_plan_index) -> TfLiteStatus {
+    const int node_index = execution_plan_[execution_plan_index];
+    if (IsCachedConstantNode(node_index)) return kTfLiteOk;
+    TfLiteNode& node = nodes_and_registration_[node_index].first;
+    const TfLiteRegistration& registration =
+        nodes_and_registration_[node_index].second;
+    TF_LITE_ENSURE_STATUS(EnsureNodeInputsReadable(node, registration));
+    if (check_cancelled_func_ != nullptr &&
+        check_cancelled_func_(cancellation_data_)) {
+      ReportError("Client requested cancel during Invoke()");
+      return kTfLiteError;
+    }
+    if (continue_invocation_ && !continue_invocation_->test_and_set()) {
+      ReportError("Client requested cancel during Invoke()");
+      return kTfLiteCancelled;
+    }
+    if (auto s = OpInvoke(registration, &node); s != kTfLiteOk) {
+      auto err = ReportOpError(&context_, node, registration, node_index,
+                               "failed to invoke");
+      return s == kTfLiteCancelled ? s : err;
+    }
+    return kTfLiteOk;
+  };
+
+  for (int level = 0; level + 1 < inter_op_level_starts_.size(); ++level) {
+    const int begin = inter_op_level_starts_[level];
+    const int end = inter_op_level_starts_[level + 1];
+    EnsureTensorsVectorCapacity();
+    tensor_resized_since_op_invoke_ = false;
+    if (end - begin == 1) {
+      TF_LITE_ENSURE_STATUS(invoke_node(begin));
+      continue;
+    }
+
+    // The first failing node determines the status of the level.
+    std::mutex status_mutex;
+    TfLiteStatus status = kTfLiteOk;
+    inter_op_thread_pool_->Run(
+        end - begin, [&](int thread_id, int task_index) {
+          inter_op_cpu_backend_context =
+              thread_id == 0
+                  ? nullptr
+                  : inter_op_cpu_backend_contexts_[thread_id - 1].get();
+          const TfLiteStatus node_status = invoke_node(begin + task_index);
+          inter_op_cpu_backend_context = nullptr;
+          if (node_status != kTfLiteOk) {
+            std::lock_guard<std::mutex> lock(status_mutex);
+            if (status == kTfLiteOk) status = node_status;
+          }
+        });
+    TF_LITE_ENSURE_STATUS(status);
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus Subgraph::ResizeTensor(TfLiteContext* context,
                                     TfLiteTensor* tensor,
                                     TfLiteIntArray* new_size) {
@@ -38,7 +38,9 @@ limitations under the License.
 #include "tensorflow/lite/core/macros.h"
 #include "tensorflow/lite/experimental/resource/initialization_status.h"
 #include "tensorflow/lite/experimental/resource/resource_base.h"
+#include "tensorflow/lite/external_cpu_backend_context.h"
 #include "tensorflow/lite/graph_info.h"
+#include "tensorflow/lite/inter_op_thread_pool.h"
 #include "tensorflow/lite/interpreter_options.h"
 #include "tensorflow/lite/memory_planner.h"
 #include "tensorflow/lite/util.h"
@@ -481,6 +483,14 @@ class Subgraph {
     return (options_ && (options_->GetDynamicAllocationForLargeTensors() > 0));
   }
 
+  // WARNING: This is an experimental API and subject to change.
+  // Returns the range [first, last] of execution plan indices of the nodes
+  // which `Invoke` may run concurrently with the node at
+  // `execution_plan_index`, see `InterpreterOptions::SetNumInterOpThreads`.
+  // Returns {execution_plan_index, execution_plan_index} if nodes are invoked
+  // one at a time.
+  std::pair<int, int> ConcurrentNodes(int execution_plan_index) const;
+
   // WARNING: This is an experimental API and subject to change.
   // Remove unused inputs of the subgraph. It checks usage of inputs and mark it
   // as kTfLiteOptionalTensor if the input is not used in graph execution.
@@ -727,6 +737,83 @@ class Subgraph {
   // Does not report invoke status through profiler.
   TfLiteStatus InvokeImpl();
 
+  // Makes sure that the input tensors of `node` can be read by its kernel.
+  TfLiteStatus EnsureNodeInputsReadable(const TfLiteNode& node,
+                                        const TfLiteRegistration& registration);
+
+  // Returns the number of threads requested by
+  // `InterpreterOptions::SetNumInterOpThreads`.
+  int NumInterOpThreads() const {
+    return options_ ? options_->GetNumInterOpThreads() : 0;
+  }
+
+  // True if the node at `node_index` has side effects beyond writing its
+  // outputs, or uses other subgraphs or delegates, and hence must not run
+  // concurrently with any other node.
+  bool MustInvokeAlone(int node_index) const;
+
+  // Groups the nodes of the execution plan into levels of independent nodes
+  // and reorders the execution plan by level. Does nothing unless more than
+  // one inter-op thread was requested and some level has several nodes.
+  TfLiteStatus PlanInterOpLevels();
+
+  // Invokes the nodes of the execution plan level by level, running the nodes
+  // of a level concurrently on `inter_op_thread_pool_`. Requires all nodes to
+  // be prepared and their tensors allocated.
+  TfLiteStatus InvokeLevels();
+
+  // True if `InterpreterOptions::SetCacheConstantSubgraphs` is set.
+  bool ShouldCacheConstantSubgraphs() const {
+    return options_ && options_->GetCacheConstantSubgraphs();
+  }
+
+  // True if `InterpreterOptions::SetStreamingMode` is set.
+  bool IsStreamingMode() const {
+    return options_ && options_->GetStreamingMode();
+  }
+
+  // A copy of a variable tensor taken before its memory is replanned.
+  struct SavedVariableTensor {
+    int index;
+    std::vector<int> dims;
+    std::vector<char> data;
+  };
+
+  // Copies the allocated variable tensors in the persistent arena.
+  std::vector<SavedVariableTensor> SaveVariableTensors() const;
+
+  // Copies `saved` back into the variable tensors whose shape is unchanged.
+  void RestoreVariableTensors(const std::vector<SavedVariableTensor>& saved);
+
+  // True if the prepared node at `node_index` has no side effects and only
+  // reads constant tensors and outputs of other constant nodes, so that its
+  // outputs never change once computed.
+  bool IsConstantNode(int node_index) const;
+
+  // Marks the node at `node_index`, which was just prepared, as constant if it
+  // is one, moving its outputs to persistent memory until
+  // `ReleaseInnerConstantTensors` finds out which of them must stay there.
+  void UpdateConstantNode(int node_index);
+
+  // Moves the outputs of the constant nodes prepared between the given
+  // execution plan indices back to the arena, unless they are outputs of the
+  // subgraph or read by a node which is invoked or not prepared yet. Only
+  // these frontier tensors need to outlive the invocation of the constant
+  // nodes.
+  void ReleaseInnerConstantTensors(int first_execution_plan_index,
+                                   int last_execution_plan_index);
+
+  // True if the outputs of the node at `node_index` are cached and the node
+  // need not be invoked.
+  bool IsCachedConstantNode(int node_index) const {
+    return node_index < constant_node_states_.size() &&
+           constant_node_states_[node_index] == ConstantNodeState::kCached;
+  }
+
+  // Invokes the prepared constant nodes whose outputs have not been computed
+  // since their tensors were allocated.
+  TfLiteStatus InvokeConstantNodes();
+
   // Allow a delegate to look at the graph and modify the graph to handle
   // parts of the graph themselves. After this is called, the graph may
   // contain new nodes that replace 1 more nodes.
@@ -1144,6 +1231,46 @@ class Subgraph {
   // metadata_ by appropriately parametrized SetMetadata method calls.
   const ControlEdges* control_edges_ = nullptr;
 
+  // Execution plan indices at which the levels of independent nodes start,
+  // followed by the size of the execution plan. Empty if nodes are always
+  // invoked one at a time. See `PlanInterOpLevels`.
+  std::vector<int> inter_op_level_starts_;
+
+  // Level of each node of the execution plan, by execution plan index.
+  std::vector<int> inter_op_levels_;
+
+  // True if `Invoke` runs the nodes of a level concurrently. Only set if the
+  // whole execution plan was prepared and allocated at once, since the memory
+  // planner must know about the concurrent nodes when allocating tensors.
+  bool invoke_levels_concurrently_ = false;
+
+  // Lazily created when the levels are first invoked concurrently.
+  std::unique_ptr<InterOpThreadPool> inter_op_thread_pool_;
+
+  // CPU backend contexts used by kernels running on the workers of
+  // `inter_op_thread_pool_`, which can't share the context of the interpreter.
+  // The context of worker `i` is at index `i - 1`.
+  std::vector<std::unique_ptr<ExternalCpuBackendContext>>
+      inter_op_cpu_backend_contexts_;
+
+  // State of each node, by node index, when the outputs of constant nodes
+  // are cached. Empty unless `ShouldCacheConstantSubgraphs`. The outputs are
+  // recomputed whenever tensors are allocated, since the memory planner may
+  // move them.
+  enum class ConstantNodeState : uint8_t { kNotConstant, kPending, kCached };
+  std::vector<ConstantNodeState> constant_node_states_;
+
+  // True for the outputs of constant nodes, by tensor index.
+  std::vector<bool> constant_tensors_;
+
+  // True for the outputs of constant nodes which only other constant nodes
+  // read, and which were therefore moved back to the arena, by tensor index.
+  std::vector<bool> released_constant_tensors_;
+
+  // Whether the variable tensors hold values from a previous allocation,
+  // which are kept across reallocation in streaming mode.
+  bool variable_tensors_initialized_ = false;
+
   // Whether this subgraph is "delegation skippable". If a subgraph is
   // delegation-skippable, then the subgraph will be handled by a TfLiteDelegate
   // (and that the delegate is supposed to be already aware of this state), and
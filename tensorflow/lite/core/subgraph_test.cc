@@ -17,16 +17,21 @@ limitations under the License.
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
 #include <memory>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/log/check.h"
 #include "tensorflow/lite/c/c_api_types.h"
+#include "tensorflow/lite/core/c/builtin_op_data.h"
 #include "tensorflow/lite/core/interpreter.h"
+#include "tensorflow/lite/interpreter_options.h"
 #include "tensorflow/lite/stderr_reporter.h"
 #include "tensorflow/lite/util.h"
 
@@ -34,8 +39,13 @@ namespace tflite {
 
 namespace ops {
 namespace builtin {
+TfLiteRegistration* Register_ADD();
+TfLiteRegistration* Register_DEQUANTIZE();
 TfLiteRegistration* Register_PADV2();
 TfLiteRegistration* Register_NEG();
+TfLiteRegistration* Register_RESHAPE();
+TfLiteRegistration* Register_TRANSPOSE();
+TfLiteRegistration* Register_UNIDIRECTIONAL_SEQUENCE_RNN();
 }  // namespace builtin
 }  // namespace ops
 
@@ -124,6 +134,302 @@ TEST(MarkSubgraphAsDelegationSkippable, MarkSubgraphAsDelegationSkippable) {
   ASSERT_TRUE(subgraphs[1]->IsDelegationSkippable());
 }
 
+TEST(InterOpParallelism, InvokesIndependentNodesConcurrently) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetNumInterOpThreads(2);
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  auto& subgraph = interpreter.primary_subgraph();
+  subgraph.AddTensors(4);
+  for (int i = 0; i < 4; ++i) {
+    subgraph.SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {16},
+                                          TfLiteQuantization());
+  }
+  subgraph.SetInputs({0});
+  subgraph.SetOutputs({2, 3});
+  TfLiteRegistration* neg_op = tflite::ops::builtin::Register_NEG();
+  // Node 2 only depends on the input, so it can run alongside node 0.
+  subgraph.AddNodeWithParameters({0}, {1}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({1}, {2}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({0}, {3}, {}, nullptr, 0, nullptr, neg_op);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  EXPECT_THAT(subgraph.execution_plan(), ElementsAreArray({0, 2, 1}));
+  EXPECT_EQ(subgraph.ConcurrentNodes(0), std::make_pair(0, 1));
+  EXPECT_EQ(subgraph.ConcurrentNodes(1), std::make_pair(0, 1));
+  EXPECT_EQ(subgraph.ConcurrentNodes(2), std::make_pair(2, 2));
+  // Outputs of concurrent nodes must not share memory.
+  EXPECT_NE(subgraph.tensor(1)->data.raw, subgraph.tensor(3)->data.raw);
+
+  for (int i = 0; i < 16; ++i) subgraph.tensor(0)->data.f[i] = i;
+  ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_EQ(subgraph.tensor(2)->data.f[i], i);
+    EXPECT_EQ(subgraph.tensor(3)->data.f[i], -i);
+  }
+}
+
+TEST(InterOpParallelism, DisabledByDefault) {
+  Interpreter interpreter;
+  auto& subgraph = interpreter.primary_subgraph();
+  subgraph.AddTensors(4);
+  for (int i = 0; i < 4; ++i) {
+    subgraph.SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {16},
+                                          TfLiteQuantization());
+  }
+  subgraph.SetInputs({0});
+  subgraph.SetOutputs({2, 3});
+  TfLiteRegistration* neg_op = tflite::ops::builtin::Register_NEG();
+  subgraph.AddNodeWithParameters({0}, {1}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({1}, {2}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({0}, {3}, {}, nullptr, 0, nullptr, neg_op);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  EXPECT_THAT(subgraph.execution_plan(), ElementsAreArray({0, 1, 2}));
+  EXPECT_EQ(subgraph.ConcurrentNodes(0), std::make_pair(0, 0));
+}
+
+// Builds a subgraph where nodes 0 and 1 negate the constant tensor 1 twice
+// into tensor 3, and node 2 negates the input tensor 0 into tensor 4.
+void BuildConstantChain(Subgraph& subgraph, const float* constant) {
+  subgraph.AddTensors(5);
+  for (int i : {0, 2, 3, 4}) {
+    subgraph.SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {4},
+                                          TfLiteQuantization());
+  }
+  subgraph.SetTensorParametersReadOnly(
+      1, kTfLiteFloat32, "", {4}, TfLiteQuantization(),
+      reinterpret_cast<const char*>(constant), 4 * sizeof(float));
+  subgraph.SetInputs({0});
+  subgraph.SetOutputs({3, 4});
+  TfLiteRegistration* neg_op = tflite::ops::builtin::Register_NEG();
+  subgraph.AddNodeWithParameters({1}, {2}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({2}, {3}, {}, nullptr, 0, nullptr, neg_op);
+  subgraph.AddNodeWithParameters({0}, {4}, {}, nullptr, 0, nullptr, neg_op);
+}
+
+TEST(CacheConstantSubgraphs, InvokesConstantNodesOnce) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetCacheConstantSubgraphs(true);
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  auto& subgraph = interpreter.primary_subgraph();
+  const float constant[4] = {1, 2, 3, 4};
+  BuildConstantChain(subgraph, constant);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  // The constant chain is computed by AllocateTensors. Only its output stays
+  // in persistent memory.
+  EXPECT_EQ(subgraph.tensor(2)->allocation_type, kTfLiteArenaRw);
+  EXPECT_EQ(subgraph.tensor(3)->allocation_type, kTfLiteArenaRwPersistent);
+  EXPECT_EQ(subgraph.tensor(4)->allocation_type, kTfLiteArenaRw);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(subgraph.tensor(3)->data.f[i], constant[i]);
+  }
+
+  // Invoke only runs the node reading the input, so it does not overwrite
+  // tensor 3.
+  for (int i = 0; i < 4; ++i) {
+    subgraph.tensor(0)->data.f[i] = i;
+    subgraph.tensor(3)->data.f[i] = 0;
+  }
+  ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(subgraph.tensor(3)->data.f[i], 0);
+    EXPECT_EQ(subgraph.tensor(4)->data.f[i], -i);
+  }
+
+  // Allocating tensors again computes the chain again.
+  ASSERT_EQ(subgraph.ResizeInputTensor(0, {8}), kTfLiteOk);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(subgraph.tensor(3)->data.f[i], constant[i]);
+  }
+}
+
+TEST(CacheConstantSubgraphs, DisabledByDefault) {
+  Interpreter interpreter;
+  auto& subgraph = interpreter.primary_subgraph();
+  const float constant[4] = {1, 2, 3, 4};
+  BuildConstantChain(subgraph, constant);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  EXPECT_EQ(subgraph.tensor(2)->allocation_type, kTfLiteArenaRw);
+  EXPECT_EQ(subgraph.tensor(3)->allocation_type, kTfLiteArenaRw);
+  subgraph.tensor(3)->data.f[0] = 0;
+  ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+  EXPECT_EQ(subgraph.tensor(3)->data.f[0], constant[0]);
+}
+
+// Builds a subgraph where DEQUANTIZE, RESHAPE and TRANSPOSE turn the constant
+// float16 tensor 1 into tensors 2, 4 and 6, and ADD adds tensor 6 to the input
+// tensor 0 into tensor 7.
+void BuildDequantizeReshapeTranspose(Subgraph& subgraph) {
+  // {{1, 2, 3}, {4, 0.5, -1}} in float16.
+  static const uint16_t kWeights[6] = {0x3C00, 0x4000, 0x4200,
+                                       0x4400, 0x3800, 0xBC00};
+  static const int32_t kShape[2] = {3, 2};
+  static const int32_t kPerm[2] = {1, 0};
+  subgraph.AddTensors(8);
+  for (int i : {0, 2, 6, 7}) {
+    subgraph.SetTensorParametersReadWrite(i, kTfLiteFloat32, "", {2, 3},
+                                          TfLiteQuantization());
+  }
+  subgraph.SetTensorParametersReadWrite(4, kTfLiteFloat32, "", {3, 2},
+                                        TfLiteQuantization());
+  subgraph.SetTensorParametersReadOnly(
+      1, kTfLiteFloat16, "", {2, 3}, TfLiteQuantization(),
+      reinterpret_cast<const char*>(kWeights), sizeof(kWeights));
+  subgraph.SetTensorParametersReadOnly(
+      3, kTfLiteInt32, "", {2}, TfLiteQuantization(),
+      reinterpret_cast<const char*>(kShape), sizeof(kShape));
+  subgraph.SetTensorParametersReadOnly(
+      5, kTfLiteInt32, "", {2}, TfLiteQuantization(),
+      reinterpret_cast<const char*>(kPerm), sizeof(kPerm));
+  subgraph.SetInputs({0});
+  subgraph.SetOutputs({7});
+  subgraph.AddNodeWithParameters({1}, {2}, {}, nullptr, 0, nullptr,
+                                 tflite::ops::builtin::Register_DEQUANTIZE());
+  subgraph.AddNodeWithParameters({2, 3}, {4}, {}, nullptr, 0, nullptr,
+                                 tflite::ops::builtin::Register_RESHAPE());
+  subgraph.AddNodeWithParameters({4, 5}, {6}, {}, nullptr, 0, nullptr,
+                                 tflite::ops::builtin::Register_TRANSPOSE());
+  auto* add_params =
+      reinterpret_cast<TfLiteAddParams*>(malloc(sizeof(TfLiteAddParams)));
+  add_params->activation = kTfLiteActNone;
+  add_params->pot_scale_int16 = false;
+  subgraph.AddNodeWithParameters({0, 6}, {7}, {}, nullptr, 0, add_params,
+                                 tflite::ops::builtin::Register_ADD());
+}
+
+TEST(CacheConstantSubgraphs, OnlyFrontierOutputsStayPersistent) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetCacheConstantSubgraphs(true);
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  auto& subgraph = interpreter.primary_subgraph();
+  BuildDequantizeReshapeTranspose(subgraph);
+  ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+
+  // Only the output of TRANSPOSE, which ADD reads, stays in persistent memory.
+  EXPECT_EQ(subgraph.tensor(2)->allocation_type, kTfLiteArenaRw);
+  EXPECT_EQ(subgraph.tensor(4)->allocation_type, kTfLiteArenaRw);
+  EXPECT_EQ(subgraph.tensor(6)->allocation_type, kTfLiteArenaRwPersistent);
+
+  // Without caching, DEQUANTIZE keeps its output in persistent memory itself,
+  // so caching the whole chain takes no more persistent memory.
+  Interpreter uncached_interpreter;
+  auto& uncached_subgraph = uncached_interpreter.primary_subgraph();
+  BuildDequantizeReshapeTranspose(uncached_subgraph);
+  ASSERT_EQ(uncached_subgraph.AllocateTensors(), kTfLiteOk);
+  EXPECT_EQ(uncached_subgraph.tensor(2)->allocation_type,
+            kTfLiteArenaRwPersistent);
+  Subgraph::SubgraphAllocInfo alloc_info;
+  Subgraph::SubgraphAllocInfo uncached_alloc_info;
+  subgraph.GetMemoryAllocInfo(&alloc_info);
+  uncached_subgraph.GetMemoryAllocInfo(&uncached_alloc_info);
+  EXPECT_EQ(alloc_info.arena_persist_size,
+            uncached_alloc_info.arena_persist_size);
+
+  // The cached result survives invocations, and is computed again when the
+  // tensors are allocated again.
+  const float kTransposed[6] = {1, 3, 0.5, 2, 4, -1};
+  for (int allocation = 0; allocation < 2; ++allocation) {
+    if (allocation > 0) {
+      ASSERT_EQ(subgraph.ResizeInputTensor(0, {1, 2, 3}), kTfLiteOk);
+      ASSERT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+    }
+    for (int invocation = 0; invocation < 2; ++invocation) {
+      for (int i = 0; i < 6; ++i) {
+        subgraph.tensor(0)->data.f[i] = i;
+      }
+      ASSERT_EQ(subgraph.Invoke(), kTfLiteOk);
+      for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(subgraph.tensor(7)->data.f[i], kTransposed[i] + i);
+      }
+    }
+  }
+}
+
+// Builds a subgraph with a time major sequence RNN of one unit whose weights
+// are all 1, so that output 5 is the running sum of the [time, 1, 1] input 0.
+// The sum is carried by the variable tensor 4.
+void BuildRunningSum(Subgraph& subgraph, int max_time) {
+  static const float kOne[1] = {1};
+  static const float kZero[1] = {0};
+  subgraph.AddTensors(6);
+  subgraph.SetTensorParametersReadWrite(0, kTfLiteFloat32, "", {max_time, 1, 1},
+                                        TfLiteQuantization());
+  for (int i : {1, 2}) {
+    subgraph.SetTensorParametersReadOnly(
+        i, kTfLiteFloat32, "", {1, 1}, TfLiteQuantization(),
+        reinterpret_cast<const char*>(kOne), sizeof(kOne));
+  }
+  subgraph.SetTensorParametersReadOnly(
+      3, kTfLiteFloat32, "", {1}, TfLiteQuantization(),
+      reinterpret_cast<const char*>(kZero), sizeof(kZero));
+  subgraph.SetTensorParametersReadWrite(4, kTfLiteFloat32, "", {1, 1},
+                                        TfLiteQuantization(),
+                                        /*is_variable=*/true);
+  subgraph.SetTensorParametersReadWrite(5, kTfLiteFloat32, "", {max_time, 1, 1},
+                                        TfLiteQuantization());
+  subgraph.SetInputs({0});
+  subgraph.SetOutputs({5});
+  subgraph.SetVariables({4});
+  auto* params = static_cast<TfLiteSequenceRNNParams*>(
+      malloc(sizeof(TfLiteSequenceRNNParams)));
+  params->time_major = true;
+  params->activation = kTfLiteActNone;
+  params->asymmetric_quantize_inputs = false;
+  subgraph.AddNodeWithParameters(
+      {0, 1, 2, 3, 4}, {5}, {}, nullptr, 0, params,
+      tflite::ops::builtin::Register_UNIDIRECTIONAL_SEQUENCE_RNN());
+}
+
+// Feeds `values` to the running sum of `BuildRunningSum`, resizing its input
+// if needed, and returns the outputs.
+std::vector<float> FeedRunningSum(Subgraph& subgraph,
+                                  const std::vector<float>& values) {
+  const int max_time = values.size();
+  if (subgraph.tensor(0)->dims->data[0] != max_time) {
+    EXPECT_EQ(subgraph.ResizeInputTensor(0, {max_time, 1, 1}), kTfLiteOk);
+  }
+  EXPECT_EQ(subgraph.AllocateTensors(), kTfLiteOk);
+  std::copy(values.begin(), values.end(), subgraph.tensor(0)->data.f);
+  EXPECT_EQ(subgraph.Invoke(), kTfLiteOk);
+  return std::vector<float>(subgraph.tensor(5)->data.f,
+                            subgraph.tensor(5)->data.f + max_time);
+}
+
+TEST(StreamingMode, KeepsVariableTensorsAcrossReallocation) {
+  Interpreter interpreter;
+  InterpreterOptions options;
+  options.SetStreamingMode(true);
+  ASSERT_EQ(interpreter.ApplyOptions(&options), kTfLiteOk);
+  auto& subgraph = interpreter.primary_subgraph();
+  BuildRunningSum(subgraph, /*max_time=*/2);
+
+  EXPECT_THAT(FeedRunningSum(subgraph, {1, 2}), ElementsAreArray({1, 3}));
+  EXPECT_THAT(FeedRunningSum(subgraph, {3}), ElementsAreArray({6}));
+  EXPECT_THAT(FeedRunningSum(subgraph, {4, 5, 6}),
+              ElementsAreArray({10, 15, 21}));
+
+  // Resetting the variable tensors starts a new stream.
+  ASSERT_EQ(subgraph.ResetVariableTensors(), kTfLiteOk);
+  EXPECT_THAT(FeedRunningSum(subgraph, {1}), ElementsAreArray({1}));
+}
+
+TEST(StreamingMode, DisabledByDefault) {
+  Interpreter interpreter;
+  auto& subgraph = interpreter.primary_subgraph();
+  BuildRunningSum(subgraph, /*max_time=*/2);
+
+  EXPECT_THAT(FeedRunningSum(subgraph, {1, 2}), ElementsAreArray({1, 3}));
+  // The state carries over between invocations, but not across reallocation.
+  EXPECT_THAT(FeedRunningSum(subgraph, {3, 4}), ElementsAreArray({6, 10}));
+  EXPECT_THAT(FeedRunningSum(subgraph, {3}), ElementsAreArray({3}));
+}
+
 // Helper to get the minimal buffer size to allocate for a buffer of given
 // shape.
 size_t BytesFor(const TfLiteType type, const int* const data,
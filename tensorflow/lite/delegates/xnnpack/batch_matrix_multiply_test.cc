@@ -253,6 +253,35 @@ TEST_F(BatchMatrixMultiplyTest, 4D_TransposeB) {
       .Test(xnnpack_delegate.get());
 }
 
+TEST_F(BatchMatrixMultiplyTest, SparseWeightsNotDelegated) {
+  const auto batch = shape_rng();
+  const auto height = shape_rng();
+  const auto input_channels = channels_rng();
+  const auto output_channels = channels_rng();
+  auto xnnpack_delegate = get_delegate();
+
+  BatchMatrixMultiplyTester()
+      .InputADims({batch, height, input_channels})
+      .InputBDims({input_channels, output_channels})
+      .SparseInputB(true)
+      .Test(xnnpack_delegate.get());
+}
+
+TEST_F(BatchMatrixMultiplyTest, SparseWeightsTransposeBNotDelegated) {
+  const auto batch = shape_rng();
+  const auto height = shape_rng();
+  const auto input_channels = channels_rng();
+  const auto output_channels = channels_rng();
+  auto xnnpack_delegate = get_delegate();
+
+  BatchMatrixMultiplyTester()
+      .InputADims({batch, height, input_channels})
+      .InputBDims({output_channels, input_channels})
+      .TransposeB(true)
+      .SparseInputB(true)
+      .Test(xnnpack_delegate.get());
+}
+
 TEST_F(BatchMatrixMultiplyTest, MultiThreading) {
   const auto batch = shape_rng();
   const auto height = shape_rng();
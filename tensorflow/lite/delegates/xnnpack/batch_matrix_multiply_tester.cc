@@ -78,8 +78,9 @@ void BatchMatrixMultiplyTester::Test(TfLiteDelegate* delegate) const {
   ASSERT_TRUE(delegate_interpreter);
   ASSERT_TRUE(default_interpreter);
 
-  ASSERT_EQ(delegate_interpreter->inputs().size(), 2);
-  ASSERT_EQ(default_interpreter->inputs().size(), 2);
+  const size_t num_inputs = SparseInputB() ? 1 : 2;
+  ASSERT_EQ(delegate_interpreter->inputs().size(), num_inputs);
+  ASSERT_EQ(default_interpreter->inputs().size(), num_inputs);
 
   ASSERT_EQ(delegate_interpreter->outputs().size(), 1);
   ASSERT_EQ(default_interpreter->outputs().size(), 1);
@@ -88,7 +89,16 @@ void BatchMatrixMultiplyTester::Test(TfLiteDelegate* delegate) const {
   ASSERT_EQ(default_interpreter->AllocateTensors(), kTfLiteOk);
 
   ASSERT_EQ(delegate_interpreter->ModifyGraphWithDelegate(delegate), kTfLiteOk);
-  ASSERT_TRUE(delegate_interpreter->primary_subgraph().IsFullyDelegated());
+  if (SparseInputB()) {
+    // The sparse BATCH_MATMUL node must be left to the TFLite kernel.
+    ASSERT_EQ(delegate_interpreter->execution_plan().size(), 1);
+    const int node_index = delegate_interpreter->execution_plan()[0];
+    ASSERT_EQ(delegate_interpreter->node_and_registration(node_index)
+                  ->second.builtin_code,
+              BuiltinOperator_BATCH_MATMUL);
+  } else {
+    ASSERT_TRUE(delegate_interpreter->primary_subgraph().IsFullyDelegated());
+  }
 
   if (weights_cache_ != nullptr) {
     TfLiteXNNPackDelegateWeightsCacheFinalizeHard(weights_cache_);
@@ -101,7 +111,7 @@ void BatchMatrixMultiplyTester::Test(TfLiteDelegate* delegate) const {
       delegate_interpreter->typed_input_tensor<float>(0);
   std::copy_n(default_input1_data, Input1Size(), delegate_input1_data);
 
-  if (InputBQuant() == kNone) {
+  if (InputBQuant() == kNone && !SparseInputB()) {
     float* default_input2_data =
         default_interpreter->typed_input_tensor<float>(1);
     std::generate_n(default_input2_data, Input2Size(), std::ref(input_rng_f32));
@@ -205,6 +215,51 @@ std::vector<char> BatchMatrixMultiplyTester::CreateTfLiteModel() const {
         /*type=*/TensorType_INT8,
         /*buffer=*/quantized_filter_buffer_id,
         /*name=*/0, filter_quantization_params));
+  } else if (SparseInputB()) {
+    // Every element of the CSR tensor is stored, so its values are the dense
+    // row-major data.
+    std::vector<float> input2_data(Input2Size());
+    std::random_device random_device;
+    auto rng = std::mt19937(random_device());
+    auto input_rng_f32 = [&]() {
+      return std::uniform_real_distribution<float>()(rng);
+    };
+    std::generate(input2_data.begin(), input2_data.end(), input_rng_f32);
+    const int32_t rows = InputBDims()[0];
+    const int32_t cols = InputBDims()[1];
+    std::vector<int32_t> segments(rows + 1);
+    for (int32_t i = 0; i <= rows; i++) {
+      segments[i] = i * cols;
+    }
+    std::vector<int32_t> indices(input2_data.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+      indices[i] = i % cols;
+    }
+    const std::vector<flatbuffers::Offset<DimensionMetadata>> dim_metadata{
+        CreateDimensionMetadata(builder, DimensionType_DENSE, rows),
+        CreateDimensionMetadata(
+            builder, DimensionType_SPARSE_CSR, /*dense_size=*/0,
+            SparseIndexVector_Int32Vector,
+            CreateInt32Vector(builder, builder.CreateVector(segments))
+                .Union(),
+            SparseIndexVector_Int32Vector,
+            CreateInt32Vector(builder, builder.CreateVector(indices))
+                .Union())};
+    const std::vector<int32_t> traversal_order{0, 1};
+    const flatbuffers::Offset<SparsityParameters> sparsity_params =
+        CreateSparsityParameters(builder, builder.CreateVector(traversal_order),
+                                 0, builder.CreateVector(dim_metadata));
+
+    const int input2_buffer_id = buffers.size();
+    buffers.emplace_back(CreateBuffer(
+        builder, builder.CreateVector(
+                     reinterpret_cast<const uint8_t*>(input2_data.data()),
+                     sizeof(float) * input2_data.size())));
+    tensors.emplace_back(CreateTensor(
+        builder,
+        builder.CreateVector<int32_t>(InputBDims().data(), InputBDims().size()),
+        TensorType_FLOAT32, /*buffer=*/input2_buffer_id, /*name=*/0,
+        /*quantization=*/0, /*is_variable=*/false, sparsity_params));
   } else {
     tensors.emplace_back(CreateTensor(
         builder,
@@ -229,7 +284,10 @@ std::vector<char> BatchMatrixMultiplyTester::CreateTfLiteModel() const {
       BuiltinOptions_BatchMatMulOptions, batch_matmul_options.Union());
 
   /****************************** Define subgraph *****************************/
-  const std::array<int32_t, 2> subgraph_inputs{{0, 1}};
+  std::vector<int32_t> subgraph_inputs{{0}};
+  if (!SparseInputB()) {
+    subgraph_inputs.push_back(1);
+  }
   const std::array<int32_t, 1> subgraph_outputs{{2}};
   const flatbuffers::Offset<SubGraph> subgraph = CreateSubGraph(
       builder, builder.CreateVector(tensors.data(), tensors.size()),
@@ -84,6 +84,15 @@ class BatchMatrixMultiplyTester {
 
   bool TransposeB() const { return transpose_b_; }
 
+  // Makes the second input a static float tensor stored in the CSR sparse
+  // format, which XNNPack doesn't support and leaves to the TFLite kernel.
+  BatchMatrixMultiplyTester& SparseInputB(bool sparse_b) {
+    sparse_b_ = sparse_b;
+    return *this;
+  }
+
+  bool SparseInputB() const { return sparse_b_; }
+
   BatchMatrixMultiplyTester& WeightsCache(
       TfLiteXNNPackDelegateWeightsCache* weights_cache) {
     weights_cache_ = weights_cache;
@@ -105,6 +114,7 @@ class BatchMatrixMultiplyTester {
   int32_t input1_size_ = 1;
   int32_t input2_size_ = 1;
   bool transpose_b_ = false;
+  bool sparse_b_ = false;
   enum WeightsType weights_type_ { WeightsType::kFP32 };
   TfLiteXNNPackDelegateWeightsCache* weights_cache_ = nullptr;
 };
@@ -19,6 +19,7 @@ limitations under the License.
 
 #if defined(_MSC_VER)
 #include <io.h>
+#include <process.h>
 #define F_OK 0
 #else
 #include <sys/mman.h>
@@ -32,10 +33,13 @@ limitations under the License.
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xnnpack.h"  // from @XNNPACK
 #include "flatbuffers/flatbuffer_builder.h"  // from @flatbuffers
@@ -201,6 +205,7 @@ void swap(WeightCacheBuilder& a, WeightCacheBuilder& b) {
   swap(a.capacity_, b.capacity_);
   swap(a.fd_, b.fd_);
   swap(a.file_path_, b.file_path_);
+  swap(a.temporary_file_path_, b.temporary_file_path_);
 }
 
 WeightCacheBuilder::WeightCacheBuilder(WeightCacheBuilder&& other) {
@@ -232,17 +237,47 @@ bool WriteData(const int fd, const uint8_t* data, size_t size,
   return true;
 }
 
+// Returns the path of the file that the cache for `path` is built in. Each
+// process gets its own file; the builders of a process are serialized by the
+// registry.
+std::string TemporaryFilePath(const std::string& path) {
+#if defined(_MSC_VER)
+  const int pid = _getpid();
+#else
+  const int pid = getpid();
+#endif
+  return path + "." + std::to_string(pid) + ".tmp";
+}
+
 }  // namespace
 
 bool WeightCacheBuilder::Start(const char* path) {
   Reset();
+  if (path == nullptr || path[0] == '\0') {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR,
+                    "XNNPack weight cache: no file path was provided.");
+    return false;
+  }
+  // Other builders of the process would overwrite the same file.
+  if (!WeightCacheRegistry::Get().StartBuild(path)) {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR,
+                    "XNNPack weight cache: '%s' is already being built by "
+                    "another delegate of this process.",
+                    path);
+    return false;
+  }
+  file_path_ = path;
   ScopeGuard reset_on_error([this] { Reset(); });
 
-  file_path_ = path;
-  fd_ = open(file_path_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  // The cache is written to a temporary file which replaces `path` once it is
+  // complete. Truncating `path` in place would pull the pages from under the
+  // providers which have the previous file mapped.
+  temporary_file_path_ = TemporaryFilePath(file_path_);
+  fd_ = open(temporary_file_path_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
   if (fd_ == -1) {
     TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR, "Could not open file ('%s'): %s.",
-                    file_path_.c_str(), strerror(errno));
+                    temporary_file_path_.c_str(), strerror(errno));
+    temporary_file_path_.clear();
     return false;
   }
 
@@ -266,6 +301,14 @@ void WeightCacheBuilder::Reset() {
   if (fd_ != -1) {
     close(fd_);
     fd_ = -1;
+  }
+  // The build didn't complete.
+  if (!temporary_file_path_.empty()) {
+    std::remove(temporary_file_path_.c_str());
+    temporary_file_path_.clear();
+  }
+  if (!file_path_.empty()) {
+    WeightCacheRegistry::Get().EndBuild(file_path_);
     file_path_.clear();
   }
   data_.reset(nullptr);
@@ -359,88 +402,46 @@ bool WeightCacheBuilder::Finalize() {
   WriteData(fd_, (const uint8_t*)&header, sizeof(header), file_path_.c_str(),
             "Writing header");
 
+  close(fd_);
+  fd_ = -1;
+#if defined(_MSC_VER)
+  // `rename` doesn't replace existing files. Loaded files are copied to memory
+  // so nothing refers to the previous file.
+  std::remove(file_path_.c_str());
+#endif
+  if (std::rename(temporary_file_path_.c_str(), file_path_.c_str())) {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR,
+                    "XNNPack weight cache: could not move '%s' to '%s': %s.",
+                    temporary_file_path_.c_str(), file_path_.c_str(),
+                    strerror(errno));
+    return false;
+  }
+  temporary_file_path_.clear();
+
   TFLITE_LOG_PROD(tflite::TFLITE_LOG_VERBOSE,
                   "XNNPack weight cache: written to '%s'.", file_path_.c_str());
   Reset();
   return true;
 }
 
-MMapWeightCacheProvider::MMapWeightCacheProvider(
-    MMapWeightCacheProvider&& other) {
-  *this = std::move(other);
-}
+bool MappedWeightCache::Load(const char* path) {
+  buffer_base_offset = 0;
+  buffers.clear();
 
-MMapWeightCacheProvider& MMapWeightCacheProvider::operator=(
-    MMapWeightCacheProvider&& other) {
-  using std::swap;
-  swap(cache_provider_, other.cache_provider_);
-  // The contexts need to keep pointing to their owning object.
-  cache_provider_.context = this;
-  other.cache_provider_.context = &other;
-  swap(file_path_, other.file_path_);
-  swap(buffer_address_to_identifier_, other.buffer_address_to_identifier_);
-  swap(cache_key_to_offset_, other.cache_key_to_offset_);
-  swap(mmap_handle_, other.mmap_handle_);
-  swap(mmap_buffer_base_offset_, other.mmap_buffer_base_offset_);
-  swap(builder_, other.builder_);
-  return *this;
-}
-
-void MMapWeightCacheProvider::SetFilePath(const char* path) {
-  XNNPACK_ABORT_CHECK(
-      !IsFinalized(),
-      "Cannot change the path of a cache that has already been loaded.");
-  // We try to keep file_path_'s data as stable as possible. Don't overwrite
-  // if the path hasn't changed.
-  if (file_path_ != path) {
-    file_path_ = path;
-  }
-}
-
-bool MMapWeightCacheProvider::LoadOrStartBuild(const char* path) {
-  if (Load(path)) {
-    TFLITE_LOG_PROD(tflite::TFLITE_LOG_VERBOSE,
-                    "XNNPack weight cache loaded from '%s'.", path);
-    return true;
-  } else if (StartBuild(path)) {
-    TFLITE_LOG_PROD(tflite::TFLITE_LOG_VERBOSE,
-                    "XNNPack weight cache build for '%s' started.", path);
-
-    return true;
-  }
-  return false;
-}
-
-bool MMapWeightCacheProvider::StartBuild(const char* path) {
-  SetFilePath(path);
-  return builder_.Start(path);
-}
-
-bool MMapWeightCacheProvider::Load(const std::string& path) {
-  SetFilePath(path.c_str());
-  return Load();
-}
-
-bool MMapWeightCacheProvider::Load() {
-  XNNPACK_ABORT_CHECK(!file_path_.empty(),
-                      "Path wasn't provided to weight cache provider.");
-  mmap_buffer_base_offset_ = 0;
-  cache_key_to_offset_.clear();
-
-  if (!FileExists(file_path_.c_str())) {
+  if (!FileExists(path)) {
     TFLITE_LOG(tflite::TFLITE_LOG_WARNING,
-               "XNNPack weight cache: could not load '%s': %s.",
-               file_path_.c_str(), strerror(errno));
+               "XNNPack weight cache: could not load '%s': %s.", path,
+               strerror(errno));
     return false;
   }
 
-  if (!mmap_handle_.Map(file_path_.c_str())) {
+  if (!mmap_handle.Map(path)) {
     return false;
   }
 
-  ScopeGuard unmap_on_fail([this] { mmap_handle_.UnMap(); });
+  ScopeGuard unmap_on_fail([this] { mmap_handle.UnMap(); });
 
-  if (mmap_handle_.size() < sizeof(XNNPackCacheHeader)) {
+  if (mmap_handle.size() < sizeof(XNNPackCacheHeader)) {
     TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR,
                     "XNNPack weight cache: invalid cache file size.");
     return false;
@@ -448,7 +449,7 @@ bool MMapWeightCacheProvider::Load() {
 
   const XNNPackCacheHeader header = [this] {
     XNNPackCacheHeader header;
-    memcpy(&header, mmap_handle_.data(), sizeof(header));
+    memcpy(&header, mmap_handle.data(), sizeof(header));
     return header;
   }();
 
@@ -468,7 +469,7 @@ bool MMapWeightCacheProvider::Load() {
     return false;
   }
 
-  if (header.buffer_list_offset >= mmap_handle_.size()) {
+  if (header.buffer_list_offset >= mmap_handle.size()) {
     TFLITE_LOG_PROD(
         tflite::TFLITE_LOG_ERROR,
         "XNNPack weight cache: invalid offset for buffer list descriptor.");
@@ -476,7 +477,7 @@ bool MMapWeightCacheProvider::Load() {
   }
 
   if (header.buffer_list_size !=
-      mmap_handle_.size() - header.buffer_list_offset) {
+      mmap_handle.size() - header.buffer_list_offset) {
     TFLITE_LOG_PROD(
         tflite::TFLITE_LOG_ERROR,
         "XNNPack weight cache: invalid size for buffer list descriptor.");
@@ -485,7 +486,7 @@ bool MMapWeightCacheProvider::Load() {
 
   // Verifiy the flabuffer part of the file.
   flatbuffers::Verifier verifier(
-      mmap_handle_.data() + header.buffer_list_offset, header.buffer_list_size);
+      mmap_handle.data() + header.buffer_list_offset, header.buffer_list_size);
   if (!cache::schema::VerifyBufferListBuffer(verifier)) {
     TFLITE_LOG_PROD(tflite::TFLITE_LOG_ERROR,
                     "XNNPack weight cache: buffer list validation failed.");
@@ -494,23 +495,24 @@ bool MMapWeightCacheProvider::Load() {
 
   // Load flatbuffer.
   const cache::schema::BufferList* buffer_list = cache::schema::GetBufferList(
-      mmap_handle_.data() + header.buffer_list_offset);
+      mmap_handle.data() + header.buffer_list_offset);
   if (!buffer_list) {
     TFLITE_LOG_PROD(
         tflite::TFLITE_LOG_ERROR,
         "XNNPack weight cache: could not get packed weights from flatbuffer.");
     return false;
   }
-  mmap_buffer_base_offset_ = buffer_list->base_offset();
-  if (const auto buffers = buffer_list->buffers(); buffers) {
-    for (auto* buffer : *buffers) {
+  buffer_base_offset = buffer_list->base_offset();
+  if (const auto buffer_list_buffers = buffer_list->buffers();
+      buffer_list_buffers) {
+    for (auto* buffer : *buffer_list_buffers) {
       if (!buffer) {
         TFLITE_LOG_PROD(
             tflite::TFLITE_LOG_ERROR,
             "XNNPack weight cache: Invalid buffer address in buffer list.");
         return false;
       }
-      cache_key_to_offset_.emplace(
+      buffers.emplace(
           PackIdentifier{/*pack_algorithm_id=*/buffer->packing_algorithm_id(),
                          /*weights_id=*/buffer->weights_id(),
                          /*bias_id=*/buffer->bias_id()},
@@ -522,6 +524,146 @@ bool MMapWeightCacheProvider::Load() {
   return true;
 }
 
+WeightCacheRegistry& WeightCacheRegistry::Get() {
+  static WeightCacheRegistry* const registry = new WeightCacheRegistry();
+  return *registry;
+}
+
+std::shared_ptr<const MappedWeightCache> WeightCacheRegistry::Load(
+    const std::string& path) {
+  struct stat file_stats;
+  if (stat(path.c_str(), &file_stats)) {
+    TFLITE_LOG(tflite::TFLITE_LOG_WARNING,
+               "XNNPack weight cache: could not load '%s': %s.", path.c_str(),
+               strerror(errno));
+    return nullptr;
+  }
+  const FileKey key(path, file_stats.st_dev, file_stats.st_ino,
+                    file_stats.st_size, file_stats.st_mtime);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (auto it = loaded_files_.find(key); it != loaded_files_.end()) {
+    if (std::shared_ptr<const MappedWeightCache> cache = it->second.lock()) {
+      return cache;
+    }
+  }
+  auto cache = std::make_shared<MappedWeightCache>();
+  if (!cache->Load(path.c_str())) {
+    return nullptr;
+  }
+  // Forget files which are no longer used by anyone.
+  for (auto it = loaded_files_.begin(); it != loaded_files_.end();) {
+    it = it->second.expired() ? loaded_files_.erase(it) : std::next(it);
+  }
+  loaded_files_[key] = cache;
+  return cache;
+}
+
+bool WeightCacheRegistry::StartBuild(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return files_being_built_.insert(path).second;
+}
+
+void WeightCacheRegistry::EndBuild(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  files_being_built_.erase(path);
+}
+
+WeightCacheRegistry::Stats WeightCacheRegistry::GetStats() {
+  Stats stats;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [key, weak_cache] : loaded_files_) {
+    const std::shared_ptr<const MappedWeightCache> cache = weak_cache.lock();
+    if (!cache) {
+      continue;
+    }
+    const MMapHandle& mapping = cache->mmap_handle;
+    ++stats.num_files;
+    stats.mapped_bytes += mapping.size();
+#if defined(_MSC_VER)
+    // The file is read into memory instead of being mapped.
+    stats.resident_bytes += mapping.size();
+#else
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> resident_pages((mapping.size() + page_size - 1) /
+                                              page_size);
+    if (mincore(const_cast<uint8_t*>(mapping.data()), mapping.size(),
+                resident_pages.data()) == 0) {
+      for (size_t i = 0; i < resident_pages.size(); ++i) {
+        if (resident_pages[i] & 1) {
+          stats.resident_bytes +=
+              std::min(page_size, mapping.size() - i * page_size);
+        }
+      }
+    }
+#endif
+  }
+  return stats;
+}
+
+MMapWeightCacheProvider::MMapWeightCacheProvider(
+    MMapWeightCacheProvider&& other) {
+  *this = std::move(other);
+}
+
+MMapWeightCacheProvider& MMapWeightCacheProvider::operator=(
+    MMapWeightCacheProvider&& other) {
+  using std::swap;
+  swap(cache_provider_, other.cache_provider_);
+  // The contexts need to keep pointing to their owning object.
+  cache_provider_.context = this;
+  other.cache_provider_.context = &other;
+  swap(file_path_, other.file_path_);
+  swap(buffer_address_to_identifier_, other.buffer_address_to_identifier_);
+  swap(cache_key_to_offset_, other.cache_key_to_offset_);
+  swap(mapped_cache_, other.mapped_cache_);
+  swap(builder_, other.builder_);
+  return *this;
+}
+
+void MMapWeightCacheProvider::SetFilePath(const char* path) {
+  XNNPACK_ABORT_CHECK(
+      !IsFinalized(),
+      "Cannot change the path of a cache that has already been loaded.");
+  // We try to keep file_path_'s data as stable as possible. Don't overwrite
+  // if the path hasn't changed.
+  if (file_path_ != path) {
+    file_path_ = path;
+  }
+}
+
+bool MMapWeightCacheProvider::LoadOrStartBuild(const char* path) {
+  if (Load(path)) {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_VERBOSE,
+                    "XNNPack weight cache loaded from '%s'.", path);
+    return true;
+  } else if (StartBuild(path)) {
+    TFLITE_LOG_PROD(tflite::TFLITE_LOG_VERBOSE,
+                    "XNNPack weight cache build for '%s' started.", path);
+
+    return true;
+  }
+  return false;
+}
+
+bool MMapWeightCacheProvider::StartBuild(const char* path) {
+  SetFilePath(path);
+  return builder_.Start(path);
+}
+
+bool MMapWeightCacheProvider::Load(const std::string& path) {
+  SetFilePath(path.c_str());
+  return Load();
+}
+
+bool MMapWeightCacheProvider::Load() {
+  XNNPACK_ABORT_CHECK(!file_path_.empty(),
+                      "Path wasn't provided to weight cache provider.");
+  cache_key_to_offset_.clear();
+  mapped_cache_ = WeightCacheRegistry::Get().Load(file_path_);
+  return mapped_cache_ != nullptr;
+}
+
 void MMapWeightCacheProvider::MapTensorIdentifiers(
     const TfLiteTensor* tensors, const size_t size,
     const std::unordered_map<size_t, size_t>& tensor_index_to_identifier) {
@@ -540,8 +682,9 @@ size_t MMapWeightCacheProvider::LookUp(
     return SIZE_MAX;
   }
   const PackIdentifier pack_id = BuildPackIdentifier(*cache_key);
-  if (auto offset_it = cache_key_to_offset_.find(pack_id);
-      offset_it != cache_key_to_offset_.end()) {
+  const auto& buffers =
+      IsFinalized() ? mapped_cache_->buffers : cache_key_to_offset_;
+  if (auto offset_it = buffers.find(pack_id); offset_it != buffers.end()) {
     return offset_it->second.offset;
   }
   return SIZE_MAX;
@@ -558,8 +701,9 @@ size_t MMapWeightCacheProvider::LookUpOrInsert(
   XNNPACK_ABORT_CHECK(cache_key, "A null cache key was provided.");
 
   const PackIdentifier pack_id = BuildPackIdentifier(*cache_key);
-  if (auto offset_it = cache_key_to_offset_.find(pack_id);
-      offset_it != cache_key_to_offset_.end()) {
+  const auto& buffers =
+      IsFinalized() ? mapped_cache_->buffers : cache_key_to_offset_;
+  if (auto offset_it = buffers.find(pack_id); offset_it != buffers.end()) {
     return offset_it->second.offset;
   }
 
@@ -577,14 +721,16 @@ void* MMapWeightCacheProvider::OffsetToAddr(const size_t offset) {
   XNNPACK_ABORT_CHECK(
       IsFinalized(),
       "Cannot get the address of a buffer in a non finalized cache.");
-  return mmap_handle_.data() + mmap_buffer_base_offset_ + offset;
+  // XNNPack only reads the packed buffers, which are shared with the other
+  // providers using the same cache file.
+  return const_cast<uint8_t*>(mapped_cache_->mmap_handle.data()) +
+         mapped_cache_->buffer_base_offset + offset;
 }
 
 void MMapWeightCacheProvider::Release() {
   buffer_address_to_identifier_.clear();
   cache_key_to_offset_.clear();
-  mmap_handle_ = MMapHandle();
-  mmap_buffer_base_offset_ = 0;
+  mapped_cache_.reset();
   builder_ = WeightCacheBuilder();
 }
 
@@ -607,7 +753,7 @@ bool MMapWeightCacheProvider::Finalize() {
 }
 
 bool MMapWeightCacheProvider::IsFinalized() const {
-  return mmap_handle_.IsMapped();
+  return mapped_cache_ != nullptr;
 }
 
 size_t MMapWeightCacheProvider::look_up(
@@ -18,8 +18,12 @@ limitations under the License.
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <set>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -128,6 +132,73 @@ class MMapHandle {
   uint8_t* data_ = nullptr;
 };
 
+// The read-only contents of a finalized cache file: its mapping and the
+// location of every packed buffer in it.
+struct MappedWeightCache {
+  // Maps the file at `path` and reads its buffer list. Returns false if the
+  // file doesn't exist or isn't a valid cache file for this XNNPack build.
+  [[nodiscard /*Loading a cache file may fail.*/]]
+  bool Load(const char* path);
+
+  MMapHandle mmap_handle;
+  // The offset to the first buffer data in the mapping.
+  size_t buffer_base_offset = 0;
+  std::unordered_multimap<PackIdentifier, BufferLocation, PackIdentifier::Hash>
+      buffers;
+};
+
+// Process-wide, reference-counted registry of cache files.
+//
+// Every MMapWeightCacheProvider loads its cache file through this registry, so
+// that all the delegates of a process which use the same file, e.g. those of
+// several interpreter replicas of one model, share a single read-only mapping
+// of the packed weights instead of mapping the file once each. A file is
+// unmapped when the last provider using it releases it.
+//
+// Files are identified by their path, inode, size and modification time, so a
+// file which is rebuilt is loaded again. A file can only be built by one
+// provider of the process at a time. Rebuilding a file replaces it, so the
+// providers which still use the previous file keep a valid mapping.
+//
+// This class is thread-safe.
+class WeightCacheRegistry {
+ public:
+  // Memory used by the cache files which are currently loaded.
+  struct Stats {
+    size_t num_files = 0;
+    size_t mapped_bytes = 0;
+    // Bytes of the mappings which are resident in physical memory.
+    size_t resident_bytes = 0;
+  };
+
+  // Returns the registry of the process.
+  static WeightCacheRegistry& Get();
+
+  // Returns the contents of the cache file at `path`, which are shared with
+  // all other users of the same file. Returns null if the file cannot be
+  // loaded.
+  std::shared_ptr<const MappedWeightCache> Load(const std::string& path);
+
+  // Marks the file at `path` as being built. Returns false if another builder
+  // of the process is building it.
+  [[nodiscard]]
+  bool StartBuild(const std::string& path);
+
+  // Marks the file at `path` as no longer being built.
+  void EndBuild(const std::string& path);
+
+  Stats GetStats();
+
+ private:
+  // Path, device, inode, size and modification time of a file.
+  using FileKey =
+      std::tuple<std::string, uint64_t, uint64_t, uint64_t, int64_t>;
+
+  std::mutex mutex_;
+  std::map<FileKey, std::weak_ptr<const MappedWeightCache>> loaded_files_;
+  std::set<std::string> files_being_built_;
+};
+
 // Provides storage to write the packed buffers to and saves those to disk.
 //
 // WARNING: the interface in this file is still under experimentation and WILL
@@ -203,6 +274,8 @@ class WeightCacheBuilder {
   // Temporary file descriptor to write the weights to disk immediately.
   int fd_ = -1;
   std::string file_path_;
+  // File the cache is written to until it is finalized.
+  std::string temporary_file_path_;
 };
 
 // Allows XNNPack to directly load packed weights from disk instead of having to
@@ -285,6 +358,9 @@ class MMapWeightCacheProvider {
   void* OffsetToAddr(size_t offset);
 
   // Releases the weight cache's memory.
+  //
+  // The mapping of the cache file is only unmapped once no other provider uses
+  // it, see `WeightCacheRegistry`.
   void Release();
 
   // Ensures that the cache is ready.
@@ -347,15 +423,13 @@ class MMapWeightCacheProvider {
   // Maps buffer addresses to buffer identifiers.
   std::unordered_map<const void*, uint64_t> buffer_address_to_identifier_;
 
-  // Maps cache request hashes to the buffer identifier.
+  // Maps cache request hashes to the buffer identifier while the cache is being
+  // built.
   std::unordered_multimap<PackIdentifier, BufferLocation, PackIdentifier::Hash>
       cache_key_to_offset_;
 
-  // MMap allocation handler.
-  MMapHandle mmap_handle_;
-
-  // The offset to the first buffer data in the MMap allocation.
-  size_t mmap_buffer_base_offset_;
+  // The loaded cache file, shared with the other providers using it.
+  std::shared_ptr<const MappedWeightCache> mapped_cache_;
 
   // Used to build the cache.
   WeightCacheBuilder builder_;
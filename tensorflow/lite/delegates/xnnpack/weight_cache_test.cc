@@ -531,6 +531,45 @@ TEST_F(BuildMMapWeightCacheProviderTest, FinalizeWorks) {
   ASSERT_TRUE(cache_provider.IsFinalized());
 }
 
+TEST_F(BuildMMapWeightCacheProviderTest, OnlyOneProviderBuildsAFile) {
+  enum { kWeightIndex, kBiasIndex };
+  TempFileDesc tmp_file(TempFileDesc::kAutoCLose);
+  ASSERT_TRUE(cache_provider.StartBuild(tmp_file.GetCPath()));
+
+  MMapWeightCacheProvider other_provider;
+  EXPECT_FALSE(other_provider.StartBuild(tmp_file.GetCPath()));
+
+  const PackIdentifier pack_id =
+      ctx.PackTensors(&cache_provider.GetCacheProvider(), kAlgoSeed1,
+                      kWeightIndex, kBiasIndex);
+  ASSERT_TRUE(cache_provider.Finalize());
+  const std::vector<uint8_t> packed =
+      ctx.packed_buffers.find(pack_id)->second.buffer;
+
+  // Once built, the file can be loaded or rebuilt by other providers.
+  other_provider.MapTensorIdentifiers(ctx.tensors.data(), ctx.tensors.size(),
+                                      ctx.tensor_buffer_identifiers);
+  ASSERT_TRUE(other_provider.Load(tmp_file.GetPath()));
+  MMapWeightCacheProvider third_provider;
+  third_provider.MapTensorIdentifiers(ctx.tensors.data(), ctx.tensors.size(),
+                                      ctx.tensor_buffer_identifiers);
+  ASSERT_TRUE(third_provider.StartBuild(tmp_file.GetCPath()));
+  ctx.PackTensors(&third_provider.GetCacheProvider(), kAlgoSeed2,
+                  kWeightIndex);
+  ASSERT_TRUE(third_provider.Finalize());
+
+  // The rebuilt file replaces the previous one, which stays readable by the
+  // providers that loaded it.
+  const xnn_weights_cache_look_up_key look_up_key =
+      ctx.LookUpKey(kAlgoSeed1, kWeightIndex, kBiasIndex);
+  const size_t offset = other_provider.LookUp(&look_up_key);
+  ASSERT_NE(offset, SIZE_MAX);
+  EXPECT_EQ(std::memcmp(other_provider.OffsetToAddr(offset), packed.data(),
+                        packed.size()),
+            0);
+  EXPECT_EQ(third_provider.LookUp(&look_up_key), SIZE_MAX);
+}
+
 struct LoadMMapWeightCacheProviderTest : BuildMMapWeightCacheProviderTest {
   enum { kWeightIndex1, kBiasIndex, kWeightIndex2 };
 
@@ -620,6 +659,31 @@ TEST_F(LoadMMapWeightCacheProviderTest, LookUpSucceeds) {
               ElementsAreArray(reference_2.buffer));
 }
 
+TEST_F(LoadMMapWeightCacheProviderTest, ProvidersOfAFileShareItsMapping) {
+  WeightCacheRegistry& registry = WeightCacheRegistry::Get();
+  const WeightCacheRegistry::Stats stats = registry.GetStats();
+  ASSERT_GE(stats.num_files, 1);
+
+  MMapWeightCacheProvider other_provider;
+  other_provider.MapTensorIdentifiers(ctx.tensors.data(), ctx.tensors.size(),
+                                      ctx.tensor_buffer_identifiers);
+  ASSERT_TRUE(other_provider.Load(tmp_file.GetPath()));
+
+  const xnn_weights_cache_look_up_key look_up_key = LookUpKey1();
+  const size_t offset = other_provider.LookUp(&look_up_key);
+  ASSERT_EQ(offset, cache_provider.LookUp(&look_up_key));
+  EXPECT_EQ(other_provider.OffsetToAddr(offset),
+            cache_provider.OffsetToAddr(offset));
+  EXPECT_EQ(registry.GetStats().num_files, stats.num_files);
+  EXPECT_EQ(registry.GetStats().mapped_bytes, stats.mapped_bytes);
+
+  // The file stays mapped until its last provider is released.
+  cache_provider.Release();
+  EXPECT_EQ(registry.GetStats().num_files, stats.num_files);
+  other_provider.Release();
+  EXPECT_EQ(registry.GetStats().num_files, stats.num_files - 1);
+}
+
 TEST(MMapWeightCacheProviderTest, XnnpackCApiJourney) {
   using std::size;
   TempFileDesc temp_fd(TempFileDesc::kAutoCLose);
@@ -2497,6 +2497,24 @@ class Subgraph {
     return kTfLiteOk;
   }
 
+  // Sparse tensors are only supported through DENSIFY nodes, whose output is
+  // dense. A sparse tensor read directly by a node holds compressed data.
+  static TfLiteStatus CheckTensorDense(TfLiteContext* context,
+                                       const TfLiteTensor& tensor,
+                                       int tensor_index,
+                                       BuiltinOperator op_type,
+                                       int node_index) {
+    if (tensor.sparsity != nullptr) {
+      TF_LITE_MAYBE_KERNEL_LOG(
+          context,
+          "unsupported sparse tensor #%d in %s node #%d: "
+          "expected dense tensor",
+          tensor_index, EnumNameBuiltinOperator(op_type), node_index);
+      return kTfLiteError;
+    }
+    return kTfLiteOk;
+  }
+
   static TfLiteStatus CheckTensorStaticOrPersistentRoAllocation(
       TfLiteContext* context, const TfLiteTensor& tensor, int tensor_index,
       int node_index) {
@@ -3226,6 +3244,9 @@ class Subgraph {
     TF_LITE_ENSURE_STATUS(CheckTensorFloat32Type(
         logging_context, input_a, node->inputs->data[0], node_index));
     const TfLiteTensor& input_b = tensors[node->inputs->data[1]];
+    TF_LITE_ENSURE_STATUS(
+        CheckTensorDense(logging_context, input_b, node->inputs->data[1],
+                         BuiltinOperator_BATCH_MATMUL, node_index));
     TF_LITE_ENSURE_STATUS(CheckTensorFloat32OrQCInt8Type(
         delegate, logging_context, input_b,
         /*expected_quantized_dimension=*/params->adj_y
@@ -4117,6 +4138,9 @@ class Subgraph {
     TF_LITE_ENSURE_STATUS(CheckTensorShape(
         logging_context, filter_tensor, 2, node->inputs->data[1],
         BuiltinOperator_FULLY_CONNECTED, node_index));
+    TF_LITE_ENSURE_STATUS(
+        CheckTensorDense(logging_context, filter_tensor, node->inputs->data[1],
+                         BuiltinOperator_FULLY_CONNECTED, node_index));
     // Dynamic filter is supported, but only for FP32.
     if (delegate.support_dynamic_fully_connected_operator() &&
         filter_tensor.type == kTfLiteFloat32) {
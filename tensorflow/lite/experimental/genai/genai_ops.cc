@@ -26,6 +26,10 @@ extern "C" void GenAIOpsRegisterer(::tflite::MutableOpResolver* resolver) {
                       tflite::ops::custom::Register_KV_CACHE());
   resolver->AddCustom("odml.scaled_dot_product_attention",
                       tflite::ops::custom::Register_SDPA());
+  resolver->AddCustom("odml.update_paged_kv_cache",
+                      tflite::ops::custom::Register_PAGED_KV_CACHE());
+  resolver->AddCustom("odml.paged_scaled_dot_product_attention",
+                      tflite::ops::custom::Register_PAGED_SDPA());
 }
 
 }  // namespace custom
@@ -16,14 +16,27 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_EXPERIMENTAL_GENAI_GENAI_OPS_H_
 #define TENSORFLOW_LITE_EXPERIMENTAL_GENAI_GENAI_OPS_H_
 
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+#include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/mutable_op_resolver.h"
 
 namespace tflite {
 namespace ops {
 namespace custom {
 
+// Resource id of the cache shared by the paged KV cache and paged SDPA ops.
+inline constexpr int kPagedKVCacheResourceId = 44;
+
 TfLiteRegistration* Register_KV_CACHE();
 TfLiteRegistration* Register_SDPA();
+TfLiteRegistration* Register_PAGED_KV_CACHE();
+TfLiteRegistration* Register_PAGED_SDPA();
+
+// Returns the paged KV cache of `interpreter`, or nullptr if its tensors have
+// not been allocated yet or the model has no paged KV cache op. Sequences can
+// be forked or released through it, e.g. to generate several continuations of
+// a prompt which share its cache entries.
+resource::PagedCacheBuffer* GetPagedKVCache(Interpreter* interpreter);
 
 extern "C" void GenAIOpsRegisterer(::tflite::MutableOpResolver* resolver);
 
@@ -0,0 +1,251 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "flatbuffers/flexbuffers.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/core/subgraph.h"
+#include "tensorflow/lite/experimental/genai/genai_ops.h"
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+#include "tensorflow/lite/experimental/resource/resource_base.h"
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+// A variant of the KV cache op which stores the entries in a
+// resource::PagedCacheBuffer, so that memory grows with the length of the
+// sequences instead of being sized for `kv_cache_max` entries up front, and
+// sequences forked from a common prompt share its entries.
+//
+// Inputs: the int64 positions [S] of the new entries, which must be
+// consecutive, their float32 keys and values [1, S, N, H], and the int32
+// sequence id [1] of the sequence to write to.
+// Output: the int32 number of entries [1] of the sequence after the update.
+//
+// The cache entries are read by the paged scaled dot product attention op.
+//
+// With the `kv_cache_bits` option set to 8 or 4, the cache stores the entries
+// as int8 or int4 with a scale per entry and head, cutting its memory by 4x or
+// 8x. The keys and values are quantized as they are written.
+
+namespace tflite {
+namespace ops {
+namespace custom {
+namespace llm {
+
+static const int kPositionTensor = 0;
+static const int kKeyTensor = 1;
+static const int kValueTensor = 2;
+static const int kSequenceIdTensor = 3;
+static const int kNumEntriesTensor = 0;
+static const int kRequiredNumDimensions = 4;
+static const int kDefaultMaxNumCacheEntries = 2048;
+static const int kDefaultNumTransformerLayers = 32;
+static const int kDefaultTransformerLayerId = 0;
+static const int kDefaultBlockSize = 16;
+
+struct OpData {
+  int num_layers;
+  int layer_index;
+  int max_num_entries;
+  int block_size;
+  int max_num_blocks;
+  // The `kv_cache_bits` option, validated in Prepare.
+  int cache_bits;
+  TfLiteType cache_type;
+  // The cache shared by all layers, owned by the subgraph resources.
+  resource::PagedCacheBuffer* cache;
+};
+
+void* PagedKVCacheInit(TfLiteContext* context, const char* buffer,
+                       size_t length) {
+  OpData* op_data = new OpData();
+  int32_t max_num_entries = 0;
+  int32_t num_layers = 0;
+  int32_t layer_index = 0;
+  int32_t block_size = 0;
+  int32_t max_num_blocks = 0;
+  int32_t cache_bits = 0;
+  if (buffer != nullptr && length > 0) {
+    const uint8_t* buffer_t = reinterpret_cast<const uint8_t*>(buffer);
+    auto flexbuffer_map = flexbuffers::GetRoot(buffer_t, length).AsMap();
+    max_num_entries = flexbuffer_map["kv_cache_max"].AsInt32();
+    num_layers = flexbuffer_map["num_layers"].AsInt32();
+    layer_index = flexbuffer_map["layer_index"].AsInt32();
+    block_size = flexbuffer_map["block_size"].AsInt32();
+    max_num_blocks = flexbuffer_map["max_num_blocks"].AsInt32();
+    cache_bits = flexbuffer_map["kv_cache_bits"].AsInt32();
+  }
+  op_data->max_num_entries =
+      max_num_entries > 0 ? max_num_entries : kDefaultMaxNumCacheEntries;
+  op_data->num_layers =
+      num_layers > 0 ? num_layers : kDefaultNumTransformerLayers;
+  op_data->layer_index =
+      layer_index > 0 ? layer_index : kDefaultTransformerLayerId;
+  op_data->block_size = block_size > 0 ? block_size : kDefaultBlockSize;
+  // Unlimited by default, blocks are only allocated when they are needed.
+  op_data->max_num_blocks = max_num_blocks > 0 ? max_num_blocks : 0;
+  op_data->cache_bits = cache_bits;
+  op_data->cache_type = cache_bits == 8   ? kTfLiteInt8
+                        : cache_bits == 4 ? kTfLiteInt4
+                                          : kTfLiteFloat32;
+  op_data->cache = nullptr;
+  return op_data;
+}
+
+void PagedKVCacheFree(TfLiteContext* context, void* buffer) {
+  delete static_cast<OpData*>(buffer);
+}
+
+TfLiteStatus PagedKVCachePrepare(TfLiteContext* context, TfLiteNode* node) {
+  TF_LITE_ENSURE_EQ(context, NumInputs(node), 4);
+  TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+
+  const TfLiteTensor* position;
+  const TfLiteTensor* key;
+  const TfLiteTensor* value;
+  const TfLiteTensor* sequence_id;
+  TF_LITE_ENSURE_OK(context,
+                    GetInputSafe(context, node, kPositionTensor, &position));
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kKeyTensor, &key));
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kValueTensor, &value));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kSequenceIdTensor, &sequence_id));
+
+  TF_LITE_ENSURE_EQ(context, position->type, kTfLiteInt64);
+  TF_LITE_ENSURE_EQ(context, key->type, kTfLiteFloat32);
+  TF_LITE_ENSURE_EQ(context, value->type, kTfLiteFloat32);
+  TF_LITE_ENSURE_EQ(context, sequence_id->type, kTfLiteInt32);
+  TF_LITE_ENSURE_EQ(context, NumElements(sequence_id), 1);
+  TF_LITE_ENSURE(context, NumDimensions(position) == 1);
+  // Support only (B, S, N, H) with B == 1.
+  TF_LITE_ENSURE(context, NumDimensions(key) == kRequiredNumDimensions);
+  TF_LITE_ENSURE(context, SizeOfDimension(key, 0) == 1);
+  TF_LITE_ENSURE(context,
+                 SizeOfDimension(position, 0) == SizeOfDimension(key, 1));
+  TF_LITE_ENSURE(context, HaveSameShapes(key, value));
+  TF_LITE_ENSURE(context, op_data->layer_index < op_data->num_layers);
+  if (op_data->cache_bits != 0 && op_data->cache_bits != 8 &&
+      op_data->cache_bits != 4) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Unsupported kv_cache_bits %d, expected 0 (float32), "
+                       "8 or 4.",
+                       op_data->cache_bits);
+    return kTfLiteError;
+  }
+
+  const int num_heads = SizeOfDimension(key, 2);
+  const int head_dim = SizeOfDimension(key, 3);
+  Subgraph* subgraph = reinterpret_cast<Subgraph*>(context->impl_);
+  auto& resources = subgraph->resources();
+  if (resources.count(kPagedKVCacheResourceId) == 0) {
+    auto cache = std::make_unique<resource::PagedCacheBuffer>();
+    TF_LITE_ENSURE_OK(
+        context, cache->Initialize(op_data->num_layers, op_data->block_size,
+                                   num_heads, head_dim,
+                                   op_data->max_num_blocks,
+                                   op_data->cache_type));
+    resources.emplace(kPagedKVCacheResourceId, std::move(cache));
+  }
+  op_data->cache = static_cast<resource::PagedCacheBuffer*>(
+      resources.at(kPagedKVCacheResourceId).get());
+  // All layers share the cache, so they must agree on its layout.
+  TF_LITE_ENSURE_EQ(context, op_data->cache->num_layers(),
+                    op_data->num_layers);
+  TF_LITE_ENSURE_EQ(context, op_data->cache->block_size(),
+                    op_data->block_size);
+  TF_LITE_ENSURE_EQ(context, op_data->cache->num_heads(), num_heads);
+  TF_LITE_ENSURE_EQ(context, op_data->cache->head_dim(), head_dim);
+  TF_LITE_ENSURE_EQ(context, op_data->cache->type(), op_data->cache_type);
+
+  TfLiteTensor* num_entries;
+  TF_LITE_ENSURE_OK(context,
+                    GetOutputSafe(context, node, kNumEntriesTensor,
+                                  &num_entries));
+  num_entries->type = kTfLiteInt32;
+  TfLiteIntArray* num_entries_dims = TfLiteIntArrayCreate(1);
+  num_entries_dims->data[0] = 1;
+  return context->ResizeTensor(context, num_entries, num_entries_dims);
+}
+
+TfLiteStatus PagedKVCacheEval(TfLiteContext* context, TfLiteNode* node) {
+  const TfLiteTensor* position;
+  const TfLiteTensor* key;
+  const TfLiteTensor* value;
+  const TfLiteTensor* sequence_id;
+  TF_LITE_ENSURE_OK(context,
+                    GetInputSafe(context, node, kPositionTensor, &position));
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kKeyTensor, &key));
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kValueTensor, &value));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kSequenceIdTensor, &sequence_id));
+  TfLiteTensor* num_entries;
+  TF_LITE_ENSURE_OK(context,
+                    GetOutputSafe(context, node, kNumEntriesTensor,
+                                  &num_entries));
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+  resource::PagedCacheBuffer* cache = op_data->cache;
+
+  const int seq = sequence_id->data.i32[0];
+  const int num_new_entries = SizeOfDimension(key, 1);
+  const int64_t first_position =
+      num_new_entries > 0 ? position->data.i64[0] : cache->GetNumEntries(seq);
+  if (first_position < 0 || first_position > cache->GetNumEntries(seq)) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Can not write past the end of sequence %d, which has "
+                       "%d entries",
+                       seq, cache->GetNumEntries(seq));
+    return kTfLiteError;
+  }
+  if (first_position + num_new_entries > op_data->max_num_entries) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Sequence %d exceeds the maximum of %d cache entries",
+                       seq, op_data->max_num_entries);
+    return kTfLiteError;
+  }
+  if (cache->Write(seq, op_data->layer_index,
+                   static_cast<int>(first_position), num_new_entries,
+                   GetTensorData<float>(key),
+                   GetTensorData<float>(value)) != kTfLiteOk) {
+    TF_LITE_KERNEL_LOG(context, "Out of paged KV cache blocks");
+    return kTfLiteError;
+  }
+  num_entries->data.i32[0] = cache->GetNumEntries(seq);
+  return kTfLiteOk;
+}
+
+}  // namespace llm
+
+TfLiteRegistration* Register_PAGED_KV_CACHE() {
+  static TfLiteRegistration r = {llm::PagedKVCacheInit, llm::PagedKVCacheFree,
+                                 llm::PagedKVCachePrepare,
+                                 llm::PagedKVCacheEval};
+  return &r;
+}
+
+resource::PagedCacheBuffer* GetPagedKVCache(Interpreter* interpreter) {
+  auto& resources = interpreter->primary_subgraph().resources();
+  auto it = resources.find(kPagedKVCacheResourceId);
+  if (it == resources.end()) return nullptr;
+  return static_cast<resource::PagedCacheBuffer*>(it->second.get());
+}
+
+}  // namespace custom
+}  // namespace ops
+}  // namespace tflite
@@ -0,0 +1,410 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "flatbuffers/flexbuffers.h"  // from @flatbuffers
+
+#ifdef PAGED_SDPA_BENCHMARKS
+#include "testing/base/public/benchmark.h"
+#endif  // PAGED_SDPA_BENCHMARKS
+#include "tensorflow/lite/c/c_api_types.h"
+#include "tensorflow/lite/experimental/genai/genai_ops.h"
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+#include "tensorflow/lite/kernels/test_util.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+namespace {
+
+using ::tflite::resource::PagedCacheBuffer;
+
+constexpr int kBlockSize = 4;
+constexpr int kNumHeads = 2;
+constexpr int kHeadDim = 4;
+constexpr int kEntrySize = kNumHeads * kHeadDim;
+
+class PagedCacheOpModel : public SingleOpModel {
+ public:
+  explicit PagedCacheOpModel(int num_entries, int cache_bits = 0) {
+    pos_ = AddInput({TensorType_INT64, {num_entries}});
+    k_ = AddInput({TensorType_FLOAT32, {1, num_entries, kNumHeads, kHeadDim}});
+    v_ = AddInput({TensorType_FLOAT32, {1, num_entries, kNumHeads, kHeadDim}});
+    seq_ = AddInput({TensorType_INT32, {1}});
+    num_entries_ = AddOutput(TensorType_INT32);
+
+    flexbuffers::Builder fbb;
+    fbb.Map([&]() {
+      fbb.Int("num_layers", 1);
+      fbb.Int("block_size", kBlockSize);
+      fbb.Int("kv_cache_bits", cache_bits);
+    });
+    fbb.Finish();
+    SetCustomOp("PagedKVCache", fbb.GetBuffer(),
+                ops::custom::Register_PAGED_KV_CACHE);
+    BuildInterpreter(
+        {GetShape(pos_), GetShape(k_), GetShape(v_), GetShape(seq_)},
+        /*num_threads=*/-1, /*allow_fp32_relax_to_fp16=*/false,
+        /*apply_delegate=*/false, /*allocate_and_delegate=*/false);
+  }
+
+  TfLiteStatus AllocateTensors() { return interpreter_->AllocateTensors(); }
+
+  // Writes the entries of `sequence_id` from `position` on.
+  TfLiteStatus Write(int sequence_id, int64_t position,
+                     const std::vector<float>& keys,
+                     const std::vector<float>& values) {
+    const int num_entries = keys.size() / kEntrySize;
+    interpreter_->ResizeInputTensor(pos_, {num_entries});
+    interpreter_->ResizeInputTensor(k_,
+                                    {1, num_entries, kNumHeads, kHeadDim});
+    interpreter_->ResizeInputTensor(v_,
+                                    {1, num_entries, kNumHeads, kHeadDim});
+    TF_LITE_ENSURE_STATUS(interpreter_->AllocateTensors());
+    std::vector<int64_t> positions(num_entries);
+    for (int i = 0; i < num_entries; ++i) positions[i] = position + i;
+    PopulateTensor(pos_, positions);
+    PopulateTensor(k_, keys);
+    PopulateTensor(v_, values);
+    PopulateTensor(seq_, {sequence_id});
+    return Invoke();
+  }
+
+  int GetNumEntries() { return ExtractVector<int32_t>(num_entries_)[0]; }
+
+  PagedCacheBuffer* cache() {
+    return ops::custom::GetPagedKVCache(interpreter_.get());
+  }
+
+ private:
+  int pos_;
+  int k_;
+  int v_;
+  int seq_;
+  int num_entries_;
+};
+
+std::vector<float> Entries(float first, int num_entries) {
+  std::vector<float> entries(num_entries * kEntrySize);
+  for (int i = 0; i < entries.size(); ++i) {
+    entries[i] = first + 0.25f * i;
+  }
+  return entries;
+}
+
+TEST(PagedCacheOpTest, SequencesShareAPrompt) {
+  PagedCacheOpModel m(/*num_entries=*/6);
+  ASSERT_EQ(m.AllocateTensors(), kTfLiteOk);
+  PagedCacheBuffer* cache = m.cache();
+  ASSERT_NE(cache, nullptr);
+
+  // Prefill the prompt once.
+  const std::vector<float> prompt_k = Entries(1, 6);
+  const std::vector<float> prompt_v = Entries(-1, 6);
+  ASSERT_EQ(m.Write(0, 0, prompt_k, prompt_v), kTfLiteOk);
+  EXPECT_EQ(m.GetNumEntries(), 6);
+  EXPECT_EQ(cache->GetNumUsedBlocks(), 2);
+
+  // Generate three continuations of it.
+  ASSERT_EQ(cache->ForkSequence(0, 1), kTfLiteOk);
+  ASSERT_EQ(cache->ForkSequence(0, 2), kTfLiteOk);
+  std::vector<std::vector<float>> tokens_k;
+  std::vector<std::vector<float>> tokens_v;
+  for (int seq = 0; seq < 3; ++seq) {
+    tokens_k.push_back(Entries(10 * (seq + 1), 3));
+    tokens_v.push_back(Entries(-10 * (seq + 1), 3));
+    ASSERT_EQ(m.Write(seq, 6, tokens_k[seq], tokens_v[seq]), kTfLiteOk);
+    EXPECT_EQ(m.GetNumEntries(), 9);
+  }
+
+  // The full first block of the prompt is still shared. The partially filled
+  // second block was copied when written to, except by the last sequence
+  // using it.
+  EXPECT_EQ(cache->GetNumUsedBlocks(), 1 + 3 * 2);
+  EXPECT_EQ(cache->GetKeys(0, 0, 0), cache->GetKeys(1, 0, 0));
+  EXPECT_EQ(cache->GetKeys(0, 0, 0), cache->GetKeys(2, 0, 0));
+  for (int seq = 0; seq < 3; ++seq) {
+    for (int i = 0; i < 9; ++i) {
+      const std::vector<float>& k = i < 6 ? prompt_k : tokens_k[seq];
+      const std::vector<float>& v = i < 6 ? prompt_v : tokens_v[seq];
+      const int offset = (i < 6 ? i : i - 6) * kEntrySize;
+      for (int j = 0; j < kEntrySize; ++j) {
+        ASSERT_EQ(cache->GetKeys(seq, 0, i)[j], k[offset + j]);
+        ASSERT_EQ(cache->GetValues(seq, 0, i)[j], v[offset + j]);
+      }
+    }
+  }
+  // A contiguous cache would hold kv_cache_max entries for each sequence.
+  EXPECT_EQ(cache->GetMemoryUsage(),
+            7 * kBlockSize * 2 * kEntrySize * sizeof(float));
+
+  cache->ReleaseSequence(1);
+  cache->ReleaseSequence(2);
+  EXPECT_EQ(cache->GetNumUsedBlocks(), 3);
+
+  // Positions past the end of the sequence are rejected.
+  EXPECT_EQ(m.Write(0, 10, tokens_k[0], tokens_v[0]), kTfLiteError);
+}
+
+TEST(PagedCacheOpTest, RejectsUnsupportedCacheBits) {
+  for (int cache_bits : {8, 4}) {
+    PagedCacheOpModel m(/*num_entries=*/1, cache_bits);
+    ASSERT_EQ(m.AllocateTensors(), kTfLiteOk);
+  }
+  for (int cache_bits : {16, 6, 1, -8}) {
+    PagedCacheOpModel m(/*num_entries=*/1, cache_bits);
+    EXPECT_EQ(m.AllocateTensors(), kTfLiteError) << cache_bits;
+  }
+}
+
+class PagedSDPAOpModel : public SingleOpModel {
+ public:
+  PagedSDPAOpModel(int num_queries, int num_heads,
+                   TfLiteType cache_type = kTfLiteFloat32,
+                   int head_dim = kHeadDim, int num_kv_heads = kNumHeads) {
+    query_ = AddInput({TensorType_FLOAT32, {1, num_queries, num_heads,
+                                            head_dim}});
+    pos_ = AddInput({TensorType_INT64, {num_queries}});
+    num_entries_ = AddInput({TensorType_INT32, {1}});
+    seq_ = AddInput({TensorType_INT32, {1}});
+    output_ = AddOutput(TensorType_FLOAT32);
+    SetCustomOp("PagedSDPA", {}, ops::custom::Register_PAGED_SDPA);
+    BuildInterpreter({GetShape(query_), GetShape(pos_), GetShape(num_entries_),
+                      GetShape(seq_)});
+
+    // The cache is normally created by the paged KV cache op.
+    auto cache = std::make_unique<PagedCacheBuffer>();
+    cache->Initialize(/*num_layers=*/1, kBlockSize, num_kv_heads, head_dim,
+                      /*max_num_blocks=*/0, cache_type);
+    cache_ = cache.get();
+    interpreter_->primary_subgraph().resources().emplace(
+        ops::custom::kPagedKVCacheResourceId, std::move(cache));
+  }
+
+  std::vector<float> Attend(int sequence_id,
+                            const std::vector<int64_t>& positions,
+                            const std::vector<float>& query) {
+    PopulateTensor(query_, query);
+    PopulateTensor(pos_, positions);
+    PopulateTensor(num_entries_, {cache_->GetNumEntries(sequence_id)});
+    PopulateTensor(seq_, {sequence_id});
+    EXPECT_EQ(Invoke(), kTfLiteOk);
+    return ExtractVector<float>(output_);
+  }
+
+  PagedCacheBuffer* cache() { return cache_; }
+
+ private:
+  int query_;
+  int pos_;
+  int num_entries_;
+  int seq_;
+  int output_;
+  PagedCacheBuffer* cache_;
+};
+
+// Causal attention of `query` over the dense `keys` and `values`.
+std::vector<float> ReferenceAttention(const std::vector<int64_t>& positions,
+                                      const std::vector<float>& query,
+                                      int num_heads,
+                                      const std::vector<float>& keys,
+                                      const std::vector<float>& values) {
+  const int heads_per_kv_head = num_heads / kNumHeads;
+  const float scale = 1.0f / sqrtf(kHeadDim);
+  std::vector<float> output(query.size(), 0.0f);
+  for (int t = 0; t < positions.size(); ++t) {
+    for (int h = 0; h < num_heads; ++h) {
+      const float* q = &query[(t * num_heads + h) * kHeadDim];
+      const int kv_offset = (h / heads_per_kv_head) * kHeadDim;
+      std::vector<float> logits;
+      float max_logit = -INFINITY;
+      for (int j = 0; j <= positions[t]; ++j) {
+        float logit = 0.0f;
+        for (int d = 0; d < kHeadDim; ++d) {
+          logit += q[d] * keys[j * kEntrySize + kv_offset + d];
+        }
+        logits.push_back(logit * scale);
+        max_logit = std::max(max_logit, logits.back());
+      }
+      float sum = 0.0f;
+      for (float& logit : logits) {
+        logit = expf(logit - max_logit);
+        sum += logit;
+      }
+      float* out = &output[(t * num_heads + h) * kHeadDim];
+      for (int j = 0; j < logits.size(); ++j) {
+        for (int d = 0; d < kHeadDim; ++d) {
+          out[d] += logits[j] / sum * values[j * kEntrySize + kv_offset + d];
+        }
+      }
+    }
+  }
+  return output;
+}
+
+TEST(PagedSDPAOpTest, MatchesDenseAttention) {
+  // Four query heads sharing two KV heads.
+  constexpr int kNumQueryHeads = 4;
+  PagedSDPAOpModel m(/*num_queries=*/2, kNumQueryHeads);
+  PagedCacheBuffer* cache = m.cache();
+  const std::vector<float> keys = Entries(-2, 10);
+  std::vector<float> values = Entries(3, 10);
+  for (float& value : values) value = sinf(value);
+  ASSERT_EQ(cache->Write(5, 0, 0, 10, keys.data(), values.data()), kTfLiteOk);
+
+  const std::vector<int64_t> positions = {4, 9};
+  std::vector<float> query = Entries(0.5, 2 * kNumQueryHeads / kNumHeads);
+  for (float& q : query) q = cosf(q);
+  const std::vector<float> expected =
+      ReferenceAttention(positions, query, kNumQueryHeads, keys, values);
+  const std::vector<float> output = m.Attend(5, positions, query);
+  ASSERT_EQ(output.size(), expected.size());
+  for (int i = 0; i < output.size(); ++i) {
+    EXPECT_NEAR(output[i], expected[i], 1e-5) << "at index " << i;
+  }
+
+  // A fork which diverged after the prompt reads the shared blocks through
+  // its own block table.
+  ASSERT_EQ(cache->ForkSequence(5, 6), kTfLiteOk);
+  std::vector<float> fork_keys = keys;
+  std::vector<float> fork_values = values;
+  for (int i = 6 * kEntrySize; i < fork_keys.size(); ++i) {
+    fork_keys[i] = -fork_keys[i];
+    fork_values[i] = 2 * fork_values[i];
+  }
+  ASSERT_EQ(cache->Write(6, 0, 6, 4, &fork_keys[6 * kEntrySize],
+                         &fork_values[6 * kEntrySize]),
+            kTfLiteOk);
+  const std::vector<float> fork_expected = ReferenceAttention(
+      positions, query, kNumQueryHeads, fork_keys, fork_values);
+  const std::vector<float> fork_output = m.Attend(6, positions, query);
+  for (int i = 0; i < fork_output.size(); ++i) {
+    EXPECT_NEAR(fork_output[i], fork_expected[i], 1e-5) << "at index " << i;
+  }
+  // The original sequence is unchanged.
+  const std::vector<float> original_output = m.Attend(5, positions, query);
+  for (int i = 0; i < original_output.size(); ++i) {
+    EXPECT_NEAR(original_output[i], expected[i], 1e-5) << "at index " << i;
+  }
+}
+
+class QuantizedPagedSDPAOpTest : public ::testing::TestWithParam<TfLiteType> {
+};
+
+TEST_P(QuantizedPagedSDPAOpTest, IsCloseToDenseAttention) {
+  constexpr int kNumQueryHeads = 4;
+  constexpr int kNumEntries = 37;
+  PagedSDPAOpModel m(/*num_queries=*/3, kNumQueryHeads, GetParam());
+  PagedCacheBuffer* cache = m.cache();
+  std::vector<float> keys = Entries(-2, kNumEntries);
+  std::vector<float> values = Entries(3, kNumEntries);
+  for (float& key : keys) key = 2 * sinf(key);
+  for (float& value : values) value = cosf(value);
+  ASSERT_EQ(cache->Write(0, 0, 0, kNumEntries, keys.data(), values.data()),
+            kTfLiteOk);
+
+  const std::vector<int64_t> positions = {0, 17, kNumEntries - 1};
+  std::vector<float> query = Entries(0.5, 3 * kNumQueryHeads / kNumHeads);
+  for (float& q : query) q = cosf(q);
+  const std::vector<float> expected =
+      ReferenceAttention(positions, query, kNumQueryHeads, keys, values);
+  const std::vector<float> output = m.Attend(0, positions, query);
+  ASSERT_EQ(output.size(), expected.size());
+  float max_delta = 0.0f;
+  for (int i = 0; i < output.size(); ++i) {
+    max_delta = std::max(max_delta, std::fabs(output[i] - expected[i]));
+  }
+  // An int4 element is off by up to 1/14 of the largest magnitude of its head.
+  EXPECT_LT(max_delta, GetParam() == kTfLiteInt8 ? 0.01f : 0.1f);
+  EXPECT_GT(max_delta, 0.0f);
+}
+
+INSTANTIATE_TEST_SUITE_P(QuantizedPagedSDPAOpTest, QuantizedPagedSDPAOpTest,
+                         ::testing::Values(kTfLiteInt8, kTfLiteInt4));
+
+#ifdef PAGED_SDPA_BENCHMARKS
+
+// Compile with --copt="-DPAGED_SDPA_BENCHMARKS"
+// Run with --benchmark_filter=all
+//
+// Decodes one token at a time with 8 query heads over 2 KV heads of 64
+// elements and a cache of state.range(1) entries of type state.range(0).
+// Reports the decode tokens per second, the bytes of cache read per second,
+// and the largest difference of the attention output to the one of a float32
+// cache.
+void BM_PagedSDPADecode(benchmark::State& state) {
+  const TfLiteType cache_type = static_cast<TfLiteType>(state.range(0));
+  const int num_entries = state.range(1);
+  constexpr int kNumQueryHeads = 8;
+  constexpr int kNumKVHeads = 2;
+  constexpr int kBenchmarkHeadDim = 64;
+  constexpr int kBenchmarkEntrySize = kNumKVHeads * kBenchmarkHeadDim;
+  std::vector<float> keys(num_entries * kBenchmarkEntrySize);
+  std::vector<float> values(keys.size());
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = sinf(0.37f * i);
+    values[i] = cosf(0.53f * i);
+  }
+  std::vector<float> query(kNumQueryHeads * kBenchmarkHeadDim);
+  for (int i = 0; i < query.size(); ++i) {
+    query[i] = sinf(1.0f + 0.29f * i);
+  }
+  const std::vector<int64_t> position = {num_entries - 1};
+
+  std::vector<float> float_output;
+  int64_t cache_bytes = 0;
+  for (TfLiteType type : {kTfLiteFloat32, cache_type}) {
+    PagedSDPAOpModel m(/*num_queries=*/1, kNumQueryHeads, type,
+                       kBenchmarkHeadDim, kNumKVHeads);
+    m.cache()->Write(0, 0, 0, num_entries, keys.data(), values.data());
+    const std::vector<float> output = m.Attend(0, position, query);
+    if (type == kTfLiteFloat32) {
+      float_output = output;
+      continue;
+    }
+    float max_delta = 0.0f;
+    for (int i = 0; i < output.size(); ++i) {
+      max_delta = std::max(max_delta, std::fabs(output[i] - float_output[i]));
+    }
+    state.counters["max_abs_delta"] = max_delta;
+    // Decoding a token reads the whole cache of the sequence.
+    cache_bytes = m.cache()->GetMemoryUsage();
+    state.counters["cache_bytes"] = cache_bytes;
+    for (auto _ : state) {
+      m.Invoke();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * cache_bytes);
+}
+BENCHMARK(BM_PagedSDPADecode)
+    ->ArgPair(kTfLiteFloat32, 1024)
+    ->ArgPair(kTfLiteInt8, 1024)
+    ->ArgPair(kTfLiteInt4, 1024)
+    ->ArgPair(kTfLiteFloat32, 8192)
+    ->ArgPair(kTfLiteInt8, 8192)
+    ->ArgPair(kTfLiteInt4, 8192);
+
+#endif  // PAGED_SDPA_BENCHMARKS
+
+}  // namespace
+}  // namespace tflite
@@ -0,0 +1,371 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "flatbuffers/flexbuffers.h"
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/core/subgraph.h"
+#include "tensorflow/lite/experimental/genai/genai_ops.h"
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+// A variant of the scaled dot product attention op which reads the keys and
+// values of a sequence through the block table of the paged KV cache, instead
+// of taking the full cache as dense tensors. The attention is causal: the
+// query at position p attends to the cache entries at positions [0, p].
+//
+// Inputs: the float32 query [1, T, N, H], the int64 positions [T] of the
+// queries, the int32 number of entries [1] of the sequence as output by the
+// paged KV cache op of the same layer, and the int32 sequence id [1].
+// Output: the float32 attention result [1, T, N, H].
+//
+// Grouped and multi-query attention are supported by caches with fewer heads
+// than the query, as long as the number of query heads is a multiple of it.
+//
+// With int8 and int4 caches, each query head is quantized to int8 with a
+// symmetric scale, so that the dot products with the keys are int8 x int8 with
+// an int32 accumulator, which compilers lower to the int8 dot product
+// instructions of the target. The values are widened to float as they are
+// accumulated. The scales of the query and of each entry are applied to the
+// results, outside of the loops over the head.
+
+namespace tflite {
+namespace ops {
+namespace custom {
+namespace llm {
+
+static const int kQueryTensor = 0;
+static const int kPositionTensor = 1;
+static const int kNumEntriesTensor = 2;
+static const int kSequenceIdTensor = 3;
+static const int kOutputTensor = 0;
+
+struct OpData {
+  float scale;
+  int layer_index;
+  // The query head being attended, quantized for int8 and int4 caches.
+  std::vector<int8_t> quantized_query;
+};
+
+void* PagedSDPAInit(TfLiteContext* context, const char* buffer,
+                    size_t length) {
+  OpData* op_data = new OpData();
+  op_data->scale = 0.0f;
+  op_data->layer_index = 0;
+  if (buffer != nullptr && length > 0) {
+    const uint8_t* buffer_t = reinterpret_cast<const uint8_t*>(buffer);
+    auto flexbuffer_map = flexbuffers::GetRoot(buffer_t, length).AsMap();
+    const float scale = flexbuffer_map["scale"].AsFloat();
+    const int32_t layer_index = flexbuffer_map["layer_index"].AsInt32();
+    op_data->scale = scale > 0.0f ? scale : 0.0f;
+    op_data->layer_index = layer_index > 0 ? layer_index : 0;
+  }
+  return op_data;
+}
+
+void PagedSDPAFree(TfLiteContext* context, void* buffer) {
+  delete static_cast<OpData*>(buffer);
+}
+
+TfLiteStatus PagedSDPAPrepare(TfLiteContext* context, TfLiteNode* node) {
+  TF_LITE_ENSURE_EQ(context, NumInputs(node), 4);
+  TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
+
+  const TfLiteTensor* query;
+  const TfLiteTensor* position;
+  const TfLiteTensor* num_entries;
+  const TfLiteTensor* sequence_id;
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kQueryTensor, &query));
+  TF_LITE_ENSURE_OK(context,
+                    GetInputSafe(context, node, kPositionTensor, &position));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kNumEntriesTensor, &num_entries));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kSequenceIdTensor, &sequence_id));
+
+  TF_LITE_ENSURE_EQ(context, query->type, kTfLiteFloat32);
+  TF_LITE_ENSURE_EQ(context, position->type, kTfLiteInt64);
+  TF_LITE_ENSURE_EQ(context, num_entries->type, kTfLiteInt32);
+  TF_LITE_ENSURE_EQ(context, sequence_id->type, kTfLiteInt32);
+  TF_LITE_ENSURE_EQ(context, NumElements(num_entries), 1);
+  TF_LITE_ENSURE_EQ(context, NumElements(sequence_id), 1);
+  TF_LITE_ENSURE_EQ(context, NumDimensions(query), 4);
+  TF_LITE_ENSURE_EQ(context, SizeOfDimension(query, 0), 1);
+  TF_LITE_ENSURE_EQ(context, NumDimensions(position), 1);
+  TF_LITE_ENSURE_EQ(context, SizeOfDimension(position, 0),
+                    SizeOfDimension(query, 1));
+
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+  op_data->quantized_query.resize(SizeOfDimension(query, 3));
+
+  TfLiteTensor* output;
+  TF_LITE_ENSURE_OK(context,
+                    GetOutputSafe(context, node, kOutputTensor, &output));
+  output->type = kTfLiteFloat32;
+  return context->ResizeTensor(context, output,
+                               TfLiteIntArrayCopy(query->dims));
+}
+
+// Quantizes `q` to int8 with a symmetric scale, which is returned.
+inline float QuantizeQuery(const float* q, int head_dim, int8_t* quantized) {
+  float max_abs = 0.0f;
+  for (int d = 0; d < head_dim; ++d) {
+    max_abs = std::max(max_abs, std::fabs(q[d]));
+  }
+  if (max_abs == 0.0f) {
+    std::fill(quantized, quantized + head_dim, 0);
+    return 0.0f;
+  }
+  const float scale = max_abs / 127.0f;
+  const float inverse_scale = 127.0f / max_abs;
+  for (int d = 0; d < head_dim; ++d) {
+    quantized[d] = static_cast<int8_t>(std::round(q[d] * inverse_scale));
+  }
+  return scale;
+}
+
+// Returns the dot product of the float query head `q` with a float32 key head.
+inline float DotProduct(const float* q, const uint8_t* k, int head_dim) {
+  const float* k_float = reinterpret_cast<const float*>(k);
+  float result = 0.0f;
+  for (int d = 0; d < head_dim; ++d) {
+    result += q[d] * k_float[d];
+  }
+  return result;
+}
+
+// Returns the dot product of the quantized query head `q` with a key head of
+// `kType`, without their scales.
+template <TfLiteType kType>
+inline int32_t DotProduct(const int8_t* q, const uint8_t* k, int head_dim) {
+  int32_t result = 0;
+  if constexpr (kType == kTfLiteInt8) {
+    const int8_t* k_int8 = reinterpret_cast<const int8_t*>(k);
+    for (int d = 0; d < head_dim; ++d) {
+      result += static_cast<int32_t>(q[d]) * k_int8[d];
+    }
+  } else {
+    const int8_t* k_int4 = reinterpret_cast<const int8_t*>(k);
+    for (int d = 0; d < head_dim / 2; ++d) {
+      const int8_t low =
+          static_cast<int8_t>(static_cast<uint8_t>(k_int4[d]) << 4) >> 4;
+      const int8_t high = k_int4[d] >> 4;
+      result += static_cast<int32_t>(q[2 * d]) * low +
+                static_cast<int32_t>(q[2 * d + 1]) * high;
+    }
+  }
+  return result;
+}
+
+// Adds `weight` times a head of a cache entry of `kType` to `out`.
+template <TfLiteType kType>
+inline void MultiplyAccumulate(float weight, const uint8_t* v, int head_dim,
+                               float* out) {
+  if constexpr (kType == kTfLiteFloat32) {
+    const float* v_float = reinterpret_cast<const float*>(v);
+    for (int d = 0; d < head_dim; ++d) {
+      out[d] += weight * v_float[d];
+    }
+  } else if constexpr (kType == kTfLiteInt8) {
+    const int8_t* v_int8 = reinterpret_cast<const int8_t*>(v);
+    for (int d = 0; d < head_dim; ++d) {
+      out[d] += weight * v_int8[d];
+    }
+  } else {
+    const int8_t* v_int4 = reinterpret_cast<const int8_t*>(v);
+    for (int d = 0; d < head_dim / 2; ++d) {
+      const int8_t low =
+          static_cast<int8_t>(static_cast<uint8_t>(v_int4[d]) << 4) >> 4;
+      const int8_t high = v_int4[d] >> 4;
+      out[2 * d] += weight * low;
+      out[2 * d + 1] += weight * high;
+    }
+  }
+}
+
+// Computes the attention of query head `q` over the first `length` entries of
+// head `kv_head` of a sequence in a cache of `kType`. For quantized caches,
+// `quantized_q` is scratch space for the quantized query head.
+template <TfLiteType kType>
+void AttendHead(const resource::PagedCacheBuffer& cache, int seq, int layer,
+                int length, int kv_head, const float* q, float scale,
+                int8_t* quantized_q, float* out) {
+  const int block_size = cache.block_size();
+  const int head_dim = cache.head_dim();
+  const int num_kv_heads = cache.num_heads();
+  const size_t entry_bytes = cache.EntryBytes();
+  const size_t head_offset = kv_head * (entry_bytes / num_kv_heads);
+  float query_scale = 1.0f;
+  if constexpr (kType != kTfLiteFloat32) {
+    query_scale = QuantizeQuery(q, head_dim, quantized_q);
+  }
+
+  // Single pass over the cache with an online softmax, so that no buffer
+  // proportional to the sequence length is needed.
+  std::fill(out, out + head_dim, 0.0f);
+  float max_logit = -INFINITY;
+  float sum = 0.0f;
+  const uint8_t* keys = nullptr;
+  const uint8_t* values = nullptr;
+  const float* key_scales = nullptr;
+  const float* value_scales = nullptr;
+  for (int j = 0; j < length; ++j) {
+    // Entries, and their scales, are contiguous within a block.
+    if (j % block_size == 0) {
+      if constexpr (kType == kTfLiteFloat32) {
+        keys = reinterpret_cast<const uint8_t*>(cache.GetKeys(seq, layer, j));
+        values =
+            reinterpret_cast<const uint8_t*>(cache.GetValues(seq, layer, j));
+      } else {
+        keys = reinterpret_cast<const uint8_t*>(
+            cache.GetQuantizedKeys(seq, layer, j));
+        values = reinterpret_cast<const uint8_t*>(
+            cache.GetQuantizedValues(seq, layer, j));
+        key_scales = cache.GetKeyScales(seq, layer, j);
+        value_scales = cache.GetValueScales(seq, layer, j);
+      }
+    }
+    const int index = j % block_size;
+    const uint8_t* k = keys + index * entry_bytes + head_offset;
+    const uint8_t* v = values + index * entry_bytes + head_offset;
+    float key_scale = scale;
+    float value_scale = 1.0f;
+    if constexpr (kType != kTfLiteFloat32) {
+      key_scale *= query_scale * key_scales[index * num_kv_heads + kv_head];
+      value_scale = value_scales[index * num_kv_heads + kv_head];
+    }
+
+    float logit;
+    if constexpr (kType == kTfLiteFloat32) {
+      logit = key_scale * DotProduct(q, k, head_dim);
+    } else {
+      logit = key_scale * DotProduct<kType>(quantized_q, k, head_dim);
+    }
+    if (logit > max_logit) {
+      const float rescale = expf(max_logit - logit);
+      sum *= rescale;
+      for (int d = 0; d < head_dim; ++d) {
+        out[d] *= rescale;
+      }
+      max_logit = logit;
+    }
+    const float weight = expf(logit - max_logit);
+    sum += weight;
+    MultiplyAccumulate<kType>(weight * value_scale, v, head_dim, out);
+  }
+  if (sum > 0.0f) {
+    for (int d = 0; d < head_dim; ++d) {
+      out[d] /= sum;
+    }
+  }
+}
+
+TfLiteStatus PagedSDPAEval(TfLiteContext* context, TfLiteNode* node) {
+  const TfLiteTensor* query;
+  const TfLiteTensor* position;
+  const TfLiteTensor* num_entries;
+  const TfLiteTensor* sequence_id;
+  TF_LITE_ENSURE_OK(context, GetInputSafe(context, node, kQueryTensor, &query));
+  TF_LITE_ENSURE_OK(context,
+                    GetInputSafe(context, node, kPositionTensor, &position));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kNumEntriesTensor, &num_entries));
+  TF_LITE_ENSURE_OK(
+      context, GetInputSafe(context, node, kSequenceIdTensor, &sequence_id));
+  TfLiteTensor* output;
+  TF_LITE_ENSURE_OK(context,
+                    GetOutputSafe(context, node, kOutputTensor, &output));
+  OpData* op_data = reinterpret_cast<OpData*>(node->user_data);
+
+  // The cache is created when the paged KV cache op is prepared.
+  Subgraph* subgraph = reinterpret_cast<Subgraph*>(context->impl_);
+  auto& resources = subgraph->resources();
+  auto it = resources.find(kPagedKVCacheResourceId);
+  TF_LITE_ENSURE_MSG(context, it != resources.end(),
+                     "No paged KV cache, the model needs a paged KV cache op");
+  const resource::PagedCacheBuffer* cache =
+      static_cast<const resource::PagedCacheBuffer*>(it->second.get());
+
+  const int num_queries = SizeOfDimension(query, 1);
+  const int num_heads = SizeOfDimension(query, 2);
+  const int head_dim = SizeOfDimension(query, 3);
+  TF_LITE_ENSURE(context, op_data->layer_index < cache->num_layers());
+  TF_LITE_ENSURE_EQ(context, cache->head_dim(), head_dim);
+  const int num_kv_heads = cache->num_heads();
+  TF_LITE_ENSURE_EQ(context, num_heads % num_kv_heads, 0);
+  const int heads_per_kv_head = num_heads / num_kv_heads;
+  const float scale = op_data->scale > 0.0f ? op_data->scale
+                                            : 1.0f / sqrtf(head_dim);
+
+  const int seq = sequence_id->data.i32[0];
+  const int kv_length =
+      std::min(num_entries->data.i32[0], cache->GetNumEntries(seq));
+  const float* query_data = GetTensorData<float>(query);
+  float* output_data = GetTensorData<float>(output);
+
+  for (int t = 0; t < num_queries; ++t) {
+    const int64_t query_position = position->data.i64[t];
+    TF_LITE_ENSURE(context, query_position >= 0);
+    const int length =
+        static_cast<int>(std::min<int64_t>(kv_length, query_position + 1));
+    for (int h = 0; h < num_heads; ++h) {
+      const float* q = query_data + (t * num_heads + h) * head_dim;
+      float* out = output_data + (t * num_heads + h) * head_dim;
+      const int kv_head = h / heads_per_kv_head;
+      switch (cache->type()) {
+        case kTfLiteFloat32:
+          AttendHead<kTfLiteFloat32>(*cache, seq, op_data->layer_index, length,
+                                     kv_head, q, scale,
+                                     op_data->quantized_query.data(), out);
+          break;
+        case kTfLiteInt8:
+          AttendHead<kTfLiteInt8>(*cache, seq, op_data->layer_index, length,
+                                  kv_head, q, scale,
+                                  op_data->quantized_query.data(), out);
+          break;
+        case kTfLiteInt4:
+          AttendHead<kTfLiteInt4>(*cache, seq, op_data->layer_index, length,
+                                  kv_head, q, scale,
+                                  op_data->quantized_query.data(), out);
+          break;
+        default:
+          TF_LITE_KERNEL_LOG(context, "Unsupported paged KV cache type %s",
+                             TfLiteTypeGetName(cache->type()));
+          return kTfLiteError;
+      }
+    }
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace llm
+
+TfLiteRegistration* Register_PAGED_SDPA() {
+  static TfLiteRegistration r = {llm::PagedSDPAInit, llm::PagedSDPAFree,
+                                 llm::PagedSDPAPrepare, llm::PagedSDPAEval};
+  return &r;
+}
+
+}  // namespace custom
+}  // namespace ops
+}  // namespace tflite
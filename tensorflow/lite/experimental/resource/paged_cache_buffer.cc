@@ -0,0 +1,244 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+
+namespace tflite {
+namespace resource {
+namespace {
+
+// Quantizes the `num_heads` heads of `head_dim` elements of `entry` to int8
+// or packed int4, with a symmetric scale per head.
+void QuantizeEntry(const float* entry, int num_heads, int head_dim,
+                   TfLiteType type, int8_t* quantized, float* scales) {
+  const float max_quantized = type == kTfLiteInt8 ? 127.0f : 7.0f;
+  for (int h = 0; h < num_heads; ++h) {
+    const float* x = entry + h * head_dim;
+    float max_abs = 0.0f;
+    for (int d = 0; d < head_dim; ++d) {
+      max_abs = std::max(max_abs, std::fabs(x[d]));
+    }
+    scales[h] = max_abs / max_quantized;
+    const float inverse_scale = max_abs > 0.0f ? max_quantized / max_abs : 0.0f;
+    auto quantize = [&](float value) {
+      return static_cast<int8_t>(std::round(std::min(
+          max_quantized, std::max(-max_quantized, value * inverse_scale))));
+    };
+    if (type == kTfLiteInt8) {
+      int8_t* q = quantized + h * head_dim;
+      for (int d = 0; d < head_dim; ++d) {
+        q[d] = quantize(x[d]);
+      }
+    } else {
+      int8_t* q = quantized + h * head_dim / 2;
+      for (int d = 0; d < head_dim; d += 2) {
+        q[d / 2] = static_cast<int8_t>(
+            (static_cast<uint8_t>(quantize(x[d])) & 0x0f) |
+            (static_cast<uint8_t>(quantize(x[d + 1])) << 4));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TfLiteStatus PagedCacheBuffer::Initialize(int num_layers, int block_size,
+                                          int num_heads, int head_dim,
+                                          int max_num_blocks, TfLiteType type) {
+  if (is_initialized_ || num_layers <= 0 || block_size <= 0 ||
+      num_heads <= 0 || head_dim <= 0 || max_num_blocks < 0) {
+    return kTfLiteError;
+  }
+  if (type != kTfLiteFloat32 && type != kTfLiteInt8 && type != kTfLiteInt4) {
+    return kTfLiteError;
+  }
+  if (type == kTfLiteInt4 && head_dim % 2 != 0) {
+    return kTfLiteError;
+  }
+  num_layers_ = num_layers;
+  block_size_ = block_size;
+  num_heads_ = num_heads;
+  head_dim_ = head_dim;
+  max_num_blocks_ = max_num_blocks;
+  type_ = type;
+  is_initialized_ = true;
+  return kTfLiteOk;
+}
+
+int PagedCacheBuffer::GetNumEntries(int sequence_id) const {
+  auto it = sequences_.find(sequence_id);
+  return it == sequences_.end() ? 0 : it->second.num_entries;
+}
+
+TfLiteStatus PagedCacheBuffer::ForkSequence(int src_sequence_id,
+                                            int dst_sequence_id) {
+  auto src = sequences_.find(src_sequence_id);
+  if (src == sequences_.end() || HasSequence(dst_sequence_id)) {
+    return kTfLiteError;
+  }
+  for (int block : src->second.block_table) {
+    ++ref_counts_[block];
+  }
+  // Copy before inserting, which may invalidate `src`.
+  Sequence dst = src->second;
+  sequences_.emplace(dst_sequence_id, std::move(dst));
+  return kTfLiteOk;
+}
+
+void PagedCacheBuffer::ReleaseSequence(int sequence_id) {
+  auto it = sequences_.find(sequence_id);
+  if (it == sequences_.end()) return;
+  for (int block : it->second.block_table) {
+    UnrefBlock(block);
+  }
+  sequences_.erase(it);
+}
+
+TfLiteStatus PagedCacheBuffer::Write(int sequence_id, int layer, int position,
+                                     int num_entries, const float* keys,
+                                     const float* values) {
+  if (!is_initialized_ || layer < 0 || layer >= num_layers_ || position < 0 ||
+      num_entries < 0) {
+    return kTfLiteError;
+  }
+  Sequence& sequence = sequences_[sequence_id];
+  if (position > sequence.num_entries) {
+    return kTfLiteError;
+  }
+
+  // Drop the blocks past the new end of the sequence.
+  const int end = position + num_entries;
+  const size_t num_blocks = (end + block_size_ - 1) / block_size_;
+  while (sequence.block_table.size() > num_blocks) {
+    UnrefBlock(sequence.block_table.back());
+    sequence.block_table.pop_back();
+  }
+  sequence.num_entries = std::min(sequence.num_entries, end);
+
+  const size_t entry_size = this->entry_size();
+  for (int i = 0; i < num_entries;) {
+    const int block_index = (position + i) / block_size_;
+    const int index_in_block = (position + i) % block_size_;
+    const int n = std::min(num_entries - i, block_size_ - index_in_block);
+
+    if (block_index == static_cast<int>(sequence.block_table.size())) {
+      const int block = AllocateBlock();
+      if (block < 0) return kTfLiteError;
+      sequence.block_table.push_back(block);
+    } else if (ref_counts_[sequence.block_table[block_index]] > 1) {
+      // The block is shared with another sequence: copy it before writing.
+      const int shared_block = sequence.block_table[block_index];
+      const int block = AllocateBlock();
+      if (block < 0) return kTfLiteError;
+      std::memcpy(blocks_[block].get(), blocks_[shared_block].get(),
+                  BlockBytes());
+      UnrefBlock(shared_block);
+      sequence.block_table[block_index] = block;
+    }
+
+    uint8_t* data = blocks_[sequence.block_table[block_index]].get();
+    StoreEntries(keys + i * entry_size, n, index_in_block,
+                 data + RegionOffset(/*is_value=*/false, layer));
+    StoreEntries(values + i * entry_size, n, index_in_block,
+                 data + RegionOffset(/*is_value=*/true, layer));
+    i += n;
+    sequence.num_entries = std::max(sequence.num_entries, position + i);
+  }
+  return kTfLiteOk;
+}
+
+void PagedCacheBuffer::StoreEntries(const float* entries, int num_entries,
+                                    int index_in_block,
+                                    uint8_t* region) const {
+  uint8_t* data = region + ScalesBytes() + index_in_block * EntryBytes();
+  if (type_ == kTfLiteFloat32) {
+    std::memcpy(data, entries, num_entries * EntryBytes());
+    return;
+  }
+  float* scales =
+      reinterpret_cast<float*>(region) + index_in_block * num_heads_;
+  for (int i = 0; i < num_entries; ++i) {
+    QuantizeEntry(entries + i * entry_size(), num_heads_, head_dim_, type_,
+                  reinterpret_cast<int8_t*>(data + i * EntryBytes()),
+                  scales + i * num_heads_);
+  }
+}
+
+const uint8_t* PagedCacheBuffer::FindBlock(int sequence_id, int position,
+                                           int* index_in_block) const {
+  auto it = sequences_.find(sequence_id);
+  if (it == sequences_.end() || position < 0 ||
+      position >= it->second.num_entries) {
+    return nullptr;
+  }
+  *index_in_block = position % block_size_;
+  return blocks_[it->second.block_table[position / block_size_]].get();
+}
+
+const uint8_t* PagedCacheBuffer::GetEntry(int sequence_id, bool is_value,
+                                          int layer, int position) const {
+  int index_in_block;
+  const uint8_t* block = FindBlock(sequence_id, position, &index_in_block);
+  if (block == nullptr) return nullptr;
+  return block + RegionOffset(is_value, layer) + ScalesBytes() +
+         index_in_block * EntryBytes();
+}
+
+const float* PagedCacheBuffer::GetScales(int sequence_id, bool is_value,
+                                         int layer, int position) const {
+  int index_in_block;
+  const uint8_t* block = FindBlock(sequence_id, position, &index_in_block);
+  if (block == nullptr || type_ == kTfLiteFloat32) return nullptr;
+  return reinterpret_cast<const float*>(block +
+                                        RegionOffset(is_value, layer)) +
+         index_in_block * num_heads_;
+}
+
+int PagedCacheBuffer::AllocateBlock() {
+  int block;
+  if (!free_blocks_.empty()) {
+    block = free_blocks_.back();
+    free_blocks_.pop_back();
+  } else if (max_num_blocks_ == 0 ||
+             static_cast<int>(blocks_.size()) < max_num_blocks_) {
+    block = static_cast<int>(blocks_.size());
+    blocks_.emplace_back(new uint8_t[BlockBytes()]);
+    ref_counts_.push_back(0);
+  } else {
+    return -1;
+  }
+  ref_counts_[block] = 1;
+  return block;
+}
+
+void PagedCacheBuffer::UnrefBlock(int block) {
+  TFLITE_DCHECK_GT(ref_counts_[block], 0);
+  if (--ref_counts_[block] == 0) {
+    free_blocks_.push_back(block);
+  }
+}
+
+}  // namespace resource
+}  // namespace tflite
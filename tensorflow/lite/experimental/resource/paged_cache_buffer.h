@@ -0,0 +1,214 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_EXPERIMENTAL_RESOURCE_PAGED_CACHE_BUFFER_H_
+#define TENSORFLOW_LITE_EXPERIMENTAL_RESOURCE_PAGED_CACHE_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/lite/core/c/common.h"
+#include "tensorflow/lite/experimental/resource/resource_base.h"
+
+namespace tflite {
+namespace resource {
+
+/// WARNING: Experimental interface, subject to change.
+// A paged cache for the keys and values of the attention layers of a
+// transformer, holding any number of sequences. Unlike CacheBuffer, which
+// preallocates the longest possible sequence, the entries of a sequence are
+// stored in fixed-size blocks which are allocated as the sequence grows. The
+// block table of a sequence maps its i-th block of `block_size` entries to the
+// block storing them.
+//
+// A sequence can be forked from another one, e.g. to generate several
+// continuations of one prompt. The fork shares all blocks of its parent, and a
+// shared block is only copied when one of its sequences writes to it.
+//
+// A block holds its entries for all layers, so that all layers of a sequence
+// use the same block table.
+//
+// Entries can be stored as int8 or int4 instead of float, with a symmetric
+// scale per entry and head. This cuts the memory of the cache, and the memory
+// bandwidth of attention over it, by 4x or 8x.
+class PagedCacheBuffer : public ResourceBase {
+ public:
+  PagedCacheBuffer() = default;
+  PagedCacheBuffer(const PagedCacheBuffer&) = delete;
+  PagedCacheBuffer& operator=(const PagedCacheBuffer&) = delete;
+
+  // Initializes a cache for `num_layers` layers whose key and value entries
+  // hold `num_heads` heads of `head_dim` elements. The entries are stored as
+  // `type`, which is kTfLiteFloat32, kTfLiteInt8 or kTfLiteInt4. `head_dim`
+  // must be even for kTfLiteInt4. At most `max_num_blocks` blocks are
+  // allocated, or any number if it is 0.
+  TfLiteStatus Initialize(int num_layers, int block_size, int num_heads,
+                          int head_dim, int max_num_blocks,
+                          TfLiteType type = kTfLiteFloat32);
+
+  bool IsInitialized() override { return is_initialized_; }
+
+  size_t GetMemoryUsage() override { return blocks_.size() * BlockBytes(); }
+
+  int num_layers() const { return num_layers_; }
+  int block_size() const { return block_size_; }
+  int num_heads() const { return num_heads_; }
+  int head_dim() const { return head_dim_; }
+  // Number of elements of a key or value entry.
+  int entry_size() const { return num_heads_ * head_dim_; }
+  TfLiteType type() const { return type_; }
+
+  // Returns the number of blocks holding entries of at least one sequence.
+  int GetNumUsedBlocks() const {
+    return static_cast<int>(blocks_.size() - free_blocks_.size());
+  }
+
+  // Returns the number of allocated blocks. Blocks which are no longer used
+  // are kept for reuse by other sequences.
+  int GetNumAllocatedBlocks() const { return static_cast<int>(blocks_.size()); }
+
+  bool HasSequence(int sequence_id) const {
+    return sequences_.count(sequence_id) != 0;
+  }
+
+  // Returns the number of entries of a sequence, or 0 if it does not exist.
+  int GetNumEntries(int sequence_id) const;
+
+  // Creates sequence `dst_sequence_id` with the entries of `src_sequence_id`.
+  // The sequences share their blocks until they are written to.
+  TfLiteStatus ForkSequence(int src_sequence_id, int dst_sequence_id);
+
+  // Removes a sequence and frees the blocks it no longer shares.
+  void ReleaseSequence(int sequence_id);
+
+  // Writes the key and value entries of `layer` for the `num_entries`
+  // positions starting at `position`, creating the sequence if it does not
+  // exist. `keys` and `values` hold `num_entries * entry_size()` floats, which
+  // are quantized if the cache is. `position` must not be past the end of the
+  // sequence. The sequence then ends after the written entries, i.e. later
+  // entries are dropped. Fails if no block is left.
+  TfLiteStatus Write(int sequence_id, int layer, int position, int num_entries,
+                     const float* keys, const float* values);
+
+  // Returns the key or value entry of `layer` at `position` of a float32
+  // cache, or nullptr if there is none. The following entries up to the end
+  // of its block are stored after it.
+  const float* GetKeys(int sequence_id, int layer, int position) const {
+    return reinterpret_cast<const float*>(
+        GetEntry(sequence_id, /*is_value=*/false, layer, position));
+  }
+  const float* GetValues(int sequence_id, int layer, int position) const {
+    return reinterpret_cast<const float*>(
+        GetEntry(sequence_id, /*is_value=*/true, layer, position));
+  }
+
+  // Like GetKeys and GetValues, for int8 and int4 caches. An int4 entry packs
+  // two elements per byte, the first one in the low nibble.
+  const int8_t* GetQuantizedKeys(int sequence_id, int layer,
+                                 int position) const {
+    return reinterpret_cast<const int8_t*>(
+        GetEntry(sequence_id, /*is_value=*/false, layer, position));
+  }
+  const int8_t* GetQuantizedValues(int sequence_id, int layer,
+                                   int position) const {
+    return reinterpret_cast<const int8_t*>(
+        GetEntry(sequence_id, /*is_value=*/true, layer, position));
+  }
+
+  // Returns the `num_heads()` scales of a quantized key or value entry, such
+  // that an element of head `h` is `scales[h] * quantized_element`. The
+  // scales of the following entries up to the end of the block are stored
+  // after them.
+  const float* GetKeyScales(int sequence_id, int layer, int position) const {
+    return GetScales(sequence_id, /*is_value=*/false, layer, position);
+  }
+  const float* GetValueScales(int sequence_id, int layer,
+                              int position) const {
+    return GetScales(sequence_id, /*is_value=*/true, layer, position);
+  }
+
+  // Returns the number of bytes of a stored key or value entry.
+  size_t EntryBytes() const {
+    return type_ == kTfLiteFloat32  ? entry_size() * sizeof(float)
+           : type_ == kTfLiteInt8 ? entry_size()
+                                  : entry_size() / 2;
+  }
+
+ private:
+  struct Sequence {
+    // Indices into blocks_ of the blocks holding the entries of the sequence.
+    std::vector<int> block_table;
+    int num_entries = 0;
+  };
+
+  // A block holds a region for the keys and one for the values of each
+  // layer. A region holds the scales of its entries, if quantized, followed
+  // by the entries, padded to keep the scales of the next region aligned.
+  size_t ScalesBytes() const {
+    return type_ == kTfLiteFloat32
+               ? 0
+               : static_cast<size_t>(block_size_) * num_heads_ * sizeof(float);
+  }
+  size_t RegionBytes() const {
+    const size_t entries_bytes = block_size_ * EntryBytes();
+    return ScalesBytes() + (entries_bytes + sizeof(float) - 1) /
+                               sizeof(float) * sizeof(float);
+  }
+  size_t BlockBytes() const {
+    return static_cast<size_t>(num_layers_) * 2 * RegionBytes();
+  }
+  size_t RegionOffset(bool is_value, int layer) const {
+    return (static_cast<size_t>(layer) * 2 + is_value) * RegionBytes();
+  }
+
+  // Returns the block and index in it of `position` of a sequence, or nullptr
+  // if the sequence has no such entry.
+  const uint8_t* FindBlock(int sequence_id, int position,
+                           int* index_in_block) const;
+  const uint8_t* GetEntry(int sequence_id, bool is_value, int layer,
+                          int position) const;
+  const float* GetScales(int sequence_id, bool is_value, int layer,
+                         int position) const;
+
+  // Stores `num_entries` float entries at `index_in_block` of a region.
+  void StoreEntries(const float* entries, int num_entries, int index_in_block,
+                    uint8_t* region) const;
+
+  // Returns a free block with a reference count of 1, or -1 if
+  // `max_num_blocks_` blocks are in use.
+  int AllocateBlock();
+  void UnrefBlock(int block);
+
+  int num_layers_ = 0;
+  int block_size_ = 0;
+  int num_heads_ = 0;
+  int head_dim_ = 0;
+  int max_num_blocks_ = 0;
+  TfLiteType type_ = kTfLiteFloat32;
+  bool is_initialized_ = false;
+
+  std::vector<std::unique_ptr<uint8_t[]>> blocks_;
+  // Number of sequences using each block.
+  std::vector<int> ref_counts_;
+  std::vector<int> free_blocks_;
+  std::unordered_map<int, Sequence> sequences_;
+};
+
+}  // namespace resource
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_EXPERIMENTAL_RESOURCE_PAGED_CACHE_BUFFER_H_
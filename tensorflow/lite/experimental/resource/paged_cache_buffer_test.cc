@@ -0,0 +1,244 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/experimental/resource/paged_cache_buffer.h"
+
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "tensorflow/lite/core/c/common.h"
+
+namespace tflite {
+namespace resource {
+namespace {
+
+constexpr int kNumLayers = 2;
+constexpr int kBlockSize = 4;
+constexpr int kNumHeads = 2;
+constexpr int kHeadDim = 2;
+constexpr int kEntrySize = kNumHeads * kHeadDim;
+
+// Returns `num_entries` entries with distinct values starting at `first`.
+std::vector<float> Entries(float first, int num_entries) {
+  std::vector<float> entries(num_entries * kEntrySize);
+  for (int i = 0; i < entries.size(); ++i) {
+    entries[i] = first + i;
+  }
+  return entries;
+}
+
+void ExpectEntries(const PagedCacheBuffer& cache, int sequence_id, int layer,
+                   int position, const std::vector<float>& keys,
+                   const std::vector<float>& values) {
+  for (int i = 0; i < keys.size() / kEntrySize; ++i) {
+    const float* k = cache.GetKeys(sequence_id, layer, position + i);
+    const float* v = cache.GetValues(sequence_id, layer, position + i);
+    ASSERT_NE(k, nullptr);
+    ASSERT_NE(v, nullptr);
+    for (int j = 0; j < kEntrySize; ++j) {
+      EXPECT_EQ(k[j], keys[i * kEntrySize + j]) << "position " << position + i;
+      EXPECT_EQ(v[j], values[i * kEntrySize + j])
+          << "position " << position + i;
+    }
+  }
+}
+
+TEST(PagedCacheBufferTest, AllocatesBlocksAsSequencesGrow) {
+  PagedCacheBuffer cache;
+  ASSERT_EQ(cache.Initialize(kNumLayers, kBlockSize, kNumHeads, kHeadDim,
+                             /*max_num_blocks=*/0),
+            kTfLiteOk);
+  EXPECT_EQ(cache.GetMemoryUsage(), 0);
+
+  const std::vector<float> k0 = Entries(0, 6);
+  const std::vector<float> v0 = Entries(100, 6);
+  const std::vector<float> k1 = Entries(200, 6);
+  const std::vector<float> v1 = Entries(300, 6);
+  ASSERT_EQ(cache.Write(7, 0, 0, 6, k0.data(), v0.data()), kTfLiteOk);
+  ASSERT_EQ(cache.Write(7, 1, 0, 6, k1.data(), v1.data()), kTfLiteOk);
+  EXPECT_EQ(cache.GetNumEntries(7), 6);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 2);
+  EXPECT_EQ(cache.GetMemoryUsage(),
+            2 * kNumLayers * 2 * kBlockSize * kEntrySize * sizeof(float));
+  ExpectEntries(cache, 7, 0, 0, k0, v0);
+  ExpectEntries(cache, 7, 1, 0, k1, v1);
+  EXPECT_EQ(cache.GetKeys(7, 0, 6), nullptr);
+
+  // Entries can only be appended or overwritten.
+  EXPECT_EQ(cache.Write(7, 0, 7, 1, k0.data(), v0.data()), kTfLiteError);
+  ASSERT_EQ(cache.Write(7, 0, 6, 1, k1.data(), v1.data()), kTfLiteOk);
+  EXPECT_EQ(cache.GetNumEntries(7), 7);
+
+  // Overwriting an earlier position drops the later entries.
+  ASSERT_EQ(cache.Write(7, 0, 2, 1, k1.data(), v1.data()), kTfLiteOk);
+  EXPECT_EQ(cache.GetNumEntries(7), 3);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 1);
+  EXPECT_EQ(cache.GetNumAllocatedBlocks(), 2);
+
+  cache.ReleaseSequence(7);
+  EXPECT_FALSE(cache.HasSequence(7));
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 0);
+}
+
+TEST(PagedCacheBufferTest, ForkedSequencesCopyOnWrite) {
+  PagedCacheBuffer cache;
+  ASSERT_EQ(cache.Initialize(kNumLayers, kBlockSize, kNumHeads, kHeadDim,
+                             /*max_num_blocks=*/0),
+            kTfLiteOk);
+
+  const std::vector<float> prompt_k = Entries(0, 6);
+  const std::vector<float> prompt_v = Entries(100, 6);
+  for (int layer = 0; layer < kNumLayers; ++layer) {
+    ASSERT_EQ(cache.Write(0, layer, 0, 6, prompt_k.data(), prompt_v.data()),
+              kTfLiteOk);
+  }
+  ASSERT_EQ(cache.ForkSequence(0, 1), kTfLiteOk);
+  EXPECT_EQ(cache.ForkSequence(0, 1), kTfLiteError);
+  EXPECT_EQ(cache.ForkSequence(2, 3), kTfLiteError);
+  EXPECT_EQ(cache.GetNumEntries(1), 6);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 2);
+
+  // Appending to the fork copies the partially filled last block only.
+  const std::vector<float> k1 = Entries(200, 1);
+  const std::vector<float> v1 = Entries(300, 1);
+  for (int layer = 0; layer < kNumLayers; ++layer) {
+    ASSERT_EQ(cache.Write(1, layer, 6, 1, k1.data(), v1.data()), kTfLiteOk);
+  }
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 3);
+  EXPECT_EQ(cache.GetKeys(0, 0, 0), cache.GetKeys(1, 0, 0));
+  EXPECT_NE(cache.GetKeys(0, 0, 4), cache.GetKeys(1, 0, 4));
+  for (int layer = 0; layer < kNumLayers; ++layer) {
+    ExpectEntries(cache, 0, layer, 0, prompt_k, prompt_v);
+    ExpectEntries(cache, 1, layer, 0, prompt_k, prompt_v);
+    ExpectEntries(cache, 1, layer, 6, k1, v1);
+  }
+  EXPECT_EQ(cache.GetNumEntries(0), 6);
+
+  // The shared block is freed once neither sequence uses it.
+  cache.ReleaseSequence(0);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 2);
+  ExpectEntries(cache, 1, 0, 0, prompt_k, prompt_v);
+  cache.ReleaseSequence(1);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 0);
+  EXPECT_EQ(cache.GetNumAllocatedBlocks(), 3);
+}
+
+TEST(PagedCacheBufferTest, FailsWhenOutOfBlocks) {
+  PagedCacheBuffer cache;
+  ASSERT_EQ(cache.Initialize(kNumLayers, kBlockSize, kNumHeads, kHeadDim,
+                             /*max_num_blocks=*/2),
+            kTfLiteOk);
+  const std::vector<float> k = Entries(0, 9);
+  const std::vector<float> v = Entries(100, 9);
+  ASSERT_EQ(cache.Write(0, 0, 0, 8, k.data(), v.data()), kTfLiteOk);
+  EXPECT_EQ(cache.Write(0, 0, 8, 1, k.data(), v.data()), kTfLiteError);
+  ASSERT_EQ(cache.ForkSequence(0, 1), kTfLiteOk);
+  EXPECT_EQ(cache.Write(1, 0, 0, 1, k.data(), v.data()), kTfLiteError);
+
+  // Released blocks are reused.
+  cache.ReleaseSequence(0);
+  ASSERT_EQ(cache.Write(1, 0, 0, 8, k.data(), v.data()), kTfLiteOk);
+  EXPECT_EQ(cache.GetNumUsedBlocks(), 2);
+  EXPECT_EQ(cache.GetNumAllocatedBlocks(), 2);
+}
+
+void TestQuantizedEntries(TfLiteType type, float max_quantized) {
+  PagedCacheBuffer cache;
+  ASSERT_EQ(cache.Initialize(kNumLayers, kBlockSize, kNumHeads, kHeadDim,
+                             /*max_num_blocks=*/0, type),
+            kTfLiteOk);
+  std::vector<float> keys = Entries(-3, 6);
+  std::vector<float> values = Entries(1, 6);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = std::sin(keys[i]);
+    values[i] = std::cos(values[i]) * 10;
+  }
+  for (int layer = 0; layer < kNumLayers; ++layer) {
+    ASSERT_EQ(cache.Write(0, layer, 0, 6, keys.data(), values.data()),
+              kTfLiteOk);
+  }
+  ASSERT_EQ(cache.ForkSequence(0, 1), kTfLiteOk);
+  ASSERT_EQ(cache.Write(1, 1, 5, 1, values.data(), keys.data()), kTfLiteOk);
+
+  auto dequantize = [&](const int8_t* entry, int index) {
+    if (type == kTfLiteInt8) return static_cast<float>(entry[index]);
+    // The first element of a byte is in its low nibble.
+    const uint8_t byte = static_cast<uint8_t>(entry[index / 2]);
+    const int element = index % 2 == 0 ? static_cast<int8_t>(byte << 4) >> 4
+                                       : static_cast<int8_t>(byte) >> 4;
+    return static_cast<float>(element);
+  };
+  for (int position = 0; position < 6; ++position) {
+    const int8_t* k = cache.GetQuantizedKeys(0, 1, position);
+    const int8_t* v = cache.GetQuantizedValues(0, 1, position);
+    const float* k_scales = cache.GetKeyScales(0, 1, position);
+    const float* v_scales = cache.GetValueScales(0, 1, position);
+    ASSERT_NE(k, nullptr);
+    ASSERT_NE(k_scales, nullptr);
+    for (int h = 0; h < kNumHeads; ++h) {
+      for (int d = 0; d < kHeadDim; ++d) {
+        const int i = position * kEntrySize + h * kHeadDim + d;
+        const int index = h * kHeadDim + d;
+        // Rounding to the nearest quantized value is off by half a step at
+        // most, and the largest magnitude of each head is exact.
+        EXPECT_NEAR(k_scales[h] * dequantize(k, index), keys[i],
+                    k_scales[h] / 2 + 1e-6);
+        EXPECT_NEAR(v_scales[h] * dequantize(v, index), values[i],
+                    v_scales[h] / 2 + 1e-6);
+        EXPECT_LE(std::fabs(keys[i]), k_scales[h] * max_quantized + 1e-6);
+      }
+    }
+  }
+  // The fork wrote to its own copy of the block.
+  EXPECT_NE(cache.GetKeyScales(1, 1, 5)[0], cache.GetKeyScales(0, 1, 5)[0]);
+  EXPECT_EQ(cache.GetKeyScales(1, 0, 5)[0], cache.GetKeyScales(0, 0, 5)[0]);
+}
+
+TEST(PagedCacheBufferTest, Int8Entries) {
+  TestQuantizedEntries(kTfLiteInt8, 127);
+}
+
+TEST(PagedCacheBufferTest, Int4Entries) {
+  TestQuantizedEntries(kTfLiteInt4, 7);
+}
+
+TEST(PagedCacheBufferTest, QuantizedBlocksAreSmaller) {
+  std::vector<float> entries = Entries(1, 1);
+  size_t memory_usage[3];
+  const TfLiteType types[3] = {kTfLiteFloat32, kTfLiteInt8, kTfLiteInt4};
+  for (int i = 0; i < 3; ++i) {
+    PagedCacheBuffer cache;
+    ASSERT_EQ(cache.Initialize(kNumLayers, kBlockSize, /*num_heads=*/1,
+                               /*head_dim=*/64, /*max_num_blocks=*/0,
+                               types[i]),
+              kTfLiteOk);
+    std::vector<float> entry(64, 1.0f);
+    ASSERT_EQ(cache.Write(0, 0, 0, 1, entry.data(), entry.data()), kTfLiteOk);
+    memory_usage[i] = cache.GetMemoryUsage();
+  }
+  // Each entry of 64 elements has a scale of 4 bytes.
+  EXPECT_EQ(memory_usage[0], kNumLayers * 2 * kBlockSize * 64 * 4);
+  EXPECT_EQ(memory_usage[1], kNumLayers * 2 * kBlockSize * (64 + 4));
+  EXPECT_EQ(memory_usage[2], kNumLayers * 2 * kBlockSize * (32 + 4));
+
+  PagedCacheBuffer odd_head_dim;
+  EXPECT_EQ(odd_head_dim.Initialize(kNumLayers, kBlockSize, 2, 3, 0,
+                                    kTfLiteInt4),
+            kTfLiteError);
+}
+
+}  // namespace
+}  // namespace resource
+}  // namespace tflite
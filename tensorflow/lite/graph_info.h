@@ -70,6 +70,15 @@ class GraphInfo {
 
   // Returns the indices of the variable tensors.
   virtual const std::vector<int>& variables() const = 0;
+
+  // Returns the range [first, last] of execution plan indices of the nodes
+  // which may run concurrently with the node at execution plan index `index`.
+  // Tensors used by nodes in the same range are live at the same time, so a
+  // memory planner must not let them share memory. By default nodes run one at
+  // a time.
+  virtual std::pair<size_t, size_t> concurrent_nodes(size_t index) const {
+    return {index, index};
+  }
 };
 
 // Represents a subset of nodes in a TensorFlow Lite graph.
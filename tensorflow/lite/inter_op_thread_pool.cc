@@ -0,0 +1,93 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/inter_op_thread_pool.h"
+
+#include <functional>
+#include <mutex>  // NOLINT(build/c++11)
+
+namespace tflite {
+
+InterOpThreadPool::InterOpThreadPool(int num_threads) {
+  for (int thread_id = 1; thread_id < num_threads; ++thread_id) {
+    workers_.emplace_back([this, thread_id] { WorkerLoop(thread_id); });
+  }
+}
+
+InterOpThreadPool::~InterOpThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  batch_started_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void InterOpThreadPool::Run(int num_tasks,
+                            const std::function<void(int, int)>& task) {
+  if (workers_.empty() || num_tasks <= 1) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(/*thread_id=*/0, i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_index_.store(0, std::memory_order_relaxed);
+    num_busy_workers_ = static_cast<int>(workers_.size());
+    ++batch_id_;
+  }
+  batch_started_.notify_all();
+
+  RunTasks(/*thread_id=*/0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  batch_done_.wait(lock, [this] { return num_busy_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void InterOpThreadPool::RunTasks(int thread_id) {
+  for (int i = next_task_index_.fetch_add(1, std::memory_order_relaxed);
+       i < num_tasks_;
+       i = next_task_index_.fetch_add(1, std::memory_order_relaxed)) {
+    (*task_)(thread_id, i);
+  }
+}
+
+void InterOpThreadPool::WorkerLoop(int thread_id) {
+  uint64_t last_batch_id = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      batch_started_.wait(
+          lock, [&] { return stopping_ || batch_id_ != last_batch_id; });
+      if (stopping_) return;
+      last_batch_id = batch_id_;
+    }
+
+    RunTasks(thread_id);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--num_busy_workers_ == 0) {
+      batch_done_.notify_one();
+    }
+  }
+}
+
+}  // namespace tflite
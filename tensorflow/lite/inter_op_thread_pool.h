@@ -0,0 +1,80 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
+#define TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <functional>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+namespace tflite {
+
+// A fixed-size pool of threads which runs batches of independent tasks. It is
+// used by the interpreter to invoke independent nodes of the execution plan
+// concurrently, see `InterpreterOptions::SetNumInterOpThreads`.
+//
+// This class is not thread-safe: only one thread may call `Run` at a time.
+class InterOpThreadPool {
+ public:
+  // Creates a pool which runs tasks on the thread calling `Run` and on
+  // `num_threads - 1` worker threads.
+  explicit InterOpThreadPool(int num_threads);
+  ~InterOpThreadPool();
+
+  InterOpThreadPool(const InterOpThreadPool&) = delete;
+  InterOpThreadPool& operator=(const InterOpThreadPool&) = delete;
+
+  // Returns the number of threads tasks may run on, including the calling
+  // thread.
+  int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls `task(thread_id, task_index)` for every `task_index` in
+  // [0, num_tasks), and returns once all calls have returned. `thread_id` is
+  // in [0, num_threads()), where 0 denotes the calling thread; tasks with the
+  // same `thread_id` never run concurrently.
+  void Run(int num_tasks, const std::function<void(int, int)>& task);
+
+ private:
+  // Runs tasks of the current batch on thread `thread_id` until none are left.
+  void RunTasks(int thread_id);
+
+  void WorkerLoop(int thread_id);
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  // Signaled when a new batch is started or the pool is destroyed.
+  std::condition_variable batch_started_;
+  // Signaled when the last worker finished its part of the current batch.
+  std::condition_variable batch_done_;
+  // Incremented for every batch, so that workers can tell new batches apart.
+  uint64_t batch_id_ = 0;
+  // Number of workers which did not finish the current batch yet.
+  int num_busy_workers_ = 0;
+  bool stopping_ = false;
+
+  // The current batch. Only written by `Run` while no worker is busy.
+  const std::function<void(int, int)>* task_ = nullptr;
+  int num_tasks_ = 0;
+  std::atomic<int> next_task_index_{0};
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_INTER_OP_THREAD_POOL_H_
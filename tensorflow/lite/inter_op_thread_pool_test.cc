@@ -0,0 +1,62 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/inter_op_thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace tflite {
+namespace {
+
+TEST(InterOpThreadPoolTest, RunsEveryTaskOnce) {
+  InterOpThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  for (int num_tasks : {0, 1, 3, 4, 100}) {
+    std::vector<std::atomic<int>> runs(num_tasks);
+    pool.Run(num_tasks, [&](int thread_id, int task_index) {
+      EXPECT_GE(thread_id, 0);
+      EXPECT_LT(thread_id, 4);
+      ++runs[task_index];
+    });
+    for (int i = 0; i < num_tasks; ++i) {
+      EXPECT_EQ(runs[i], 1) << "task " << i << " of " << num_tasks;
+    }
+  }
+}
+
+TEST(InterOpThreadPoolTest, ThreadIdsAreNotUsedConcurrently) {
+  InterOpThreadPool pool(3);
+  std::vector<std::atomic<int>> running(pool.num_threads());
+  pool.Run(1000, [&](int thread_id, int task_index) {
+    EXPECT_EQ(++running[thread_id], 1);
+    --running[thread_id];
+  });
+}
+
+TEST(InterOpThreadPoolTest, SingleThreadRunsOnCaller) {
+  InterOpThreadPool pool(1);
+  EXPECT_EQ(pool.num_threads(), 1);
+  int sum = 0;
+  pool.Run(10, [&](int thread_id, int task_index) {
+    EXPECT_EQ(thread_id, 0);
+    sum += task_index;
+  });
+  EXPECT_EQ(sum, 45);
+}
+
+}  // namespace
+}  // namespace tflite
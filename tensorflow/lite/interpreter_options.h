@@ -103,12 +103,81 @@ class InterpreterOptions {
     return experimental_cache_constant_cast_op_;
   }
 
+  // If set to `true`, nodes whose inputs are all constant tensors or outputs
+  // of such nodes, e.g. a chain of DEQUANTIZE, RESHAPE and TRANSPOSE on
+  // weights, are invoked once when tensors are allocated instead of on every
+  // `Invoke`. Their outputs which are read by nodes that are still invoked, or
+  // are outputs of the subgraph, are kept in persistent memory, which grows by
+  // their size. This generalizes `SetCacheConstantCastOp` to all builtin ops
+  // without side effects.
+  //
+  // Custom ops, delegated nodes, control flow ops and ops using variables,
+  // resources or random numbers are never cached, nor are nodes with dynamic
+  // outputs.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  void SetCacheConstantSubgraphs(bool value) {
+    experimental_cache_constant_subgraphs_ = value;
+  }
+
+  // Returns whether the outputs of constant nodes are cached, see
+  // `SetCacheConstantSubgraphs`.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  bool GetCacheConstantSubgraphs() const {
+    return experimental_cache_constant_subgraphs_;
+  }
+
+  // Invokes independent nodes of the execution plan, e.g. the towers of a
+  // multi-tower model, concurrently on up to `num_threads` threads, including
+  // the thread calling `Invoke`. Nodes are grouped into levels such that the
+  // nodes of a level only depend on nodes of earlier levels, and the levels
+  // are run one after the other. Values less than 2 disable this.
+  //
+  // Each thread uses its own CPU backend context with `num_threads` of the
+  // interpreter, so the two thread counts should be chosen together to avoid
+  // oversubscribing the CPU. Delegated nodes, control flow ops, custom ops and
+  // ops accessing variables or resources always run alone. Subgraphs with
+  // dynamic tensors, profilers or `OptimizeMemoryForLargeTensors` run their
+  // nodes one at a time. The memory planner does not reuse memory across
+  // nodes of the same level, so peak memory usage may grow.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  void SetNumInterOpThreads(int num_threads) {
+    experimental_num_inter_op_threads_ = num_threads;
+  }
+
+  // Returns the number of threads set by `SetNumInterOpThreads`.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  int GetNumInterOpThreads() const {
+    return experimental_num_inter_op_threads_;
+  }
+
+  // If set to `true`, variable tensors, e.g. the states of the sequence RNN
+  // and LSTM ops, keep their values when tensors are reallocated, so that a
+  // stream can be fed in chunks of varying length by resizing the inputs
+  // between invocations. Variable tensors are zeroed when first allocated or
+  // when their shape changes, and otherwise only by `ResetVariableTensors`.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  void SetStreamingMode(bool value) { experimental_streaming_mode_ = value; }
+
+  // Returns whether variable tensors keep their values when tensors are
+  // reallocated, see `SetStreamingMode`.
+  //
+  // WARNING: This is an experimental API and subject to change.
+  bool GetStreamingMode() const { return experimental_streaming_mode_; }
+
  private:
   bool experimental_preserve_all_tensors_ = false;
   bool experimental_ensure_dynamic_tensors_are_released_ = false;
   int experimental_optimize_memory_for_large_tensors_ = 0;
   bool experimental_disable_delegate_clustering_ = false;
   bool experimental_cache_constant_cast_op_ = false;
+  bool experimental_cache_constant_subgraphs_ = false;
+  int experimental_num_inter_op_threads_ = 0;
+  bool experimental_streaming_mode_ = false;
 };
 
 }  // namespace tflite
@@ -20,6 +20,8 @@ limitations under the License.
 #include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <utility>
+#include <vector>
 
 #include "tensorflow/lite/core/c/builtin_op_data.h"
 #include "tensorflow/lite/core/c/common.h"
@@ -27,11 +29,13 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/kernels/internal/optimized/batch_matmul.h"
 #include "tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/fully_connected.h"
 #include "tensorflow/lite/kernels/internal/reference/reference_ops.h"
 #include "tensorflow/lite/kernels/internal/tensor.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/internal/tensor_utils.h"
 #include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/kernels/internal/utils/sparsity_format_converter.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 
 namespace tflite {
@@ -65,6 +69,17 @@ struct OpData {
   int scratch_tensor_index;
   bool rhs_transposed;
   bool compute_row_sums = false;
+  // A constant sparse RHS is re-encoded once as a block sparse matrix of
+  // [num_units, accum_depth], the layout of the sparse FullyConnected weights.
+  bool has_sparse_rhs = false;
+  int sparse_rhs_rows;
+  int sparse_rhs_cols;
+  int sparse_rhs_block_rows;
+  int sparse_rhs_block_cols;
+  std::vector<int> sparse_rhs_segments;
+  std::vector<int> sparse_rhs_indices;
+  std::vector<float> sparse_rhs_float_values;
+  std::vector<int8_t> sparse_rhs_int8_values;
 };
 
 struct OpContext {
@@ -190,6 +205,10 @@ TfLiteStatus InitializeTemporaries(TfLiteContext* context, TfLiteNode* node,
     // Swap last two dimensions.
     scratch_buffer_size->data[rhs_rank - 2] = rhs->dims->data[rhs_rank - 1];
     scratch_buffer_size->data[rhs_rank - 1] = rhs->dims->data[rhs_rank - 2];
+    // A sparse RHS is transposed as it is re-encoded into the op data.
+    if (rhs->sparsity != nullptr) {
+      scratch_buffer_size->data[rhs_rank - 1] = 0;
+    }
 
     if (IsConstantTensor(op_context->rhs)) {
       scratch_buffer->allocation_type = kTfLiteArenaRwPersistent;
@@ -291,6 +310,101 @@ TfLiteStatus InitializeTemporaries(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+// Re-encodes the constant sparse RHS [accum_depth, num_units], or
+// [num_units, accum_depth] if adj_y, as a block sparse matrix of
+// [num_units, accum_depth], transposing its blocks along with it.
+template <typename T>
+TfLiteStatus EncodeSparseRhs(TfLiteContext* context, const TfLiteTensor* rhs,
+                             bool adj_y, OpData* op_data,
+                             std::vector<T>* values) {
+  // Verifies the segments, indices and number of values of the RHS before
+  // decoding it.
+  optimized_ops::BlockSparseMatrix<T> rhs_matrix;
+  if (!optimized_ops::GetBlockSparseMatrix(
+          *rhs->sparsity, GetTensorShape(rhs), GetTensorData<T>(rhs),
+          rhs->bytes / sizeof(T), &rhs_matrix)) {
+    TF_LITE_KERNEL_LOG(context, "Unsupported sparse BatchMatMul RHS format.");
+    return kTfLiteError;
+  }
+  int block_rows = rhs_matrix.block_rows;
+  int block_cols = rhs_matrix.block_cols;
+  const int rhs_rows = rhs_matrix.rows;
+  const int rhs_cols = rhs_matrix.cols;
+  internal::sparsity::FormatConverter<T> decoder({rhs_rows, rhs_cols},
+                                                 *rhs->sparsity);
+  TF_LITE_ENSURE_OK(context, decoder.SparseToDense(GetTensorData<T>(rhs)));
+  std::vector<T> dense = decoder.GetData();
+  int rows = rhs_rows;
+  int cols = rhs_cols;
+  if (!adj_y) {
+    std::swap(rows, cols);
+    std::swap(block_rows, block_cols);
+    for (int i = 0; i < rhs_rows; ++i) {
+      for (int j = 0; j < rhs_cols; ++j) {
+        dense[j * rhs_rows + i] = decoder.GetData()[i * rhs_cols + j];
+      }
+    }
+  }
+  if (!optimized_ops::IsSupportedSparseBlockShape(block_rows, block_cols) ||
+      rows % block_rows != 0 || cols % block_cols != 0) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Unsupported %dx%d block size of sparse BatchMatMul "
+                       "RHS.",
+                       block_rows, block_cols);
+    return kTfLiteError;
+  }
+
+  std::vector<int> traversal_order = {0, 1};
+  std::vector<TfLiteDimensionType> format = {kTfLiteDimDense,
+                                             kTfLiteDimSparseCSR};
+  std::vector<int> block_size;
+  std::vector<int> block_map;
+  const int block_shape[2] = {block_rows, block_cols};
+  for (int i = 0; i < 2; ++i) {
+    if (block_shape[i] > 1) {
+      traversal_order.push_back(static_cast<int>(traversal_order.size()));
+      format.push_back(kTfLiteDimDense);
+      block_size.push_back(block_shape[i]);
+      block_map.push_back(i);
+    }
+  }
+  internal::sparsity::FormatConverter<T> encoder(
+      {rows, cols}, traversal_order, format, block_size, block_map);
+  TF_LITE_ENSURE_OK(context, encoder.DenseToSparse(dense.data()));
+  op_data->sparse_rhs_rows = rows;
+  op_data->sparse_rhs_cols = cols;
+  op_data->sparse_rhs_block_rows = block_rows;
+  op_data->sparse_rhs_block_cols = block_cols;
+  op_data->sparse_rhs_segments = encoder.GetDimMetadata()[2];
+  op_data->sparse_rhs_indices = encoder.GetDimMetadata()[3];
+  *values = encoder.GetData();
+  op_data->has_sparse_rhs = true;
+  return kTfLiteOk;
+}
+
+TfLiteStatus PrepareSparseRhs(TfLiteContext* context, const TfLiteTensor* lhs,
+                              const TfLiteTensor* rhs,
+                              const TfLiteTensor* output, bool adj_y,
+                              OpData* op_data) {
+  // The RHS is constant, so it is only encoded once.
+  if (op_data->has_sparse_rhs) return kTfLiteOk;
+  TF_LITE_ENSURE(context, IsConstantTensor(rhs));
+  TF_LITE_ENSURE_EQ(context, NumDimensions(rhs), 2);
+  if (lhs->type == kTfLiteFloat32 && rhs->type == kTfLiteFloat32) {
+    return EncodeSparseRhs(context, rhs, adj_y, op_data,
+                           &op_data->sparse_rhs_float_values);
+  }
+  if (lhs->type == kTfLiteInt8 && rhs->type == kTfLiteInt8 &&
+      output->type == kTfLiteInt8) {
+    TF_LITE_ENSURE_EQ(context, rhs->params.zero_point, 0);
+    return EncodeSparseRhs(context, rhs, adj_y, op_data,
+                           &op_data->sparse_rhs_int8_values);
+  }
+  TF_LITE_KERNEL_LOG(context,
+                     "Sparse BatchMatMul RHS supports float and int8 only.");
+  return kTfLiteError;
+}
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, NumInputs(node), 2);
   TF_LITE_ENSURE_EQ(context, NumOutputs(node), 1);
@@ -356,6 +470,11 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE(context, NumDimensions(lhs_data) <= 5);
   TF_LITE_ENSURE(context, NumDimensions(rhs_data) >= 2);
   TF_LITE_ENSURE(context, NumDimensions(rhs_data) <= 5);
+  if (rhs_data->sparsity != nullptr) {
+    TF_LITE_ENSURE_OK(context,
+                      PrepareSparseRhs(context, lhs_data, rhs_data, output,
+                                       adj_y, op_data));
+  }
 
   const int lhs_rank = NumDimensions(lhs_data);
   const int rhs_rank = NumDimensions(rhs_data);
@@ -693,6 +812,64 @@ TfLiteTensor* GetTempLhs(TfLiteContext* context, TfLiteNode* node,
   return transposed_lhs;
 }
 
+// Multiplies the LHS with the sparse RHS, which is broadcast to its batches.
+// This is a FullyConnected with the re-encoded RHS as weights.
+TfLiteStatus EvalSparseRhs(TfLiteContext* context, TfLiteNode* node,
+                           OpData* op_data, const TfLiteTensor* lhs,
+                           TfLiteTensor* output) {
+  const auto* params =
+      reinterpret_cast<TfLiteBatchMatMulParams*>(node->builtin_data);
+  const TfLiteTensor* lhs_tensor = lhs;
+  if (params->adj_x) {
+    lhs_tensor = GetTempLhs(context, node, lhs);
+    TF_LITE_ENSURE_OK(context,
+                      TransposeRowsColumns(context, lhs,
+                                           GetTemporary(context, node, 0)));
+  }
+  FullyConnectedParams op_params;
+  CpuBackendContext* cpu_backend_context =
+      CpuBackendContext::GetFromContext(context);
+  if (lhs->type == kTfLiteFloat32) {
+    op_params.float_activation_min = std::numeric_limits<float>::lowest();
+    op_params.float_activation_max = std::numeric_limits<float>::max();
+    const optimized_ops::BlockSparseMatrix<float> rhs_matrix = {
+        op_data->sparse_rhs_rows,
+        op_data->sparse_rhs_cols,
+        op_data->sparse_rhs_block_rows,
+        op_data->sparse_rhs_block_cols,
+        op_data->sparse_rhs_segments.data(),
+        op_data->sparse_rhs_indices.data(),
+        op_data->sparse_rhs_float_values.data()};
+    optimized_ops::FullyConnectedBlockSparseWeight(
+        rhs_matrix, op_params, GetTensorShape(lhs_tensor),
+        GetTensorData<float>(lhs_tensor), RuntimeShape(), nullptr,
+        GetTensorShape(output), GetTensorData<float>(output),
+        cpu_backend_context);
+  } else {
+    op_params.input_offset = -lhs->params.zero_point;
+    op_params.output_offset = output->params.zero_point;
+    op_params.output_multiplier = op_data->output_multiplier;
+    op_params.output_shift = op_data->output_shift;
+    op_params.quantized_activation_min = op_data->output_activation_min;
+    op_params.quantized_activation_max = op_data->output_activation_max;
+    const optimized_ops::BlockSparseMatrix<int8_t> rhs_matrix = {
+        op_data->sparse_rhs_rows,
+        op_data->sparse_rhs_cols,
+        op_data->sparse_rhs_block_rows,
+        op_data->sparse_rhs_block_cols,
+        op_data->sparse_rhs_segments.data(),
+        op_data->sparse_rhs_indices.data(),
+        op_data->sparse_rhs_int8_values.data()};
+    optimized_ops::FullyConnectedBlockSparseWeight(
+        rhs_matrix, op_params, /*per_channel_scale=*/nullptr,
+        /*per_channel_shift=*/nullptr, GetTensorShape(lhs_tensor),
+        GetTensorData<int8_t>(lhs_tensor), RuntimeShape(), nullptr,
+        GetTensorShape(output), GetTensorData<int8_t>(output),
+        cpu_backend_context);
+  }
+  return kTfLiteOk;
+}
+
 // Perform a batch matrix multiply on
 // LHS <..., A, B>  X  RHS<..., B, C>
 // where the leading dimensions of LHS and RHS obey broadcasting rules
@@ -717,6 +894,9 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   TfLiteTensor* output;
   TF_LITE_ENSURE_OK(context,
                     GetOutputSafe(context, node, kOutputTensor, &output));
+  if (op_data->has_sparse_rhs) {
+    return EvalSparseRhs(context, node, op_data, lhs, output);
+  }
   RuntimeShape orig_lhs_shape = GetTensorShape(lhs);
   RuntimeShape orig_rhs_shape = GetTensorShape(rhs);
 
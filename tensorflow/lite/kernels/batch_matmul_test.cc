@@ -19,7 +19,9 @@ limitations under the License.
 #include <limits>
 #include <map>
 #include <numeric>
+#include <random>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <gmock/gmock.h>
@@ -422,6 +424,168 @@ TEST(ConstRHSBatchMatMulOpModel, RHSNotAdjoint) {
   EXPECT_THAT(model.GetOutputShape(), ElementsAreArray({1, 6, 3}));
 }
 
+// A BatchMatMul whose RHS is a constant 2D tensor sparsified in blocks of
+// `block_rows` x `block_cols`, in the format of the converter.
+class SparseConstRHSBatchMatMulOpModel : public SingleOpModel {
+ public:
+  SparseConstRHSBatchMatMulOpModel(const TensorData& lhs, TensorData rhs,
+                                   const std::vector<float>& rhs_data,
+                                   int block_rows, int block_cols,
+                                   const TensorData& output, bool adj_x,
+                                   bool adj_y) {
+    rhs.traversal_order = {0, 1};
+    rhs.format = {kTfLiteDimDense, kTfLiteDimSparseCSR};
+    const int block_shape[2] = {block_rows, block_cols};
+    for (int i = 0; i < 2; ++i) {
+      if (block_shape[i] > 1) {
+        rhs.traversal_order.push_back(
+            static_cast<int>(rhs.traversal_order.size()));
+        rhs.block_map.push_back(i);
+        rhs.block_size.push_back(block_shape[i]);
+      }
+    }
+    lhs_id_ = AddInput(lhs);
+    rhs_id_ = AddConstSparseInput(rhs, rhs_data);
+    output_id_ = AddOutput(output);
+    SetBuiltinOp(BuiltinOperator_BATCH_MATMUL,
+                 BuiltinOptions_BatchMatMulOptions,
+                 CreateBatchMatMulOptions(builder_, adj_x, adj_y).Union());
+    BuildInterpreter({GetShape(lhs_id_), GetShape(rhs_id_)});
+  }
+
+  int lhs() const { return lhs_id_; }
+  template <typename T>
+  std::vector<T> GetOutput() {
+    return ExtractVector<T>(output_id_);
+  }
+  std::vector<int32_t> GetOutputShape() { return GetTensorShape(output_id_); }
+
+ protected:
+  int lhs_id_;
+  int rhs_id_;
+  int output_id_;
+};
+
+// Returns the product of `batches` matrices of `rows` x `depth`, or their
+// transpose if `adj_x`, and the `depth` x `units` RHS, or the transpose of
+// `rhs` if `adj_y`.
+std::vector<float> DenseBatchMatMul(const std::vector<float>& lhs,
+                                    const std::vector<float>& rhs, int batches,
+                                    int rows, int depth, int units, bool adj_x,
+                                    bool adj_y) {
+  std::vector<float> output(batches * rows * units);
+  for (int b = 0; b < batches; ++b) {
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < units; ++j) {
+        float total = 0;
+        for (int k = 0; k < depth; ++k) {
+          const float l = adj_x ? lhs[(b * depth + k) * rows + i]
+                                : lhs[(b * rows + i) * depth + k];
+          const float r = adj_y ? rhs[j * depth + k] : rhs[k * units + j];
+          total += l * r;
+        }
+        output[(b * rows + i) * units + j] = total;
+      }
+    }
+  }
+  return output;
+}
+
+// Returns `rows` x `cols` integer values in [-3, 3] whose blocks of
+// `block_rows` x `block_cols` are zero with a probability of a half.
+std::vector<float> RandomBlockSparseRHS(int rows, int cols, int block_rows,
+                                        int block_cols) {
+  std::mt19937 random_engine;
+  std::bernoulli_distribution zero_dist(0.5);
+  std::uniform_int_distribution<int> value_dist(-3, 3);
+  std::vector<float> rhs(rows * cols);
+  for (int block_row = 0; block_row < rows; block_row += block_rows) {
+    for (int block_col = 0; block_col < cols; block_col += block_cols) {
+      const bool is_zero = zero_dist(random_engine);
+      for (int r = block_row; r < block_row + block_rows; ++r) {
+        for (int c = block_col; c < block_col + block_cols; ++c) {
+          rhs[r * cols + c] = is_zero ? 0 : value_dist(random_engine);
+        }
+      }
+    }
+  }
+  return rhs;
+}
+
+// The block shapes of the RHS produced by the converter, which are transposed
+// unless the RHS is adjoint.
+std::vector<std::pair<int, int>> SparseRHSBlockShapes(bool adj_y) {
+  if (adj_y) return {{1, 1}, {1, 4}, {1, 8}, {8, 1}, {4, 4}};
+  return {{1, 1}, {4, 1}, {8, 1}, {1, 8}, {16, 1}, {4, 4}};
+}
+
+TEST_P(BatchMatMulOpTest, Float32Test_SparseConstRHS) {
+  const int batches = 2;
+  const int rows = 3;
+  const int depth = 32;
+  const int units = 16;
+  std::vector<float> lhs(batches * rows * depth);
+  for (int i = 0; i < lhs.size(); ++i) lhs[i] = (i % 7 - 3) * 0.5f;
+  for (bool adj_x : {false, true}) {
+    for (bool adj_y : {false, true}) {
+      for (const auto& [block_rows, block_cols] :
+           SparseRHSBlockShapes(adj_y)) {
+        const int rhs_rows = adj_y ? units : depth;
+        const int rhs_cols = adj_y ? depth : units;
+        const std::vector<float> rhs = RandomBlockSparseRHS(
+            rhs_rows, rhs_cols, block_rows, block_cols);
+        SparseConstRHSBatchMatMulOpModel m(
+            {TensorType_FLOAT32,
+             {batches, adj_x ? depth : rows, adj_x ? rows : depth}},
+            {TensorType_FLOAT32, {rhs_rows, rhs_cols}}, rhs, block_rows,
+            block_cols, {TensorType_FLOAT32}, adj_x, adj_y);
+        m.PopulateTensor<float>(m.lhs(), lhs);
+
+        ASSERT_EQ(m.Invoke(), kTfLiteOk);
+
+        EXPECT_THAT(m.GetOutputShape(), ElementsAre(batches, rows, units));
+        EXPECT_THAT(m.GetOutput<float>(),
+                    ElementsAreArray(ArrayFloatNear(DenseBatchMatMul(
+                        lhs, rhs, batches, rows, depth, units, adj_x, adj_y))))
+            << block_rows << "x" << block_cols << " adj_x " << adj_x
+            << " adj_y " << adj_y;
+      }
+    }
+  }
+}
+
+TEST_P(BatchMatMulOpTest, Int8Test_SparseConstRHS) {
+  const int batches = 2;
+  const int rows = 3;
+  const int depth = 32;
+  const int units = 16;
+  std::vector<float> lhs(batches * rows * depth);
+  for (int i = 0; i < lhs.size(); ++i) lhs[i] = i % 5 - 2;
+  for (bool adj_y : {false, true}) {
+    for (const auto& [block_rows, block_cols] : SparseRHSBlockShapes(adj_y)) {
+      const int rhs_rows = adj_y ? units : depth;
+      const int rhs_cols = adj_y ? depth : units;
+      const std::vector<float> rhs =
+          RandomBlockSparseRHS(rhs_rows, rhs_cols, block_rows, block_cols);
+      SparseConstRHSBatchMatMulOpModel m(
+          {TensorType_INT8, {batches, rows, depth}, 0, 0, 1, -4},
+          {TensorType_INT8, {rhs_rows, rhs_cols}, 0, 0, 1}, rhs, block_rows,
+          block_cols, {TensorType_INT8, {}, 0, 0, 1}, /*adj_x=*/false, adj_y);
+      m.QuantizeAndPopulate<int8_t>(m.lhs(), lhs);
+
+      ASSERT_EQ(m.Invoke(), kTfLiteOk);
+
+      std::vector<int8_t> expected;
+      for (float value : DenseBatchMatMul(lhs, rhs, batches, rows, depth,
+                                          units, /*adj_x=*/false, adj_y)) {
+        expected.push_back(std::min(std::max(value, -128.f), 127.f));
+      }
+      EXPECT_THAT(m.GetOutput<int8_t>(), ElementsAreArray(expected))
+          << block_rows << "x" << block_cols << " adj_y " << adj_y;
+    }
+  }
+}
+
 // In the hybrid model the weights are quantized int8. But the input
 // and output are expected to be in float precision.
 class HybridBatchMatMulOpModel : public SingleOpModel {
@@ -325,6 +325,8 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   if (ShouldCacheOutput(context, input)) {
     output->allocation_type = kTfLiteArenaRwPersistent;
   }
+  // The output may be reallocated after Prepare, so it is computed again.
+  reinterpret_cast<OpData*>(node->user_data)->cached_output = false;
 
   TF_LITE_ENSURE_OK(
       context,
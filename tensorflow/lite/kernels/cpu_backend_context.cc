@@ -31,6 +31,7 @@ limitations under the License.
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/core/macros.h"
 #include "tensorflow/lite/external_cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_shared_pool.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/kernels/op_macros.h"
 
@@ -151,6 +152,38 @@ void CpuBackendContext::SetMaxNumThreads(int max_num_threads) {
 
 void CpuBackendContext::SetUseCaching(bool flag) { use_caching_ = flag; }
 
+int CpuBackendContext::AcquireThreads() {
+  if (lease_depth_++ > 0) {
+    return num_leased_threads_;
+  }
+  // A single-threaded computation runs on the calling thread, which needs no
+  // lease.
+  leased_pool_ = max_num_threads_ > 1 ? shared_pool_ : nullptr;
+  num_leased_threads_ = leased_pool_ != nullptr
+                            ? leased_pool_->Acquire(max_num_threads_)
+                            : max_num_threads_;
+  if (num_leased_threads_ != max_num_threads_) {
+    ruy_context_->set_max_num_threads(num_leased_threads_);
+    gemmlowp_context_->set_max_num_threads(num_leased_threads_);
+  }
+  return num_leased_threads_;
+}
+
+void CpuBackendContext::ReleaseThreads() {
+  TFLITE_DCHECK_GT(lease_depth_, 0);
+  if (--lease_depth_ > 0) {
+    return;
+  }
+  if (leased_pool_ != nullptr) {
+    leased_pool_->Release(num_leased_threads_);
+    leased_pool_ = nullptr;
+  }
+  if (num_leased_threads_ != max_num_threads_) {
+    ruy_context_->set_max_num_threads(max_num_threads_);
+    gemmlowp_context_->set_max_num_threads(max_num_threads_);
+  }
+}
+
 #ifdef TFLITE_KERNEL_USE_XNNPACK
 pthreadpool_t CpuBackendContext::get_xnnpack_threadpool() {
   if (!xnnpack_threadpool_ && max_num_threads_ > 1) {
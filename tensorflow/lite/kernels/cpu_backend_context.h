@@ -30,6 +30,7 @@ limitations under the License.
 #include "ruy/context.h"  // from @ruy
 #include "tensorflow/lite/core/c/common.h"
 #include "tensorflow/lite/external_cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_shared_pool.h"
 
 namespace tflite {
 
@@ -50,7 +51,20 @@ class CpuBackendContext final : public TfLiteInternalBackendContext {
   // passing around this information.
   void SetMaxNumThreads(int max_num_threads) override;
 
-  int max_num_threads() const { return max_num_threads_; }
+  // Returns the number of threads set by SetMaxNumThreads, or the number of
+  // leased threads while a CpuBackendThreadLease is held.
+  int max_num_threads() const {
+    return lease_depth_ > 0 ? num_leased_threads_ : max_num_threads_;
+  }
+
+  // Attaches this context to a pool of threads shared with the contexts of
+  // other interpreters, see CpuBackendSharedPool, or detaches it if nullptr.
+  // The pool must outlive the context.
+  void SetSharedPool(CpuBackendSharedPool* shared_pool) {
+    shared_pool_ = shared_pool;
+  }
+
+  CpuBackendSharedPool* shared_pool() const { return shared_pool_; }
 
   void SetUseCaching(bool flag);
 
@@ -67,8 +81,17 @@ class CpuBackendContext final : public TfLiteInternalBackendContext {
   bool PreferGemmlowpOnX86();
 
  private:
+  friend class CpuBackendThreadLease;
+
   bool RuyHasAvxOrAbove();
 
+  // Leases threads from the shared pool, if any, and limits the ruy and
+  // gemmlowp contexts to them until the matching ReleaseThreads call. Nested
+  // calls share the lease of the outermost one. Returns the number of leased
+  // threads.
+  int AcquireThreads();
+  void ReleaseThreads();
+
   // Copy the wrapper class for cpuinfo from Ruy.
   class CpuInfo final {
    public:
@@ -122,6 +145,12 @@ class CpuBackendContext final : public TfLiteInternalBackendContext {
   // (currently the Ruy library only).
   bool use_caching_;
 
+  CpuBackendSharedPool* shared_pool_ = nullptr;
+  // The pool the current lease was taken from, if any.
+  CpuBackendSharedPool* leased_pool_ = nullptr;
+  int lease_depth_ = 0;
+  int num_leased_threads_ = 0;
+
 #ifdef TFLITE_KERNEL_USE_XNNPACK
   // A smart pointer for the xnnpack threadpool. Is created by a call from the
   // interpreter, and then consumed by xnnpack, possibly via a TFLite kernel.
@@ -132,6 +161,25 @@ class CpuBackendContext final : public TfLiteInternalBackendContext {
   CpuBackendContext(const CpuBackendContext&) = delete;
 };
 
+// Leases the threads of a parallel computation from the shared pool of a
+// context, if it has one, for the lifetime of this object. The computation
+// must not use more than num_threads() threads.
+class CpuBackendThreadLease {
+ public:
+  explicit CpuBackendThreadLease(CpuBackendContext* context)
+      : context_(context), num_threads_(context->AcquireThreads()) {}
+  ~CpuBackendThreadLease() { context_->ReleaseThreads(); }
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  CpuBackendContext* const context_;
+  const int num_threads_;
+
+  CpuBackendThreadLease(const CpuBackendThreadLease&) = delete;
+  CpuBackendThreadLease& operator=(const CpuBackendThreadLease&) = delete;
+};
+
 }  // namespace tflite
 
 #endif  // TENSORFLOW_LITE_KERNELS_CPU_BACKEND_CONTEXT_H_
@@ -105,6 +105,7 @@ struct GemmImplUsingGemmlowp<
     clamp_stage.max = params.clamp_max;
     SaturatingCastStageType saturating_cast_stage;
     using BitDepthParams = typename GemmlowpBitDepthParams<SrcScalar>::Type;
+    CpuBackendThreadLease lease(context);
     if (params.bias) {
       ColVectorMap bias_vector(params.bias, lhs_params.rows);
       gemmlowp::OutputStageBiasAddition<ColVectorMap> bias_addition_stage;
@@ -174,6 +175,7 @@ struct GemmImplUsingGemmlowp<LhsScalar, RhsScalar, AccumScalar, DstScalar,
     auto output_pipeline = std::make_tuple(bias_addition_stage, scale_stage,
                                            clamp_stage, saturating_cast_stage);
     using BitDepthParams = typename GemmlowpBitDepthParams<SrcScalar>::Type;
+    CpuBackendThreadLease lease(context);
     gemmlowp::GemmWithOutputPipeline<SrcScalar, DstScalar, BitDepthParams>(
         context->gemmlowp_context(), gemmlowp_lhs, gemmlowp_rhs, &gemmlowp_dst,
         -lhs_params.zero_point, -rhs_params.zero_point, output_pipeline);
@@ -0,0 +1,61 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/kernels/cpu_backend_shared_pool.h"
+
+#include <algorithm>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+
+namespace tflite {
+
+CpuBackendSharedPool::CpuBackendSharedPool(int num_threads)
+    : num_threads_(std::max(num_threads, 1)) {}
+
+CpuBackendSharedPool* CpuBackendSharedPool::GetDefault() {
+  static CpuBackendSharedPool* pool = new CpuBackendSharedPool(
+      static_cast<int>(std::thread::hardware_concurrency()));
+  return pool;
+}
+
+int CpuBackendSharedPool::Acquire(int max_num_threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++num_leases_;
+  // Leases are short-lived, a single GEMM for instance, so granting an equal
+  // share to the leases held now is fair over time without having to wait.
+  const int fair_share = std::max(num_threads_ / num_leases_, 1);
+  const int num_free_threads = num_threads_ - num_leased_threads_;
+  const int num_threads =
+      std::max(std::min({max_num_threads, fair_share, num_free_threads}), 1);
+  num_leased_threads_ += num_threads;
+  return num_threads;
+}
+
+void CpuBackendSharedPool::Release(int num_threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  TFLITE_DCHECK_GT(num_leases_, 0);
+  TFLITE_DCHECK_GE(num_leased_threads_, num_threads);
+  --num_leases_;
+  num_leased_threads_ -= num_threads;
+}
+
+int CpuBackendSharedPool::num_leased_threads() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_leased_threads_;
+}
+
+}  // namespace tflite
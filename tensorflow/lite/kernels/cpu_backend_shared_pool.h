@@ -0,0 +1,84 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_KERNELS_CPU_BACKEND_SHARED_POOL_H_
+#define TENSORFLOW_LITE_KERNELS_CPU_BACKEND_SHARED_POOL_H_
+
+#include <mutex>  // NOLINT(build/c++11)
+
+namespace tflite {
+
+// A budget of threads shared by the CpuBackendContexts of several
+// interpreters, so that interpreters invoked concurrently do not oversubscribe
+// the cores with the thread pools of their contexts.
+//
+// An attached context leases threads from the pool for each parallel
+// computation, i.e. each GEMM and cpu_backend_threadpool::Execute call, and
+// runs it on as many threads as it was granted. A lease is granted at most the
+// number of threads of its interpreter, see `Interpreter::SetNumThreads`, and
+// at most an equal share of the pool among the leases held at the time. Leases
+// never block: the calling thread is always granted, so a computation runs on
+// one thread when the pool is exhausted.
+//
+// The pool only limits how many threads are used at once. Each context still
+// runs its computations on the threads of its own ruy or gemmlowp context.
+//
+// To attach an interpreter to the pool of the process:
+//
+//   auto* cpu_backend_context = new CpuBackendContext();
+//   cpu_backend_context->SetSharedPool(CpuBackendSharedPool::GetDefault());
+//   ExternalCpuBackendContext external_context;
+//   external_context.set_internal_backend_context(
+//       std::unique_ptr<TfLiteInternalBackendContext>(cpu_backend_context));
+//   interpreter->SetExternalContext(kTfLiteCpuBackendContext,
+//                                   &external_context);
+//   interpreter->SetNumThreads(num_threads);
+//
+// This class is thread-safe.
+class CpuBackendSharedPool {
+ public:
+  explicit CpuBackendSharedPool(int num_threads);
+
+  CpuBackendSharedPool(const CpuBackendSharedPool&) = delete;
+  CpuBackendSharedPool& operator=(const CpuBackendSharedPool&) = delete;
+
+  // Returns the pool of the process, which has a thread per core. It is never
+  // destroyed.
+  static CpuBackendSharedPool* GetDefault();
+
+  int num_threads() const { return num_threads_; }
+
+  // Leases at most `max_num_threads` threads, counting the calling thread.
+  // Returns the number of leased threads, which is at least 1. The threads
+  // must be returned with `Release`.
+  int Acquire(int max_num_threads);
+
+  // Returns the `num_threads` threads of a lease to the pool.
+  void Release(int num_threads);
+
+  // Returns the number of threads currently leased.
+  int num_leased_threads() const;
+
+ private:
+  const int num_threads_;
+
+  mutable std::mutex mutex_;
+  int num_leased_threads_ = 0;
+  int num_leases_ = 0;
+};
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_KERNELS_CPU_BACKEND_SHARED_POOL_H_
@@ -0,0 +1,132 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/kernels/cpu_backend_shared_pool.h"
+
+#include <atomic>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_threadpool.h"
+
+namespace tflite {
+
+namespace {
+
+TEST(CpuBackendSharedPoolTest, GrantsFairShare) {
+  CpuBackendSharedPool pool(8);
+  // A single lease may take the whole pool, up to its limit.
+  EXPECT_EQ(pool.Acquire(4), 4);
+  EXPECT_EQ(pool.Acquire(16), 4);
+  EXPECT_EQ(pool.num_leased_threads(), 8);
+  // An exhausted pool still grants the calling thread.
+  EXPECT_EQ(pool.Acquire(4), 1);
+  pool.Release(4);
+  // Three leases are held, so this one gets a third of the pool.
+  EXPECT_EQ(pool.Acquire(8), 2);
+  pool.Release(2);
+  pool.Release(1);
+  pool.Release(4);
+  EXPECT_EQ(pool.num_leased_threads(), 0);
+  EXPECT_EQ(pool.Acquire(8), 8);
+  pool.Release(8);
+}
+
+TEST(CpuBackendSharedPoolTest, LeasesLimitContextThreads) {
+  CpuBackendSharedPool pool(4);
+  CpuBackendContext context;
+  context.SetMaxNumThreads(3);
+  context.SetSharedPool(&pool);
+  EXPECT_EQ(pool.Acquire(2), 2);
+  {
+    CpuBackendThreadLease lease(&context);
+    EXPECT_EQ(lease.num_threads(), 2);
+    EXPECT_EQ(context.max_num_threads(), 2);
+    // Nested leases share the outer one.
+    CpuBackendThreadLease nested_lease(&context);
+    EXPECT_EQ(nested_lease.num_threads(), 2);
+    EXPECT_EQ(pool.num_leased_threads(), 4);
+  }
+  EXPECT_EQ(context.max_num_threads(), 3);
+  EXPECT_EQ(pool.num_leased_threads(), 2);
+  pool.Release(2);
+
+  // Single-threaded contexts do not lease.
+  context.SetMaxNumThreads(1);
+  CpuBackendThreadLease lease(&context);
+  EXPECT_EQ(lease.num_threads(), 1);
+  EXPECT_EQ(pool.num_leased_threads(), 0);
+}
+
+class IncrementTask : public cpu_backend_threadpool::Task {
+ public:
+  IncrementTask(std::atomic<int>* counter, int* value)
+      : counter_(counter), value_(value) {}
+
+  void Run() override {
+    ++*value_;
+    counter_->fetch_add(1);
+  }
+
+ private:
+  std::atomic<int>* counter_;
+  int* value_;
+};
+
+TEST(CpuBackendSharedPoolTest, ExecutesAllTasksWithFewerThreads) {
+  CpuBackendSharedPool pool(2);
+  CpuBackendContext context;
+  context.SetMaxNumThreads(5);
+  context.SetSharedPool(&pool);
+  std::atomic<int> counter(0);
+  std::vector<int> values(5);
+  std::vector<IncrementTask> tasks;
+  for (int& value : values) tasks.emplace_back(&counter, &value);
+  cpu_backend_threadpool::Execute(tasks.size(), tasks.data(), &context);
+  EXPECT_EQ(counter, 5);
+  EXPECT_EQ(values, std::vector<int>(5, 1));
+  EXPECT_EQ(pool.num_leased_threads(), 0);
+}
+
+TEST(CpuBackendSharedPoolTest, ConcurrentContexts) {
+  const int kNumContexts = 6;
+  const int kNumThreadsPerContext = 4;
+  CpuBackendSharedPool pool(4);
+  std::atomic<int> counter(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumContexts; ++i) {
+    threads.emplace_back([&]() {
+      CpuBackendContext context;
+      context.SetMaxNumThreads(kNumThreadsPerContext);
+      context.SetSharedPool(&pool);
+      std::vector<int> values(kNumThreadsPerContext);
+      std::vector<IncrementTask> tasks;
+      for (int& value : values) tasks.emplace_back(&counter, &value);
+      for (int run = 0; run < 100; ++run) {
+        cpu_backend_threadpool::Execute(tasks.size(), tasks.data(), &context);
+      }
+      EXPECT_EQ(values, std::vector<int>(kNumThreadsPerContext, 100));
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(counter, kNumContexts * kNumThreadsPerContext * 100);
+  EXPECT_EQ(pool.num_leased_threads(), 0);
+}
+
+}  // namespace
+
+}  // namespace tflite
@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_KERNELS_CPU_BACKEND_THREADPOOL_H_
 #define TENSORFLOW_LITE_KERNELS_CPU_BACKEND_THREADPOOL_H_
 
+#include <algorithm>
+
 #include "tensorflow/lite/kernels/cpu_backend_context.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 
@@ -37,8 +39,13 @@ template <typename TaskType>
 void Execute(int tasks_count, TaskType* tasks,
              CpuBackendContext* cpu_backend_context) {
   TFLITE_DCHECK_LE(tasks_count, cpu_backend_context->max_num_threads());
-  cpu_backend_context->ruy_context()->mutable_thread_pool()->Execute(
-      tasks_count, tasks);
+  // With a shared pool, fewer threads than tasks may be leased. The tasks then
+  // run in waves of as many tasks as leased threads.
+  CpuBackendThreadLease lease(cpu_backend_context);
+  for (int i = 0; i < tasks_count; i += lease.num_threads()) {
+    cpu_backend_context->ruy_context()->mutable_thread_pool()->Execute(
+        std::min(lease.num_threads(), tasks_count - i), tasks + i);
+  }
 }
 
 #else  // not TFLITE_WITH_RUY
@@ -49,8 +56,12 @@ template <typename TaskType>
 void Execute(int tasks_count, TaskType* tasks,
              CpuBackendContext* cpu_backend_context) {
   TFLITE_DCHECK_LE(tasks_count, cpu_backend_context->max_num_threads());
-  cpu_backend_context->gemmlowp_context()->workers_pool()->Execute(tasks_count,
-                                                                   tasks);
+  // See the ruy variant above.
+  CpuBackendThreadLease lease(cpu_backend_context);
+  for (int i = 0; i < tasks_count; i += lease.num_threads()) {
+    cpu_backend_context->gemmlowp_context()->workers_pool()->Execute(
+        std::min(lease.num_threads(), tasks_count - i), tasks + i);
+  }
 }
 
 #endif
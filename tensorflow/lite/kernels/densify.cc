@@ -63,6 +63,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   op_context.output->type = op_context.input->type;
   op_context.output->name = "Densify_output";
   op_context.output->allocation_type = kTfLiteArenaRwPersistent;
+  // The output may be reallocated after Prepare, so it is densified again.
+  reinterpret_cast<OpData*>(node->user_data)->dense_weights_initialized =
+      false;
 
   return context->ResizeTensor(context, op_context.output,
                                TfLiteIntArrayCopy(op_context.input->dims));
@@ -67,10 +67,13 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   op_context.output->type = kTfLiteFloat32;
   // If the input tensor is constant, we can persist the dequantized value in
-  // the output tensor. Otherwise we run dequantize upon each eval.
+  // the output tensor. Otherwise we run dequantize upon each eval. The output
+  // may be reallocated after Prepare, so it is dequantized again.
   if (IsConstantTensor(op_context.input)) {
     op_context.output->allocation_type = kTfLiteArenaRwPersistent;
   }
+  reinterpret_cast<OpData*>(node->user_data)
+      ->float_dequantized_weights_initialized = false;
   return context->ResizeTensor(context, op_context.output,
                                TfLiteIntArrayCopy(op_context.input->dims));
 }
@@ -19,6 +19,7 @@ limitations under the License.
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "tensorflow/lite/core/c/builtin_op_data.h"
@@ -63,7 +64,6 @@ bool SupportedSparsityFormat(const TfLiteSparsity& sparsity) {
 }
 
 static const int kDimMetadataSizeRandomSparse = 2;
-static const int kDimMetadataSizeBlockSparse = 3;
 
 TfLiteStatus CreateLedgerTensor(const TfLiteSparsity* sparsity,
                                 TfLiteContext* context, TfLiteTensor* ledger) {
@@ -157,6 +157,10 @@ struct OpData {
   bool compute_row_sums = false;
   // Only used for sparse hybrid fully connected kernels.
   bool ledger_initialized;
+  // The layout of a block sparse float or int8 filter, verified once in
+  // Prepare. Its values are read from the filter in Eval.
+  optimized_ops::BlockSparseMatrix<float> float_block_sparse_filter;
+  optimized_ops::BlockSparseMatrix<int8_t> int8_block_sparse_filter;
   // Used for 4bit hybrid
   std::unique_ptr<optimized_4bit::OpData4Bit> op_data_4bit = nullptr;
   TfLiteType quantized_bias_type = kTfLiteNoType;
@@ -353,6 +357,72 @@ TfLiteStatus PrepareImpl4Bit(TfLiteContext* context, TfLiteNode* node,
                           cols);
 }
 
+// Verifies that sparsity values are valid given input/weight/output.
+bool VerifySparsity(const RuntimeShape& weights_shape,
+                    const RuntimeShape& input_shape,
+                    const RuntimeShape& output_shape,
+                    const TfLiteSparsity* sparsity) {
+  const int weights_dims_count = weights_shape.DimensionsCount();
+  const int output_dims_count = output_shape.DimensionsCount();
+  const int w0_size = sparsity->dim_metadata[0].dense_size;
+  const int accum_depth = weights_shape.Dims(weights_dims_count - 1);
+  const int output_elements = output_shape.FlatSize();
+  const int input_elements = input_shape.FlatSize();
+  const int batches = FlatSizeSkipDim(output_shape, output_dims_count - 1);
+  const int output_depth = MatchingDim(weights_shape, weights_dims_count - 2,
+                                       output_shape, output_dims_count - 1);
+  const int max_batch_index = batches - 1;
+  const int max_output = max_batch_index * output_depth + w0_size;
+  const int max_batch_depth = accum_depth * max_batch_index;
+
+  // Verify output size is enough.
+  if (output_elements < max_output) return false;
+
+  // Verify index from sparse in input is valid.
+  for (int i = 0; i < sparsity->dim_metadata[1].array_indices->size; ++i) {
+    if (input_elements <=
+        max_batch_depth + sparsity->dim_metadata[1].array_indices->data[i])
+      return false;
+  }
+  return true;
+}
+
+// Verifies the sparse `filter` of the float or int8 kernels once, and fills
+// `block_sparse_filter` with its layout. Random sparse float filters have a
+// kernel of their own, and no block sparse layout.
+template <typename T>
+TfLiteStatus PrepareSparseFilter(
+    TfLiteContext* context, const TfLiteTensor* input,
+    const TfLiteTensor* filter, const TfLiteTensor* output,
+    optimized_ops::BlockSparseMatrix<T>* block_sparse_filter) {
+  const TfLiteSparsity& sparsity = *filter->sparsity;
+  if (!SupportedSparsityFormat(sparsity)) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Unsupported sparse fully-connected weight format.");
+    return kTfLiteError;
+  }
+  const RuntimeShape filter_shape = GetTensorShape(filter);
+  if (!VerifySparsity(filter_shape, GetTensorShape(input),
+                      GetTensorShape(output), &sparsity)) {
+    TF_LITE_KERNEL_LOG(context, "Invalid sparse fully-connected format.");
+    return kTfLiteError;
+  }
+  if (std::is_same<T, float>::value &&
+      sparsity.dim_metadata_size == kDimMetadataSizeRandomSparse) {
+    return kTfLiteOk;
+  }
+  if (!optimized_ops::GetBlockSparseMatrix(
+          sparsity, filter_shape, GetTensorData<T>(filter),
+          filter->bytes / sizeof(T), block_sparse_filter) ||
+      !optimized_ops::IsSupportedSparseBlockShape(
+          block_sparse_filter->block_rows, block_sparse_filter->block_cols)) {
+    TF_LITE_KERNEL_LOG(context,
+                       "Unsupported sparse fully-connected weight format.");
+    return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node,
                          KernelType kernel_type) {
   auto* params =
@@ -625,8 +695,29 @@ TfLiteStatus PrepareImpl(TfLiteContext* context, TfLiteNode* node,
   }
 
   // Resize output.
-  return UpdateOutputSize(context, params, input, output, batch_size, num_units,
-                          filter->dims->data[1]);
+  TF_LITE_ENSURE_OK(context,
+                    UpdateOutputSize(context, params, input, output,
+                                     batch_size, num_units,
+                                     filter->dims->data[1]));
+
+  if (is_sparse && filter->type == kTfLiteFloat32 &&
+      kernel_type == kGenericOptimized) {
+    return PrepareSparseFilter(context, input, filter, output,
+                               &data->float_block_sparse_filter);
+  }
+  if (is_sparse && !is_hybrid && output->type == kTfLiteInt8) {
+    if (filter->params.zero_point != 0) {
+      TF_LITE_KERNEL_LOG(context,
+                         "Quantized and sparse fully-connected format "
+                         "supports symmetric weight quantization only.");
+      return kTfLiteError;
+    }
+    // Int4 support for sparse filter tensor is currently not supported
+    TF_LITE_ENSURE(context, filter->type != kTfLiteInt4);
+    return PrepareSparseFilter(context, input, filter, output,
+                               &data->int8_block_sparse_filter);
+  }
+  return kTfLiteOk;
 }
 
 template <KernelType kernel_type>
@@ -1252,36 +1343,6 @@ void FullyConnectedPerChannelInt16(const OpData* data,
 
 }  // namespace
 
-// Verifies that sparsity values are valid given input/weight/output.
-bool VerifySparsity(const RuntimeShape& weights_shape,
-                    const RuntimeShape& input_shape,
-                    const RuntimeShape& output_shape,
-                    const TfLiteSparsity* sparsity) {
-  const int weights_dims_count = weights_shape.DimensionsCount();
-  const int output_dims_count = output_shape.DimensionsCount();
-  const int w0_size = sparsity->dim_metadata[0].dense_size;
-  const int accum_depth = weights_shape.Dims(weights_dims_count - 1);
-  const int output_elements = output_shape.FlatSize();
-  const int input_elements = input_shape.FlatSize();
-  const int batches = FlatSizeSkipDim(output_shape, output_dims_count - 1);
-  const int output_depth = MatchingDim(weights_shape, weights_dims_count - 2,
-                                       output_shape, output_dims_count - 1);
-  const int max_batch_index = batches - 1;
-  const int max_output = max_batch_index * output_depth + w0_size;
-  const int max_batch_depth = accum_depth * max_batch_index;
-
-  // Verify output size is enough.
-  if (output_elements < max_output) return false;
-
-  // Verify index from sparse in input is valid.
-  for (int i = 0; i < sparsity->dim_metadata[1].array_indices->size; ++i) {
-    if (input_elements <=
-        max_batch_depth + sparsity->dim_metadata[1].array_indices->data[i])
-      return false;
-  }
-  return true;
-}
-
 template <KernelType kernel_type>
 TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
                            TfLiteFullyConnectedParams* params, OpData* data,
@@ -1347,29 +1408,17 @@ TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
         break;
       case kTfLiteInt8:
         if (filter->sparsity != nullptr) {
+          // The sparse filter was verified in Prepare.
           const TfLiteSparsity& sparsity = *filter->sparsity;
           const auto input_shape = GetTensorShape(input);
           const auto filter_shape = GetTensorShape(filter);
           const auto output_shape = GetTensorShape(output);
           const auto bias_shape = GetTensorShape(bias);
-          if (filter_offset != 0) {
-            TF_LITE_KERNEL_LOG(context,
-                               "Quantized and sparse fully-connected format "
-                               "supports symmetric weight quantization only.");
-            return kTfLiteError;
-          }
-          if (!SupportedSparsityFormat(sparsity) ||
-              !VerifySparsity(filter_shape, input_shape, output_shape,
-                              &sparsity)) {
-            TF_LITE_KERNEL_LOG(
-                context,
-                "Invalid quantized and sparse fully-connected format.");
-            return kTfLiteError;
-          }
-          // Int4 support for sparse filter tensor is currently not supported
-          TF_LITE_ENSURE(context, filter->type != kTfLiteInt4);
-          if (sparsity.dim_metadata_size == kDimMetadataSizeBlockSparse &&
-              sparsity.dim_metadata[2].dense_size == 16) {
+          optimized_ops::BlockSparseMatrix<int8_t> block_sparse_filter =
+              data->int8_block_sparse_filter;
+          block_sparse_filter.values = GetTensorData<int8_t>(filter);
+          if (block_sparse_filter.block_rows == 1 &&
+              block_sparse_filter.block_cols == 16) {
             // Block sparse with block size of 1x16.
             optimized_ops::FullyConnectedSparseWeight1x16(
                 sparsity, op_params, input_shape, GetTensorData<int8_t>(input),
@@ -1380,9 +1429,17 @@ TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
                 GetTensorData<int8_t>(output),
                 CpuBackendContext::GetFromContext(context));
           } else {
-            TF_LITE_KERNEL_LOG(
-                context, "Unsupported sparse fully-connected weight format.");
-            return kTfLiteError;
+            // Block sparse with block size of 1x8, 4x4, 8x1, etc.
+            optimized_ops::FullyConnectedBlockSparseWeight(
+                block_sparse_filter, op_params,
+                is_per_channel ? data->per_channel_output_multiplier.data()
+                               : nullptr,
+                is_per_channel ? data->per_channel_output_shift.data()
+                               : nullptr,
+                input_shape, GetTensorData<int8_t>(input), bias_shape,
+                GetTensorData<int32_t>(bias), output_shape,
+                GetTensorData<int8_t>(output),
+                CpuBackendContext::GetFromContext(context));
           }
         } else {
           is_per_channel ? FullyConnectedPerChannelInt8<kernel_type>(
@@ -1537,21 +1594,15 @@ TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
     op_params.float_activation_min = output_activation_min;
     op_params.float_activation_max = output_activation_max;
     if (filter->sparsity != nullptr) {
+      // The sparse filter was verified in Prepare.
       const auto& sparsity = *filter->sparsity;
-      if (!SupportedSparsityFormat(sparsity)) {
-        TF_LITE_KERNEL_LOG(context,
-                           "Unsupported sparse fully-connected weight format.");
-        return kTfLiteError;
-      }
       const auto& input_shape = GetTensorShape(input);
       const auto& filter_shape = GetTensorShape(filter);
       const auto& output_shape = GetTensorShape(output);
       const auto& bias_shape = GetTensorShape(bias);
-      if (!VerifySparsity(filter_shape, input_shape, output_shape, &sparsity)) {
-        TF_LITE_KERNEL_LOG(context, "Invalid sparse fully-connected format.");
-        return kTfLiteError;
-      }
-
+      optimized_ops::BlockSparseMatrix<float> block_sparse_filter =
+          data->float_block_sparse_filter;
+      block_sparse_filter.values = GetTensorData<float>(filter);
       if (sparsity.dim_metadata_size == kDimMetadataSizeRandomSparse) {
         // Random sparse.
         optimized_ops::FullyConnectedSparseWeight(
@@ -1560,8 +1611,8 @@ TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
             filter_shape, GetTensorData<float>(filter),  // Disable formatting
             bias_shape, GetTensorData<float>(bias),      // Disable formatting
             output_shape, GetTensorData<float>(output));
-      } else if (sparsity.dim_metadata_size == kDimMetadataSizeBlockSparse &&
-                 sparsity.dim_metadata[2].dense_size == 4) {
+      } else if (block_sparse_filter.block_rows == 1 &&
+                 block_sparse_filter.block_cols == 4) {
         // Block sparse with block size of 1x4.
         optimized_ops::FullyConnectedSparseWeight1x4(
             sparsity, op_params,                         // Disable formatting
@@ -1571,9 +1622,12 @@ TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
             output_shape, GetTensorData<float>(output),
             CpuBackendContext::GetFromContext(context));
       } else {
-        TF_LITE_KERNEL_LOG(context,
-                           "Unsupported sparse fully-connected weight format.");
-        return kTfLiteError;
+        // Block sparse with block size of 1x8, 4x4, 8x1, etc.
+        optimized_ops::FullyConnectedBlockSparseWeight(
+            block_sparse_filter, op_params, input_shape,
+            GetTensorData<float>(input), bias_shape, GetTensorData<float>(bias),
+            output_shape, GetTensorData<float>(output),
+            CpuBackendContext::GetFromContext(context));
       }
 
     } else {
@@ -34,11 +34,26 @@ limitations under the License.
 #include "flatbuffers/flatbuffers.h"  // from @flatbuffers
 #include "tensorflow/lite/core/api/op_resolver.h"
 #include "tensorflow/lite/core/interpreter.h"
+#include "tensorflow/lite/kernels/internal/optimized/sparse_ops/fully_connected.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/internal/tensor_utils.h"
 #include "tensorflow/lite/kernels/test_util.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/string_type.h"
 
+#ifdef SPARSE_FULLY_CONNECTED_BENCHMARKS
+#include "testing/base/public/benchmark.h"
+#endif  // SPARSE_FULLY_CONNECTED_BENCHMARKS
+
+#ifdef CPU_BACKEND_SHARED_POOL_BENCHMARKS
+#include <thread>  // NOLINT(build/c++11)
+
+#include "testing/base/public/benchmark.h"
+#include "tensorflow/lite/external_cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_shared_pool.h"
+#endif  // CPU_BACKEND_SHARED_POOL_BENCHMARKS
+
 namespace tflite {
 namespace {
 
@@ -1752,6 +1767,9 @@ class SparseFullyConnectedOpModel : public SingleOpModel {
   int input_size() { return input_size_; }
   int num_units() { return units_; }
   int num_batches() { return batches_; }
+  const TfLiteTensor* weights_tensor() {
+    return interpreter_->tensor(weights_);
+  }
 
  protected:
   int input_;
@@ -2016,6 +2034,127 @@ TEST_P(SparseFullyConnectedOpTest, Simple1x4TestMultiThreadedMoreBatches) {
   }
 }
 
+// Returns the sparse weight format of the converter with blocks of
+// `block_rows` x `block_cols`.
+TensorData BlockSparseWeight(TensorData weight, int block_rows,
+                             int block_cols) {
+  weight.traversal_order = {0, 1};
+  weight.format = {kTfLiteDimDense, kTfLiteDimSparseCSR};
+  const int block_shape[2] = {block_rows, block_cols};
+  for (int i = 0; i < 2; ++i) {
+    if (block_shape[i] > 1) {
+      weight.traversal_order.push_back(
+          static_cast<int>(weight.traversal_order.size()));
+      weight.block_map.push_back(i);
+      weight.block_size.push_back(block_shape[i]);
+    }
+  }
+  return weight;
+}
+
+// Returns `rows` x `cols` integer weights in [-3, 3] whose blocks of
+// `block_rows` x `block_cols` are zero with a probability of `sparsity`.
+std::vector<float> RandomBlockSparseWeights(int rows, int cols, int block_rows,
+                                            int block_cols, float sparsity) {
+  std::mt19937 random_engine;
+  std::bernoulli_distribution zero_dist(sparsity);
+  std::uniform_int_distribution<int> value_dist(-3, 3);
+  std::vector<float> weights(rows * cols);
+  for (int block_row = 0; block_row < rows; block_row += block_rows) {
+    for (int block_col = 0; block_col < cols; block_col += block_cols) {
+      const bool is_zero = zero_dist(random_engine);
+      for (int r = block_row; r < block_row + block_rows; ++r) {
+        for (int c = block_col; c < block_col + block_cols; ++c) {
+          weights[r * cols + c] = is_zero ? 0 : value_dist(random_engine);
+        }
+      }
+    }
+  }
+  return weights;
+}
+
+// Returns the fully connected output of the dense weights, with a RELU.
+std::vector<float> DenseFullyConnected(const std::vector<float>& weights,
+                                       const std::vector<float>& input,
+                                       const std::vector<float>& bias,
+                                       int units) {
+  const int input_size = weights.size() / units;
+  const int batches = input.size() / input_size;
+  std::vector<float> output(batches * units);
+  for (int b = 0; b < batches; ++b) {
+    for (int u = 0; u < units; ++u) {
+      float total = bias[u];
+      for (int i = 0; i < input_size; ++i) {
+        total += weights[u * input_size + i] * input[b * input_size + i];
+      }
+      output[b * units + u] = std::max(total, 0.f);
+    }
+  }
+  return output;
+}
+
+const std::vector<std::pair<int, int>>& BlockSparseShapes() {
+  static const auto* block_shapes = new std::vector<std::pair<int, int>>(
+      {{1, 8}, {1, 16}, {4, 1}, {8, 1}, {4, 4}});
+  return *block_shapes;
+}
+
+TEST_P(SparseFullyConnectedOpTest, BlockSparseMatchesDense) {
+  const int units = 16;
+  const int input_size = 32;
+  const int batches = 3;
+  std::vector<float> input(batches * input_size);
+  for (int i = 0; i < input.size(); ++i) input[i] = i % 7 - 3;
+  std::vector<float> bias(units);
+  for (int i = 0; i < units; ++i) bias[i] = i % 3;
+  for (const auto& [block_rows, block_cols] : BlockSparseShapes()) {
+    const std::vector<float> weight_data = RandomBlockSparseWeights(
+        units, input_size, block_rows, block_cols, /*sparsity=*/0.7);
+    const TensorData weight = BlockSparseWeight(
+        {TensorType_FLOAT32, {units, input_size}}, block_rows, block_cols);
+    for (int num_threads : {1, 4}) {
+      SparseFullyConnectedOpModel<float> m(
+          GetRegistration(), units, batches,
+          /*input=*/{TensorType_FLOAT32, {batches, input_size}}, weight,
+          weight_data, /*output=*/{TensorType_FLOAT32},
+          /*bias_tensor_optional=*/false, num_threads);
+      m.SetBias(bias);
+      m.SetInput(input);
+
+      ASSERT_EQ(m.Invoke(), kTfLiteOk);
+
+      EXPECT_THAT(m.GetOutput(),
+                  ElementsAreArray(ArrayFloatNear(
+                      DenseFullyConnected(weight_data, input, bias, units))))
+          << block_rows << "x" << block_cols << ", " << num_threads
+          << " threads";
+    }
+  }
+}
+
+TEST_P(SparseFullyConnectedOpTest, BlockSparseRejectsMissingValues) {
+  const int units = 8;
+  const int input_size = 16;
+  const std::vector<float> weight_data = RandomBlockSparseWeights(
+      units, input_size, /*block_rows=*/4, /*block_cols=*/4, /*sparsity=*/0.5);
+  SparseFullyConnectedOpModel<float> m(
+      GetRegistration(), units, /*batches=*/1,
+      /*input=*/{TensorType_FLOAT32, {1, input_size}},
+      BlockSparseWeight({TensorType_FLOAT32, {units, input_size}},
+                        /*block_rows=*/4, /*block_cols=*/4),
+      weight_data);
+  const TfLiteTensor* weights = m.weights_tensor();
+  const size_t num_values = weights->bytes / sizeof(float);
+  optimized_ops::BlockSparseMatrix<float> matrix;
+  EXPECT_TRUE(optimized_ops::GetBlockSparseMatrix(
+      *weights->sparsity, GetTensorShape(weights),
+      GetTensorData<float>(weights), num_values, &matrix));
+  // The segments refer to more blocks than there are values.
+  EXPECT_FALSE(optimized_ops::GetBlockSparseMatrix(
+      *weights->sparsity, GetTensorShape(weights),
+      GetTensorData<float>(weights), num_values - 1, &matrix));
+}
+
 TEST_P(SparseHybridFullyConnectedOpTest, SparseHybrid1x16Test) {
   std::initializer_list<float> weight_data = {
       /* 1st row */
@@ -2377,9 +2516,184 @@ TEST_P(SparseQuantizedFullyConnectedOpTest,
   EXPECT_THAT(m.GetOutput(), ElementsAre(11, 1, 25, 0, 1, 21));
 }
 
+TEST_P(SparseQuantizedFullyConnectedOpTest, BlockSparseMatchesDense) {
+  const int units = 16;
+  const int input_size = 32;
+  const int batches = 3;
+  // The input has a zero point, which the kernels apply to the weights.
+  std::vector<float> input(batches * input_size);
+  for (int i = 0; i < input.size(); ++i) input[i] = i % 5 - 2;
+  std::vector<float> bias(units);
+  for (int i = 0; i < units; ++i) bias[i] = i % 3;
+  for (const auto& [block_rows, block_cols] : BlockSparseShapes()) {
+    const std::vector<float> weight_data = RandomBlockSparseWeights(
+        units, input_size, block_rows, block_cols, /*sparsity=*/0.7);
+    const TensorData weight = BlockSparseWeight(
+        {TensorType_INT8, {units, input_size}, 0, 0, 1}, block_rows,
+        block_cols);
+    for (int num_threads : {1, 4}) {
+      SparseQuantizedFullyConnectedOpModel m(
+          GetRegistration(), units, batches,
+          /*input=*/{TensorType_INT8, {batches, input_size}, 0, 0, 1, 3},
+          weight, weight_data, /*output=*/{TensorType_INT8, {}, 0, 0, 1},
+          /*bias_tensor_optional=*/false, num_threads);
+      m.SetBias(bias);
+      m.SetInput(input);
+
+      ASSERT_EQ(m.Invoke(), kTfLiteOk);
+
+      std::vector<int8_t> expected;
+      for (float value :
+           DenseFullyConnected(weight_data, input, bias, units)) {
+        expected.push_back(std::min(value, 127.f));
+      }
+      EXPECT_THAT(m.GetOutput(), ElementsAreArray(expected))
+          << block_rows << "x" << block_cols << ", " << num_threads
+          << " threads";
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     SparseQuantizedFullyConnectedOpTest, SparseQuantizedFullyConnectedOpTest,
     ::testing::ValuesIn(SingleOpTest::GetKernelTags(*kKernelMapNoPie)));
 
+#ifdef SPARSE_FULLY_CONNECTED_BENCHMARKS
+
+// Compile with --copt="-DSPARSE_FULLY_CONNECTED_BENCHMARKS"
+// Run with --benchmark_filter=all
+//
+// Runs a 1024x1024 float fully connected on a single batch, with weights in
+// blocks of state.range(0) x state.range(1) of which state.range(2) percent
+// are zero. Blocks of 1x1 are the random sparse kernel. Reports the memory of
+// the sparse weights, indices included.
+void BM_SparseFullyConnected(benchmark::State& state) {
+  const int block_rows = state.range(0);
+  const int block_cols = state.range(1);
+  const float sparsity = state.range(2) / 100.f;
+  constexpr int kUnits = 1024;
+  constexpr int kInputSize = 1024;
+  const std::vector<float> weight_data = RandomBlockSparseWeights(
+      kUnits, kInputSize, block_rows, block_cols, sparsity);
+  SparseFullyConnectedOpModel<float> m(
+      ops::builtin::Register_FULLY_CONNECTED_GENERIC_OPT(), kUnits,
+      /*batches=*/1, /*input=*/{TensorType_FLOAT32, {1, kInputSize}},
+      BlockSparseWeight({TensorType_FLOAT32, {kUnits, kInputSize}},
+                        block_rows, block_cols),
+      weight_data, /*output=*/{TensorType_FLOAT32},
+      /*bias_tensor_optional=*/true);
+  std::vector<float> input(kInputSize);
+  for (int i = 0; i < kInputSize; ++i) input[i] = i % 7 - 3;
+  m.SetInput(input);
+  const TfLiteTensor* weights = m.weights_tensor();
+  const TfLiteDimensionMetadata& block_cols_metadata =
+      weights->sparsity->dim_metadata[1];
+  state.counters["weight_bytes"] =
+      weights->bytes +
+      sizeof(int) * (block_cols_metadata.array_segments->size +
+                     block_cols_metadata.array_indices->size);
+  for (auto _ : state) {
+    m.Invoke();
+  }
+  state.SetItemsProcessed(state.iterations() * kUnits * kInputSize);
+}
+
+void SparseFullyConnectedArgs(benchmark::internal::Benchmark* b) {
+  const std::pair<int, int> block_shapes[] = {{1, 1}, {1, 4}, {1, 8}, {1, 16},
+                                              {4, 1}, {8, 1}, {4, 4}};
+  for (const auto& [block_rows, block_cols] : block_shapes) {
+    for (int sparsity : {50, 70, 90}) {
+      b->Args({block_rows, block_cols, sparsity});
+    }
+  }
+}
+BENCHMARK(BM_SparseFullyConnected)->Apply(SparseFullyConnectedArgs);
+
+#endif  // SPARSE_FULLY_CONNECTED_BENCHMARKS
+
+#ifdef CPU_BACKEND_SHARED_POOL_BENCHMARKS
+
+class SharedPoolFullyConnectedOpModel : public QuantizedFullyConnectedOpModel {
+ public:
+  using QuantizedFullyConnectedOpModel::QuantizedFullyConnectedOpModel;
+
+  void SetExternalCpuBackendContext(TfLiteExternalContext* context) {
+    interpreter_->SetExternalContext(kTfLiteCpuBackendContext, context);
+  }
+};
+
+// Compile with --copt="-DCPU_BACKEND_SHARED_POOL_BENCHMARKS"
+// Run with --benchmark_filter=all
+//
+// Invokes state.range(1) interpreters concurrently, each running a 1024x1024
+// int8 fully connected on 16 batches with a thread per core. The interpreters
+// are attached to the default CpuBackendSharedPool if state.range(0) is 1.
+// Reports the throughput of all the interpreters in invocations per second.
+void BM_ConcurrentInterpretersSharedPool(benchmark::State& state) {
+  const bool use_shared_pool = state.range(0);
+  const int num_interpreters = state.range(1);
+  constexpr int kUnits = 1024;
+  constexpr int kInputSize = 1024;
+  constexpr int kBatches = 16;
+  constexpr int kInvocationsPerIteration = 4;
+  const int num_threads = std::thread::hardware_concurrency();
+
+  std::vector<float> weights(kUnits * kInputSize);
+  for (int i = 0; i < weights.size(); ++i) weights[i] = i % 13 - 6;
+  std::vector<float> input(kBatches * kInputSize);
+  for (int i = 0; i < input.size(); ++i) input[i] = i % 7 - 3;
+
+  // Declared first, as the interpreters must not outlive their contexts.
+  std::vector<std::unique_ptr<ExternalCpuBackendContext>> external_contexts;
+  std::vector<std::unique_ptr<SharedPoolFullyConnectedOpModel>> models;
+  for (int i = 0; i < num_interpreters; ++i) {
+    models.push_back(std::make_unique<SharedPoolFullyConnectedOpModel>(
+        ops::builtin::Register_FULLY_CONNECTED_GENERIC_OPT(), kUnits, kBatches,
+        /*input=*/
+        TensorData{TensorType_INT8, {kBatches, kInputSize}, -63.5, 64},
+        /*output=*/TensorData{TensorType_INT8, {}, -127, 128}));
+    SharedPoolFullyConnectedOpModel& m = *models.back();
+    m.SetWeights<int8_t>(weights);
+    m.SetBias(std::vector<float>(kUnits));
+    m.SetInput<int8_t>(input);
+    auto cpu_backend_context = std::make_unique<CpuBackendContext>();
+    if (use_shared_pool) {
+      cpu_backend_context->SetSharedPool(CpuBackendSharedPool::GetDefault());
+    }
+    external_contexts.push_back(std::make_unique<ExternalCpuBackendContext>());
+    external_contexts.back()->set_internal_backend_context(
+        std::move(cpu_backend_context));
+    m.SetExternalCpuBackendContext(external_contexts.back().get());
+    m.SetNumThreads(num_threads);
+  }
+
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    for (auto& model : models) {
+      threads.emplace_back([&m = *model]() {
+        for (int i = 0; i < kInvocationsPerIteration; ++i) {
+          CHECK_EQ(m.Invoke(), kTfLiteOk);
+        }
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+  }
+  state.SetItemsProcessed(state.iterations() * num_interpreters *
+                          kInvocationsPerIteration);
+}
+
+void ConcurrentInterpretersArgs(benchmark::internal::Benchmark* b) {
+  for (int num_interpreters : {1, 4, 16}) {
+    for (int use_shared_pool : {0, 1}) {
+      b->Args({use_shared_pool, num_interpreters});
+    }
+  }
+}
+BENCHMARK(BM_ConcurrentInterpretersSharedPool)
+    ->Apply(ConcurrentInterpretersArgs)
+    ->UseRealTime();
+
+#endif  // CPU_BACKEND_SHARED_POOL_BENCHMARKS
+
 }  // namespace
 }  // namespace tflite
@@ -16,7 +16,9 @@ limitations under the License.
 #define TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_FULLY_CONNECTED_H_
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "ruy/profiler/instrumentation.h"  // from @ruy
 #include "tensorflow/lite/core/c/common.h"
@@ -263,6 +265,360 @@ inline void FullyConnectedSparseWeight1x4(
                                   cpu_backend_context);
 }
 
+// A weight matrix of `rows` x `cols` encoded in blocks of `block_rows` x
+// `block_cols` by the converter. The non-zero blocks of the i-th row of blocks
+// are `segments[i]` to `segments[i + 1]`, `indices` holds their block column,
+// and `values` the elements of each of them in row-major order.
+template <typename T>
+struct BlockSparseMatrix {
+  int rows;
+  int cols;
+  int block_rows;
+  int block_cols;
+  const int* segments;
+  const int* indices;
+  const T* values;
+};
+
+// Returns the block shape of a 2D tensor encoded by the converter, i.e. with
+// its dimensions in order, the first one dense, the second one CSR, and at most
+// one block per dimension. Random sparsity is a block of 1x1.
+inline bool GetSparsityBlockShape(const TfLiteSparsity& sparsity,
+                                  int* block_rows, int* block_cols) {
+  const int num_dims = sparsity.dim_metadata_size;
+  if (num_dims < 2 || num_dims > 4 || sparsity.traversal_order == nullptr ||
+      sparsity.traversal_order->size != num_dims) {
+    return false;
+  }
+  for (int i = 0; i < num_dims; ++i) {
+    if (sparsity.traversal_order->data[i] != i ||
+        sparsity.dim_metadata[i].format !=
+            (i == 1 ? kTfLiteDimSparseCSR : kTfLiteDimDense)) {
+      return false;
+    }
+  }
+  const int num_block_dims = num_dims - 2;
+  if (num_block_dims > 0 && (sparsity.block_map == nullptr ||
+                             sparsity.block_map->size != num_block_dims)) {
+    return false;
+  }
+  *block_rows = 1;
+  *block_cols = 1;
+  for (int i = 0; i < num_block_dims; ++i) {
+    // Two block dimensions must be in the order of the dimensions.
+    const int block_dim = sparsity.block_map->data[i];
+    if (block_dim < 0 || block_dim > 1 ||
+        (num_block_dims == 2 && block_dim != i)) {
+      return false;
+    }
+    if (block_dim == 0) {
+      *block_rows = sparsity.dim_metadata[2 + i].dense_size;
+    } else {
+      *block_cols = sparsity.dim_metadata[2 + i].dense_size;
+    }
+  }
+  return *block_rows > 0 && *block_cols > 0;
+}
+
+// Fills `matrix` with the sparse weights of `weights_shape` stored in the
+// `num_values` elements of `values`, and verifies that its indices and blocks
+// are in range. Returns false if the weights are not a block sparse 2D matrix.
+template <typename T>
+inline bool GetBlockSparseMatrix(const TfLiteSparsity& sparsity,
+                                 const RuntimeShape& weights_shape,
+                                 const T* values, size_t num_values,
+                                 BlockSparseMatrix<T>* matrix) {
+  if (weights_shape.DimensionsCount() != 2 ||
+      !GetSparsityBlockShape(sparsity, &matrix->block_rows,
+                             &matrix->block_cols)) {
+    return false;
+  }
+  matrix->rows = weights_shape.Dims(0);
+  matrix->cols = weights_shape.Dims(1);
+  if (matrix->rows % matrix->block_rows != 0 ||
+      matrix->cols % matrix->block_cols != 0) {
+    return false;
+  }
+  const int num_block_rows = matrix->rows / matrix->block_rows;
+  const int num_block_cols = matrix->cols / matrix->block_cols;
+  const TfLiteDimensionMetadata& block_cols = sparsity.dim_metadata[1];
+  if (sparsity.dim_metadata[0].dense_size != num_block_rows ||
+      block_cols.array_segments == nullptr ||
+      block_cols.array_indices == nullptr ||
+      block_cols.array_segments->size != num_block_rows + 1) {
+    return false;
+  }
+  matrix->segments = block_cols.array_segments->data;
+  matrix->indices = block_cols.array_indices->data;
+  matrix->values = values;
+  if (matrix->segments[0] != 0 ||
+      matrix->segments[num_block_rows] != block_cols.array_indices->size) {
+    return false;
+  }
+  for (int i = 0; i < num_block_rows; ++i) {
+    if (matrix->segments[i] > matrix->segments[i + 1]) return false;
+  }
+  if (static_cast<uint64_t>(matrix->segments[num_block_rows]) *
+          matrix->block_rows * matrix->block_cols >
+      num_values) {
+    return false;
+  }
+  for (int i = 0; i < block_cols.array_indices->size; ++i) {
+    if (matrix->indices[i] < 0 || matrix->indices[i] >= num_block_cols) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <int kBlockRows, int kBlockCols>
+struct SparseBlockShape {
+  static constexpr int kRows = kBlockRows;
+  static constexpr int kCols = kBlockCols;
+};
+
+// Calls `fn` with the SparseBlockShape of `block_rows` x `block_cols`, and
+// returns false if there is no block sparse kernel for that shape.
+template <typename Fn>
+inline bool DispatchSparseBlockShape(int block_rows, int block_cols,
+                                     const Fn& fn) {
+  if (block_rows == 1) {
+    switch (block_cols) {
+      case 1:
+        fn(SparseBlockShape<1, 1>());
+        return true;
+      case 4:
+        fn(SparseBlockShape<1, 4>());
+        return true;
+      case 8:
+        fn(SparseBlockShape<1, 8>());
+        return true;
+      case 16:
+        fn(SparseBlockShape<1, 16>());
+        return true;
+    }
+  } else if (block_cols == 1) {
+    switch (block_rows) {
+      case 4:
+        fn(SparseBlockShape<4, 1>());
+        return true;
+      case 8:
+        fn(SparseBlockShape<8, 1>());
+        return true;
+    }
+  } else if (block_rows == 4 && block_cols == 4) {
+    fn(SparseBlockShape<4, 4>());
+    return true;
+  }
+  return false;
+}
+
+inline bool IsSupportedSparseBlockShape(int block_rows, int block_cols) {
+  return DispatchSparseBlockShape(block_rows, block_cols, [](auto) {});
+}
+
+// Multiplies the block rows [block_row_start, block_row_end) of `weights` with
+// each of the `batches` rows of `input_data`. A block is accumulated into one
+// partial sum per element, which the compiler vectorizes for any block shape
+// without reassociating the float additions.
+template <int kBlockRows, int kBlockCols>
+inline void FullyConnectedBlockSparseWeightImpl(
+    const BlockSparseMatrix<float>& weights, const FullyConnectedParams& params,
+    const float* input_data, int batches, const float* bias_data,
+    float* output_data, int block_row_start, int block_row_end) {
+  constexpr int kBlockSize = kBlockRows * kBlockCols;
+  for (int block_row = block_row_start; block_row < block_row_end;
+       ++block_row) {
+    const int* indices = weights.indices + weights.segments[block_row];
+    const int num_blocks =
+        weights.segments[block_row + 1] - weights.segments[block_row];
+    const float* block_values =
+        weights.values + weights.segments[block_row] * kBlockSize;
+    const int row = block_row * kBlockRows;
+    for (int b = 0; b < batches; ++b) {
+      const float* input = input_data + b * weights.cols;
+      float acc[kBlockSize] = {};
+      const float* values = block_values;
+      for (int i = 0; i < num_blocks; ++i) {
+        const float* input_block = input + indices[i] * kBlockCols;
+        for (int r = 0; r < kBlockRows; ++r) {
+          for (int c = 0; c < kBlockCols; ++c) {
+            acc[r * kBlockCols + c] +=
+                values[r * kBlockCols + c] * input_block[c];
+          }
+        }
+        values += kBlockSize;
+      }
+      float* output = output_data + b * weights.rows + row;
+      for (int r = 0; r < kBlockRows; ++r) {
+        float total = bias_data ? bias_data[row + r] : 0.f;
+        for (int c = 0; c < kBlockCols; ++c) {
+          total += acc[r * kBlockCols + c];
+        }
+        output[r] = ActivationFunctionWithMinMax(
+            total, params.float_activation_min, params.float_activation_max);
+      }
+    }
+  }
+}
+
+// Like the float kernel, for symmetric int8 weights, requantizing with the
+// per channel multipliers if `per_channel_scale` is not null.
+template <int kBlockRows, int kBlockCols>
+inline void FullyConnectedBlockSparseWeightImpl(
+    const BlockSparseMatrix<int8_t>& weights,
+    const FullyConnectedParams& params, const int32_t* per_channel_scale,
+    const int32_t* per_channel_shift, const int8_t* input_data, int batches,
+    const int32_t* bias_data, int8_t* output_data, int block_row_start,
+    int block_row_end) {
+  constexpr int kBlockSize = kBlockRows * kBlockCols;
+  for (int block_row = block_row_start; block_row < block_row_end;
+       ++block_row) {
+    const int* indices = weights.indices + weights.segments[block_row];
+    const int num_blocks =
+        weights.segments[block_row + 1] - weights.segments[block_row];
+    const int8_t* block_values =
+        weights.values + weights.segments[block_row] * kBlockSize;
+    const int row = block_row * kBlockRows;
+    // The input offset is applied to the sum of the weights of each row.
+    int32_t weights_sum[kBlockRows] = {};
+    for (int i = 0; i < num_blocks * kBlockSize; ++i) {
+      weights_sum[(i % kBlockSize) / kBlockCols] += block_values[i];
+    }
+    for (int b = 0; b < batches; ++b) {
+      const int8_t* input = input_data + b * weights.cols;
+      int32_t acc[kBlockSize] = {};
+      const int8_t* values = block_values;
+      for (int i = 0; i < num_blocks; ++i) {
+        const int8_t* input_block = input + indices[i] * kBlockCols;
+        for (int r = 0; r < kBlockRows; ++r) {
+          for (int c = 0; c < kBlockCols; ++c) {
+            acc[r * kBlockCols + c] += static_cast<int32_t>(
+                values[r * kBlockCols + c] * input_block[c]);
+          }
+        }
+        values += kBlockSize;
+      }
+      int8_t* output = output_data + b * weights.rows + row;
+      for (int r = 0; r < kBlockRows; ++r) {
+        int32_t total = weights_sum[r] * params.input_offset;
+        if (bias_data) total += bias_data[row + r];
+        for (int c = 0; c < kBlockCols; ++c) {
+          total += acc[r * kBlockCols + c];
+        }
+        total = MultiplyByQuantizedMultiplier(
+            total,
+            per_channel_scale ? per_channel_scale[row + r]
+                              : params.output_multiplier,
+            per_channel_shift ? per_channel_shift[row + r]
+                              : params.output_shift);
+        total += params.output_offset;
+        output[r] = static_cast<int8_t>(ActivationFunctionWithMinMax(
+            total, params.quantized_activation_min,
+            params.quantized_activation_max));
+      }
+    }
+  }
+}
+
+template <typename Fn>
+struct BlockSparseRowsTask : cpu_backend_threadpool::Task {
+  BlockSparseRowsTask(const Fn& fn, int block_row_start, int block_row_end)
+      : fn(fn),
+        block_row_start(block_row_start),
+        block_row_end(block_row_end) {}
+
+  void Run() override { fn(block_row_start, block_row_end); }
+
+ private:
+  const Fn& fn;
+  int block_row_start;
+  int block_row_end;
+};
+
+// Runs `fn` on ranges of the `num_block_rows` block rows. Unlike the 1x4
+// kernel, the work is sliced along the rows of the weights, so that a single
+// batch, which is the common case for sparse models, uses all threads.
+template <typename Fn>
+inline void RunOnBlockRows(int num_block_rows, const Fn& fn,
+                           CpuBackendContext* cpu_backend_context) {
+  const int thread_count = std::max(
+      1, std::min(num_block_rows, cpu_backend_context->max_num_threads()));
+  if (thread_count == 1) {
+    fn(0, num_block_rows);
+    return;
+  }
+  std::vector<BlockSparseRowsTask<Fn>> tasks;
+  tasks.reserve(thread_count);
+  int block_row_start = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    int block_row_end = block_row_start + num_block_rows / thread_count;
+    if (i < num_block_rows % thread_count) block_row_end++;
+    tasks.emplace_back(fn, block_row_start, block_row_end);
+    block_row_start = block_row_end;
+  }
+  cpu_backend_threadpool::Execute(tasks.size(), tasks.data(),
+                                  cpu_backend_context);
+}
+
+// Fully connected with float weights in any block shape for which
+// IsSupportedSparseBlockShape() is true.
+inline void FullyConnectedBlockSparseWeight(
+    const BlockSparseMatrix<float>& weights, const FullyConnectedParams& params,
+    const RuntimeShape& input_shape, const float* input_data,
+    const RuntimeShape& bias_shape, const float* bias_data,
+    const RuntimeShape& output_shape, float* output_data,
+    CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("FullyConnected");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int batches =
+      FlatSizeSkipDim(output_shape, output_shape.DimensionsCount() - 1);
+  TFLITE_DCHECK_EQ(input_shape.FlatSize(), batches * weights.cols);
+  DispatchSparseBlockShape(
+      weights.block_rows, weights.block_cols, [&](auto block_shape) {
+        using BlockShape = decltype(block_shape);
+        RunOnBlockRows(
+            weights.rows / BlockShape::kRows,
+            [&](int block_row_start, int block_row_end) {
+              FullyConnectedBlockSparseWeightImpl<BlockShape::kRows,
+                                                  BlockShape::kCols>(
+                  weights, params, input_data, batches, bias_data,
+                  output_data, block_row_start, block_row_end);
+            },
+            cpu_backend_context);
+      });
+}
+
+// Fully connected with symmetric int8 weights in any block shape for which
+// IsSupportedSparseBlockShape() is true.
+inline void FullyConnectedBlockSparseWeight(
+    const BlockSparseMatrix<int8_t>& weights,
+    const FullyConnectedParams& params, const int32_t* per_channel_scale,
+    const int32_t* per_channel_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data, CpuBackendContext* cpu_backend_context) {
+  ruy::profiler::ScopeLabel label("FullyConnected");
+  ruy::profiler::ScopeLabel inner_label("Block Sparse");
+  const int batches =
+      FlatSizeSkipDim(output_shape, output_shape.DimensionsCount() - 1);
+  TFLITE_DCHECK_EQ(input_shape.FlatSize(), batches * weights.cols);
+  DispatchSparseBlockShape(
+      weights.block_rows, weights.block_cols, [&](auto block_shape) {
+        using BlockShape = decltype(block_shape);
+        RunOnBlockRows(
+            weights.rows / BlockShape::kRows,
+            [&](int block_row_start, int block_row_end) {
+              FullyConnectedBlockSparseWeightImpl<BlockShape::kRows,
+                                                  BlockShape::kCols>(
+                  weights, params, per_channel_scale, per_channel_shift,
+                  input_data, batches, bias_data, output_data,
+                  block_row_start, block_row_end);
+            },
+            cpu_backend_context);
+      });
+}
+
 }  // namespace optimized_ops
 }  // namespace tflite
 #endif  // TENSORFLOW_LITE_KERNELS_INTERNAL_OPTIMIZED_SPARSE_OPS_FULLY_CONNECTED_H_
@@ -21,6 +21,7 @@ limitations under the License.
 #include <gtest/gtest.h>
 #include "benchmark/benchmark.h"  // from @com_google_benchmark
 #include "flatbuffers/flatbuffers.h"  // from @flatbuffers
+#include "tensorflow/lite/interpreter_options.h"
 #include "tensorflow/lite/kernels/test_util.h"
 #include "tensorflow/lite/kernels/unidirectional_sequence_lstm_test_util.h"
 #include "tensorflow/lite/schema/schema_generated.h"
@@ -3393,5 +3394,126 @@ QUANTIZE_PARAMETER_TEST(
     NoCifgNoPeepholeNoProjectionNoClippingUnidirectionalLstmTest);
 QUANTIZE_PARAMETER_TEST(NoCifgPeepholeProjectionClippingUnidirectionalLstmTest);
 #undef QUANTIZE_PARAMETER_TEST
+
+class StreamingLSTMOpModel : public UnidirectionalLSTMOpModel {
+ public:
+  using UnidirectionalLSTMOpModel::UnidirectionalLSTMOpModel;
+
+  // Keeps the LSTM state across invocations and reallocations.
+  void SetStreamingMode() {
+    InterpreterOptions options;
+    options.SetStreamingMode(true);
+    CHECK_EQ(interpreter_->ApplyOptions(&options), kTfLiteOk);
+  }
+
+  // Resizes the input to `sequence_length` time steps.
+  void ResizeInput(int sequence_length) {
+    CHECK_EQ(interpreter_->ResizeInputTensor(
+                 input_, {sequence_length, n_batch_, n_input_}),
+             kTfLiteOk);
+    CHECK_EQ(interpreter_->AllocateTensors(), kTfLiteOk);
+  }
+
+  TfLiteStatus ResetVariableTensors() {
+    return interpreter_->ResetVariableTensors();
+  }
+};
+
+// Run with --benchmark_filter=all
+//
+// Processes a stream arriving in chunks of 3 and 5 time steps, and produces
+// the output of an LSTM over the last 64 time steps for every chunk. In
+// streaming mode (Arg 1), every chunk is fed once to an LSTM which keeps its
+// state, resizing the input to the chunk length. Otherwise (Arg 0), the whole
+// window is run again from a zero state for every chunk. Reports chunks per
+// second.
+void BM_LstmStreamingVsFullWindow(benchmark::State& state) {
+  const bool streaming = state.range(0);
+  const int n_batch = 1;
+  const int n_input = 64;
+  const int n_cell = 256;
+  const int n_output = 256;
+  const int window_length = 64;
+  const int chunk_lengths[] = {3, 5};
+
+  StreamingLSTMOpModel lstm(
+      n_batch, n_input, n_cell, n_output, window_length,
+      /*time_major=*/true, /*use_cifg=*/false, /*use_peephole=*/false,
+      /*use_projection_weights=*/false,
+      /*use_projection_bias=*/false,
+      /*cell_clip=*/0.0, /*proj_clip=*/0.0,
+      {
+          {window_length, n_batch, n_input},  // input tensor
+
+          {n_cell, n_input},  // input_to_input_weight tensor
+          {n_cell, n_input},  // input_to_forget_weight tensor
+          {n_cell, n_input},  // input_to_cell_weight tensor
+          {n_cell, n_input},  // input_to_output_weight tensor
+
+          {n_cell, n_output},  // recurrent_to_input_weight tensor
+          {n_cell, n_output},  // recurrent_to_forget_weight tensor
+          {n_cell, n_output},  // recurrent_to_cell_weight tensor
+          {n_cell, n_output},  // recurrent_to_output_weight tensor
+
+          {0},  // cell_to_input_weight tensor
+          {0},  // cell_to_forget_weight tensor
+          {0},  // cell_to_output_weight tensor
+
+          {n_cell},  // input_gate_bias tensor
+          {n_cell},  // forget_gate_bias tensor
+          {n_cell},  // cell_gate_bias tensor
+          {n_cell},  // output_gate_bias tensor
+
+          {0, 0},  // projection_weight tensor
+          {0},     // projection_bias tensor
+
+          {n_batch, n_output},  // output_state tensor
+          {n_batch, n_cell},    // cell_state tensor
+      });
+  std::vector<float> input_weights(n_cell * n_input);
+  for (int i = 0; i < input_weights.size(); ++i) {
+    input_weights[i] = (i % 17 - 8) / 64.f;
+  }
+  std::vector<float> recurrent_weights(n_cell * n_output);
+  for (int i = 0; i < recurrent_weights.size(); ++i) {
+    recurrent_weights[i] = (i % 13 - 6) / 256.f;
+  }
+  const std::vector<float> bias(n_cell, 0.1f);
+  lstm.SetInputToInputWeights(input_weights);
+  lstm.SetInputToCellWeights(input_weights);
+  lstm.SetInputToForgetWeights(input_weights);
+  lstm.SetInputToOutputWeights(input_weights);
+  lstm.SetInputGateBias(bias);
+  lstm.SetCellBias(bias);
+  lstm.SetForgetGateBias(bias);
+  lstm.SetOutputGateBias(bias);
+  lstm.SetRecurrentToInputWeights(recurrent_weights);
+  lstm.SetRecurrentToCellWeights(recurrent_weights);
+  lstm.SetRecurrentToForgetWeights(recurrent_weights);
+  lstm.SetRecurrentToOutputWeights(recurrent_weights);
+  if (streaming) {
+    lstm.SetStreamingMode();
+  }
+
+  std::vector<float> input(window_length * n_batch * n_input);
+  for (int i = 0; i < input.size(); ++i) input[i] = (i % 7 - 3) / 4.f;
+  int num_chunks = 0;
+  for (auto _ : state) {
+    if (streaming) {
+      const int chunk_length = chunk_lengths[num_chunks % 2];
+      lstm.ResizeInput(chunk_length);
+      lstm.SetInput(0, input.data(),
+                    input.data() + chunk_length * n_batch * n_input);
+    } else {
+      CHECK_EQ(lstm.ResetVariableTensors(), kTfLiteOk);
+      lstm.SetInput(0, input.data(), input.data() + input.size());
+    }
+    CHECK_EQ(lstm.Invoke(), kTfLiteOk);
+    ++num_chunks;
+  }
+  state.SetItemsProcessed(num_chunks);
+}
+BENCHMARK(BM_LstmStreamingVsFullWindow)->Arg(0)->Arg(1);
+
 }  // namespace
 }  // namespace tflite
@@ -315,6 +315,16 @@ TfLiteStatus SimpleMemoryArena::ClearPlan() {
   return kTfLiteOk;
 }
 
+SimpleMemoryArena::Plan SimpleMemoryArena::GetPlan() const {
+  return Plan{active_allocs_, high_water_mark_};
+}
+
+void SimpleMemoryArena::RestorePlan(const Plan& plan) {
+  committed_ = false;
+  high_water_mark_ = plan.high_water_mark;
+  active_allocs_ = plan.active_allocs;
+}
+
 TfLiteStatus SimpleMemoryArena::ReleaseBuffer() {
   committed_ = false;
   underlying_buffer_.Release();
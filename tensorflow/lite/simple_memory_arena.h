@@ -153,6 +153,20 @@ class SimpleMemoryArena {
   // again.
   TfLiteStatus ClearPlan();
 
+  // The allocations scheduled since the plan was last cleared. It can be saved
+  // and restored later to skip recomputing the same allocations.
+  struct Plan {
+    std::vector<ArenaAllocWithUsageInterval> active_allocs;
+    size_t high_water_mark = 0;
+  };
+
+  // Returns a copy of the current allocation plan.
+  Plan GetPlan() const;
+
+  // Replaces the allocation plan with `plan`. As after ClearPlan(), the arena
+  // must be committed before allocations are resolved again.
+  void RestorePlan(const Plan& plan);
+
   // This releases the underlying buffer but does not clear the allocation plan.
   // Since all associated pointers are invalidated, the arena cannot be used
   // again until Commit() is called & tensor allocations are resolved.
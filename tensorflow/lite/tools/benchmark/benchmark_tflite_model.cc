@@ -44,6 +44,7 @@ limitations under the License.
 #include "tensorflow/lite/core/model_builder.h"
 #include "tensorflow/lite/core/signature_runner.h"
 #include "tensorflow/lite/core/subgraph.h"
+#include "tensorflow/lite/delegates/xnnpack/weight_cache.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/cpu_backend_context.h"
 #include "tensorflow/lite/op_resolver.h"
@@ -143,6 +144,44 @@ class InterpreterStatePrinter : public BenchmarkListener {
   const BenchmarkParams* params_ = nullptr;   // not own the memory.
 };
 
+// Logs the number of requests per second served by batched invocations.
+class BatchedInvokeThroughputListener : public BenchmarkListener {
+ public:
+  explicit BatchedInvokeThroughputListener(int num_requests)
+      : num_requests_(num_requests) {}
+
+  void OnBenchmarkEnd(const BenchmarkResults& results) override {
+    const auto& inference_time_us = results.inference_time_us();
+    if (inference_time_us.count() == 0 || inference_time_us.avg() <= 0) return;
+    TFLITE_LOG(INFO) << "Batched invoke throughput: "
+                     << num_requests_ * 1e6 / inference_time_us.avg()
+                     << " requests/s (" << num_requests_
+                     << " requests per run)";
+  }
+
+ private:
+  const int num_requests_;
+};
+
+// Logs the memory used by XNNPack weight cache files. Each file is mapped once
+// per process and shared by all interpreters using it.
+class XNNPackWeightCacheMemoryListener : public BenchmarkListener {
+ public:
+  void OnBenchmarkEnd(const BenchmarkResults& results) override {
+    // Only report alongside the peak memory footprint.
+    if (results.peak_mem_mb() <= 0) return;
+    const xnnpack::WeightCacheRegistry::Stats stats =
+        xnnpack::WeightCacheRegistry::Get().GetStats();
+    if (stats.num_files == 0) return;
+    TFLITE_LOG(INFO) << "+ XNNPack weight cache: "
+                     << stats.resident_bytes / (1024.0 * 1024.0)
+                     << " MB resident of "
+                     << stats.mapped_bytes / (1024.0 * 1024.0)
+                     << " MB mapped in " << stats.num_files
+                     << " file(s), shared by all interpreters";
+  }
+};
+
 class OutputSaver : public BenchmarkListener {
  public:
   explicit OutputSaver(BenchmarkInterpreterRunner* runner)
@@ -516,6 +555,16 @@ BenchmarkParams BenchmarkTfLiteModel::DefaultParams() {
                           BenchmarkParam::Create<bool>(false));
   default_params.AddParam("enable_builtin_cast_constant_cache",
                           BenchmarkParam::Create<bool>(false));
+  default_params.AddParam("cache_constant_subgraphs",
+                          BenchmarkParam::Create<bool>(false));
+  default_params.AddParam("num_inter_op_threads",
+                          BenchmarkParam::Create<int32_t>(0));
+  default_params.AddParam("use_shared_cpu_backend_pool",
+                          BenchmarkParam::Create<bool>(false));
+  default_params.AddParam("batched_requests",
+                          BenchmarkParam::Create<int32_t>(0));
+  default_params.AddParam("batch_size_buckets",
+                          BenchmarkParam::Create<std::string>(""));
   default_params.AddParam("output_filepath",
                           BenchmarkParam::Create<std::string>(""));
 
@@ -619,6 +668,28 @@ std::vector<Flag> BenchmarkTfLiteModel::GetFlags() {
           "enable_builtin_cast_constant_cache", &params_,
           "Cache the output of the builtin cast operation when its input "
           "is a constant tensor."),
+      CreateFlag<bool>(
+          "cache_constant_subgraphs", &params_,
+          "Compute the outputs of operators whose inputs are all constant "
+          "once when tensors are allocated, instead of on every run."),
+      CreateFlag<int32_t>(
+          "num_inter_op_threads", &params_,
+          "Number of threads used to invoke independent operators "
+          "concurrently. Values less than 2 invoke one operator at a time."),
+      CreateFlag<bool>(
+          "use_shared_cpu_backend_pool", &params_,
+          "Lease the threads of the CPU backend (ruy and gemmlowp) from the "
+          "thread pool shared by the interpreters of the process."),
+      CreateFlag<int32_t>(
+          "batched_requests", &params_,
+          "If positive, every run serves this many single-example requests "
+          "with one SignatureRunner::InvokeBatch call. Requires a signature "
+          "whose inputs and outputs have a leading batch dimension."),
+      CreateFlag<std::string>(
+          "batch_size_buckets", &params_,
+          "Comma-separated batch sizes that --batched_requests are padded "
+          "to, e.g. '1,4,16'. By default the batch size is the number of "
+          "requests."),
       CreateFlag<std::string>(
           "output_filepath", &params_,
           "File path to export outputs layer as binary data."),
@@ -698,6 +769,16 @@ void BenchmarkTfLiteModel::LogParams() {
                       "Disable delegate clustering", verbose);
   LOG_BENCHMARK_PARAM(bool, "enable_builtin_cast_constant_cache",
                       "Constant CAST output cache", verbose);
+  LOG_BENCHMARK_PARAM(bool, "cache_constant_subgraphs",
+                      "Constant subgraph output cache", verbose);
+  LOG_BENCHMARK_PARAM(int32_t, "num_inter_op_threads",
+                      "#threads used to invoke independent operators", verbose);
+  LOG_BENCHMARK_PARAM(bool, "use_shared_cpu_backend_pool",
+                      "Use the shared CPU backend thread pool", verbose);
+  LOG_BENCHMARK_PARAM(int32_t, "batched_requests",
+                      "#requests served by a batched invoke", verbose);
+  LOG_BENCHMARK_PARAM(std::string, "batch_size_buckets",
+                      "Batch size buckets", verbose);
   LOG_BENCHMARK_PARAM(std::string, "output_filepath",
                       "File path to export outputs layer to", verbose);
   LOG_BENCHMARK_PARAM(int32_t, "tensor_name_display_length",
@@ -879,10 +960,66 @@ TfLiteStatus BenchmarkTfLiteModel::PrepareInputData() {
     }
     inputs_data_.push_back(std::move(t_data));
   }
+  return PrepareBatchedRequests();
+}
+
+TfLiteStatus BenchmarkTfLiteModel::PrepareBatchedRequests() {
+  batched_requests_.clear();
+  batched_outputs_.clear();
+  const int num_requests = params_.Get<int32_t>("batched_requests");
+  if (num_requests <= 0) return kTfLiteOk;
+
+  SignatureRunner* runner = interpreter_runner_->signature_runner();
+  // Returns the size of one example of `t`, which must be batched.
+  auto example_bytes = [](const TfLiteTensor& t) -> size_t {
+    if (t.type == kTfLiteString || t.dims->size == 0 || t.dims->data[0] <= 0) {
+      return 0;
+    }
+    return t.bytes / t.dims->data[0];
+  };
+
+  // The requests list the inputs in the order of the signature, while
+  // `inputs_data_` follows the order of the subgraph inputs.
+  const std::vector<int>& runner_inputs = interpreter_runner_->inputs();
+  std::vector<const void*> example_inputs;
+  for (const char* name : runner->input_names()) {
+    const TfLiteTensor* t = runner->input_tensor(name);
+    const auto it = std::find_if(
+        runner_inputs.begin(), runner_inputs.end(),
+        [&](int i) { return interpreter_runner_->tensor(i) == t; });
+    if (it == runner_inputs.end() || example_bytes(*t) == 0) {
+      TFLITE_LOG(ERROR) << "Input " << name << " can't be batched.";
+      return kTfLiteError;
+    }
+    const int input_index = it - runner_inputs.begin();
+    example_inputs.push_back(inputs_data_[input_index].data.get());
+  }
+
+  std::vector<size_t> output_bytes;
+  for (const char* name : runner->output_names()) {
+    output_bytes.push_back(example_bytes(*runner->output_tensor(name)));
+    if (output_bytes.back() == 0) {
+      TFLITE_LOG(ERROR) << "Output " << name << " can't be batched.";
+      return kTfLiteError;
+    }
+  }
+
+  batched_requests_.resize(num_requests);
+  batched_outputs_.reserve(num_requests * output_bytes.size());
+  for (SignatureRunner::BatchRequest& request : batched_requests_) {
+    request.inputs = example_inputs;
+    for (size_t bytes : output_bytes) {
+      batched_outputs_.emplace_back(bytes);
+      request.outputs.push_back(batched_outputs_.back().data());
+    }
+  }
   return kTfLiteOk;
 }
 
 TfLiteStatus BenchmarkTfLiteModel::ResetInputsAndOutputs() {
+  // Batched invocations copy the inputs of every request themselves.
+  if (!batched_requests_.empty()) return kTfLiteOk;
+
   const std::vector<int>& runner_inputs = interpreter_runner_->inputs();
   // Set the values of the input tensors from inputs_data_.
   for (int j = 0; j < runner_inputs.size(); ++j) {
@@ -914,6 +1051,8 @@ TfLiteStatus BenchmarkTfLiteModel::InitInterpreter() {
   auto resolver = GetOpResolver();
   const int32_t num_threads = params_.Get<int32_t>("num_threads");
   const bool use_caching = params_.Get<bool>("use_caching");
+  const bool use_shared_cpu_backend_pool =
+      params_.Get<bool>("use_shared_cpu_backend_pool");
 
   InterpreterOptions options;
   options.SetEnsureDynamicTensorsAreReleased(
@@ -924,6 +1063,9 @@ TfLiteStatus BenchmarkTfLiteModel::InitInterpreter() {
       params_.Get<bool>("disable_delegate_clustering"));
   options.SetCacheConstantCastOp(
       params_.Get<bool>("enable_builtin_cast_constant_cache"));
+  options.SetCacheConstantSubgraphs(
+      params_.Get<bool>("cache_constant_subgraphs"));
+  options.SetNumInterOpThreads(params_.Get<int32_t>("num_inter_op_threads"));
 
   tflite::InterpreterBuilder builder(*model_, *resolver, &options);
   if (builder.SetNumThreads(num_threads) != kTfLiteOk) {
@@ -936,12 +1078,19 @@ TfLiteStatus BenchmarkTfLiteModel::InitInterpreter() {
     TFLITE_LOG(ERROR) << "Failed to initialize the interpreter";
     return kTfLiteError;
   }
-  // Manually enable caching behavior in TF Lite interpreter.
-  if (use_caching) {
+  // Manually enable caching behavior or the shared thread pool in TF Lite
+  // interpreter.
+  if (use_caching || use_shared_cpu_backend_pool) {
     external_context_ = std::make_unique<tflite::ExternalCpuBackendContext>();
     std::unique_ptr<tflite::CpuBackendContext> cpu_backend_context(
         new tflite::CpuBackendContext());
-    cpu_backend_context->SetUseCaching(true);
+    if (use_caching) {
+      cpu_backend_context->SetUseCaching(true);
+    }
+    if (use_shared_cpu_backend_pool) {
+      cpu_backend_context->SetSharedPool(
+          tflite::CpuBackendSharedPool::GetDefault());
+    }
     cpu_backend_context->SetMaxNumThreads(num_threads);
     external_context_->set_internal_backend_context(
         std::move(cpu_backend_context));
@@ -1129,6 +1278,30 @@ TfLiteStatus BenchmarkTfLiteModel::Init() {
   AddOwnedListener(std::unique_ptr<BenchmarkListener>(
       new OutputSaver(interpreter_runner_.get())));
 
+  if (params_.HasParam("xnnpack_weight_cache_file_path") &&
+      !params_.Get<std::string>("xnnpack_weight_cache_file_path").empty()) {
+    AddOwnedListener(std::make_unique<XNNPackWeightCacheMemoryListener>());
+  }
+
+  const int32_t batched_requests = params_.Get<int32_t>("batched_requests");
+  if (batched_requests > 0) {
+    SignatureRunner* runner = interpreter_runner_->signature_runner();
+    if (runner == nullptr) {
+      TFLITE_LOG(ERROR) << "--batched_requests requires a signature.";
+      return kTfLiteError;
+    }
+    std::vector<int> batch_size_buckets;
+    const std::string buckets = params_.Get<std::string>("batch_size_buckets");
+    if (!buckets.empty() &&
+        !util::SplitAndParse(buckets, ',', &batch_size_buckets)) {
+      TFLITE_LOG(ERROR) << "Invalid --batch_size_buckets: " << buckets;
+      return kTfLiteError;
+    }
+    TF_LITE_ENSURE_STATUS(runner->SetBatchSizeBuckets(batch_size_buckets));
+    AddOwnedListener(std::make_unique<BatchedInvokeThroughputListener>(
+        batched_requests));
+  }
+
   return kTfLiteOk;
 }
 
@@ -1183,6 +1356,10 @@ BenchmarkTfLiteModel::MayCreateProfilingListener() const {
 }
 
 TfLiteStatus BenchmarkTfLiteModel::RunImpl() {
+  if (!batched_requests_.empty()) {
+    return interpreter_runner_->signature_runner()->InvokeBatch(
+        batched_requests_);
+  }
   return interpreter_runner_->Invoke();
 }
 
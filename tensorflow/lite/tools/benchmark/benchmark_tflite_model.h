@@ -87,6 +87,11 @@ class BenchmarkInterpreterRunner {
   // the given signature in dependency order).
   TfLiteStatus Invoke();
 
+  // Returns the signature runner, or nullptr if the interpreter is used.
+  tflite::SignatureRunner* signature_runner() const {
+    return signature_runner_.get();
+  }
+
   // Return vector of node indices in the order of execution.
   //
   // This is a list of node indices (to index into nodes_and_registration).
@@ -189,6 +194,10 @@ class BenchmarkTfLiteModel : public BenchmarkModel {
 
   void CleanUp();
 
+  // Creates `batched_requests_` from the prepared input data if the
+  // signature is benchmarked with `SignatureRunner::InvokeBatch`.
+  TfLiteStatus PrepareBatchedRequests();
+
   utils::InputTensorData LoadInputTensorData(
       const TfLiteTensor& t, const std::string& input_file_path);
 
@@ -199,6 +208,12 @@ class BenchmarkTfLiteModel : public BenchmarkModel {
   std::unique_ptr<BenchmarkInterpreterRunner> interpreter_runner_;
   std::unique_ptr<tflite::ExternalCpuBackendContext> external_context_;
 
+  // Requests passed to `SignatureRunner::InvokeBatch` in each run, all of
+  // which read the first example of `inputs_data_`.
+  std::vector<tflite::SignatureRunner::BatchRequest> batched_requests_;
+  // Buffers receiving the outputs of `batched_requests_`.
+  std::vector<std::vector<char>> batched_outputs_;
+
  private:
   utils::InputTensorData CreateRandomTensorData(
       const TfLiteTensor& t, const InputLayerInfo* layer_info);
@@ -163,6 +163,21 @@ OpSignature GetOpSignature(const OperatorCode* op_code, const Operator* op,
           subgraph->tensors()->Get(op->inputs()->Get(1));
       op_sig.ext_options.fully_connected.sparse_weight =
           (weight_tensor->sparsity() != nullptr);
+      const SparsityParameters* sparsity = weight_tensor->sparsity();
+      if (sparsity && sparsity->block_map() && sparsity->dim_metadata() &&
+          sparsity->dim_metadata()->size() ==
+              2 + sparsity->block_map()->size()) {
+        const int num_block_dims = sparsity->block_map()->size();
+        for (int i = 0; i < num_block_dims; ++i) {
+          const int block_size =
+              sparsity->dim_metadata()->Get(2 + i)->dense_size();
+          if (sparsity->block_map()->Get(i) == 0) {
+            op_sig.ext_options.fully_connected.sparse_block_rows = block_size;
+          } else {
+            op_sig.ext_options.fully_connected.sparse_block_cols = block_size;
+          }
+        }
+      }
       const QuantizationParameters* weight_quant =
           weight_tensor->quantization();
       if (weight_quant && weight_quant->scale() &&
@@ -262,6 +277,15 @@ OpSignature GetOpSignature(const OperatorCode* op_code, const Operator* op,
       }
     } break;
 
+    case BuiltinOperator_BATCH_MATMUL: {
+      if (op->inputs()->Length() < 2) {
+        break;
+      }
+      const Tensor* rhs_tensor = subgraph->tensors()->Get(op->inputs()->Get(1));
+      op_sig.ext_options.batch_matmul.sparse_rhs =
+          (rhs_tensor->sparsity() != nullptr);
+    } break;
+
     case BuiltinOperator_ADD: {
       if (subgraph->tensors()->Get(op->inputs()->Get(0))->quantization()) {
         op_sig.ext_options.add.input_quantized = true;
@@ -53,7 +53,14 @@ typedef struct {
       // computation.
       bool sparse_weight;
       bool is_per_channel_quantized;
+      // The block shape of a sparse weight, 0 in the dimensions without
+      // blocks.
+      int32_t sparse_block_rows;
+      int32_t sparse_block_cols;
     } fully_connected;
+    struct {
+      bool sparse_rhs;
+    } batch_matmul;
     struct {
       float input1_scale;
       float input2_scale;
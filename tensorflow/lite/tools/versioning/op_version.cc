@@ -173,6 +173,19 @@ int GetBuiltinOperatorVersion(const OpSignature& op_sig) {
           reinterpret_cast<TfLiteFullyConnectedParams*>(op_sig.builtin_data);
       TFLITE_DCHECK(fully_connected_params != nullptr);
 
+      // Sparse weights with blocks other than 1x4 and 1x16 are supported at
+      // version 13.
+      if (op_sig.ext_options.fully_connected.sparse_weight) {
+        const int block_rows =
+            op_sig.ext_options.fully_connected.sparse_block_rows;
+        const int block_cols =
+            op_sig.ext_options.fully_connected.sparse_block_cols;
+        if (block_rows > 1 ||
+            (block_cols > 1 && block_cols != 4 && block_cols != 16)) {
+          return 13;
+        }
+      }
+
       if (op_sig.inputs.at(0).type == kTfLiteFloat32 &&
           op_sig.inputs.at(1).type == kTfLiteInt8 &&
           op_sig.outputs.at(0).type == kTfLiteFloat32 &&
@@ -810,6 +823,10 @@ int GetBuiltinOperatorVersion(const OpSignature& op_sig) {
       return 1;
 
     case BuiltinOperator_BATCH_MATMUL: {
+      // A sparse rhs is supported at version 5.
+      if (op_sig.ext_options.batch_matmul.sparse_rhs) {
+        return 5;
+      }
       // In case of int16 inputs, the version is 3.
       if (op_sig.inputs.at(0).type == kTfLiteInt16) {
         return 3;
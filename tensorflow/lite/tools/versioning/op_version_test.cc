@@ -687,6 +687,15 @@ TEST(OpVersionTest, VersioningFullyConnectedTest) {
       kTfLiteFullyConnectedWeightsFormatDefault;
   fake_op_sig.ext_options.fully_connected.sparse_weight = true;
   EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 8);
+  fake_op_sig.ext_options.fully_connected.sparse_block_rows = 1;
+  fake_op_sig.ext_options.fully_connected.sparse_block_cols = 16;
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 8);
+  // Blocks other than 1x4 and 1x16 are version 13.
+  fake_op_sig.ext_options.fully_connected.sparse_block_cols = 8;
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 13);
+  fake_op_sig.ext_options.fully_connected.sparse_block_rows = 4;
+  fake_op_sig.ext_options.fully_connected.sparse_block_cols = 4;
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 13);
 
   fake_op_sig = {
       .op = BuiltinOperator_FULLY_CONNECTED,
@@ -1298,6 +1307,18 @@ TEST(OpVersionTest, VersioningBatchMatMulTest) {
   };
   batch_mat_mul_params.asymmetric_quantize_inputs = true;
   EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 4);
+
+  // A sparse rhs is version 5.
+  batch_mat_mul_params = {};
+  fake_op_sig = {
+      .op = BuiltinOperator_BATCH_MATMUL,
+      .inputs = CreateOpSignatureTensorSpecs(
+          std::vector<TfLiteType>{kTfLiteFloat32, kTfLiteFloat32}),
+      .outputs = CreateOpSignatureTensorSpecs(kTfLiteFloat32),
+      .builtin_data = reinterpret_cast<void*>(&batch_mat_mul_params),
+  };
+  fake_op_sig.ext_options.batch_matmul.sparse_rhs = true;
+  EXPECT_EQ(GetBuiltinOperatorVersion(fake_op_sig), 5);
 }
 TEST(OpVersionTest, VersioningSquaredDifferenceTest) {
   // Default.